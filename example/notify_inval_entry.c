@@ -12,7 +12,8 @@
  * file name changes dynamically to reflect the current time.
  *
  * It illustrates the use of the fuse_lowlevel_notify_inval_entry()
- * function.
+ * function, or, with ``--async``, of its queued variant
+ * fuse_lowlevel_notify_inval_entry_async().
  *
  * To see the effect, first start the file system with the
  * ``--no-notify``
@@ -94,6 +95,7 @@ static int lookup_cnt = 0;
 /* Command line parsing */
 struct options {
     int no_notify;
+    int async;
     float timeout;
     int update_interval;
 };
@@ -107,6 +109,7 @@ static struct options options = {
     { t, offsetof(struct options, p), 1 }
 static const struct fuse_opt option_spec[] = {
     OPTION("--no-notify", no_notify),
+    OPTION("--async", async),
     OPTION("--update-interval=%d", update_interval),
     OPTION("--timeout=%f", timeout),
     FUSE_OPT_END
@@ -250,9 +253,14 @@ static void* update_fs_loop(void *data) {
     while(1) {
         old_name = strdup(file_name);
         update_fs();
-        if (!options.no_notify && lookup_cnt)
-            assert(fuse_lowlevel_notify_inval_entry
-                   (se, FUSE_ROOT_ID, old_name, strlen(old_name)) == 0);
+        if (!options.no_notify && lookup_cnt) {
+            if (options.async)
+                assert(fuse_lowlevel_notify_inval_entry_async
+                       (se, FUSE_ROOT_ID, old_name, strlen(old_name)) == 0);
+            else
+                assert(fuse_lowlevel_notify_inval_entry
+                       (se, FUSE_ROOT_ID, old_name, strlen(old_name)) == 0);
+        }
         free(old_name);
         sleep(options.update_interval);
     }
@@ -266,6 +274,7 @@ static void show_help(const char *progname)
                "    --timeout=<secs>       Timeout for kernel caches\n"
                "    --update-interval=<secs>  Update-rate of file system contents\n"
                "    --no-notify            Disable kernel notifications\n"
+               "    --async                Queue notifications for a sender thread\n"
                "\n");
 }
 
@@ -324,6 +333,16 @@ int main(int argc, char *argv[]) {
     else
         ret = fuse_session_loop_mt(se, opts.clone_fd);
 
+    if (options.async) {
+        struct fuse_notify_queue_stats stats;
+
+        fuse_lowlevel_notify_queue_stats(se, &stats);
+        printf("%llu notifications queued, %llu coalesced, %llu sent\n",
+               (unsigned long long) stats.queued,
+               (unsigned long long) stats.coalesced,
+               (unsigned long long) stats.sent);
+    }
+
     fuse_session_unmount(se);
 err_out3:
     fuse_remove_signal_handlers(se);
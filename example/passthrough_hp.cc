@@ -39,6 +39,12 @@
  * requests for all files (which the passthrough filesystem cannot
  * satisfy if it can't read the file in the underlying filesystem).
  *
+ * If --passthrough is specified and the kernel supports it, reads and
+ * writes of regular files are passed through to the source files by the
+ * kernel itself and never reach this process.  This disables the
+ * writeback cache, and needs CAP_SYS_ADMIN; if the kernel refuses a
+ * file, it is accessed through the filesystem as usual.
+ *
  * ## Source code ##
  * \include passthrough_hp.cc
  */
@@ -124,6 +130,9 @@ struct Inode {
     dev_t src_dev {0};
     ino_t src_ino {0};
     uint64_t nlookup {0};
+    int backing_id {0};       // protected by m
+    uint64_t nopen {0};       // protected by m
+    bool no_passthrough {false}; // protected by m
     std::mutex m;
 
     // Delete copy constructor and assignments. We could implement
@@ -152,6 +161,7 @@ struct Fs {
     dev_t src_dev;
     bool nosplice;
     bool nocache;
+    bool passthrough;
 };
 static Fs fs{};
 
@@ -186,7 +196,15 @@ static void sfs_init(void *userdata, fuse_conn_info *conn) {
     if (conn->capable & FUSE_CAP_EXPORT_SUPPORT)
         conn->want |= FUSE_CAP_EXPORT_SUPPORT;
 
-    if (fs.timeout && conn->capable & FUSE_CAP_WRITEBACK_CACHE)
+    if (fs.passthrough && !(conn->capable & FUSE_CAP_PASSTHROUGH)) {
+        cerr << "WARNING: kernel does not support passthrough, "
+             << "using regular I/O." << endl;
+        fs.passthrough = false;
+    }
+    // The kernel does not support passthrough with writeback caching
+    if (fs.passthrough)
+        conn->want |= FUSE_CAP_PASSTHROUGH;
+    else if (fs.timeout && conn->capable & FUSE_CAP_WRITEBACK_CACHE)
         conn->want |= FUSE_CAP_WRITEBACK_CACHE;
 
     if (conn->capable & FUSE_CAP_FLOCK_LOCKS)
@@ -216,6 +234,23 @@ static void sfs_getattr(fuse_req_t req, fuse_ino_t ino, fuse_file_info *fi) {
 }
 
 
+#ifdef HAVE_STATX
+static void sfs_statx(fuse_req_t req, fuse_ino_t ino, int flags, int mask,
+                      fuse_file_info *fi) {
+    (void)fi;
+    Inode& inode = get_inode(ino);
+    struct statx attr;
+    auto res = statx(inode.fd, "", flags | AT_EMPTY_PATH | AT_SYMLINK_NOFOLLOW,
+                     mask, &attr);
+    if (res == -1) {
+        fuse_reply_err(req, errno);
+        return;
+    }
+    fuse_reply_statx(req, 0, &attr, fs.timeout);
+}
+#endif
+
+
 #ifdef HAVE_UTIMENSAT
 static int utimensat_empty_nofollow(Inode& inode,
                                     const struct timespec *tv) {
@@ -778,6 +813,39 @@ static void sfs_releasedir(fuse_req_t req, fuse_ino_t ino, fuse_file_info *fi) {
 }
 
 
+static void passthrough_open(fuse_req_t req, Inode& inode, int fd,
+                             fuse_file_info *fi) {
+    if (!fs.passthrough)
+        return;
+
+    // All handles of an inode share one backing id, so release() knows
+    // whether to drop it.  If the kernel refuses the file once, don't
+    // retry.
+    lock_guard<mutex> g {inode.m};
+    if (!inode.backing_id && !inode.no_passthrough) {
+        inode.backing_id = fuse_passthrough_open(req, fd);
+        if (!inode.backing_id)
+            inode.no_passthrough = true;
+    }
+    if (inode.backing_id) {
+        inode.nopen++;
+        fi->backing_id = inode.backing_id;
+    }
+}
+
+
+static void passthrough_release(fuse_req_t req, Inode& inode) {
+    if (!fs.passthrough)
+        return;
+
+    lock_guard<mutex> g {inode.m};
+    if (inode.backing_id && --inode.nopen == 0) {
+        fuse_passthrough_close(req, inode.backing_id);
+        inode.backing_id = 0;
+    }
+}
+
+
 static void sfs_create(fuse_req_t req, fuse_ino_t parent, const char *name,
                        mode_t mode, fuse_file_info *fi) {
     Inode& inode_p = get_inode(parent);
@@ -799,8 +867,10 @@ static void sfs_create(fuse_req_t req, fuse_ino_t parent, const char *name,
         if (err == ENFILE || err == EMFILE)
             cerr << "ERROR: Reached maximum number of file descriptors." << endl;
         fuse_reply_err(req, err);
-    } else
+    } else {
+        passthrough_open(req, get_inode(e.ino), fd, fi);
         fuse_reply_create(req, &e, fi);
+    }
 }
 
 
@@ -851,12 +921,13 @@ static void sfs_open(fuse_req_t req, fuse_ino_t ino, fuse_file_info *fi) {
 
     fi->keep_cache = (fs.timeout != 0);
     fi->fh = fd;
+    passthrough_open(req, inode, fd, fi);
     fuse_reply_open(req, fi);
 }
 
 
 static void sfs_release(fuse_req_t req, fuse_ino_t ino, fuse_file_info *fi) {
-    (void) ino;
+    passthrough_release(req, get_inode(ino));
     close(fi->fh);
     fuse_reply_err(req, 0);
 }
@@ -1113,6 +1184,9 @@ static void assign_operations(fuse_lowlevel_ops &sfs_oper) {
     sfs_oper.forget = sfs_forget;
     sfs_oper.forget_multi = sfs_forget_multi;
     sfs_oper.getattr = sfs_getattr;
+#ifdef HAVE_STATX
+    sfs_oper.statx = sfs_statx;
+#endif
     sfs_oper.setattr = sfs_setattr;
     sfs_oper.readlink = sfs_readlink;
     sfs_oper.opendir = sfs_opendir;
@@ -1164,6 +1238,7 @@ static cxxopts::ParseResult parse_options(int argc, char **argv) {
         ("help", "Print help")
         ("nocache", "Disable all caching")
         ("nosplice", "Do not use splice(2) to transfer data")
+        ("passthrough", "Pass reads and writes through to source files")
         ("single", "Run single-threaded");
 
     // FIXME: Find a better way to limit the try clause to just
@@ -1187,6 +1262,7 @@ static cxxopts::ParseResult parse_options(int argc, char **argv) {
 
     fs.debug = options.count("debug") != 0;
     fs.nosplice = options.count("nosplice") != 0;
+    fs.passthrough = options.count("passthrough") != 0;
     fs.source = std::string {realpath(argv[1], NULL)};
 
     return options;
@@ -655,19 +655,18 @@ static void lo_do_readdir(fuse_req_t req, fuse_ino_t ino, size_t size,
 			  off_t offset, struct fuse_file_info *fi, int plus)
 {
 	struct lo_dirp *d = lo_dirp(fi);
+	struct fuse_dirbuf db;
 	char *buf;
-	char *p;
-	size_t rem = size;
 	int err;
 
 	(void) ino;
 
 	buf = calloc(1, size);
+	fuse_dirbuf_init(&db, buf, size, plus);
 	if (!buf) {
 		err = ENOMEM;
 		goto error;
 	}
-	p = buf;
 
 	if (offset != d->offset) {
 		seekdir(d->dp, offset);
@@ -675,9 +674,8 @@ static void lo_do_readdir(fuse_req_t req, fuse_ino_t ino, size_t size,
 		d->offset = offset;
 	}
 	while (1) {
-		size_t entsize;
-		off_t nextoff;
-		const char *name;
+		struct fuse_entry_param e;
+		struct fuse_direntry de;
 
 		if (!d->entry) {
 			errno = 0;
@@ -691,44 +689,29 @@ static void lo_do_readdir(fuse_req_t req, fuse_ino_t ino, size_t size,
 				}
 			}
 		}
-		nextoff = d->entry->d_off;
-		name = d->entry->d_name;
-		fuse_ino_t entry_ino = 0;
-		if (plus) {
-			struct fuse_entry_param e;
-			if (is_dot_or_dotdot(name)) {
-				e = (struct fuse_entry_param) {
-					.attr.st_ino = d->entry->d_ino,
-					.attr.st_mode = d->entry->d_type << 12,
-				};
-			} else {
-				err = lo_do_lookup(req, ino, name, &e);
-				if (err)
-					goto error;
-				entry_ino = e.ino;
-			}
-
-			entsize = fuse_add_direntry_plus(req, p, rem, name,
-							 &e, nextoff);
-		} else {
-			struct stat st = {
-				.st_ino = d->entry->d_ino,
-				.st_mode = d->entry->d_type << 12,
-			};
-			entsize = fuse_add_direntry(req, p, rem, name,
-						    &st, nextoff);
-		}
-		if (entsize > rem) {
-			if (entry_ino != 0) 
-				lo_forget_one(req, entry_ino, 1);
+		de = (struct fuse_direntry) {
+			.name = d->entry->d_name,
+			.namelen = strlen(d->entry->d_name),
+			.ino = d->entry->d_ino,
+			.type = d->entry->d_type,
+			.off = d->entry->d_off,
+		};
+		// Check for room first, so that no lookup count is taken
+		// for an entry that is not sent
+		if (!fuse_dirbuf_fit(&db, &de, 1))
 			break;
+		if (plus && !is_dot_or_dotdot(de.name)) {
+			err = lo_do_lookup(req, ino, de.name, &e);
+			if (err)
+				goto error;
+			de.ino = e.attr.st_ino;
+			de.type = e.attr.st_mode >> 12;
+			de.e = &e;
 		}
-		
-		p += entsize;
-		rem -= entsize;
+		fuse_dirbuf_add(&db, &de, 1);
 
 		d->entry = NULL;
-		d->offset = nextoff;
+		d->offset = de.off;
 	}
 
     err = 0;
@@ -737,10 +720,10 @@ error:
     // any entries yet - otherwise we'd end up with wrong lookup
     // counts for the entries that are already in the buffer. So we
     // return what we've collected until that point.
-    if (err && rem == size)
+    if (err && db.len == 0)
 	    fuse_reply_err(req, err);
     else
-	    fuse_reply_buf(req, buf, size - rem);
+	    fuse_reply_buf(req, buf, db.len);
     free(buf);
 }
 
@@ -987,7 +970,7 @@ static void lo_getxattr(fuse_req_t req, fuse_ino_t ino, const char *name,
 	sprintf(procname, "/proc/self/fd/%i", inode->fd);
 
 	if (size) {
-		value = malloc(size);
+		value = fuse_req_alloc(req, size);
 		if (!value)
 			goto out_err;
 
@@ -1006,15 +989,12 @@ static void lo_getxattr(fuse_req_t req, fuse_ino_t ino, const char *name,
 
 		fuse_reply_xattr(req, ret);
 	}
-out_free:
-	free(value);
 	return;
 
 out_err:
 	saverr = errno;
 out:
 	fuse_reply_err(req, saverr);
-	goto out_free;
 }
 
 static void lo_listxattr(fuse_req_t req, fuse_ino_t ino, size_t size)
@@ -1043,7 +1023,7 @@ static void lo_listxattr(fuse_req_t req, fuse_ino_t ino, size_t size)
 	sprintf(procname, "/proc/self/fd/%i", inode->fd);
 
 	if (size) {
-		value = malloc(size);
+		value = fuse_req_alloc(req, size);
 		if (!value)
 			goto out_err;
 
@@ -1062,15 +1042,12 @@ static void lo_listxattr(fuse_req_t req, fuse_ino_t ino, size_t size)
 
 		fuse_reply_xattr(req, ret);
 	}
-out_free:
-	free(value);
 	return;
 
 out_err:
 	saverr = errno;
 out:
 	fuse_reply_err(req, saverr);
-	goto out_free;
 }
 
 static void lo_setxattr(fuse_req_t req, fuse_ino_t ino, const char *name,
@@ -36,6 +36,9 @@ extern "C" {
 /** Handle for a FUSE filesystem */
 struct fuse;
 
+/* Defined by <sys/stat.h> with _GNU_SOURCE on glibc 2.28 and later */
+struct statx;
+
 /**
  * Readdir flags, passed to ->readdir()
  */
@@ -142,7 +145,9 @@ struct fuse_config {
 	/**
 	 * Specify which signal number to send to the filesystem when
 	 * a request is interrupted.  The default is hardcoded to
-	 * USR1.
+	 * USR1.  With zero, no signal is sent, and interrupts are
+	 * only reported through fuse_interrupted() and the request's
+	 * cancellation token (see fuse_get_cancel()).
 	 */
 	int intr_signal;
 
@@ -271,6 +276,83 @@ struct fuse_config {
 	int show_help;
 	char *modules;
 	int debug;
+
+	/**
+	 * If this option is set, concurrent getattr calls for the same
+	 * path, as issued for lookup and getattr requests, are passed
+	 * to the filesystem only once and their result is shared by
+	 * all callers.  A caller may then see attributes that were
+	 * obtained before its own request arrived, so this should only
+	 * be enabled if attributes don't depend on the calling process
+	 * and such staleness is acceptable.
+	 */
+	int coalesce_getattr;
+
+	/**
+	 * The timeout in seconds for which the results of getxattr
+	 * calls are cached, including the absence of an attribute.
+	 * Setting or removing an attribute, changing the mode or owner
+	 * through this filesystem, and fuse_invalidate_path() drop the
+	 * cached attributes of a file.  Attributes changed by other
+	 * means, or through another hard link, may be seen late.  Zero
+	 * (the default) disables the cache.
+	 */
+	double xattr_timeout;
+
+	/**
+	 * The maximum number of bytes of directory entries that are
+	 * buffered for an open directory whose readdir() implementation
+	 * ignores the offset parameter.  Larger directories are returned
+	 * in windows of this size, and readdir() is called again, from
+	 * the start, for each window.  Entries created or removed during
+	 * the listing may then be missed or returned twice.  Zero means
+	 * no limit; the default is 64 MiB.
+	 */
+	unsigned int max_readdir_buffer;
+
+	/**
+	 * If non-zero, the attributes of entries that readdir() returns
+	 * without FUSE_FILL_DIR_PLUS are looked up by the library for
+	 * readdirplus requests, using up to this many getattr() calls in
+	 * parallel, before the reply is sent.  This avoids a separate
+	 * lookup request for each entry afterwards, at the expense of
+	 * looking up entries that the caller may not need.
+	 */
+	unsigned int readdirplus_prefetch;
+
+	/**
+	 * This option lets the kernel cache directory listings and
+	 * keep them across opendir(3), like `kernel_cache` does for
+	 * file contents.  The kernel drops a listing when the
+	 * directory is changed through the mounted filesystem, so
+	 * this should only be enabled if directories are never
+	 * changed externally.
+	 *
+	 * Internally, enabling this option causes fuse to set the
+	 * `cache_readdir` and `keep_cache` fields of the `struct
+	 * fuse_file_info` of opened directories.
+	 */
+	int cache_readdir;
+
+	/**
+	 * This option is an alternative to `cache_readdir`. Instead of
+	 * unconditionally keeping cached listings, a listing is
+	 * dropped on opendir(3) if the modification time of the
+	 * directory has changed since it was last opened, or if the
+	 * directory was changed through the library in the meantime.
+	 * Like `auto_cache`, it uses `ac_attr_timeout`.
+	 */
+	int auto_cache_readdir;
+
+	/**
+	 * This option lets the kernel cache the targets of symbolic
+	 * links, so that readlink() is called only once per link (see
+	 * FUSE_CAP_CACHE_SYMLINKS).  A cached target is dropped by
+	 * fuse_invalidate_path(), and when the library sees the
+	 * modification time or the size of the link change, e.g.
+	 * because the link was replaced externally.
+	 */
+	int cache_symlinks;
 };
 
 
@@ -544,14 +626,20 @@ struct fuse_operations {
 	 *
 	 * 1) The readdir implementation ignores the offset parameter, and
 	 * passes zero to the filler function's offset.  The filler
-	 * function will not return '1' (unless an error happens), so the
-	 * whole directory is read in a single readdir operation.
+	 * function will not return '1' (unless an error happens, or more
+	 * than `max_readdir_buffer` bytes of entries have been buffered),
+	 * so the whole directory is read in a single readdir operation.
+	 * The entries are buffered by the library until the directory is
+	 * rewound or released.
 	 *
 	 * 2) The readdir implementation keeps track of the offsets of the
 	 * directory entries.  It uses the offset parameter and always
 	 * passes non-zero offset to the filler function.  When the buffer
 	 * is full (or an error happens) the filler function will return
-	 * '1'.
+	 * '1'.  The offsets are opaque continuation cookies: the offset
+	 * passed with an entry is the one readdir is next called with to
+	 * continue after that entry.  Nothing is buffered by the library,
+	 * so memory use doesn't depend on the size of the directory.
 	 */
 	int (*readdir) (const char *, void *, fuse_fill_dir_t, off_t,
 			struct fuse_file_info *, enum fuse_readdir_flags);
@@ -786,6 +874,21 @@ struct fuse_operations {
 	 * Find next data or hole after the specified offset
 	 */
 	off_t (*lseek) (const char *, off_t off, int whence, struct fuse_file_info *);
+
+	/** Get extended file attributes.
+	 *
+	 * Similar to statx().  Called instead of getattr() when statx()
+	 * asks for more than the basic attributes, e.g. the birth time.
+	 * 'mask' holds the requested STATX_* fields; fields that were not
+	 * asked for may be left out, and stx_mask must be set to the
+	 * fields that were filled in.  The same fields as in getattr()
+	 * are ignored or overridden.
+	 *
+	 * If not implemented, getattr() is used instead, but the birth
+	 * time is not available.
+	 */
+	int (*statx) (const char *path, int flags, int mask,
+		      struct statx *stxbuf, struct fuse_file_info *fi);
 };
 
 /** Extra context that may be needed by some filesystems
@@ -1058,10 +1161,80 @@ int fuse_getgroups(int size, gid_t list[]);
  */
 int fuse_interrupted(void);
 
+/**
+ * Cancellation token of a request
+ *
+ * An interrupted request is cancelled through its token.  The
+ * filesystem can poll the token, register a callback on it, or wait
+ * for the token's file descriptor to become readable, whichever suits
+ * its backend.  Unlike the interrupt signal, this also works for
+ * operations that don't return EINTR.
+ */
+struct fuse_cancel;
+
+/**
+ * Callback function for a cancellation token
+ *
+ * This is called with a lock of the library held, so it must not
+ * block or call back into the library.
+ *
+ * @param data user data passed to fuse_cancel_set_callback()
+ */
+typedef void (*fuse_cancel_func_t)(void *data);
+
+/**
+ * Get the cancellation token of the current request
+ *
+ * The token is only available if interrupts are enabled (see the
+ * `intr` option), and only within the handler of the request.  Once
+ * the filesystem has obtained the token of a request, the library no
+ * longer sends `intr_signal` to the thread handling it.
+ *
+ * @return the token, or NULL if the request cannot be interrupted
+ */
+struct fuse_cancel *fuse_get_cancel(void);
+
+/**
+ * Check if the request of a token has been interrupted
+ *
+ * @param cancel the token
+ * @return 1 if the request has been interrupted, 0 otherwise
+ */
+int fuse_cancel_requested(struct fuse_cancel *cancel);
+
+/**
+ * Register or unregister a callback on a token
+ *
+ * If the request has already been interrupted, the callback is called
+ * from within this function.  After unregistering, the callback is
+ * guaranteed not to be running or to be called any more.
+ *
+ * @param cancel the token
+ * @param func the callback function or NULL to unregister
+ * @param data user data passed to the callback function
+ */
+void fuse_cancel_set_callback(struct fuse_cancel *cancel,
+			      fuse_cancel_func_t func, void *data);
+
+/**
+ * Get a file descriptor that becomes readable when the request of a
+ * token is interrupted
+ *
+ * This may be added to an event loop or passed to poll(2).  The
+ * descriptor is owned by the library and closed when the handler
+ * returns.  This is currently only implemented on Linux; elsewhere
+ * -ENOSYS is returned.
+ *
+ * @param cancel the token
+ * @return a file descriptor, or -errno on failure
+ */
+int fuse_cancel_fd(struct fuse_cancel *cancel);
+
 /**
  * Invalidates cache for the given path.
  *
- * This calls fuse_lowlevel_notify_inval_inode internally.
+ * This calls fuse_lowlevel_notify_inval_inode internally, and drops
+ * the extended attributes cached for the path (see `xattr_timeout`).
  *
  * @return 0 on successful invalidation, negative error value otherwise.
  *         This routine may return -ENOENT to indicate that there was
@@ -1215,6 +1388,8 @@ ssize_t fuse_fs_copy_file_range(struct fuse_fs *fs, const char *path_in,
 				size_t len, int flags);
 off_t fuse_fs_lseek(struct fuse_fs *fs, const char *path, off_t off, int whence,
 		    struct fuse_file_info *fi);
+int fuse_fs_statx(struct fuse_fs *fs, const char *path, int flags, int mask,
+		  struct statx *stxbuf, struct fuse_file_info *fi);
 void fuse_fs_init(struct fuse_fs *fs, struct fuse_conn_info *conn,
 		struct fuse_config *cfg);
 void fuse_fs_destroy(struct fuse_fs *fs);
@@ -1266,6 +1441,19 @@ typedef struct fuse_fs *(*fuse_module_factory_t)(struct fuse_args *args,
 #define FUSE_REGISTER_MODULE(name_, factory_) \
 	fuse_module_factory_t fuse_module_ ## name_ ## _factory = factory_
 
+/**
+ * Log the latency statistics of the "stats" module
+ *
+ * Writes a snapshot of the per-operation call counts, error counts
+ * and latency histograms collected by every instance of the "stats"
+ * module (-o modules=stats) in the stack of the given filesystem
+ * through fuse_log(). Statistics keep accumulating afterwards.
+ *
+ * @param f the FUSE handle, or NULL for all filesystems
+ * @return 0 on success, -ENOENT if no stats module is in use
+ */
+int fuse_stats_dump(struct fuse *f);
+
 /** Get session from fuse object */
 struct fuse_session *fuse_get_session(struct fuse *f);
 
@@ -83,8 +83,17 @@ struct fuse_file_info {
 	    nothing when set by open()). */
 	unsigned int cache_readdir : 1;
 
+	/** Can be filled in by open, to indicate that flush is not needed
+	    on close. */
+	unsigned int noflush : 1;
+
+	/** Can be filled in by open and create, to allow the kernel to
+	    send direct writes to the same file in parallel.  The
+	    filesystem must then handle concurrent writes that overlap. */
+	unsigned int parallel_direct_writes : 1;
+
 	/** Padding.  Reserved for future use*/
-	unsigned int padding : 25;
+	unsigned int padding : 23;
 	unsigned int padding2 : 32;
 
 	/** File handle id.  May be filled in by filesystem in create,
@@ -98,6 +107,14 @@ struct fuse_file_info {
 	/** Requested poll events.  Available in ->poll.  Only set on kernels
 	    which support it.  If unsupported, this field is set to zero. */
 	uint32_t poll_events;
+
+	/** Backing file id returned by fuse_passthrough_open().  May be
+	    set in open() and create() to have the kernel perform reads
+	    and writes directly on the backing file.  Only honored if
+	    FUSE_CAP_PASSTHROUGH has been negotiated.  keep_cache and
+	    cache_readdir are ignored, and nonseekable files are opened
+	    without passthrough. */
+	int32_t backing_id;
 };
 
 /**
@@ -346,6 +363,28 @@ struct fuse_loop_config {
  */
 #define FUSE_CAP_HANDLE_KILLPRIV         (1 << 20)
 
+/**
+ * Indicates that the kernel accepts requests of more than 32 pages.
+ * The maximum is then determined by the `max_write` field of
+ * `fuse_conn_info`, up to the limit of the kernel.  Without
+ * this, reads and writes are split into requests of at most 128 KiB
+ * (with 4 KiB pages).
+ *
+ * This feature is enabled by default when supported by the kernel.
+ */
+#define FUSE_CAP_MAX_PAGES               (1 << 22)
+
+/**
+ * Indicates that the kernel supports caching symlinks in its page cache.
+ *
+ * When this feature is enabled, symlink targets are saved in the page
+ * cache and only read once with readlink().  They are invalidated like
+ * file data, e.g. by fuse_lowlevel_notify_inval_inode().
+ *
+ * This feature is disabled by default.
+ */
+#define FUSE_CAP_CACHE_SYMLINKS          (1 << 23)
+
 /**
  * Indicates support for zero-message opendirs. If this flag is set in
  * the `capable` field of the `fuse_conn_info` structure, then the filesystem
@@ -381,6 +420,47 @@ struct fuse_loop_config {
  */
 #define FUSE_CAP_EXPLICIT_INVAL_DATA    (1 << 25)
 
+/**
+ * Indicates that the kernel supports marking cached directory entries
+ * as expired without dropping them, see
+ * fuse_lowlevel_notify_expire_entry().  Expired entries are checked
+ * with a lookup on their next use, but dentries that are in use (e.g.
+ * mount points) are not affected.
+ *
+ * This is a capability of the kernel only and does not need to be
+ * requested in the `want` field.
+ */
+#define FUSE_CAP_EXPIRE_ONLY            (1 << 26)
+
+/**
+ * Indicates that the kernel allows shared writable mmap() of files
+ * opened with direct_io.  Without this, such mappings fail, and
+ * filesystems that use direct_io for consistency cannot be used to run
+ * programs that map their files.
+ *
+ * This feature is enabled by default when supported by the kernel.
+ */
+#define FUSE_CAP_DIRECT_IO_ALLOW_MMAP   (1 << 28)
+
+/**
+ * Indicates support for passthrough of read and write requests to a
+ * backing file.  If enabled, open() and create() may register an open
+ * file descriptor with fuse_passthrough_open() and set the returned id
+ * in the `backing_id` field of `fuse_file_info`.  The kernel then
+ * performs reads and writes on that file directly, without sending
+ * requests to the filesystem.
+ *
+ * Registering backing files requires CAP_SYS_ADMIN.  If it fails,
+ * fuse_passthrough_open() returns zero and the file is simply opened
+ * without passthrough.
+ *
+ * The kernel does not support passthrough together with the writeback
+ * cache; if both are requested, passthrough is disabled.
+ *
+ * This feature is disabled by default.
+ */
+#define FUSE_CAP_PASSTHROUGH            (1 << 29)
+
 /**
  * Ioctl flags
  *
@@ -418,6 +498,11 @@ struct fuse_conn_info {
 
 	/**
 	 * Maximum size of the write buffer
+	 *
+	 * This also limits the size of read requests, and is 1 MiB
+	 * by default.  It may be raised up to the limit of the kernel
+	 * (256 pages, or the fs.fuse.max_pages_limit sysctl if
+	 * present), larger values are reduced to that.
 	 */
 	unsigned max_write;
 
@@ -510,10 +595,18 @@ struct fuse_conn_info {
 	 */
 	unsigned time_gran;
 
+	/**
+	 * When FUSE_CAP_PASSTHROUGH is enabled, the maximum stacking depth
+	 * of the filesystems that backing files may live on.  The default
+	 * is 0, i.e. backing files must not be on a stacked filesystem such
+	 * as another FUSE filesystem or overlayfs.
+	 */
+	unsigned max_backing_stack_depth;
+
 	/**
 	 * For future use.
 	 */
-	unsigned reserved[22];
+	unsigned reserved[21];
 };
 
 struct fuse_session;
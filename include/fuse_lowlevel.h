@@ -35,6 +35,9 @@
 extern "C" {
 #endif
 
+/* Defined by <sys/stat.h> with _GNU_SOURCE on glibc 2.28 and later */
+struct statx;
+
 /* ----------------------------------------------------------- *
  * Miscellaneous definitions				       *
  * ----------------------------------------------------------- */
@@ -1245,6 +1248,34 @@ struct fuse_lowlevel_ops {
 	 */
 	void (*lseek) (fuse_req_t req, fuse_ino_t ino, off_t off, int whence,
 		       struct fuse_file_info *fi);
+
+	/**
+	 * Get extended file attributes.
+	 *
+	 * Sent by kernels that support it when statx(2) asks for more
+	 * than the basic attributes, e.g. the birth time.  'mask' holds
+	 * the STATX_* fields that were requested; the filesystem may
+	 * skip fields that are expensive to compute and not asked for,
+	 * and must set stx_mask to the fields it actually filled in.
+	 * The kernel only updates its attribute cache if all of
+	 * STATX_BASIC_STATS are returned.
+	 *
+	 * If this request is answered with an error code of ENOSYS, this is
+	 * treated as a permanent failure and the kernel uses getattr()
+	 * instead.
+	 *
+	 * Valid replies:
+	 *   fuse_reply_statx
+	 *   fuse_reply_err
+	 *
+	 * @param req request handle
+	 * @param ino the inode number
+	 * @param flags the AT_STATX_* synchronization flags of statx(2)
+	 * @param mask the requested STATX_* fields
+	 * @param fi file information, or NULL
+	 */
+	void (*statx) (fuse_req_t req, fuse_ino_t ino, int flags, int mask,
+		       struct fuse_file_info *fi);
 };
 
 /**
@@ -1301,7 +1332,8 @@ int fuse_reply_entry(fuse_req_t req, const struct fuse_entry_param *e);
  * Reply with a directory entry and open parameters
  *
  * currently the following members of 'fi' are used:
- *   fh, direct_io, keep_cache
+ *   fh, direct_io, keep_cache, noflush, parallel_direct_writes,
+ *   backing_id
  *
  * Possible requests:
  *   create
@@ -1347,7 +1379,8 @@ int fuse_reply_readlink(fuse_req_t req, const char *link);
  * Reply with open parameters
  *
  * currently the following members of 'fi' are used:
- *   fh, direct_io, keep_cache
+ *   fh, direct_io, keep_cache, noflush, parallel_direct_writes,
+ *   backing_id
  *
  * Possible requests:
  *   open, opendir
@@ -1358,6 +1391,42 @@ int fuse_reply_readlink(fuse_req_t req, const char *link);
  */
 int fuse_reply_open(fuse_req_t req, const struct fuse_file_info *fi);
 
+/**
+ * Register a backing file for passthrough
+ *
+ * Makes the open file descriptor 'fd' known to the kernel, so that
+ * reads and writes on a FUSE file can be performed directly on it.
+ * The returned id is set in the backing_id field of 'fi' before
+ * replying to open or create.  The kernel keeps its own reference to
+ * the file, so 'fd' may be closed afterwards.
+ *
+ * If FUSE_CAP_PASSTHROUGH has not been negotiated, or the kernel
+ * refuses the file (e.g. for lack of privileges), zero is returned and
+ * the file should be opened without passthrough.
+ *
+ * Possible requests:
+ *   open, create
+ *
+ * @param req request handle
+ * @param fd open file descriptor of the backing file
+ * @return a positive backing id, or zero if passthrough is unavailable
+ */
+int fuse_passthrough_open(fuse_req_t req, int fd);
+
+/**
+ * Unregister a backing file
+ *
+ * Releases the id returned by fuse_passthrough_open().  Files that
+ * are still open keep using the backing file; this only drops the
+ * reference held for the id.  Typically called once the kernel has
+ * replied to the open request, or from release().
+ *
+ * @param req request handle
+ * @param backing_id id returned by fuse_passthrough_open()
+ * @return zero on success, -errno on failure
+ */
+int fuse_passthrough_close(fuse_req_t req, int backing_id);
+
 /**
  * Reply with number of bytes written
  *
@@ -1542,6 +1611,94 @@ size_t fuse_add_direntry_plus(fuse_req_t req, char *buf, size_t bufsize,
 			      const char *name,
 			      const struct fuse_entry_param *e, off_t off);
 
+/**
+ * Directory entry for fuse_dirbuf_add()
+ */
+struct fuse_direntry {
+	/** Name of the entry, need not be null terminated if namelen
+	    is given */
+	const char *name;
+
+	/** Length of the name, or zero to have it computed with
+	    strlen() */
+	size_t namelen;
+
+	/** Inode number of the entry */
+	uint64_t ino;
+
+	/** Type of the entry, as in the d_type field of struct dirent */
+	unsigned int type;
+
+	/** Offset of the next entry, see fuse_add_direntry() */
+	off_t off;
+
+	/** Lookup result for readdirplus, or NULL if the entry was not
+	    looked up.  Ignored for readdir */
+	const struct fuse_entry_param *e;
+};
+
+/**
+ * Buffer for building a readdir or readdirplus reply
+ *
+ * Initialize with fuse_dirbuf_init(), fill with fuse_dirbuf_add() and
+ * send `len` bytes from `buf` with fuse_reply_buf().
+ */
+struct fuse_dirbuf {
+	/** Reply buffer */
+	char *buf;
+
+	/** Size of the buffer, usually the size of the request */
+	size_t size;
+
+	/** Number of bytes filled in */
+	size_t len;
+
+	/** Whether entries are added as for readdirplus */
+	int plus;
+};
+
+/**
+ * Initialize a directory buffer
+ *
+ * @param db the directory buffer
+ * @param buf the memory to fill
+ * @param size size of the memory
+ * @param plus non-zero to build a readdirplus reply
+ */
+void fuse_dirbuf_init(struct fuse_dirbuf *db, char *buf, size_t size,
+		      int plus);
+
+/**
+ * Count the directory entries that still fit into a buffer
+ *
+ * Nothing is written.  This allows looking up only those entries of
+ * a readdirplus reply that will actually be sent.
+ *
+ * @param db the directory buffer
+ * @param ents the entries, the `e` fields are not used
+ * @param count number of entries
+ * @return the number of leading entries that fit
+ */
+size_t fuse_dirbuf_fit(const struct fuse_dirbuf *db,
+		       const struct fuse_direntry *ents, size_t count);
+
+/**
+ * Add directory entries to a buffer
+ *
+ * Entries are packed in order until the next one does not fit; that
+ * one and the ones after it are not added.  This produces the same
+ * bytes as calling fuse_add_direntry() or fuse_add_direntry_plus()
+ * for each entry, but without probing for the size of every entry
+ * and, if name lengths are given, without computing them.
+ *
+ * @param db the directory buffer
+ * @param ents the entries
+ * @param count number of entries
+ * @return the number of entries added
+ */
+size_t fuse_dirbuf_add(struct fuse_dirbuf *db,
+		       const struct fuse_direntry *ents, size_t count);
+
 /**
  * Reply to ask for data fetch and output buffer preparation.  ioctl
  * will be retried with the specified input data fetched and output
@@ -1596,6 +1753,25 @@ int fuse_reply_ioctl_iov(fuse_req_t req, int result, const struct iovec *iov,
  */
 int fuse_reply_poll(fuse_req_t req, unsigned revents);
 
+/**
+ * Reply with extended file attributes
+ *
+ * Only the fields in statx->stx_mask are used by the kernel, so a
+ * partial result may be returned.  The birth time is passed on if
+ * STATX_BTIME is set.
+ *
+ * Possible requests:
+ *   statx
+ *
+ * @param req request handle
+ * @param flags reserved, must be zero
+ * @param statx the attributes
+ * @param attr_timeout	validity timeout (in seconds) for the attributes
+ * @return zero for success, -errno for failure to send reply
+ */
+int fuse_reply_statx(fuse_req_t req, int flags, struct statx *statx,
+		     double attr_timeout);
+
 /**
  * Reply with offset
  *
@@ -1675,6 +1851,31 @@ int fuse_lowlevel_notify_inval_inode(struct fuse_session *se, fuse_ino_t ino,
 int fuse_lowlevel_notify_inval_entry(struct fuse_session *se, fuse_ino_t parent,
 				     const char *name, size_t namelen);
 
+/**
+ * Notify to expire the dentry matching parent/name
+ *
+ * Unlike fuse_lowlevel_notify_inval_entry(), the dentry is not dropped
+ * but only marked as expired, so that the next access revalidates it
+ * with a lookup.  Dentries that are in use, e.g. mount points, stay
+ * valid.  The attributes of the parent are not invalidated.
+ *
+ * The same restrictions as for fuse_lowlevel_notify_inval_entry()
+ * apply to calling this function.
+ *
+ * Added in FUSE protocol version 7.38. If the kernel does not support
+ * this (see FUSE_CAP_EXPIRE_ONLY), the function will return -ENOSYS
+ * and do nothing.
+ *
+ * @param se the session object
+ * @param parent inode number
+ * @param name file name
+ * @param namelen strlen() of file name
+ * @return zero for success, -errno for failure
+ */
+int fuse_lowlevel_notify_expire_entry(struct fuse_session *se,
+				      fuse_ino_t parent, const char *name,
+				      size_t namelen);
+
 /**
  * This function behaves like fuse_lowlevel_notify_inval_entry() with
  * the following additional effect (at least as of Linux kernel 4.8):
@@ -1707,6 +1908,111 @@ int fuse_lowlevel_notify_delete(struct fuse_session *se,
 				fuse_ino_t parent, fuse_ino_t child,
 				const char *name, size_t namelen);
 
+/**
+ * Queue an invalidation of inode attributes and data
+ *
+ * This is the asynchronous form of fuse_lowlevel_notify_inval_inode().
+ * The notification is sent to the kernel by a sender thread of the
+ * session, so it is safe to call this function from a request
+ * handler.
+ *
+ * While a notification for the same inode is still queued, further
+ * ones are merged into it.  The invalidated data then covers the
+ * smallest range that contains all the queued ones.
+ *
+ * If the queue holds `notify_queue_max` notifications (a session
+ * option, 65536 by default), the caller blocks until the sender has
+ * made room.  Notifications still queued when the session is
+ * destroyed are discarded.
+ *
+ * @param se the session object
+ * @param ino the inode number
+ * @param off the offset in the inode where to start invalidating
+ *            or negative to invalidate attributes only
+ * @param len the amount of cache to invalidate or 0 for all
+ * @return zero if the notification was queued, -errno for failure
+ */
+int fuse_lowlevel_notify_inval_inode_async(struct fuse_session *se,
+					   fuse_ino_t ino, off_t off,
+					   off_t len);
+
+/**
+ * Queue an invalidation of a directory entry
+ *
+ * This is the asynchronous form of fuse_lowlevel_notify_inval_entry(),
+ * see fuse_lowlevel_notify_inval_inode_async().  Repeated
+ * invalidations of the same entry are sent only once while the
+ * first is still queued.
+ *
+ * @param se the session object
+ * @param parent inode number
+ * @param name file name
+ * @param namelen strlen() of file name
+ * @return zero if the notification was queued, -errno for failure
+ */
+int fuse_lowlevel_notify_inval_entry_async(struct fuse_session *se,
+					   fuse_ino_t parent,
+					   const char *name, size_t namelen);
+
+/**
+ * Queue a deletion notification of a directory entry
+ *
+ * This is the asynchronous form of fuse_lowlevel_notify_delete(),
+ * see fuse_lowlevel_notify_inval_inode_async().
+ *
+ * @param se the session object
+ * @param parent inode number
+ * @param child inode number
+ * @param name file name
+ * @param namelen strlen() of file name
+ * @return zero if the notification was queued, -errno for failure
+ */
+int fuse_lowlevel_notify_delete_async(struct fuse_session *se,
+				      fuse_ino_t parent, fuse_ino_t child,
+				      const char *name, size_t namelen);
+
+/**
+ * Wait until all queued notifications have been sent
+ *
+ * Like the synchronous notification functions, this must not be
+ * called from a request handler whose operation may be needed by the
+ * kernel to process a queued notification.
+ *
+ * @param se the session object
+ * @return zero on success, -errno for failure
+ */
+int fuse_lowlevel_notify_flush(struct fuse_session *se);
+
+/**
+ * Statistics of the asynchronous notification queue
+ */
+struct fuse_notify_queue_stats {
+	/** Notifications added to the queue */
+	uint64_t queued;
+	/** Notifications merged into one that was already queued */
+	uint64_t coalesced;
+	/** Notifications sent to the kernel */
+	uint64_t sent;
+	/** Notifications the kernel returned an error for, other than
+	    -ENOENT for an unknown inode or entry */
+	uint64_t failed;
+	/** Number of times a caller had to wait for room in the queue */
+	uint64_t blocked;
+	/** Notifications currently queued */
+	unsigned int depth;
+	/** Largest number of notifications queued at once */
+	unsigned int max_depth;
+};
+
+/**
+ * Get statistics of the asynchronous notification queue
+ *
+ * @param se the session object
+ * @param stats the structure to fill in
+ */
+void fuse_lowlevel_notify_queue_stats(struct fuse_session *se,
+				      struct fuse_notify_queue_stats *stats);
+
 /**
  * Store data to the kernel buffers
  *
@@ -1767,6 +2073,149 @@ int fuse_lowlevel_notify_store(struct fuse_session *se, fuse_ino_t ino,
 int fuse_lowlevel_notify_retrieve(struct fuse_session *se, fuse_ino_t ino,
 				  size_t size, off_t offset, void *cookie);
 
+/**
+ * Page cache prewarming
+ *
+ * A prewarm object copies file contents into the kernel page cache
+ * with fuse_lowlevel_notify_store(), on a small pool of threads, so
+ * that later reads are served without READ requests.  The data is read
+ * from a file descriptor of the backing file, and is spliced into the
+ * kernel if splice is enabled for the session.
+ *
+ * Only inodes that the kernel has looked up, and that are not being
+ * evicted, can be prewarmed; stores to other inodes fail with -ENOENT
+ * and the rest of the range is skipped.  Cached data is dropped when a
+ * file is opened without `keep_cache`, so files should be opened with
+ * it before they are prewarmed.
+ */
+struct fuse_prewarm;
+
+/**
+ * Statistics of a prewarm object
+ */
+struct fuse_prewarm_stats {
+	/** Bytes stored into the page cache */
+	uint64_t bytes;
+	/** Number of store notifications sent */
+	uint64_t stores;
+	/** Number of ranges that were cut short by an error */
+	uint64_t failed;
+};
+
+/**
+ * Create a prewarm object
+ *
+ * At most `threads` stores are in flight at a time, each of at most
+ * `max_memory / threads` bytes (but no more than 1 MiB), which bounds
+ * the memory used for copying when the data can't be spliced.  Zero
+ * selects the defaults of 4 threads and 4 MiB.
+ *
+ * The threads are started when the first range is queued.
+ *
+ * @param se the session object
+ * @param threads maximum number of concurrent stores
+ * @param max_memory maximum number of bytes being stored at a time
+ * @return the prewarm object, or NULL on failure
+ */
+struct fuse_prewarm *fuse_prewarm_new(struct fuse_session *se,
+				      unsigned int threads,
+				      size_t max_memory);
+
+/**
+ * Queue a range of a file for prewarming
+ *
+ * The data is read from `fd`, which is duplicated, so the caller may
+ * close it when this function returns.  The range is clipped to the
+ * current size of the file.
+ *
+ * @param pw the prewarm object
+ * @param ino the inode number
+ * @param fd file descriptor of the backing file
+ * @param off the offset of the range
+ * @param len the length of the range, or 0 for the rest of the file
+ * @return zero if the range was queued, -errno for failure
+ */
+int fuse_prewarm_fd(struct fuse_prewarm *pw, fuse_ino_t ino, int fd,
+		    off_t off, size_t len);
+
+/**
+ * Callback used by fuse_prewarm_hints() to look up a hinted file
+ *
+ * @param data the `data` argument of fuse_prewarm_hints()
+ * @param name the name of the file as listed in the hint file
+ * @param ino set to the inode number of the file
+ * @param fd set to a file descriptor of the backing file, which is
+ *           closed by the library
+ * @return zero on success, -errno to skip the file
+ */
+typedef int (*fuse_prewarm_resolve_t)(void *data, const char *name,
+				      fuse_ino_t *ino, int *fd);
+
+/**
+ * Queue the files listed in a hint file for prewarming
+ *
+ * Each line of the hint file names a file, optionally followed by the
+ * offset and length of the range to prewarm, separated by white space.
+ * Without a range the whole file is prewarmed.  Empty lines and lines
+ * starting with '#' are ignored.  File names are passed verbatim to
+ * `resolve` and may not contain white space.
+ *
+ * @param pw the prewarm object
+ * @param hintfile path of the hint file
+ * @param resolve callback looking up the listed files
+ * @param data user data passed to `resolve`
+ * @return the number of ranges queued, or -errno if the hint file can't
+ *         be read
+ */
+int fuse_prewarm_hints(struct fuse_prewarm *pw, const char *hintfile,
+		       fuse_prewarm_resolve_t resolve, void *data);
+
+/**
+ * Reply to an open request and prewarm the opened file
+ *
+ * This is fuse_reply_open() followed by queueing the first `len` bytes
+ * of the file, or all of it if `len` is zero, for prewarming.  Nothing
+ * is prewarmed unless `fi->keep_cache` is set, because the kernel would
+ * drop the data again.
+ *
+ * @param req request handle
+ * @param fi file information
+ * @param pw the prewarm object
+ * @param ino the inode number of the opened file
+ * @param fd file descriptor of the backing file
+ * @param len the number of bytes to prewarm, or 0 for the whole file
+ * @return zero for success, -errno for failure to send reply
+ */
+int fuse_reply_open_prewarm(fuse_req_t req, const struct fuse_file_info *fi,
+			    struct fuse_prewarm *pw, fuse_ino_t ino, int fd,
+			    size_t len);
+
+/**
+ * Wait until all queued ranges have been stored
+ *
+ * @param pw the prewarm object
+ */
+void fuse_prewarm_wait(struct fuse_prewarm *pw);
+
+/**
+ * Get statistics of a prewarm object
+ *
+ * @param pw the prewarm object
+ * @param stats the structure to fill in
+ */
+void fuse_prewarm_get_stats(struct fuse_prewarm *pw,
+			    struct fuse_prewarm_stats *stats);
+
+/**
+ * Destroy a prewarm object
+ *
+ * Ranges that are still queued are discarded.  This must be called
+ * before the session is destroyed.
+ *
+ * @param pw the prewarm object
+ */
+void fuse_prewarm_destroy(struct fuse_prewarm *pw);
+
 
 /* ----------------------------------------------------------- *
  * Utility functions					       *
@@ -1800,7 +2249,13 @@ const struct fuse_ctx *fuse_req_ctx(fuse_req_t req);
  *
  * The current fuse kernel module in linux (as of 2.6.30) doesn't pass
  * the group list to userspace, hence this function needs to parse
- * "/proc/$TID/task/$TID/status" to get the group IDs.
+ * "/proc/$TID/task/$TID/status" to get the group IDs.  The result is
+ * kept with the request.  With the `groups_timeout` option it is also
+ * cached for further requests from the same process with the same uid
+ * and gid for that many seconds (default 0, no caching).  Group
+ * changes of a process, or of a new process reusing its pid, may then
+ * take that long to be noticed, so only enable it if the filesystem
+ * can tolerate that.
  *
  * This feature may not be supported on all operating systems.  In
  * such a case this function will return -ENOSYS.
@@ -1812,6 +2267,19 @@ const struct fuse_ctx *fuse_req_ctx(fuse_req_t req);
  */
 int fuse_req_getgroups(fuse_req_t req, int size, gid_t list[]);
 
+/**
+ * Look up the supplementary group IDs for the specified request
+ *
+ * This does the work of fuse_req_getgroups() up front, for example
+ * at the start of a handler, without copying the result.  Later calls
+ * to fuse_req_getgroups() or fuse_getgroups() for the same request,
+ * from any layer, are then answered from the request itself.
+ *
+ * @param req request handle
+ * @return zero on success or -errno on failure
+ */
+int fuse_req_prefetch_groups(fuse_req_t req);
+
 /**
  * Callback function for an interrupt
  *
@@ -1842,6 +2310,26 @@ void fuse_req_interrupt_func(fuse_req_t req, fuse_interrupt_func_t func,
  */
 int fuse_req_interrupted(fuse_req_t req);
 
+/**
+ * Allocate scratch memory for the duration of a request
+ *
+ * The memory is taken from an arena belonging to the request and is
+ * released automatically once the request has been replied to, so it
+ * must not be passed to free() or used after the reply.  This is
+ * cheaper than malloc() for short lived buffers such as xattr lists,
+ * directory listings and path names, and may be passed directly to
+ * the reply functions.
+ *
+ * The returned memory is suitably aligned for any type, but is not
+ * zeroed.  The function must not be called concurrently for the same
+ * request.
+ *
+ * @param req request handle
+ * @param size number of bytes to allocate
+ * @return pointer to the memory, or NULL on allocation failure
+ */
+void *fuse_req_alloc(fuse_req_t req, size_t size);
+
 
 /* ----------------------------------------------------------- *
  * Inquiry functions                                           *
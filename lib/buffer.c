@@ -14,10 +14,14 @@
 #include "config.h"
 #include "fuse_i.h"
 #include "fuse_lowlevel.h"
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
 #include <assert.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/mman.h>
 
 size_t fuse_buf_size(const struct fuse_bufvec *bufv)
 {
@@ -319,3 +323,352 @@ ssize_t fuse_buf_copy(struct fuse_bufvec *dstv, struct fuse_bufvec *srcv,
 
 	return copied;
 }
+
+/*
+ * Arena of buffers backed by 2MiB pages.  Chunks are whole, aligned
+ * 2MiB pages, taken from hugetlbfs if pages are reserved there and
+ * advised for transparent huge pages otherwise.  While a session with
+ * -o hugepages exists, freed chunks are kept for reuse, so that their
+ * pages need not be faulted in again.
+ */
+#define ARENA_PAGE_SHIFT 21
+#define ARENA_PAGE_SIZE ((size_t) 1 << ARENA_PAGE_SHIFT)
+#define ARENA_CACHE_MAX (64 * 1024 * 1024)
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+#define ARENA_HUGETLB (MAP_HUGETLB | (ARENA_PAGE_SHIFT << MAP_HUGE_SHIFT))
+#endif
+
+/* Kept at the start of a free chunk */
+struct arena_chunk {
+	struct arena_chunk *next;
+	size_t size;
+};
+
+static pthread_mutex_t arena_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct arena_chunk *arena_free;
+static unsigned arena_users;
+#ifdef ARENA_HUGETLB
+static int arena_no_hugetlb;
+#endif
+static struct fuse_buf_arena_stats arena_stats;
+
+static size_t arena_size(size_t size)
+{
+	return (size + ARENA_PAGE_SIZE - 1) & ~(ARENA_PAGE_SIZE - 1);
+}
+
+/* Called with arena_lock held */
+static void *arena_map(size_t size)
+{
+	char *mem;
+	size_t head;
+
+#ifdef ARENA_HUGETLB
+	if (arena_users && !arena_no_hugetlb) {
+		mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS | ARENA_HUGETLB, -1, 0);
+		if (mem != MAP_FAILED) {
+			arena_stats.hugetlb++;
+			return mem;
+		}
+		/* No reserved pages, don't try again */
+		arena_no_hugetlb = 1;
+	}
+#endif
+	/* Huge pages need an aligned range */
+	mem = mmap(NULL, size + ARENA_PAGE_SIZE, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED)
+		return NULL;
+	head = -(uintptr_t) mem & (ARENA_PAGE_SIZE - 1);
+	if (head)
+		munmap(mem, head);
+	munmap(mem + head + size, ARENA_PAGE_SIZE - head);
+	mem += head;
+
+#ifdef MADV_HUGEPAGE
+	if (madvise(mem, size, MADV_HUGEPAGE) == 0) {
+		arena_stats.thp++;
+		return mem;
+	}
+#endif
+	arena_stats.fallback++;
+	return mem;
+}
+
+void *fuse_buf_arena_alloc(size_t size)
+{
+	struct arena_chunk **pp;
+	struct arena_chunk *chunk;
+	void *mem = NULL;
+
+	size = arena_size(size);
+	pthread_mutex_lock(&arena_lock);
+	for (pp = &arena_free; *pp; pp = &(*pp)->next) {
+		if ((*pp)->size == size) {
+			chunk = *pp;
+			*pp = chunk->next;
+			arena_stats.cached -= size;
+			arena_stats.hits++;
+			mem = chunk;
+			break;
+		}
+	}
+	if (!mem) {
+		mem = arena_map(size);
+		if (mem)
+			arena_stats.misses++;
+	}
+	if (mem)
+		arena_stats.in_use += size;
+	pthread_mutex_unlock(&arena_lock);
+
+	return mem;
+}
+
+void fuse_buf_arena_free(void *mem, size_t size)
+{
+	struct arena_chunk *chunk = mem;
+
+	if (!mem)
+		return;
+
+	size = arena_size(size);
+	pthread_mutex_lock(&arena_lock);
+	arena_stats.in_use -= size;
+	if (arena_users && arena_stats.cached + size <= ARENA_CACHE_MAX) {
+		chunk->size = size;
+		chunk->next = arena_free;
+		arena_free = chunk;
+		arena_stats.cached += size;
+		mem = NULL;
+	} else {
+		arena_stats.released++;
+	}
+	pthread_mutex_unlock(&arena_lock);
+
+	if (mem)
+		munmap(mem, size);
+}
+
+void fuse_buf_arena_get(void)
+{
+	pthread_mutex_lock(&arena_lock);
+	arena_users++;
+	pthread_mutex_unlock(&arena_lock);
+}
+
+void fuse_buf_arena_put(void)
+{
+	struct arena_chunk *chunk = NULL;
+
+	pthread_mutex_lock(&arena_lock);
+	if (--arena_users == 0) {
+		chunk = arena_free;
+		arena_free = NULL;
+		arena_stats.cached = 0;
+	}
+	pthread_mutex_unlock(&arena_lock);
+
+	while (chunk) {
+		struct arena_chunk *next = chunk->next;
+
+		munmap(chunk, chunk->size);
+		chunk = next;
+	}
+}
+
+void fuse_buf_arena_get_stats(struct fuse_buf_arena_stats *stats)
+{
+	pthread_mutex_lock(&arena_lock);
+	*stats = arena_stats;
+	pthread_mutex_unlock(&arena_lock);
+}
+
+/*
+ * Per-thread pool of bounce buffers.  Sizes are rounded up to a power
+ * of two, and a few buffers of each size class are kept around for
+ * the next request handled by the same thread.  Classes of at least
+ * 2MiB come from the arena above.
+ */
+#define POOL_MIN_SHIFT 12
+#define POOL_MAX_SHIFT 24
+#define POOL_HUGE_SHIFT 21
+#define POOL_CLASSES (POOL_MAX_SHIFT - POOL_MIN_SHIFT + 1)
+#define POOL_DEPTH 2
+#define POOL_THREAD_MAX (16 * 1024 * 1024)
+
+struct buf_pool {
+	void *free[POOL_CLASSES][POOL_DEPTH];
+	unsigned count[POOL_CLASSES];
+	size_t cached;
+	struct fuse_buf_pool_stats stats;
+	struct buf_pool *prev;
+	struct buf_pool *next;
+};
+
+static pthread_once_t buf_pool_once = PTHREAD_ONCE_INIT;
+static pthread_key_t buf_pool_key;
+static int buf_pool_key_ok;
+static pthread_mutex_t buf_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct buf_pool buf_pools = { .prev = &buf_pools, .next = &buf_pools };
+/* Counters of threads that have exited */
+static struct fuse_buf_pool_stats buf_pool_retired;
+
+static int buf_pool_class(size_t size)
+{
+	int shift = POOL_MIN_SHIFT;
+
+	while (shift <= POOL_MAX_SHIFT && ((size_t) 1 << shift) < size)
+		shift++;
+	return shift - POOL_MIN_SHIFT;
+}
+
+static void *buf_pool_map(int class, struct fuse_buf_pool_stats *stats)
+{
+	size_t size = (size_t) 1 << (class + POOL_MIN_SHIFT);
+	void *mem;
+
+	if (class + POOL_MIN_SHIFT < POOL_HUGE_SHIFT)
+		return malloc(size);
+
+	mem = fuse_buf_arena_alloc(size);
+	if (mem && stats)
+		stats->huge++;
+	return mem;
+}
+
+static void buf_pool_unmap(void *mem, int class)
+{
+	if (class + POOL_MIN_SHIFT < POOL_HUGE_SHIFT)
+		free(mem);
+	else
+		fuse_buf_arena_free(mem, (size_t) 1 << (class + POOL_MIN_SHIFT));
+}
+
+static void buf_pool_add_stats(struct fuse_buf_pool_stats *dst,
+			       const struct fuse_buf_pool_stats *src)
+{
+	dst->hits += src->hits;
+	dst->misses += src->misses;
+	dst->oversize += src->oversize;
+	dst->released += src->released;
+	dst->huge += src->huge;
+}
+
+static void buf_pool_destroy(void *data)
+{
+	struct buf_pool *pool = data;
+	int class;
+
+	for (class = 0; class < POOL_CLASSES; class++)
+		while (pool->count[class])
+			buf_pool_unmap(pool->free[class][--pool->count[class]],
+				       class);
+
+	pthread_mutex_lock(&buf_pool_lock);
+	pool->prev->next = pool->next;
+	pool->next->prev = pool->prev;
+	buf_pool_add_stats(&buf_pool_retired, &pool->stats);
+	pthread_mutex_unlock(&buf_pool_lock);
+	free(pool);
+}
+
+static void buf_pool_init(void)
+{
+	buf_pool_key_ok = pthread_key_create(&buf_pool_key,
+					     buf_pool_destroy) == 0;
+}
+
+static struct buf_pool *buf_pool_get(void)
+{
+	struct buf_pool *pool;
+
+	pthread_once(&buf_pool_once, buf_pool_init);
+	if (!buf_pool_key_ok)
+		return NULL;
+
+	pool = pthread_getspecific(buf_pool_key);
+	if (pool)
+		return pool;
+
+	pool = calloc(1, sizeof(struct buf_pool));
+	if (!pool)
+		return NULL;
+	if (pthread_setspecific(buf_pool_key, pool) != 0) {
+		free(pool);
+		return NULL;
+	}
+	pthread_mutex_lock(&buf_pool_lock);
+	pool->next = buf_pools.next;
+	pool->prev = &buf_pools;
+	pool->next->prev = pool;
+	buf_pools.next = pool;
+	pthread_mutex_unlock(&buf_pool_lock);
+	return pool;
+}
+
+void *fuse_buf_pool_alloc(size_t size)
+{
+	int class = buf_pool_class(size);
+	struct buf_pool *pool;
+
+	if (class >= POOL_CLASSES)
+		goto oversize;
+	pool = buf_pool_get();
+	if (!pool)
+		return buf_pool_map(class, NULL);
+
+	if (pool->count[class]) {
+		pool->stats.hits++;
+		pool->cached -= (size_t) 1 << (class + POOL_MIN_SHIFT);
+		return pool->free[class][--pool->count[class]];
+	}
+	pool->stats.misses++;
+	return buf_pool_map(class, &pool->stats);
+
+oversize:
+	pool = buf_pool_get();
+	if (pool)
+		pool->stats.oversize++;
+	return malloc(size);
+}
+
+void fuse_buf_pool_free(void *mem, size_t size)
+{
+	int class = buf_pool_class(size);
+	size_t csize = (size_t) 1 << (class + POOL_MIN_SHIFT);
+	struct buf_pool *pool;
+
+	if (!mem)
+		return;
+	if (class >= POOL_CLASSES) {
+		free(mem);
+		return;
+	}
+
+	pool = buf_pool_get();
+	if (pool && pool->count[class] < POOL_DEPTH &&
+	    pool->cached + csize <= POOL_THREAD_MAX) {
+		pool->free[class][pool->count[class]++] = mem;
+		pool->cached += csize;
+		return;
+	}
+	if (pool)
+		pool->stats.released++;
+	buf_pool_unmap(mem, class);
+}
+
+void fuse_buf_pool_get_stats(struct fuse_buf_pool_stats *stats)
+{
+	struct buf_pool *pool;
+
+	pthread_mutex_lock(&buf_pool_lock);
+	*stats = buf_pool_retired;
+	stats->cached = 0;
+	for (pool = buf_pools.next; pool != &buf_pools; pool = pool->next) {
+		buf_pool_add_stats(stats, &pool->stats);
+		stats->cached += pool->cached;
+	}
+	pthread_mutex_unlock(&buf_pool_lock);
+}
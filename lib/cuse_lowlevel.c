@@ -218,6 +218,13 @@ void cuse_lowlevel_init(fuse_req_t req, fuse_ino_t nodeid, const void *inarg)
 		return;
 	}
 
+	if (bufsize > FUSE_DEFAULT_MAX_PAGES_LIMIT * getpagesize() +
+	    FUSE_BUFFER_HEADER_SIZE) {
+		bufsize = FUSE_DEFAULT_MAX_PAGES_LIMIT * getpagesize() +
+			FUSE_BUFFER_HEADER_SIZE;
+		se->bufsize = bufsize;
+	}
+
 	if (bufsize < FUSE_MIN_READ_BUFFER) {
 		fuse_log(FUSE_LOG_ERR, "cuse: warning: buffer size too small: %zu\n",
 			bufsize);
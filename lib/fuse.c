@@ -39,6 +39,9 @@
 #include <sys/time.h>
 #include <sys/mman.h>
 #include <sys/file.h>
+#ifdef HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
 
 #define FUSE_NODE_SLAB 1
 
@@ -51,6 +54,7 @@
 #endif
 
 #define FUSE_DEFAULT_INTR_SIGNAL SIGUSR1
+#define FUSE_DEFAULT_READDIR_BUFFER (64 * 1024 * 1024)
 
 #define FUSE_UNKNOWN_INO 0xffffffff
 #define OFFSET_MAX 0x7fffffffffffffffLL
@@ -86,6 +90,20 @@ struct lock_queue_element {
 	bool done : 1;
 };
 
+/* A getattr call in progress, shared by concurrent callers */
+struct getattr_flight {
+	struct getattr_flight *next;
+	const char *path;
+	size_t hash;
+	int ref;
+	int done;
+	int err;
+	struct stat attr;
+	pthread_cond_t cond;
+};
+
+#define GETATTR_FLIGHT_BUCKETS 64
+
 struct node_table {
 	struct node **array;
 	size_t use;
@@ -111,6 +129,39 @@ struct node_slab {
 	int used;
 };
 
+/* An entry of a readdirplus reply whose attributes are looked up */
+struct readdir_pending {
+	unsigned pos;
+	off_t off;
+	char *name;
+	struct fuse_entry_param e;
+	int res;
+};
+
+struct lookup_batch {
+	struct fuse_context ctx;
+	fuse_req_t req;
+	fuse_ino_t parent;
+	struct readdir_pending *items;
+	size_t count;
+	size_t next;
+	size_t done;
+	pthread_cond_t cond;
+	struct lookup_batch *next_batch;
+};
+
+#define FUSE_MAX_LOOKUP_THREADS 64
+
+struct lookup_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	struct lookup_batch *head;
+	int started;
+	int exiting;
+	unsigned nthreads;
+	pthread_t threads[FUSE_MAX_LOOKUP_THREADS];
+};
+
 struct fuse {
 	struct fuse_session *se;
 	struct node_table name_table;
@@ -128,6 +179,13 @@ struct fuse {
 	struct list_head partial_slabs;
 	struct list_head full_slabs;
 	pthread_t prune_thread;
+	struct getattr_flight *flights[GETATTR_FLIGHT_BUCKETS];
+	unsigned long long flight_calls;
+	unsigned long long flight_shared;
+	unsigned long long xattr_hits;
+	unsigned long long xattr_misses;
+	struct lookup_pool lookup_pool;
+	unsigned long long prefetched;
 };
 
 struct lock {
@@ -136,6 +194,10 @@ struct lock {
 	off_t end;
 	pid_t pid;
 	uint64_t owner;
+	struct lock *left;
+	struct lock *right;
+	off_t max_end;
+	unsigned int prio;
 	struct lock *next;
 };
 
@@ -153,12 +215,30 @@ struct node {
 	struct timespec mtime;
 	off_t size;
 	struct lock *locks;
+	struct xattr_entry *xattrs;
+	unsigned int xattr_gen;
 	unsigned int is_hidden : 1;
 	unsigned int cache_valid : 1;
 	int treelock;
 	char inline_name[32];
 };
 
+/* Cached getxattr result, value (if any) follows the name */
+struct xattr_entry {
+	struct xattr_entry *next;
+	struct timespec cached;
+	int res;
+	char *value;
+	char name[];
+};
+
+#define XATTR_CACHE_MAX_ENTRIES 16
+#define XATTR_CACHE_MAX_VALUE 4096
+
+#ifndef ENOATTR
+#define ENOATTR ENODATA
+#endif
+
 #define TREELOCK_WRITE -1
 #define TREELOCK_WAIT_OFFSET INT_MIN
 
@@ -168,23 +248,54 @@ struct node_lru {
 	struct timespec forget_time;
 };
 
-struct fuse_direntry {
-	struct stat stat;
-	char *name;
-	struct fuse_direntry *next;
+/*
+ * Directory entries of filesystems that ignore readdir offsets are
+ * kept in a compact buffer.  Only the inode number and the type are
+ * needed to send the entries to the kernel, so each record holds just
+ * these and the name, padded to 8 bytes.
+ */
+struct fuse_dh_entry {
+	uint64_t ino;
+	uint32_t mode;
+	uint32_t namelen;
+	char name[];
 };
 
+#define DH_ENTRY_SIZE(namelen) \
+	((sizeof(struct fuse_dh_entry) + (namelen) + 1 + 7) & ~(size_t) 7)
+
+/* Number of listed entries handed to fuse_dirbuf_add() at once */
+#define READDIR_BATCH 64
+
 struct fuse_dh {
 	pthread_mutex_t lock;
 	struct fuse *fuse;
 	fuse_req_t req;
 	char *contents;
-	struct fuse_direntry *first;
-	struct fuse_direntry **last;
 	unsigned len;
 	unsigned size;
 	unsigned needlen;
 	int filled;
+	/*
+	 * The buffered window of the directory: 'count' entries starting
+	 * at position 'start'.  If 'more' is set, the window was cut short
+	 * by max_readdir_buffer and entries past it are read on demand by
+	 * skipping over the first 'skip' entries in a new pass.
+	 */
+	char *ents;
+	size_t ents_len;
+	size_t ents_size;
+	off_t start;
+	off_t count;
+	off_t skip;
+	int more;
+	/* Position and buffer offset where the previous reply ended */
+	off_t cursor;
+	size_t cursor_off;
+	/* Entries of the reply to look up with readdirplus_prefetch */
+	struct readdir_pending *pending;
+	size_t npending;
+	size_t pending_size;
 	uint64_t fh;
 	int error;
 	fuse_ino_t nodeid;
@@ -193,15 +304,26 @@ struct fuse_dh {
 struct fuse_context_i {
 	struct fuse_context ctx;
 	fuse_req_t req;
+	struct fuse_intr_data *intr;
 };
 
-/* Defined by FUSE_REGISTER_MODULE() in lib/modules/subdir.c and iconv.c.  */
+/* Defined by FUSE_REGISTER_MODULE() in lib/modules/subdir.c, iconv.c,
+   cache.c, readahead.c, coalesce.c and stats.c.  */
 extern fuse_module_factory_t fuse_module_subdir_factory;
+extern fuse_module_factory_t fuse_module_cache_factory;
+extern fuse_module_factory_t fuse_module_readahead_factory;
+extern fuse_module_factory_t fuse_module_coalesce_factory;
+extern fuse_module_factory_t fuse_module_stats_factory;
 #ifdef HAVE_ICONV
 extern fuse_module_factory_t fuse_module_iconv_factory;
 #endif
 
-static pthread_key_t fuse_context_key;
+/*
+ * The context lives in thread local storage, so that setting it up for
+ * each request needs neither a key lookup nor, on a new thread, an
+ * allocation.  A NULL ctx.fuse means it hasn't been created yet.
+ */
+static __thread struct fuse_context_i fuse_context_tls;
 static pthread_mutex_t fuse_context_lock = PTHREAD_MUTEX_INITIALIZER;
 static int fuse_context_ref;
 static struct fuse_module *fuse_modules = NULL;
@@ -568,13 +690,51 @@ static void set_forget_time(struct fuse *f, struct node *node)
 	curr_time(&lnode->forget_time);
 }
 
+static void lock_tree_free(struct lock *t)
+{
+	while (t) {
+		struct lock *right = t->right;
+
+		lock_tree_free(t->left);
+		free(t);
+		t = right;
+	}
+}
+
+static void xattr_cache_clear(struct node *node)
+{
+	while (node->xattrs) {
+		struct xattr_entry *xe = node->xattrs;
+
+		node->xattrs = xe->next;
+		free(xe);
+	}
+	node->xattr_gen++;
+}
+
 static void free_node(struct fuse *f, struct node *node)
 {
+	lock_tree_free(node->locks);
+	xattr_cache_clear(node);
 	if (node->name != node->inline_name)
 		free(node->name);
 	free_node_mem(f, node);
 }
 
+static void xattr_cache_invalidate(struct fuse *f, fuse_ino_t ino)
+{
+	struct node *node;
+
+	if (f->conf.xattr_timeout <= 0)
+		return;
+
+	pthread_mutex_lock(&f->lock);
+	node = get_node_nocheck(f, ino);
+	if (node != NULL)
+		xattr_cache_clear(node);
+	pthread_mutex_unlock(&f->lock);
+}
+
 static void node_table_reduce(struct node_table *t)
 {
 	size_t newsize = t->size / 2;
@@ -1556,50 +1716,110 @@ static void fuse_intr_sighandler(int sig)
 	/* Nothing to do */
 }
 
+/*
+ * State of a request that may be interrupted.  Without an interrupt,
+ * preparing and finishing only touch the request's own callback, and
+ * f->lock is taken only if fuse_interrupt() is waiting for the handler
+ * to finish.
+ */
+enum {
+	INTR_RUNNING,
+	INTR_WAITING,
+	INTR_FINISHED,
+};
+
+/*
+ * Cancellation token handed to the filesystem.  Once the handler has
+ * asked for it, interrupts are delivered only through the token and no
+ * longer by signalling the thread.  func and fd are protected by
+ * f->lock.
+ */
+struct fuse_cancel {
+	struct fuse *f;
+	int cancelled;
+	int cooperative;
+	fuse_cancel_func_t func;
+	void *data;
+	int fd;
+};
+
 struct fuse_intr_data {
 	pthread_t id;
 	pthread_cond_t cond;
-	int finished;
+	int state;
+	struct fuse_cancel cancel;
 };
 
+static void fuse_cancel_notify(struct fuse_cancel *cancel)
+{
+	if (cancel->func)
+		cancel->func(cancel->data);
+#ifdef HAVE_EVENTFD
+	if (cancel->fd != -1)
+		eventfd_write(cancel->fd, 1);
+#endif
+}
+
 static void fuse_interrupt(fuse_req_t req, void *d_)
 {
 	struct fuse_intr_data *d = d_;
 	struct fuse *f = req_fuse(req);
+	int state = INTR_RUNNING;
 
-	if (d->id == pthread_self())
-		return;
-
+	__atomic_store_n(&d->cancel.cancelled, 1, __ATOMIC_RELEASE);
 	pthread_mutex_lock(&f->lock);
-	while (!d->finished) {
-		struct timeval now;
-		struct timespec timeout;
+	fuse_cancel_notify(&d->cancel);
+	if (d->id == pthread_self() || !f->conf.intr_signal)
+		goto out;
 
-		pthread_kill(d->id, f->conf.intr_signal);
-		gettimeofday(&now, NULL);
-		timeout.tv_sec = now.tv_sec + 1;
-		timeout.tv_nsec = now.tv_usec * 1000;
-		pthread_cond_timedwait(&d->cond, &f->lock, &timeout);
+	if (__atomic_compare_exchange_n(&d->state, &state, INTR_WAITING, 0,
+					__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) ||
+	    state == INTR_WAITING) {
+		while (__atomic_load_n(&d->state, __ATOMIC_ACQUIRE) !=
+		       INTR_FINISHED && !d->cancel.cooperative) {
+			struct timeval now;
+			struct timespec timeout;
+
+			pthread_kill(d->id, f->conf.intr_signal);
+			gettimeofday(&now, NULL);
+			timeout.tv_sec = now.tv_sec + 1;
+			timeout.tv_nsec = now.tv_usec * 1000;
+			pthread_cond_timedwait(&d->cond, &f->lock, &timeout);
+		}
 	}
+out:
 	pthread_mutex_unlock(&f->lock);
 }
 
 static void fuse_do_finish_interrupt(struct fuse *f, fuse_req_t req,
 				     struct fuse_intr_data *d)
 {
-	pthread_mutex_lock(&f->lock);
-	d->finished = 1;
-	pthread_cond_broadcast(&d->cond);
-	pthread_mutex_unlock(&f->lock);
+	if (__atomic_exchange_n(&d->state, INTR_FINISHED, __ATOMIC_ACQ_REL) ==
+	    INTR_WAITING) {
+		pthread_mutex_lock(&f->lock);
+		pthread_cond_broadcast(&d->cond);
+		pthread_mutex_unlock(&f->lock);
+	}
+	/* Waits for a running fuse_interrupt() to return */
 	fuse_req_interrupt_func(req, NULL, NULL);
 	pthread_cond_destroy(&d->cond);
+	if (d->cancel.fd != -1)
+		close(d->cancel.fd);
+	fuse_context_tls.intr = NULL;
 }
 
 static void fuse_do_prepare_interrupt(fuse_req_t req, struct fuse_intr_data *d)
 {
 	d->id = pthread_self();
 	pthread_cond_init(&d->cond, NULL);
-	d->finished = 0;
+	d->state = INTR_RUNNING;
+	d->cancel.f = req_fuse(req);
+	d->cancel.cancelled = 0;
+	d->cancel.cooperative = 0;
+	d->cancel.func = NULL;
+	d->cancel.data = NULL;
+	d->cancel.fd = -1;
+	fuse_context_tls.intr = d;
 	fuse_req_interrupt_func(req, fuse_interrupt, d);
 }
 
@@ -1912,7 +2132,7 @@ int fuse_fs_write_buf(struct fuse_fs *fs, const char *path,
 				flatbuf = &buf->buf[0];
 			} else {
 				res = -ENOMEM;
-				mem = malloc(size);
+				mem = fuse_buf_pool_alloc(size);
 				if (mem == NULL)
 					goto out;
 
@@ -1928,7 +2148,7 @@ int fuse_fs_write_buf(struct fuse_fs *fs, const char *path,
 			res = fs->op.write(path, flatbuf->mem, flatbuf->size,
 					   off, fi);
 out_free:
-			free(mem);
+			fuse_buf_pool_free(mem, size);
 		}
 out:
 		if (fs->debug && res >= 0)
@@ -2401,6 +2621,23 @@ off_t fuse_fs_lseek(struct fuse_fs *fs, const char *path, off_t off, int whence,
 	}
 }
 
+int fuse_fs_statx(struct fuse_fs *fs, const char *path, int flags, int mask,
+		  struct statx *stxbuf, struct fuse_file_info *fi)
+{
+	fuse_get_context()->private_data = fs->user_data;
+	if (fs->op.statx) {
+		if (fs->debug) {
+			char buf[10];
+			fuse_log(FUSE_LOG_DEBUG, "statx[%s] %s 0x%x 0x%x\n",
+				file_info_string(fi, buf, sizeof(buf)),
+				path, flags, mask);
+		}
+		return fs->op.statx(path, flags, mask, stxbuf, fi);
+	} else {
+		return -ENOSYS;
+	}
+}
+
 static int is_open(struct fuse *f, fuse_ino_t dir, const char *name)
 {
 	struct node *node;
@@ -2494,15 +2731,50 @@ static void curr_time(struct timespec *now)
 	}
 }
 
-static void update_stat(struct node *node, const struct stat *stbuf)
+/* Whether modification times of nodes need to be tracked */
+static int auto_cache_on(struct fuse *f)
 {
-	if (node->cache_valid && (!mtime_eq(stbuf, &node->mtime) ||
-				  stbuf->st_size != node->size))
+	return f->conf.auto_cache || f->conf.auto_cache_readdir ||
+		f->conf.cache_symlinks;
+}
+
+/*
+ * Called with f->lock held.  Returns whether the symlink target cached
+ * by the kernel is out of date, which the caller must pass on to
+ * symlink_changed() once the lock is dropped.
+ */
+static int update_stat(struct fuse *f, struct node *node,
+		       const struct stat *stbuf)
+{
+	int changed = !mtime_eq(stbuf, &node->mtime) ||
+		stbuf->st_size != node->size;
+	int stale = changed && f->conf.cache_symlinks &&
+		S_ISLNK(stbuf->st_mode) && node->stat_updated.tv_sec;
+
+	if (node->cache_valid && changed)
 		node->cache_valid = 0;
 	node->mtime.tv_sec = stbuf->st_mtime;
 	node->mtime.tv_nsec = ST_MTIM_NSEC(stbuf);
 	node->size = stbuf->st_size;
 	curr_time(&node->stat_updated);
+	return stale;
+}
+
+/* The kernel keeps a cached symlink target until told otherwise */
+static void symlink_changed(struct fuse *f, fuse_ino_t ino, int stale)
+{
+	if (stale)
+		fuse_lowlevel_notify_inval_inode_async(f->se, ino, 0, 0);
+}
+
+/* Listings of the directory cached by the kernel are out of date */
+static void dir_changed(struct fuse *f, fuse_ino_t dir)
+{
+	if (f->conf.auto_cache_readdir) {
+		pthread_mutex_lock(&f->lock);
+		get_node(f, dir)->cache_valid = 0;
+		pthread_mutex_unlock(&f->lock);
+	}
 }
 
 static int do_lookup(struct fuse *f, fuse_ino_t nodeid, const char *name,
@@ -2518,15 +2790,115 @@ static int do_lookup(struct fuse *f, fuse_ino_t nodeid, const char *name,
 	e->generation = node->generation;
 	e->entry_timeout = f->conf.entry_timeout;
 	e->attr_timeout = f->conf.attr_timeout;
-	if (f->conf.auto_cache) {
+	if (auto_cache_on(f)) {
+		int stale;
+
 		pthread_mutex_lock(&f->lock);
-		update_stat(node, &e->attr);
+		stale = update_stat(f, node, &e->attr);
 		pthread_mutex_unlock(&f->lock);
+		symlink_changed(f, e->ino, stale);
 	}
 	set_stat(f, e->ino, &e->attr);
 	return 0;
 }
 
+static struct getattr_flight *find_flight(struct fuse *f, const char *path,
+					  size_t hash)
+{
+	struct getattr_flight *fl;
+
+	for (fl = f->flights[hash % GETATTR_FLIGHT_BUCKETS]; fl; fl = fl->next)
+		if (fl->hash == hash && strcmp(fl->path, path) == 0)
+			return fl;
+	return NULL;
+}
+
+static void put_flight(struct getattr_flight *fl)
+{
+	if (--fl->ref == 0) {
+		pthread_cond_destroy(&fl->cond);
+		free(fl);
+	}
+}
+
+/*
+ * Call getattr for a path, or wait for the result of an identical call
+ * that is already in progress if coalescing is enabled.  Only used for
+ * lookup and getattr requests, never for the lookup that follows a
+ * modification.  Calls with a file handle are not coalesced.
+ */
+static int getattr_path(struct fuse *f, const char *path, struct stat *buf,
+			struct fuse_file_info *fi)
+{
+	struct getattr_flight *fl, **flp;
+	size_t hash = 0;
+	const char *s;
+	int err;
+
+	if (!f->conf.coalesce_getattr || fi != NULL || path == NULL)
+		return fuse_fs_getattr(f->fs, path, buf, fi);
+
+	for (s = path; *s; s++)
+		hash = hash * 31 + (unsigned char) *s;
+
+	pthread_mutex_lock(&f->lock);
+	fl = find_flight(f, path, hash);
+	if (fl != NULL) {
+		f->flight_shared++;
+		fl->ref++;
+		while (!fl->done)
+			pthread_cond_wait(&fl->cond, &f->lock);
+		err = fl->err;
+		*buf = fl->attr;
+		put_flight(fl);
+		pthread_mutex_unlock(&f->lock);
+		return err;
+	}
+	f->flight_calls++;
+	fl = calloc(1, sizeof(struct getattr_flight));
+	if (fl != NULL) {
+		fl->path = path;
+		fl->hash = hash;
+		fl->ref = 1;
+		pthread_cond_init(&fl->cond, NULL);
+		flp = &f->flights[hash % GETATTR_FLIGHT_BUCKETS];
+		fl->next = *flp;
+		*flp = fl;
+	}
+	pthread_mutex_unlock(&f->lock);
+
+	err = fuse_fs_getattr(f->fs, path, buf, NULL);
+	if (fl == NULL)
+		return err;
+
+	pthread_mutex_lock(&f->lock);
+	for (flp = &f->flights[hash % GETATTR_FLIGHT_BUCKETS]; *flp != fl;
+	     flp = &(*flp)->next);
+	*flp = fl->next;
+	fl->path = NULL;
+	fl->err = err;
+	fl->attr = *buf;
+	fl->done = 1;
+	pthread_cond_broadcast(&fl->cond);
+	put_flight(fl);
+	pthread_mutex_unlock(&f->lock);
+
+	return err;
+}
+
+static int lookup_found(struct fuse *f, fuse_ino_t nodeid, const char *name,
+			struct fuse_entry_param *e)
+{
+	int res;
+
+	res = do_lookup(f, nodeid, name, e);
+	if (res == 0 && f->conf.debug) {
+		fuse_log(FUSE_LOG_DEBUG, "   NODEID: %llu\n",
+			(unsigned long long) e->ino);
+	}
+	return res;
+}
+
 static int lookup_path(struct fuse *f, fuse_ino_t nodeid,
 		       const char *name, const char *path,
 		       struct fuse_entry_param *e, struct fuse_file_info *fi)
@@ -2535,87 +2907,68 @@ static int lookup_path(struct fuse *f, fuse_ino_t nodeid,
 
 	memset(e, 0, sizeof(struct fuse_entry_param));
 	res = fuse_fs_getattr(f->fs, path, &e->attr, fi);
-	if (res == 0) {
-		res = do_lookup(f, nodeid, name, e);
-		if (res == 0 && f->conf.debug) {
-			fuse_log(FUSE_LOG_DEBUG, "   NODEID: %llu\n",
-				(unsigned long long) e->ino);
-		}
-	}
+	if (res == 0)
+		res = lookup_found(f, nodeid, name, e);
 	return res;
 }
 
 static struct fuse_context_i *fuse_get_context_internal(void)
 {
-	return (struct fuse_context_i *) pthread_getspecific(fuse_context_key);
+	struct fuse_context_i *c = &fuse_context_tls;
+
+	return c->ctx.fuse ? c : NULL;
 }
 
 static struct fuse_context_i *fuse_create_context(struct fuse *f)
 {
-	struct fuse_context_i *c = fuse_get_context_internal();
-	if (c == NULL) {
-		c = (struct fuse_context_i *)
-			calloc(1, sizeof(struct fuse_context_i));
-		if (c == NULL) {
-			/* This is hard to deal with properly, so just
-			   abort.  If memory is so low that the
-			   context cannot be allocated, there's not
-			   much hope for the filesystem anyway */
-			fuse_log(FUSE_LOG_ERR, "fuse: failed to allocate thread specific data\n");
-			abort();
-		}
-		pthread_setspecific(fuse_context_key, c);
-	} else {
-		memset(c, 0, sizeof(*c));
-	}
+	struct fuse_context_i *c = &fuse_context_tls;
+
 	c->ctx.fuse = f;
+	c->ctx.uid = 0;
+	c->ctx.gid = 0;
+	c->ctx.pid = 0;
+	c->ctx.private_data = NULL;
+	c->ctx.umask = 0;
+	c->req = NULL;
+	c->intr = NULL;
 
 	return c;
 }
 
-static void fuse_freecontext(void *data)
+struct fuse_context *fuse_thread_context(struct fuse *f)
 {
-	free(data);
+	return &fuse_create_context(f)->ctx;
 }
 
-static int fuse_create_context_key(void)
+static void fuse_get_context_ref(void)
 {
-	int err = 0;
 	pthread_mutex_lock(&fuse_context_lock);
-	if (!fuse_context_ref) {
-		err = pthread_key_create(&fuse_context_key, fuse_freecontext);
-		if (err) {
-			fuse_log(FUSE_LOG_ERR, "fuse: failed to create thread specific key: %s\n",
-				strerror(err));
-			pthread_mutex_unlock(&fuse_context_lock);
-			return -1;
-		}
-	}
 	fuse_context_ref++;
 	pthread_mutex_unlock(&fuse_context_lock);
-	return 0;
 }
 
-static void fuse_delete_context_key(void)
+static void fuse_put_context_ref(void)
 {
 	pthread_mutex_lock(&fuse_context_lock);
 	fuse_context_ref--;
-	if (!fuse_context_ref) {
-		free(pthread_getspecific(fuse_context_key));
-		pthread_key_delete(fuse_context_key);
-	}
+	if (!fuse_context_ref)
+		memset(&fuse_context_tls, 0, sizeof(fuse_context_tls));
 	pthread_mutex_unlock(&fuse_context_lock);
 }
 
 static struct fuse *req_fuse_prepare(fuse_req_t req)
 {
-	struct fuse_context_i *c = fuse_create_context(req_fuse(req));
+	struct fuse_context_i *c = &fuse_context_tls;
 	const struct fuse_ctx *ctx = fuse_req_ctx(req);
-	c->req = req;
+
+	c->ctx.fuse = req_fuse(req);
 	c->ctx.uid = ctx->uid;
 	c->ctx.gid = ctx->gid;
 	c->ctx.pid = ctx->pid;
+	c->ctx.private_data = NULL;
 	c->ctx.umask = ctx->umask;
+	c->req = req;
+	c->intr = NULL;
 	return c->ctx.fuse;
 }
 
@@ -2661,6 +3014,9 @@ static void fuse_lib_init(void *data, struct fuse_conn_info *conn)
 	if(conn->capable & FUSE_CAP_EXPORT_SUPPORT)
 		conn->want |= FUSE_CAP_EXPORT_SUPPORT;
 	fuse_fs_init(f->fs, conn, &f->conf);
+	if (f->conf.cache_symlinks &&
+	    (conn->capable & FUSE_CAP_CACHE_SYMLINKS))
+		conn->want |= FUSE_CAP_CACHE_SYMLINKS;
 }
 
 void fuse_fs_destroy(struct fuse_fs *fs)
@@ -2722,7 +3078,10 @@ static void fuse_lib_lookup(fuse_req_t req, fuse_ino_t parent,
 		if (f->conf.debug)
 			fuse_log(FUSE_LOG_DEBUG, "LOOKUP %s\n", path);
 		fuse_prepare_interrupt(f, req, &d);
-		err = lookup_path(f, parent, name, path, &e, NULL);
+		memset(&e, 0, sizeof(e));
+		err = getattr_path(f, path, &e.attr, NULL);
+		if (err == 0)
+			err = lookup_found(f, parent, name, &e);
 		if (err == -ENOENT && f->conf.negative_timeout != 0.0) {
 			e.ino = 0;
 			e.entry_timeout = f->conf.negative_timeout;
@@ -2783,26 +3142,88 @@ static void fuse_lib_getattr(fuse_req_t req, fuse_ino_t ino,
 	if (!err) {
 		struct fuse_intr_data d;
 		fuse_prepare_interrupt(f, req, &d);
-		err = fuse_fs_getattr(f->fs, path, &buf, fi);
+		err = getattr_path(f, path, &buf, fi);
 		fuse_finish_interrupt(f, req, &d);
 		free_path(f, ino, path);
 	}
 	if (!err) {
 		struct node *node;
+		int stale = 0;
 
 		pthread_mutex_lock(&f->lock);
 		node = get_node(f, ino);
 		if (node->is_hidden && buf.st_nlink > 0)
 			buf.st_nlink--;
-		if (f->conf.auto_cache)
-			update_stat(node, &buf);
+		if (auto_cache_on(f))
+			stale = update_stat(f, node, &buf);
 		pthread_mutex_unlock(&f->lock);
+		symlink_changed(f, ino, stale);
 		set_stat(f, ino, &buf);
 		fuse_reply_attr(req, &buf, f->conf.attr_timeout);
 	} else
 		reply_err(req, err);
 }
 
+#ifdef HAVE_STATX
+static void fuse_lib_statx(fuse_req_t req, fuse_ino_t ino, int flags, int mask,
+			   struct fuse_file_info *fi)
+{
+	struct fuse *f = req_fuse_prepare(req);
+	struct statx buf;
+	char *path;
+	int err;
+
+	memset(&buf, 0, sizeof(buf));
+
+	if (fi != NULL)
+		err = get_path_nullok(f, ino, &path);
+	else
+		err = get_path(f, ino, &path);
+	if (!err) {
+		struct fuse_intr_data d;
+		fuse_prepare_interrupt(f, req, &d);
+		err = fuse_fs_statx(f->fs, path, flags, mask, &buf, fi);
+		fuse_finish_interrupt(f, req, &d);
+		free_path(f, ino, path);
+	}
+	if (!err) {
+		struct node *node;
+		int stale = 0;
+
+		/* Same adjustments as for getattr, on the fields present */
+		pthread_mutex_lock(&f->lock);
+		node = get_node(f, ino);
+		if (node->is_hidden && buf.stx_nlink > 0)
+			buf.stx_nlink--;
+		if (auto_cache_on(f) &&
+		    (buf.stx_mask & (STATX_MTIME | STATX_SIZE)) ==
+		    (STATX_MTIME | STATX_SIZE)) {
+			struct stat stbuf;
+
+			memset(&stbuf, 0, sizeof(stbuf));
+			stbuf.st_mtime = buf.stx_mtime.tv_sec;
+			ST_MTIM_NSEC_SET(&stbuf, buf.stx_mtime.tv_nsec);
+			stbuf.st_mode = buf.stx_mode;
+			stbuf.st_size = buf.stx_size;
+			stale = update_stat(f, node, &stbuf);
+		}
+		pthread_mutex_unlock(&f->lock);
+		symlink_changed(f, ino, stale);
+		if (!f->conf.use_ino)
+			buf.stx_ino = ino;
+		if (f->conf.set_mode)
+			buf.stx_mode = (buf.stx_mode & S_IFMT) |
+				       (0777 & ~f->conf.umask);
+		if (f->conf.set_uid)
+			buf.stx_uid = f->conf.uid;
+		if (f->conf.set_gid)
+			buf.stx_gid = f->conf.gid;
+		fuse_reply_statx(req, 0, &buf, f->conf.attr_timeout);
+	} else
+		reply_err(req, err);
+}
+#endif
+
 int fuse_fs_chmod(struct fuse_fs *fs, const char *path, mode_t mode,
 		  struct fuse_file_info *fi)
 {
@@ -2883,6 +3304,10 @@ static void fuse_lib_setattr(fuse_req_t req, fuse_ino_t ino, struct stat *attr,
 			tv[1].tv_nsec = ST_MTIM_NSEC(attr);
 			err = fuse_fs_utimens(f->fs, path, tv, fi);
 		}
+		/* Capabilities and ACLs may change with mode and owner */
+		if (valid & (FUSE_SET_ATTR_MODE | FUSE_SET_ATTR_UID |
+			     FUSE_SET_ATTR_GID))
+			xattr_cache_invalidate(f, ino);
 		if (!err) {
 			err = fuse_fs_getattr(f->fs, path, &buf, fi);
 		}
@@ -2890,10 +3315,13 @@ static void fuse_lib_setattr(fuse_req_t req, fuse_ino_t ino, struct stat *attr,
 		free_path(f, ino, path);
 	}
 	if (!err) {
-		if (f->conf.auto_cache) {
+		if (auto_cache_on(f)) {
+			int stale;
+
 			pthread_mutex_lock(&f->lock);
-			update_stat(get_node(f, ino), &buf);
+			stale = update_stat(f, get_node(f, ino), &buf);
 			pthread_mutex_unlock(&f->lock);
+			symlink_changed(f, ino, stale);
 		}
 		set_stat(f, ino, &buf);
 		fuse_reply_attr(req, &buf, f->conf.attr_timeout);
@@ -2922,16 +3350,23 @@ static void fuse_lib_access(fuse_req_t req, fuse_ino_t ino, int mask)
 static void fuse_lib_readlink(fuse_req_t req, fuse_ino_t ino)
 {
 	struct fuse *f = req_fuse_prepare(req);
-	char linkname[PATH_MAX + 1];
+	char *linkname = NULL;
 	char *path;
 	int err;
 
 	err = get_path(f, ino, &path);
 	if (!err) {
 		struct fuse_intr_data d;
-		fuse_prepare_interrupt(f, req, &d);
-		err = fuse_fs_readlink(f->fs, path, linkname, sizeof(linkname));
-		fuse_finish_interrupt(f, req, &d);
+
+		/* Taken from the thread's pool rather than the stack */
+		linkname = fuse_buf_pool_alloc(PATH_MAX + 1);
+		if (linkname) {
+			fuse_prepare_interrupt(f, req, &d);
+			err = fuse_fs_readlink(f->fs, path, linkname,
+					       PATH_MAX + 1);
+			fuse_finish_interrupt(f, req, &d);
+		} else
+			err = -ENOMEM;
 		free_path(f, ino, path);
 	}
 	if (!err) {
@@ -2939,6 +3374,8 @@ static void fuse_lib_readlink(fuse_req_t req, fuse_ino_t ino)
 		fuse_reply_readlink(req, linkname);
 	} else
 		reply_err(req, err);
+	if (linkname)
+		fuse_buf_pool_free(linkname, PATH_MAX + 1);
 }
 
 static void fuse_lib_mknod(fuse_req_t req, fuse_ino_t parent, const char *name,
@@ -2962,6 +3399,7 @@ static void fuse_lib_mknod(fuse_req_t req, fuse_ino_t parent, const char *name,
 			fi.flags = O_CREAT | O_EXCL | O_WRONLY;
 			err = fuse_fs_create(f->fs, path, mode, &fi);
 			if (!err) {
+				dir_changed(f, parent);
 				err = lookup_path(f, parent, name, path, &e,
 						  &fi);
 				fuse_fs_release(f->fs, path, &fi);
@@ -2969,9 +3407,11 @@ static void fuse_lib_mknod(fuse_req_t req, fuse_ino_t parent, const char *name,
 		}
 		if (err == -ENOSYS) {
 			err = fuse_fs_mknod(f->fs, path, mode, rdev);
-			if (!err)
+			if (!err) {
+				dir_changed(f, parent);
 				err = lookup_path(f, parent, name, path, &e,
 						  NULL);
+			}
 		}
 		fuse_finish_interrupt(f, req, &d);
 		free_path(f, parent, path);
@@ -2993,8 +3433,10 @@ static void fuse_lib_mkdir(fuse_req_t req, fuse_ino_t parent, const char *name,
 
 		fuse_prepare_interrupt(f, req, &d);
 		err = fuse_fs_mkdir(f->fs, path, mode);
-		if (!err)
+		if (!err) {
+			dir_changed(f, parent);
 			err = lookup_path(f, parent, name, path, &e, NULL);
+		}
 		fuse_finish_interrupt(f, req, &d);
 		free_path(f, parent, path);
 	}
@@ -3021,6 +3463,8 @@ static void fuse_lib_unlink(fuse_req_t req, fuse_ino_t parent,
 			if (!err)
 				remove_node(f, parent, name);
 		}
+		if (!err)
+			dir_changed(f, parent);
 		fuse_finish_interrupt(f, req, &d);
 		free_path_wrlock(f, parent, wnode, path);
 	}
@@ -3041,8 +3485,10 @@ static void fuse_lib_rmdir(fuse_req_t req, fuse_ino_t parent, const char *name)
 		fuse_prepare_interrupt(f, req, &d);
 		err = fuse_fs_rmdir(f->fs, path);
 		fuse_finish_interrupt(f, req, &d);
-		if (!err)
+		if (!err) {
 			remove_node(f, parent, name);
+			dir_changed(f, parent);
+		}
 		free_path_wrlock(f, parent, wnode, path);
 	}
 	reply_err(req, err);
@@ -3062,8 +3508,10 @@ static void fuse_lib_symlink(fuse_req_t req, const char *linkname,
 
 		fuse_prepare_interrupt(f, req, &d);
 		err = fuse_fs_symlink(f->fs, linkname, path);
-		if (!err)
+		if (!err) {
+			dir_changed(f, parent);
 			err = lookup_path(f, parent, name, path, &e, NULL);
+		}
 		fuse_finish_interrupt(f, req, &d);
 		free_path(f, parent, path);
 	}
@@ -3093,6 +3541,8 @@ static void fuse_lib_rename(fuse_req_t req, fuse_ino_t olddir,
 		if (!err) {
 			err = fuse_fs_rename(f->fs, oldpath, newpath, flags);
 			if (!err) {
+				dir_changed(f, olddir);
+				dir_changed(f, newdir);
 				if (flags & RENAME_EXCHANGE) {
 					err = exchange_node(f, olddir, oldname,
 							    newdir, newname);
@@ -3124,9 +3574,11 @@ static void fuse_lib_link(fuse_req_t req, fuse_ino_t ino, fuse_ino_t newparent,
 
 		fuse_prepare_interrupt(f, req, &d);
 		err = fuse_fs_link(f->fs, oldpath, newpath);
-		if (!err)
+		if (!err) {
+			dir_changed(f, newparent);
 			err = lookup_path(f, newparent, newname, newpath,
 					  &e, NULL);
+		}
 		fuse_finish_interrupt(f, req, &d);
 		free_path2(f, ino, newparent, NULL, NULL, oldpath, newpath);
 	}
@@ -3180,6 +3632,7 @@ static void fuse_lib_create(fuse_req_t req, fuse_ino_t parent,
 		fuse_prepare_interrupt(f, req, &d);
 		err = fuse_fs_create(f->fs, path, mode, fi);
 		if (!err) {
+			dir_changed(f, parent);
 			err = lookup_path(f, parent, name, path, &e, fi);
 			if (err)
 				fuse_fs_release(f->fs, path, fi);
@@ -3221,35 +3674,49 @@ static double diff_timespec(const struct timespec *t1,
 		((double) t1->tv_nsec - (double) t2->tv_nsec) / 1000000000.0;
 }
 
-static void open_auto_cache(struct fuse *f, fuse_ino_t ino, const char *path,
-			    struct fuse_file_info *fi)
+/* Returns whether data the kernel cached for the node is still valid */
+static int auto_cache_valid(struct fuse *f, fuse_ino_t ino, const char *path,
+			    struct fuse_file_info *fi, int dir)
 {
 	struct node *node;
+	struct timespec now;
+	int stale = 0;
+	int valid;
 
 	pthread_mutex_lock(&f->lock);
 	node = get_node(f, ino);
-	if (node->cache_valid) {
-		struct timespec now;
-
-		curr_time(&now);
-		if (diff_timespec(&now, &node->stat_updated) >
-		    f->conf.ac_attr_timeout) {
-			struct stat stbuf;
-			int err;
-			pthread_mutex_unlock(&f->lock);
-			err = fuse_fs_getattr(f->fs, path, &stbuf, fi);
-			pthread_mutex_lock(&f->lock);
-			if (!err)
-				update_stat(node, &stbuf);
-			else
-				node->cache_valid = 0;
-		}
+	curr_time(&now);
+	/* For directories this is also done when the listing is known to
+	   be invalid, e.g. after an entry was created through the mount,
+	   so that the next opendir has a recent modification time to
+	   compare with.  The root directory is never looked up, so it
+	   would not have one otherwise */
+	if ((node->cache_valid || dir) &&
+	    diff_timespec(&now, &node->stat_updated) >
+	    f->conf.ac_attr_timeout) {
+		struct stat stbuf;
+		int err;
+		pthread_mutex_unlock(&f->lock);
+		err = fuse_fs_getattr(f->fs, path, &stbuf, fi);
+		pthread_mutex_lock(&f->lock);
+		if (!err)
+			stale = update_stat(f, node, &stbuf);
+		else
+			node->cache_valid = 0;
 	}
-	if (node->cache_valid)
-		fi->keep_cache = 1;
-
+	valid = node->cache_valid;
 	node->cache_valid = 1;
 	pthread_mutex_unlock(&f->lock);
+	symlink_changed(f, ino, stale);
+
+	return valid;
+}
+
+static void open_auto_cache(struct fuse *f, fuse_ino_t ino, const char *path,
+			    struct fuse_file_info *fi)
+{
+	if (auto_cache_valid(f, ino, path, fi, 0))
+		fi->keep_cache = 1;
 }
 
 static void fuse_lib_open(fuse_req_t req, fuse_ino_t ino,
@@ -3295,6 +3762,8 @@ static void fuse_lib_read(fuse_req_t req, fuse_ino_t ino, size_t size,
 {
 	struct fuse *f = req_fuse_prepare(req);
 	struct fuse_bufvec *buf = NULL;
+	struct fuse_bufvec bounce;
+	void *mem = NULL;
 	char *path;
 	int res;
 
@@ -3303,7 +3772,26 @@ static void fuse_lib_read(fuse_req_t req, fuse_ino_t ino, size_t size,
 		struct fuse_intr_data d;
 
 		fuse_prepare_interrupt(f, req, &d);
-		res = fuse_fs_read_buf(f->fs, path, &buf, size, off, fi);
+		if (!f->fs->op.read_buf && f->fs->op.read) {
+			/*
+			 * Nobody but us sees the buffer, so it can come
+			 * from the pool instead of fuse_fs_read_buf()
+			 */
+			res = -ENOMEM;
+			mem = fuse_buf_pool_alloc(size);
+			if (mem)
+				res = fuse_fs_read(f->fs, path, mem, size, off,
+						   fi);
+			if (res >= 0) {
+				bounce = FUSE_BUFVEC_INIT(res);
+				bounce.buf[0].mem = mem;
+				buf = &bounce;
+				res = 0;
+			}
+		} else {
+			res = fuse_fs_read_buf(f->fs, path, &buf, size, off,
+					       fi);
+		}
 		fuse_finish_interrupt(f, req, &d);
 		free_path(f, ino, path);
 	}
@@ -3313,7 +3801,10 @@ static void fuse_lib_read(fuse_req_t req, fuse_ino_t ino, size_t size,
 	else
 		reply_err(req, res);
 
-	fuse_free_buf(buf);
+	if (mem)
+		fuse_buf_pool_free(mem, size);
+	else
+		fuse_free_buf(buf);
 }
 
 static void fuse_lib_write_buf(fuse_req_t req, fuse_ino_t ino,
@@ -3386,7 +3877,7 @@ static void fuse_lib_opendir(fuse_req_t req, fuse_ino_t ino,
 	memset(dh, 0, sizeof(struct fuse_dh));
 	dh->fuse = f;
 	dh->contents = NULL;
-	dh->first = NULL;
+	dh->ents = NULL;
 	dh->len = 0;
 	dh->filled = 0;
 	dh->nodeid = ino;
@@ -3401,10 +3892,24 @@ static void fuse_lib_opendir(fuse_req_t req, fuse_ino_t ino,
 	if (!err) {
 		fuse_prepare_interrupt(f, req, &d);
 		err = fuse_fs_opendir(f->fs, path, &fi);
+		if (!err) {
+			if (f->conf.cache_readdir) {
+				fi.cache_readdir = 1;
+				fi.keep_cache = 1;
+			}
+			if (f->conf.auto_cache_readdir) {
+				fi.cache_readdir = 1;
+				/* The directory handle is not for getattr */
+				if (auto_cache_valid(f, ino, path, NULL, 1))
+					fi.keep_cache = 1;
+			}
+		}
 		fuse_finish_interrupt(f, req, &d);
 		dh->fh = fi.fh;
 	}
 	if (!err) {
+		llfi->cache_readdir = fi.cache_readdir;
+		llfi->keep_cache = fi.keep_cache;
 		if (fuse_reply_open(req, llfi) == -ENOENT) {
 			/* The opendir syscall was interrupted, so it
 			   must be cancelled */
@@ -3448,24 +3953,45 @@ static int extend_contents(struct fuse_dh *dh, unsigned minsize)
 static int fuse_add_direntry_to_dh(struct fuse_dh *dh, const char *name,
 				   struct stat *st)
 {
-	struct fuse_direntry *de;
+	struct fuse_dh_entry *de;
+	size_t namelen = strlen(name);
+	size_t reclen = DH_ENTRY_SIZE(namelen);
+	size_t max = dh->fuse->conf.max_readdir_buffer;
 
-	de = malloc(sizeof(struct fuse_direntry));
-	if (!de) {
-		dh->error = -ENOMEM;
+	if (dh->more)
 		return -1;
-	}
-	de->name = strdup(name);
-	if (!de->name) {
-		dh->error = -ENOMEM;
-		free(de);
+
+	/* Always take at least one entry, so that every pass advances */
+	if (max && dh->count && dh->ents_len + reclen > max) {
+		dh->more = 1;
 		return -1;
 	}
-	de->stat = *st;
-	de->next = NULL;
 
-	*dh->last = de;
-	dh->last = &de->next;
+	if (dh->ents_len + reclen > dh->ents_size) {
+		size_t newsize = dh->ents_size ? dh->ents_size * 2 : 4096;
+		char *newptr;
+
+		while (newsize < dh->ents_len + reclen)
+			newsize *= 2;
+		if (max && newsize > max && dh->ents_len + reclen <= max)
+			newsize = max;
+
+		newptr = realloc(dh->ents, newsize);
+		if (!newptr) {
+			dh->error = -ENOMEM;
+			return -1;
+		}
+		dh->ents = newptr;
+		dh->ents_size = newsize;
+	}
+
+	de = (struct fuse_dh_entry *) (dh->ents + dh->ents_len);
+	de->ino = st->st_ino;
+	de->mode = st->st_mode;
+	de->namelen = namelen;
+	memcpy(de->name, name, namelen + 1);
+	dh->ents_len += reclen;
+	dh->count++;
 
 	return 0;
 }
@@ -3496,6 +4022,13 @@ static int fill_dir(void *dh_, const char *name, const struct stat *statp,
 		return 1;
 	}
 
+	if (!off && dh->skip) {
+		/* Before the window that is being filled */
+		dh->filled = 1;
+		dh->skip--;
+		return 0;
+	}
+
 	if (statp)
 		stbuf = *statp;
 	else {
@@ -3519,7 +4052,7 @@ static int fill_dir(void *dh_, const char *name, const struct stat *statp,
 			return 1;
 		}
 
-		if (dh->first) {
+		if (dh->count) {
 			dh->error = -EIO;
 			return 1;
 		}
@@ -3550,6 +4083,39 @@ static int is_dot_or_dotdot(const char *name)
 				  (name[1] == '.' && name[2] == '\0'));
 }
 
+static void add_pending(struct fuse_dh *dh, unsigned pos, const char *name,
+			off_t off)
+{
+	struct readdir_pending *p;
+
+	if (dh->npending == dh->pending_size) {
+		size_t newsize = dh->pending_size ? dh->pending_size * 2 : 64;
+
+		p = realloc(dh->pending, newsize * sizeof(*p));
+		if (!p)
+			return;
+		dh->pending = p;
+		dh->pending_size = newsize;
+	}
+	p = &dh->pending[dh->npending];
+	p->name = strdup(name);
+	if (!p->name)
+		return;
+	p->pos = pos;
+	p->off = off;
+	p->res = -EIO;
+	dh->npending++;
+}
+
+static void clear_pending(struct fuse_dh *dh)
+{
+	size_t i;
+
+	for (i = 0; i < dh->npending; i++)
+		free(dh->pending[i].name);
+	dh->npending = 0;
+}
+
 static int fill_dir_plus(void *dh_, const char *name, const struct stat *statp,
 			 off_t off, enum fuse_fill_dir_flags flags)
 {
@@ -3566,6 +4132,12 @@ static int fill_dir_plus(void *dh_, const char *name, const struct stat *statp,
 		return 1;
 	}
 
+	if (!off && dh->skip) {
+		dh->filled = 1;
+		dh->skip--;
+		return 0;
+	}
+
 	if (off && statp && (flags & FUSE_FILL_DIR_PLUS)) {
 		e.attr = *statp;
 
@@ -3592,7 +4164,7 @@ static int fill_dir_plus(void *dh_, const char *name, const struct stat *statp,
 			return 1;
 		}
 
-		if (dh->first) {
+		if (dh->count) {
 			dh->error = -EIO;
 			return 1;
 		}
@@ -3605,6 +4177,9 @@ static int fill_dir_plus(void *dh_, const char *name, const struct stat *statp,
 					       &e, off);
 		if (newlen > dh->needlen)
 			return 1;
+		if (e.ino == 0 && f->conf.readdirplus_prefetch &&
+		    !is_dot_or_dotdot(name))
+			add_pending(dh, dh->len, name, off);
 		dh->len = newlen;
 	} else {
 		dh->filled = 1;
@@ -3616,13 +4191,149 @@ static int fill_dir_plus(void *dh_, const char *name, const struct stat *statp,
 	return 0;
 }
 
-static void free_direntries(struct fuse_direntry *de)
+static void prefetch_one(struct fuse *f, struct lookup_batch *b,
+			 struct readdir_pending *p)
+{
+	char *path;
+	int res;
+
+	memset(&p->e, 0, sizeof(p->e));
+	res = get_path_name(f, b->parent, p->name, &path);
+	if (!res) {
+		res = getattr_path(f, path, &p->e.attr, NULL);
+		if (!res)
+			res = do_lookup(f, b->parent, p->name, &p->e);
+		free_path(f, b->parent, path);
+	}
+	p->res = res;
+}
+
+/* Looks up the next entry of the batch; called with the pool lock held */
+static void lookup_batch_step(struct fuse *f, struct lookup_batch *b)
 {
-	while (de) {
-		struct fuse_direntry *next = de->next;
-		free(de->name);
-		free(de);
-		de = next;
+	struct lookup_pool *lp = &f->lookup_pool;
+	struct fuse_context_i *c = &fuse_context_tls;
+	struct fuse_context_i saved = *c;
+	size_t i = b->next++;
+
+	if (b->next == b->count) {
+		struct lookup_batch **bp;
+
+		for (bp = &lp->head; *bp != b; bp = &(*bp)->next_batch);
+		*bp = b->next_batch;
+	}
+	pthread_mutex_unlock(&lp->lock);
+
+	/* Run the filesystem methods on behalf of the requester */
+	c->ctx = b->ctx;
+	c->req = b->req;
+	c->intr = NULL;
+	prefetch_one(f, b, &b->items[i]);
+	*c = saved;
+
+	pthread_mutex_lock(&lp->lock);
+	if (++b->done == b->count)
+		pthread_cond_signal(&b->cond);
+}
+
+static void *lookup_worker(void *data)
+{
+	struct fuse *f = (struct fuse *) data;
+	struct lookup_pool *lp = &f->lookup_pool;
+
+	pthread_mutex_lock(&lp->lock);
+	while (!lp->exiting) {
+		if (lp->head)
+			lookup_batch_step(f, lp->head);
+		else
+			pthread_cond_wait(&lp->work, &lp->lock);
+	}
+	pthread_mutex_unlock(&lp->lock);
+	return NULL;
+}
+
+/* Called with the pool lock held */
+static void lookup_pool_start(struct fuse *f)
+{
+	struct lookup_pool *lp = &f->lookup_pool;
+	unsigned nthreads = f->conf.readdirplus_prefetch - 1;
+
+	/* Threads can't be started by fuse_new(), which may be followed
+	   by fuse_daemonize() */
+	if (lp->started)
+		return;
+	lp->started = 1;
+	if (nthreads > FUSE_MAX_LOOKUP_THREADS)
+		nthreads = FUSE_MAX_LOOKUP_THREADS;
+	while (lp->nthreads < nthreads) {
+		if (fuse_start_thread(&lp->threads[lp->nthreads],
+				      lookup_worker, f) == -1)
+			break;
+		lp->nthreads++;
+	}
+}
+
+static void lookup_pool_stop(struct fuse *f)
+{
+	struct lookup_pool *lp = &f->lookup_pool;
+	unsigned i;
+
+	pthread_mutex_lock(&lp->lock);
+	lp->exiting = 1;
+	pthread_cond_broadcast(&lp->work);
+	pthread_mutex_unlock(&lp->lock);
+	for (i = 0; i < lp->nthreads; i++)
+		pthread_join(lp->threads[i], NULL);
+	pthread_cond_destroy(&lp->work);
+	pthread_mutex_destroy(&lp->lock);
+}
+
+/*
+ * Looks up the entries of a readdirplus reply for which the filesystem
+ * supplied no attributes, using up to readdirplus_prefetch threads
+ * including the caller, and fills in their attributes.
+ */
+static void readdir_prefetch(struct fuse *f, fuse_req_t req,
+			     struct fuse_dh *dh)
+{
+	struct lookup_pool *lp = &f->lookup_pool;
+	struct lookup_batch b;
+	struct lookup_batch **bp;
+	size_t i;
+
+	if (!dh->npending)
+		return;
+
+	memset(&b, 0, sizeof(b));
+	b.ctx = fuse_context_tls.ctx;
+	b.req = req;
+	b.parent = dh->nodeid;
+	b.items = dh->pending;
+	b.count = dh->npending;
+	pthread_cond_init(&b.cond, NULL);
+
+	pthread_mutex_lock(&lp->lock);
+	lookup_pool_start(f);
+	for (bp = &lp->head; *bp; bp = &(*bp)->next_batch);
+	*bp = &b;
+	if (b.count > 1)
+		pthread_cond_broadcast(&lp->work);
+	while (b.next < b.count)
+		lookup_batch_step(f, &b);
+	while (b.done < b.count)
+		pthread_cond_wait(&b.cond, &lp->lock);
+	f->prefetched += b.count;
+	pthread_mutex_unlock(&lp->lock);
+	pthread_cond_destroy(&b.cond);
+
+	for (i = 0; i < dh->npending; i++) {
+		struct readdir_pending *p = &dh->pending[i];
+
+		/* The entry keeps its size, so it is rewritten in place */
+		if (!p->res)
+			fuse_add_direntry_plus(req, dh->contents + p->pos,
+					       dh->needlen - p->pos, p->name,
+					       &p->e, p->off);
 	}
 }
 
@@ -3645,9 +4356,14 @@ static int readdir_fill(struct fuse *f, fuse_req_t req, fuse_ino_t ino,
 		if (flags & FUSE_READDIR_PLUS)
 			filler = fill_dir_plus;
 
-		free_direntries(dh->first);
-		dh->first = NULL;
-		dh->last = &dh->first;
+		dh->ents_len = 0;
+		dh->start = off;
+		dh->count = 0;
+		dh->skip = off;
+		dh->more = 0;
+		dh->cursor = off;
+		dh->cursor_off = 0;
+		clear_pending(dh);
 		dh->len = 0;
 		dh->error = 0;
 		dh->needlen = size;
@@ -3661,52 +4377,78 @@ static int readdir_fill(struct fuse *f, fuse_req_t req, fuse_ino_t ino,
 			err = dh->error;
 		if (err)
 			dh->filled = 0;
+		if (!dh->filled && dh->ents_size > dh->ents_len + 65536) {
+			/* Don't hold on to the buffer of an earlier listing */
+			free(dh->ents);
+			dh->ents = NULL;
+			dh->ents_size = 0;
+		}
 		free_path(f, ino, path);
 	}
 	return err;
 }
 
-static int readdir_fill_from_list(fuse_req_t req, struct fuse_dh *dh,
-				  off_t off, enum fuse_readdir_flags flags)
+static int readdir_fill_from_list(struct fuse_dh *dh, off_t off,
+				  enum fuse_readdir_flags flags)
 {
-	off_t pos;
-	struct fuse_direntry *de = dh->first;
+	struct fuse_dirbuf db;
+	off_t pos = dh->start;
+	size_t ent = 0;
 
+	clear_pending(dh);
 	dh->len = 0;
 
 	if (extend_contents(dh, dh->needlen) == -1)
 		return dh->error;
 
-	for (pos = 0; pos < off; pos++) {
-		if (!de)
-			break;
-
-		de = de->next;
-	}
-	while (de) {
-		char *p = dh->contents + dh->len;
-		unsigned rem = dh->needlen - dh->len;
-		unsigned thislen;
-		unsigned newlen;
-		pos++;
-
-		if (flags & FUSE_READDIR_PLUS) {
-			struct fuse_entry_param e = {
-				.ino = 0,
-				.attr = de->stat,
-			};
-			thislen = fuse_add_direntry_plus(req, p, rem,
-							 de->name, &e, pos);
-		} else {
-			thislen = fuse_add_direntry(req, p, rem,
-						    de->name, &de->stat, pos);
+	if (off >= dh->cursor && dh->cursor >= dh->start) {
+		/* Sequential reads continue where the last reply ended */
+		pos = dh->cursor;
+		ent = dh->cursor_off;
+	}
+	for (; pos < off && ent < dh->ents_len; pos++) {
+		struct fuse_dh_entry *de =
+			(struct fuse_dh_entry *) (dh->ents + ent);
+		ent += DH_ENTRY_SIZE(de->namelen);
+	}
+	fuse_dirbuf_init(&db, dh->contents, dh->needlen,
+			 flags & FUSE_READDIR_PLUS);
+	while (ent < dh->ents_len) {
+		struct fuse_direntry batch[READDIR_BATCH];
+		size_t entpos = db.len;
+		size_t count, added, i;
+
+		for (count = 0, i = ent;
+		     count < READDIR_BATCH && i < dh->ents_len; count++) {
+			struct fuse_dh_entry *de =
+				(struct fuse_dh_entry *) (dh->ents + i);
+
+			batch[count].name = de->name;
+			batch[count].namelen = de->namelen;
+			batch[count].ino = de->ino;
+			batch[count].type = (de->mode & S_IFMT) >> 12;
+			batch[count].off = pos + count + 1;
+			batch[count].e = NULL;
+			i += DH_ENTRY_SIZE(de->namelen);
 		}
-		newlen = dh->len + thislen;
-		if (newlen > dh->needlen)
+		added = fuse_dirbuf_add(&db, batch, count);
+		for (i = 0; i < added; i++) {
+			if (db.plus && dh->fuse->conf.readdirplus_prefetch &&
+			    !is_dot_or_dotdot(batch[i].name))
+				add_pending(dh, entpos, batch[i].name,
+					    batch[i].off);
+			entpos += FUSE_DIRENT_ALIGN((db.plus ?
+				FUSE_NAME_OFFSET_DIRENTPLUS : FUSE_NAME_OFFSET) +
+				batch[i].namelen);
+			ent += DH_ENTRY_SIZE(batch[i].namelen);
+			pos++;
+		}
+		if (added < count)
 			break;
-		dh->len = newlen;
-		de = de->next;
 	}
+	dh->len = db.len;
+	dh->cursor = pos;
+	dh->cursor_off = ent;
 	return 0;
 }
 
@@ -3725,6 +4467,11 @@ static void fuse_readdir_common(fuse_req_t req, fuse_ino_t ino, size_t size,
 	if (!off)
 		dh->filled = 0;
 
+	/* Outside of the buffered window the directory is read again */
+	if (dh->filled && (off < dh->start ||
+			   (dh->more && off >= dh->start + dh->count)))
+		dh->filled = 0;
+
 	if (!dh->filled) {
 		err = readdir_fill(f, req, ino, size, off, dh, &fi, flags);
 		if (err) {
@@ -3734,13 +4481,23 @@ static void fuse_readdir_common(fuse_req_t req, fuse_ino_t ino, size_t size,
 	}
 	if (dh->filled) {
 		dh->needlen = size;
-		err = readdir_fill_from_list(req, dh, off, flags);
+		err = readdir_fill_from_list(dh, off, flags);
 		if (err) {
 			reply_err(req, err);
 			goto out;
 		}
 	}
-	fuse_reply_buf(req, dh->contents, dh->len);
+	readdir_prefetch(f, req, dh);
+	if (fuse_reply_buf(req, dh->contents, dh->len) == -ENOENT) {
+		size_t i;
+
+		/* The kernel won't take the references of the entries */
+		for (i = 0; i < dh->npending; i++) {
+			if (!dh->pending[i].res)
+				forget_node(f, dh->pending[i].e.ino, 1);
+		}
+	}
+	clear_pending(dh);
 out:
 	pthread_mutex_unlock(&dh->lock);
 }
@@ -3776,7 +4533,8 @@ static void fuse_lib_releasedir(fuse_req_t req, fuse_ino_t ino,
 	pthread_mutex_lock(&dh->lock);
 	pthread_mutex_unlock(&dh->lock);
 	pthread_mutex_destroy(&dh->lock);
-	free_direntries(dh->first);
+	free(dh->ents);
+	free(dh->pending);
 	free(dh->contents);
 	free(dh);
 	reply_err(req, 0);
@@ -3828,6 +4586,106 @@ static void fuse_lib_statfs(fuse_req_t req, fuse_ino_t ino)
 		reply_err(req, err);
 }
 
+/*
+ * Look up a cached getxattr result.  Returns 1 and sets *res on a hit.
+ * On a miss the generation of the node's cache is returned in *gen,
+ * for xattr_cache_store().
+ */
+static int xattr_cache_lookup(struct fuse *f, fuse_ino_t ino, const char *name,
+			      char *value, size_t size, int *res,
+			      unsigned int *gen)
+{
+	struct xattr_entry **xep, *xe;
+	struct node *node;
+	struct timespec now;
+	int hit = 0;
+
+	curr_time(&now);
+	pthread_mutex_lock(&f->lock);
+	node = get_node(f, ino);
+	*gen = node->xattr_gen;
+	for (xep = &node->xattrs; (xe = *xep) != NULL; xep = &xe->next) {
+		if (strcmp(xe->name, name) != 0)
+			continue;
+
+		if (diff_timespec(&now, &xe->cached) >= f->conf.xattr_timeout) {
+			*xep = xe->next;
+			free(xe);
+			break;
+		}
+		if (xe->res < 0 || size == 0) {
+			*res = xe->res;
+		} else if (size < (size_t) xe->res) {
+			*res = -ERANGE;
+		} else {
+			memcpy(value, xe->value, xe->res);
+			*res = xe->res;
+		}
+		hit = 1;
+		break;
+	}
+	if (hit)
+		f->xattr_hits++;
+	else
+		f->xattr_misses++;
+	pthread_mutex_unlock(&f->lock);
+
+	return hit;
+}
+
+static void xattr_cache_store(struct fuse *f, fuse_ino_t ino, const char *name,
+			      const char *value, size_t size, int res,
+			      unsigned int gen)
+{
+	struct xattr_entry **xep, *xe;
+	struct node *node;
+	size_t namelen = strlen(name) + 1;
+	size_t valuelen = 0;
+	int n;
+
+	/* Sizes alone are not cached, the value will be asked for next */
+	if (res >= 0) {
+		if (size == 0 || res > XATTR_CACHE_MAX_VALUE)
+			return;
+		valuelen = res;
+	} else if (res != -ENOATTR && res != -EOPNOTSUPP) {
+		return;
+	}
+
+	xe = malloc(sizeof(struct xattr_entry) + namelen + valuelen);
+	if (xe == NULL)
+		return;
+	curr_time(&xe->cached);
+	xe->res = res;
+	memcpy(xe->name, name, namelen);
+	xe->value = xe->name + namelen;
+	if (valuelen)
+		memcpy(xe->value, value, valuelen);
+
+	pthread_mutex_lock(&f->lock);
+	node = get_node_nocheck(f, ino);
+	if (node == NULL || node->xattr_gen != gen) {
+		/* Changed while the filesystem was asked */
+		pthread_mutex_unlock(&f->lock);
+		free(xe);
+		return;
+	}
+	xe->next = node->xattrs;
+	node->xattrs = xe;
+	for (n = 1, xep = &xe->next; *xep != NULL; ) {
+		struct xattr_entry *old = *xep;
+
+		if (n == XATTR_CACHE_MAX_ENTRIES || strcmp(old->name, name) == 0) {
+			*xep = old->next;
+			free(old);
+		} else {
+			xep = &old->next;
+			n++;
+		}
+	}
+	pthread_mutex_unlock(&f->lock);
+}
+
 static void fuse_lib_setxattr(fuse_req_t req, fuse_ino_t ino, const char *name,
 			      const char *value, size_t size, int flags)
 {
@@ -3841,6 +4699,7 @@ static void fuse_lib_setxattr(fuse_req_t req, fuse_ino_t ino, const char *name,
 		fuse_prepare_interrupt(f, req, &d);
 		err = fuse_fs_setxattr(f->fs, path, name, value, size, flags);
 		fuse_finish_interrupt(f, req, &d);
+		xattr_cache_invalidate(f, ino);
 		free_path(f, ino, path);
 	}
 	reply_err(req, err);
@@ -3851,13 +4710,23 @@ static int common_getxattr(struct fuse *f, fuse_req_t req, fuse_ino_t ino,
 {
 	int err;
 	char *path;
+	unsigned int gen = 0;
 
 	err = get_path(f, ino, &path);
 	if (!err) {
 		struct fuse_intr_data d;
+		int cache = f->conf.xattr_timeout > 0;
+
+		if (cache && xattr_cache_lookup(f, ino, name, value, size,
+						&err, &gen)) {
+			free_path(f, ino, path);
+			return err;
+		}
 		fuse_prepare_interrupt(f, req, &d);
 		err = fuse_fs_getxattr(f->fs, path, name, value, size);
 		fuse_finish_interrupt(f, req, &d);
+		if (cache)
+			xattr_cache_store(f, ino, name, value, size, err, gen);
 		free_path(f, ino, path);
 	}
 	return err;
@@ -3946,42 +4815,166 @@ static void fuse_lib_removexattr(fuse_req_t req, fuse_ino_t ino,
 		fuse_prepare_interrupt(f, req, &d);
 		err = fuse_fs_removexattr(f->fs, path, name);
 		fuse_finish_interrupt(f, req, &d);
+		xattr_cache_invalidate(f, ino);
 		free_path(f, ino, path);
 	}
 	reply_err(req, err);
 }
 
-static struct lock *locks_conflict(struct node *node, const struct lock *lock)
+/*
+ * POSIX locks held through this filesystem are kept per node in an
+ * interval tree: a treap ordered by (start, address), where each lock
+ * also records the largest end offset found in its subtree.  That lets
+ * both the conflict check and the collection of an owner's neighbouring
+ * locks skip every subtree that cannot overlap the range in question,
+ * instead of walking all locks held on the file.
+ */
+static unsigned int lock_prio(const struct lock *l)
 {
-	struct lock *l;
+	uint64_t x = (uintptr_t) l;
+
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	return (unsigned int) x;
+}
+
+static int lock_before(const struct lock *a, const struct lock *b)
+{
+	if (a->start != b->start)
+		return a->start < b->start;
+	return (uintptr_t) a < (uintptr_t) b;
+}
 
-	for (l = node->locks; l; l = l->next)
-		if (l->owner != lock->owner &&
-		    lock->start <= l->end && l->start <= lock->end &&
-		    (l->type == F_WRLCK || lock->type == F_WRLCK))
+static void lock_update(struct lock *l)
+{
+	l->max_end = l->end;
+	if (l->left && l->left->max_end > l->max_end)
+		l->max_end = l->left->max_end;
+	if (l->right && l->right->max_end > l->max_end)
+		l->max_end = l->right->max_end;
+}
+
+/* All locks in @a must sort before all locks in @b */
+static struct lock *lock_tree_join(struct lock *a, struct lock *b)
+{
+	if (!a)
+		return b;
+	if (!b)
+		return a;
+
+	if (a->prio > b->prio) {
+		a->right = lock_tree_join(a->right, b);
+		lock_update(a);
+		return a;
+	} else {
+		b->left = lock_tree_join(a, b->left);
+		lock_update(b);
+		return b;
+	}
+}
+
+static void lock_tree_split(struct lock *t, const struct lock *key,
+			    struct lock **lo, struct lock **hi)
+{
+	if (!t) {
+		*lo = *hi = NULL;
+		return;
+	}
+	if (lock_before(t, key)) {
+		lock_tree_split(t->right, key, &t->right, hi);
+		*lo = t;
+	} else {
+		lock_tree_split(t->left, key, lo, &t->left);
+		*hi = t;
+	}
+	lock_update(t);
+}
+
+static void lock_tree_insert(struct lock **root, struct lock *lock)
+{
+	struct lock *lo;
+	struct lock *hi;
+
+	lock->left = lock->right = NULL;
+	lock->prio = lock_prio(lock);
+	lock_update(lock);
+	lock_tree_split(*root, lock, &lo, &hi);
+	*root = lock_tree_join(lock_tree_join(lo, lock), hi);
+}
+
+static struct lock *lock_tree_remove(struct lock *t, struct lock *lock)
+{
+	if (t == lock)
+		return lock_tree_join(t->left, t->right);
+
+	if (lock_before(lock, t))
+		t->left = lock_tree_remove(t->left, lock);
+	else
+		t->right = lock_tree_remove(t->right, lock);
+	lock_update(t);
+	return t;
+}
+
+/*
+ * Append the locks of @owner overlapping [start, end] to the list at
+ * @tail (linked through ->next, in ascending order of start) and return
+ * the new tail.
+ */
+static struct lock **lock_tree_collect(struct lock *t, off_t start, off_t end,
+				       uint64_t owner, struct lock **tail)
+{
+	while (t && t->max_end >= start) {
+		tail = lock_tree_collect(t->left, start, end, owner, tail);
+		if (t->start > end)
 			break;
+		if (t->owner == owner && t->end >= start) {
+			*tail = t;
+			tail = &t->next;
+		}
+		t = t->right;
+	}
+	return tail;
+}
 
-	return l;
+static struct lock *lock_tree_conflict(struct lock *t,
+				       const struct lock *lock)
+{
+	while (t && t->max_end >= lock->start) {
+		struct lock *l = lock_tree_conflict(t->left, lock);
+
+		if (l)
+			return l;
+		if (t->start > lock->end)
+			break;
+		if (t->owner != lock->owner && lock->start <= t->end &&
+		    (t->type == F_WRLCK || lock->type == F_WRLCK))
+			return t;
+		t = t->right;
+	}
+	return NULL;
 }
 
-static void delete_lock(struct lock **lockp)
+static struct lock *locks_conflict(struct node *node, const struct lock *lock)
 {
-	struct lock *l = *lockp;
-	*lockp = l->next;
-	free(l);
+	return lock_tree_conflict(node->locks, lock);
 }
 
-static void insert_lock(struct lock **pos, struct lock *lock)
+static void delete_lock(struct node *node, struct lock *l)
 {
-	lock->next = *pos;
-	*pos = lock;
+	node->locks = lock_tree_remove(node->locks, l);
+	free(l);
 }
 
 static int locks_insert(struct node *node, struct lock *lock)
 {
-	struct lock **lp;
+	struct lock *head = NULL;
+	struct lock *l;
+	struct lock *next;
 	struct lock *newl1 = NULL;
 	struct lock *newl2 = NULL;
+	off_t start;
+	off_t end;
 
 	if (lock->type != F_UNLCK || lock->start != 0 ||
 	    lock->end != OFFSET_MAX) {
@@ -3995,54 +4988,52 @@ static int locks_insert(struct node *node, struct lock *lock)
 		}
 	}
 
-	for (lp = &node->locks; *lp;) {
-		struct lock *l = *lp;
-		if (l->owner != lock->owner)
-			goto skip;
+	/* Locks of the same type are merged with adjacent ones as well */
+	start = lock->start ? lock->start - 1 : 0;
+	end = lock->end != OFFSET_MAX ? lock->end + 1 : OFFSET_MAX;
+	*lock_tree_collect(node->locks, start, end, lock->owner, &head) = NULL;
+
+	for (l = head; l; l = l->next) {
+		if (l->type == lock->type &&
+		    l->start <= lock->start && lock->end <= l->end)
+			goto out;
+	}
 
+	for (l = head; l; l = next) {
+		next = l->next;
 		if (lock->type == l->type) {
-			if (l->end < lock->start - 1)
-				goto skip;
-			if (lock->end < l->start - 1)
-				break;
-			if (l->start <= lock->start && lock->end <= l->end)
-				goto out;
 			if (l->start < lock->start)
 				lock->start = l->start;
 			if (lock->end < l->end)
 				lock->end = l->end;
-			goto delete;
+			delete_lock(node, l);
+			continue;
+		}
+		if (l->end < lock->start || lock->end < l->start)
+			continue;
+		if (lock->start <= l->start && l->end <= lock->end) {
+			delete_lock(node, l);
+			continue;
+		}
+
+		/* Start or end of @l changes, so re-insert it */
+		node->locks = lock_tree_remove(node->locks, l);
+		if (l->end <= lock->end) {
+			l->end = lock->start - 1;
+		} else if (lock->start <= l->start) {
+			l->start = lock->end + 1;
 		} else {
-			if (l->end < lock->start)
-				goto skip;
-			if (lock->end < l->start)
-				break;
-			if (lock->start <= l->start && l->end <= lock->end)
-				goto delete;
-			if (l->end <= lock->end) {
-				l->end = lock->start - 1;
-				goto skip;
-			}
-			if (lock->start <= l->start) {
-				l->start = lock->end + 1;
-				break;
-			}
 			*newl2 = *l;
 			newl2->start = lock->end + 1;
 			l->end = lock->start - 1;
-			insert_lock(&l->next, newl2);
+			lock_tree_insert(&node->locks, newl2);
 			newl2 = NULL;
 		}
-	skip:
-		lp = &l->next;
-		continue;
-
-	delete:
-		delete_lock(lp);
+		lock_tree_insert(&node->locks, l);
 	}
 	if (lock->type != F_UNLCK) {
 		*newl1 = *lock;
-		insert_lock(lp, newl1);
+		lock_tree_insert(&node->locks, newl1);
 		newl1 = NULL;
 	}
 out:
@@ -4494,6 +5485,9 @@ static struct fuse_lowlevel_ops fuse_path_ops = {
 	.fallocate = fuse_lib_fallocate,
 	.copy_file_range = fuse_lib_copy_file_range,
 	.lseek = fuse_lib_lseek,
+#ifdef HAVE_STATX
+	.statx = fuse_lib_statx,
+#endif
 };
 
 int fuse_notify_poll(struct fuse_pollhandle *ph)
@@ -4622,12 +5616,72 @@ int fuse_interrupted(void)
 {
 	struct fuse_context_i *c = fuse_get_context_internal();
 
-	if (c)
+	if (c && c->intr)
+		return __atomic_load_n(&c->intr->cancel.cancelled,
+				       __ATOMIC_ACQUIRE);
+	else if (c)
 		return fuse_req_interrupted(c->req);
 	else
 		return 0;
 }
 
+struct fuse_cancel *fuse_get_cancel(void)
+{
+	struct fuse_context_i *c = fuse_get_context_internal();
+	struct fuse_cancel *cancel;
+
+	if (!c || !c->intr)
+		return NULL;
+
+	cancel = &c->intr->cancel;
+	if (!cancel->cooperative) {
+		pthread_mutex_lock(&cancel->f->lock);
+		cancel->cooperative = 1;
+		pthread_mutex_unlock(&cancel->f->lock);
+	}
+	return cancel;
+}
+
+int fuse_cancel_requested(struct fuse_cancel *cancel)
+{
+	return __atomic_load_n(&cancel->cancelled, __ATOMIC_ACQUIRE);
+}
+
+void fuse_cancel_set_callback(struct fuse_cancel *cancel,
+			      fuse_cancel_func_t func, void *data)
+{
+	pthread_mutex_lock(&cancel->f->lock);
+	cancel->func = func;
+	cancel->data = data;
+	if (func && cancel->cancelled)
+		func(data);
+	pthread_mutex_unlock(&cancel->f->lock);
+}
+
+int fuse_cancel_fd(struct fuse_cancel *cancel)
+{
+#ifdef HAVE_EVENTFD
+	int fd;
+
+	pthread_mutex_lock(&cancel->f->lock);
+	if (cancel->fd == -1) {
+		cancel->fd = eventfd(cancel->cancelled, EFD_CLOEXEC |
+				     EFD_NONBLOCK);
+		if (cancel->fd == -1) {
+			pthread_mutex_unlock(&cancel->f->lock);
+			return -errno;
+		}
+	}
+	fd = cancel->fd;
+	pthread_mutex_unlock(&cancel->f->lock);
+
+	return fd;
+#else
+	(void) cancel;
+	return -ENOSYS;
+#endif
+}
+
 int fuse_invalidate_path(struct fuse *f, const char *path) {
 	fuse_ino_t ino;
 	int err = lookup_path_in_cache(f, path, &ino);
@@ -4635,6 +5689,7 @@ int fuse_invalidate_path(struct fuse *f, const char *path) {
 		return err;
 	}
 
+	xattr_cache_invalidate(f, ino);
 	return fuse_lowlevel_notify_inval_inode(f->se, ino, 0, 0);
 }
 
@@ -4648,6 +5703,10 @@ static const struct fuse_opt fuse_lib_opts[] = {
 	FUSE_LIB_OPT("kernel_cache",	      kernel_cache, 1),
 	FUSE_LIB_OPT("auto_cache",	      auto_cache, 1),
 	FUSE_LIB_OPT("noauto_cache",	      auto_cache, 0),
+	FUSE_LIB_OPT("cache_readdir",	      cache_readdir, 1),
+	FUSE_LIB_OPT("auto_cache_readdir",    auto_cache_readdir, 1),
+	FUSE_LIB_OPT("noauto_cache_readdir",  auto_cache_readdir, 0),
+	FUSE_LIB_OPT("cache_symlinks",	      cache_symlinks, 1),
 	FUSE_LIB_OPT("umask=",		      set_mode, 1),
 	FUSE_LIB_OPT("umask=%o",	      umask, 0),
 	FUSE_LIB_OPT("uid=",		      set_uid, 1),
@@ -4662,6 +5721,12 @@ static const struct fuse_opt fuse_lib_opts[] = {
 	FUSE_LIB_OPT("noforget",              remember, -1),
 	FUSE_LIB_OPT("remember=%u",           remember, 0),
 	FUSE_LIB_OPT("modules=%s",	      modules, 0),
+	FUSE_LIB_OPT("coalesce_getattr",      coalesce_getattr, 1),
+	FUSE_LIB_OPT("xattr_timeout=%lf",     xattr_timeout, 0),
+	FUSE_LIB_OPT("intr",		      intr, 1),
+	FUSE_LIB_OPT("intr_signal=%d",	      intr_signal, 0),
+	FUSE_LIB_OPT("max_readdir_buffer=%u", max_readdir_buffer, 0),
+	FUSE_LIB_OPT("readdirplus_prefetch=%u", readdirplus_prefetch, 0),
 	FUSE_OPT_END
 };
 
@@ -4700,6 +5765,10 @@ void fuse_lib_help(struct fuse_args *args)
 	printf(
 "    -o kernel_cache        cache files in kernel\n"
 "    -o [no]auto_cache      enable caching based on modification times (off)\n"
+"    -o cache_readdir       cache directory listings in kernel\n"
+"    -o [no]auto_cache_readdir  cache directory listings until the directory\n"
+"                           is modified (off)\n"
+"    -o cache_symlinks      cache symlink targets in kernel\n"
 "    -o umask=M             set file permissions (octal)\n"
 "    -o uid=N               set file owner\n"
 "    -o gid=N               set file group\n"
@@ -4709,7 +5778,16 @@ void fuse_lib_help(struct fuse_args *args)
 "    -o ac_attr_timeout=T   auto cache timeout for attributes (attr_timeout)\n"
 "    -o noforget            never forget cached inodes\n"
 "    -o remember=T          remember cached inodes for T seconds (0s)\n"
-"    -o modules=M1[:M2...]  names of modules to push onto filesystem stack\n");
+"    -o coalesce_getattr    share results of concurrent getattr calls\n"
+"    -o xattr_timeout=T     cache timeout for extended attributes (0.0s)\n"
+"    -o intr                allow requests to be interrupted\n"
+"    -o intr_signal=NUM     signal to send on interrupt, 0 for none (%i)\n"
+"    -o max_readdir_buffer=N  max. bytes of directory entries buffered per\n"
+"                           open directory, 0 for unlimited (%i)\n"
+"    -o readdirplus_prefetch=N  look up attributes missing from readdir\n"
+"                           with N threads (0)\n"
+"    -o modules=M1[:M2...]  names of modules to push onto filesystem stack\n",
+	       FUSE_DEFAULT_INTR_SIGNAL, FUSE_DEFAULT_READDIR_BUFFER);
 
 
 	/* Print low-level help */
@@ -4717,6 +5795,10 @@ void fuse_lib_help(struct fuse_args *args)
 
 	/* Print help for builtin modules */
 	print_module_help("subdir", &fuse_module_subdir_factory);
+	print_module_help("cache", &fuse_module_cache_factory);
+	print_module_help("readahead", &fuse_module_readahead_factory);
+	print_module_help("coalesce", &fuse_module_coalesce_factory);
+	print_module_help("stats", &fuse_module_stats_factory);
 #ifdef HAVE_ICONV
 	print_module_help("iconv", &fuse_module_iconv_factory);
 #endif
@@ -4890,6 +5972,7 @@ struct fuse *fuse_new_31(struct fuse_args *args,
 	f->conf.attr_timeout = 1.0;
 	f->conf.negative_timeout = 0.0;
 	f->conf.intr_signal = FUSE_DEFAULT_INTR_SIGNAL;
+	f->conf.max_readdir_buffer = FUSE_DEFAULT_READDIR_BUFFER;
 
 	/* Parse options */
 	if (fuse_opt_parse(args, &f->conf, fuse_lib_opts,
@@ -4902,6 +5985,12 @@ struct fuse *fuse_new_31(struct fuse_args *args,
 	if (builtin_modules_registered == 0) {
 		/* If not, register them. */
 		fuse_register_module("subdir", fuse_module_subdir_factory, NULL);
+		fuse_register_module("cache", fuse_module_cache_factory, NULL);
+		fuse_register_module("readahead", fuse_module_readahead_factory,
+				     NULL);
+		fuse_register_module("coalesce", fuse_module_coalesce_factory,
+				     NULL);
+		fuse_register_module("stats", fuse_module_stats_factory, NULL);
 #ifdef HAVE_ICONV
 		fuse_register_module("iconv", fuse_module_iconv_factory, NULL);
 #endif
@@ -4909,12 +5998,11 @@ struct fuse *fuse_new_31(struct fuse_args *args,
 	}
 	pthread_mutex_unlock(&fuse_context_lock);
 
-	if (fuse_create_context_key() == -1)
-		goto out_free;
+	fuse_get_context_ref();
 
 	fs = fuse_fs_new(op, op_size, user_data);
 	if (!fs)
-		goto out_delete_context_key;
+		goto out_put_context_ref;
 
 	f->fs = fs;
 
@@ -4974,6 +6062,8 @@ struct fuse *fuse_new_31(struct fuse_args *args,
 		goto out_free_name_table;
 
 	fuse_mutex_init(&f->lock);
+	fuse_mutex_init(&f->lookup_pool.lock);
+	pthread_cond_init(&f->lookup_pool.work, NULL);
 
 	root = alloc_node(f);
 	if (root == NULL) {
@@ -4988,7 +6078,7 @@ struct fuse *fuse_new_31(struct fuse_args *args,
 	strcpy(root->inline_name, "/");
 	root->name = root->inline_name;
 
-	if (f->conf.intr &&
+	if (f->conf.intr && f->conf.intr_signal &&
 	    fuse_init_intr_signal(f->conf.intr_signal,
 				  &f->intr_installed) == -1)
 		goto out_free_root;
@@ -5013,8 +6103,8 @@ out_free_fs:
 		fuse_put_module(f->fs->m);
 	free(f->fs);
 	free(f->conf.modules);
-out_delete_context_key:
-	fuse_delete_context_key();
+out_put_context_ref:
+	fuse_put_context_ref();
 out_free:
 	free(f);
 out:
@@ -5057,6 +6147,8 @@ void fuse_destroy(struct fuse *f)
 	if (f->conf.intr && f->intr_installed)
 		fuse_restore_intr_signal(f->conf.intr_signal);
 
+	lookup_pool_stop(f);
+
 	if (f->fs) {
 		fuse_create_context(f);
 
@@ -5088,16 +6180,44 @@ void fuse_destroy(struct fuse *f)
 	assert(list_empty(&f->partial_slabs));
 	assert(list_empty(&f->full_slabs));
 
-	while (fuse_modules) {
-		fuse_put_module(fuse_modules);
+	if (f->conf.coalesce_getattr) {
+		unsigned long long total = f->flight_calls + f->flight_shared;
+
+		fuse_log(FUSE_LOG_INFO, "fuse: getattr: %llu requests, %llu calls, %llu coalesced (%.1f%%)\n",
+			 total, f->flight_calls, f->flight_shared,
+			 total ? 100.0 * f->flight_shared / total : 0.0);
+	}
+
+	if (f->conf.xattr_timeout > 0) {
+		fuse_log(FUSE_LOG_INFO, "fuse: xattr cache: %llu hits, %llu misses\n",
+			 f->xattr_hits, f->xattr_misses);
+	}
+
+	if (f->conf.readdirplus_prefetch) {
+		fuse_log(FUSE_LOG_INFO, "fuse: readdirplus: %llu entries prefetched\n",
+			 f->prefetched);
+	}
+
+	if (f->conf.debug) {
+		struct fuse_buf_pool_stats ps;
+
+		fuse_buf_pool_get_stats(&ps);
+		fuse_log(FUSE_LOG_DEBUG, "fuse: buffer pool: %llu hits, %llu misses, %llu oversized, %llu released, %llu hugepage backed, %zu bytes cached\n",
+			 ps.hits, ps.misses, ps.oversize, ps.released, ps.huge,
+			 ps.cached);
 	}
+
 	free(f->id_table.array);
 	free(f->name_table.array);
 	pthread_mutex_destroy(&f->lock);
+	/* Calls the destroy handlers, which still reference the modules */
 	fuse_session_destroy(f->se);
+	while (fuse_modules) {
+		fuse_put_module(fuse_modules);
+	}
 	free(f->conf.modules);
 	free(f);
-	fuse_delete_context_key();
+	fuse_put_context_ref();
 }
 
 int fuse_mount(struct fuse *f, const char *mountpoint) {
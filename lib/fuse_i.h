@@ -20,6 +20,8 @@ struct fuse_req {
 	struct fuse_chan *ch;
 	int interrupted;
 	unsigned int ioctl_64bit : 1;
+	struct fuse_req_chunk *arena;
+	struct fuse_groups *groups;
 	union {
 		struct {
 			uint64_t unique;
@@ -41,6 +43,9 @@ struct fuse_notify_req {
 	struct fuse_notify_req *prev;
 };
 
+#define FUSE_GROUPS_HASH_SIZE 64
+#define FUSE_NOTIFY_HASH_SIZE 4096
+
 struct fuse_session {
 	char *mountpoint;
 	volatile int exited;
@@ -59,11 +64,31 @@ struct fuse_session {
 	pthread_mutex_t lock;
 	int got_destroy;
 	pthread_key_t pipe_key;
+	pthread_key_t arena_key;
 	int broken_splice_nonblock;
 	uint64_t notify_ctr;
 	struct fuse_notify_req notify_list;
 	size_t bufsize;
+	int hugepages;
 	int error;
+	double groups_timeout;
+	pthread_mutex_t groups_lock;
+	struct fuse_groups *groups_hash[FUSE_GROUPS_HASH_SIZE];
+	struct fuse_groups *groups_oldest;
+	struct fuse_groups *groups_newest;
+	unsigned int groups_count;
+	unsigned int notify_queue_max;
+	pthread_mutex_t notify_lock;
+	pthread_cond_t notify_work;
+	pthread_cond_t notify_space;
+	struct fuse_notify_item *notify_head;
+	struct fuse_notify_item **notify_tail;
+	struct fuse_notify_item *notify_hash[FUSE_NOTIFY_HASH_SIZE];
+	int notify_busy;
+	int notify_started;
+	int notify_exit;
+	pthread_t notify_thread;
+	struct fuse_notify_queue_stats notify_stats;
 };
 
 struct fuse_chan {
@@ -121,6 +146,60 @@ void cuse_lowlevel_init(fuse_req_t req, fuse_ino_t nodeide, const void *inarg);
 
 int fuse_start_thread(pthread_t *thread_id, void *(*func)(void *), void *arg);
 
+/*
+ * Reset the context of the calling thread, so that helper threads of
+ * the built-in modules can call fuse_fs_*() outside of a request.
+ */
+struct fuse_context *fuse_thread_context(struct fuse *f);
+
+/*
+ * Bounce buffers for read and write requests, reused by the same
+ * thread.  The size passed to fuse_buf_pool_free() must be the one
+ * passed to fuse_buf_pool_alloc().
+ */
+struct fuse_buf_pool_stats {
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long oversize;
+	unsigned long long released;
+	unsigned long long huge;
+	size_t cached;
+};
+
+void *fuse_buf_pool_alloc(size_t size);
+void fuse_buf_pool_free(void *mem, size_t size);
+void fuse_buf_pool_get_stats(struct fuse_buf_pool_stats *stats);
+
+/*
+ * Buffers backed by 2MiB pages, for the receive buffers of sessions
+ * with -o hugepages and the largest pool classes.
+ * Sizes are rounded up to whole pages.  The size passed to
+ * fuse_buf_arena_free() must be the one passed to
+ * fuse_buf_arena_alloc().  Such sessions hold a reference on the
+ * arena, which keeps freed buffers for reuse and tries hugetlbfs
+ * pages before transparent huge pages while there are any.
+ */
+struct fuse_buf_arena_stats {
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long hugetlb;
+	unsigned long long thp;
+	unsigned long long fallback;
+	unsigned long long released;
+	size_t in_use;
+	size_t cached;
+};
+
+void *fuse_buf_arena_alloc(size_t size);
+void fuse_buf_arena_free(void *mem, size_t size);
+void fuse_buf_arena_get(void);
+void fuse_buf_arena_put(void);
+void fuse_buf_arena_get_stats(struct fuse_buf_arena_stats *stats);
+
+/* Receive buffers of the session loops */
+void *fuse_session_buf_alloc(struct fuse_session *se, size_t size);
+void fuse_session_buf_free(struct fuse_session *se, void *mem, size_t size);
+
 int fuse_session_receive_buf_int(struct fuse_session *se, struct fuse_buf *buf,
 				 struct fuse_chan *ch);
 void fuse_session_process_buf_int(struct fuse_session *se,
@@ -131,8 +210,11 @@ struct fuse *fuse_new_31(struct fuse_args *args, const struct fuse_operations *o
 int fuse_loop_mt_32(struct fuse *f, struct fuse_loop_config *config);
 int fuse_session_loop_mt_32(struct fuse_session *se, struct fuse_loop_config *config);
 
-#define FUSE_MAX_MAX_PAGES 256
+/* init_out.max_pages is 16 bits wide */
+#define FUSE_MAX_MAX_PAGES 65535
 #define FUSE_DEFAULT_MAX_PAGES_PER_REQ 32
+/* kernel limit when fs.fuse.max_pages_limit is not available */
+#define FUSE_DEFAULT_MAX_PAGES_LIMIT 256
 
 /* room needed in buffer to accommodate header */
 #define FUSE_BUFFER_HEADER_SIZE 0x1000
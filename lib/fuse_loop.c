@@ -22,8 +22,19 @@ int fuse_session_loop(struct fuse_session *se)
 	struct fuse_buf fbuf = {
 		.mem = NULL,
 	};
+	size_t bufsize = 0;
 
 	while (!fuse_session_exited(se)) {
+		if (!fbuf.mem) {
+			bufsize = se->bufsize;
+			fbuf.mem = fuse_session_buf_alloc(se, bufsize);
+			if (!fbuf.mem) {
+				fuse_log(FUSE_LOG_ERR,
+					"fuse: failed to allocate read buffer\n");
+				res = -ENOMEM;
+				break;
+			}
+		}
 		res = fuse_session_receive_buf_int(se, &fbuf, NULL);
 
 		if (res == -EINTR)
@@ -32,9 +43,15 @@ int fuse_session_loop(struct fuse_session *se)
 			break;
 
 		fuse_session_process_buf_int(se, &fbuf, NULL);
+
+		/* Allocated before INIT negotiated the request size */
+		if (bufsize > se->bufsize) {
+			fuse_session_buf_free(se, fbuf.mem, bufsize);
+			fbuf.mem = NULL;
+		}
 	}
 
-	free(fbuf.mem);
+	fuse_session_buf_free(se, fbuf.mem, bufsize);
 	if(res > 0)
 		/* No error, just the length of the most recently read
 		   request */
@@ -123,6 +123,17 @@ static void *fuse_do_work(void *data)
 		int isforget = 0;
 		int res;
 
+		if (!w->fbuf.mem) {
+			w->bufsize = mt->se->bufsize;
+			w->fbuf.mem = fuse_session_buf_alloc(mt->se, w->bufsize);
+			if (!w->fbuf.mem) {
+				fuse_log(FUSE_LOG_ERR,
+					"fuse: failed to allocate read buffer\n");
+				fuse_session_exit(mt->se);
+				mt->error = -ENOMEM;
+				break;
+			}
+		}
 		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
 		res = fuse_session_receive_buf_int(mt->se, &w->fbuf, w->ch);
 		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
@@ -162,6 +173,12 @@ static void *fuse_do_work(void *data)
 
 		fuse_session_process_buf_int(mt->se, &w->fbuf, w->ch);
 
+		/* Allocated before INIT negotiated the request size */
+		if (w->bufsize > mt->se->bufsize) {
+			fuse_session_buf_free(mt->se, w->fbuf.mem, w->bufsize);
+			w->fbuf.mem = NULL;
+		}
+
 		pthread_mutex_lock(&mt->lock);
 		if (!isforget)
 			mt->numavail++;
@@ -176,7 +193,7 @@ static void *fuse_do_work(void *data)
 			pthread_mutex_unlock(&mt->lock);
 
 			pthread_detach(w->thread_id);
-			free(w->fbuf.mem);
+			fuse_session_buf_free(mt->se, w->fbuf.mem, w->bufsize);
 			fuse_chan_put(w->ch);
 			free(w);
 			return NULL;
@@ -299,7 +316,7 @@ static void fuse_join_worker(struct fuse_mt *mt, struct fuse_worker *w)
 	pthread_mutex_lock(&mt->lock);
 	list_del_worker(w);
 	pthread_mutex_unlock(&mt->lock);
-	free(w->fbuf.mem);
+	fuse_session_buf_free(mt->se, w->fbuf.mem, w->bufsize);
 	fuse_chan_put(w->ch);
 	free(w);
 }
@@ -26,7 +26,9 @@
 #include <limits.h>
 #include <errno.h>
 #include <assert.h>
+#include <time.h>
 #include <sys/file.h>
+#include <sys/ioctl.h>
 
 #ifndef F_LINUX_SPECIFIC_BASE
 #define F_LINUX_SPECIFIC_BASE       1024
@@ -74,6 +76,35 @@ static void convert_stat(const struct stat *stbuf, struct fuse_attr *attr)
 	attr->ctimensec = ST_CTIM_NSEC(stbuf);
 }
 
+#ifdef HAVE_STATX
+static void convert_statx(const struct statx *stxbuf, struct fuse_statx *stx)
+{
+	stx->mask		= stxbuf->stx_mask;
+	stx->blksize		= stxbuf->stx_blksize;
+	stx->attributes		= stxbuf->stx_attributes;
+	stx->nlink		= stxbuf->stx_nlink;
+	stx->uid		= stxbuf->stx_uid;
+	stx->gid		= stxbuf->stx_gid;
+	stx->mode		= stxbuf->stx_mode;
+	stx->ino		= stxbuf->stx_ino;
+	stx->size		= stxbuf->stx_size;
+	stx->blocks		= stxbuf->stx_blocks;
+	stx->attributes_mask	= stxbuf->stx_attributes_mask;
+	stx->atime.tv_sec	= stxbuf->stx_atime.tv_sec;
+	stx->atime.tv_nsec	= stxbuf->stx_atime.tv_nsec;
+	stx->btime.tv_sec	= stxbuf->stx_btime.tv_sec;
+	stx->btime.tv_nsec	= stxbuf->stx_btime.tv_nsec;
+	stx->ctime.tv_sec	= stxbuf->stx_ctime.tv_sec;
+	stx->ctime.tv_nsec	= stxbuf->stx_ctime.tv_nsec;
+	stx->mtime.tv_sec	= stxbuf->stx_mtime.tv_sec;
+	stx->mtime.tv_nsec	= stxbuf->stx_mtime.tv_nsec;
+	stx->rdev_major		= stxbuf->stx_rdev_major;
+	stx->rdev_minor		= stxbuf->stx_rdev_minor;
+	stx->dev_major		= stxbuf->stx_dev_major;
+	stx->dev_minor		= stxbuf->stx_dev_minor;
+}
+#endif
+
 static void convert_attr(const struct fuse_setattr_in *attr, struct stat *stbuf)
 {
 	stbuf->st_mode	       = attr->mode;
@@ -121,8 +152,138 @@ static void list_add_req(struct fuse_req *req, struct fuse_req *next)
 	next->prev = req;
 }
 
+/*
+ * Scratch memory returned by fuse_req_alloc() is carved from a chain
+ * of chunks hanging off the request, and released all at once when
+ * the request is freed.  Every thread keeps one spare chunk, so that
+ * in the steady state a request doesn't need to call malloc().
+ */
+#define FUSE_REQ_CHUNK_SIZE 16384
+#define FUSE_REQ_ALIGN 16
+
+struct fuse_req_chunk {
+	struct fuse_req_chunk *next;
+	size_t size;
+	size_t used;
+};
+
+#define FUSE_REQ_CHUNK_HDR \
+	((sizeof(struct fuse_req_chunk) + FUSE_REQ_ALIGN - 1) & \
+	 ~(size_t) (FUSE_REQ_ALIGN - 1))
+#define FUSE_REQ_CHUNK_DATA (FUSE_REQ_CHUNK_SIZE - FUSE_REQ_CHUNK_HDR)
+
+static struct fuse_req_chunk *fuse_req_chunk_get(struct fuse_session *se,
+						 size_t size)
+{
+	struct fuse_req_chunk *chunk;
+
+	if (size <= FUSE_REQ_CHUNK_DATA) {
+		chunk = pthread_getspecific(se->arena_key);
+		if (chunk) {
+			pthread_setspecific(se->arena_key, NULL);
+		} else {
+			chunk = malloc(FUSE_REQ_CHUNK_SIZE);
+			if (!chunk)
+				return NULL;
+		}
+		chunk->size = FUSE_REQ_CHUNK_DATA;
+	} else {
+		if (size > SIZE_MAX - FUSE_REQ_CHUNK_HDR)
+			return NULL;
+		chunk = malloc(FUSE_REQ_CHUNK_HDR + size);
+		if (!chunk)
+			return NULL;
+		chunk->size = size;
+	}
+	chunk->used = 0;
+
+	return chunk;
+}
+
+static void fuse_req_arena_free(struct fuse_session *se,
+				struct fuse_req_chunk *chunk)
+{
+	while (chunk) {
+		struct fuse_req_chunk *next = chunk->next;
+
+		if (chunk->size != FUSE_REQ_CHUNK_DATA ||
+		    pthread_getspecific(se->arena_key) ||
+		    pthread_setspecific(se->arena_key, chunk) != 0)
+			free(chunk);
+		chunk = next;
+	}
+}
+
+static void fuse_req_arena_destructor(void *data)
+{
+	free(data);
+}
+
+void *fuse_req_alloc(fuse_req_t req, size_t size)
+{
+	struct fuse_req_chunk *chunk = req->arena;
+	size_t len = (size + FUSE_REQ_ALIGN - 1) & ~(size_t) (FUSE_REQ_ALIGN - 1);
+	void *mem;
+
+	if (len < size)
+		return NULL;
+	if (!len)
+		len = FUSE_REQ_ALIGN;
+
+	if (!chunk || chunk->size - chunk->used < len) {
+		struct fuse_req_chunk *new = fuse_req_chunk_get(req->se, len);
+		if (!new)
+			return NULL;
+
+		/* Keep bumping the current chunk after an oversized request */
+		if (chunk && len > FUSE_REQ_CHUNK_DATA) {
+			new->next = chunk->next;
+			chunk->next = new;
+		} else {
+			new->next = chunk;
+			req->arena = new;
+		}
+		chunk = new;
+	}
+	mem = (char *) chunk + FUSE_REQ_CHUNK_HDR + chunk->used;
+	chunk->used += len;
+
+	return mem;
+}
+
+/*
+ * Supplementary group list of a process, see fuse_req_getgroups().
+ * The cache holds one reference, and every request that the list was
+ * looked up for holds another.
+ */
+struct fuse_groups {
+	struct fuse_groups *hash_next;
+	struct fuse_groups *newer;
+	pid_t pid;
+	uid_t uid;
+	gid_t gid;
+	int ref;
+	double expires;
+	int count;
+	gid_t list[];
+};
+
+static void fuse_groups_put(struct fuse_session *se, struct fuse_groups *g)
+{
+	int ref;
+
+	pthread_mutex_lock(&se->groups_lock);
+	ref = --g->ref;
+	pthread_mutex_unlock(&se->groups_lock);
+	if (!ref)
+		free(g);
+}
+
 static void destroy_req(fuse_req_t req)
 {
+	if (req->groups)
+		fuse_groups_put(req->se, req->groups);
+	fuse_req_arena_free(req->se, req->arena);
 	pthread_mutex_destroy(&req->lock);
 	free(req);
 }
@@ -131,7 +292,11 @@ void fuse_free_req(fuse_req_t req)
 {
 	int ctr;
 	struct fuse_session *se = req->se;
+	struct fuse_req_chunk *arena = req->arena;
+	struct fuse_groups *groups = req->groups;
 
+	req->arena = NULL;
+	req->groups = NULL;
 	pthread_mutex_lock(&se->lock);
 	req->u.ni.func = NULL;
 	req->u.ni.data = NULL;
@@ -140,6 +305,9 @@ void fuse_free_req(fuse_req_t req)
 	fuse_chan_put(req->ch);
 	req->ch = NULL;
 	pthread_mutex_unlock(&se->lock);
+	fuse_req_arena_free(se, arena);
+	if (groups)
+		fuse_groups_put(se, groups);
 	if (!ctr)
 		destroy_req(req);
 }
@@ -245,20 +413,16 @@ static int send_reply(fuse_req_t req, int error, const void *arg,
 
 int fuse_reply_iov(fuse_req_t req, const struct iovec *iov, int count)
 {
-	int res;
 	struct iovec *padded_iov;
 
-	padded_iov = malloc((count + 1) * sizeof(struct iovec));
+	padded_iov = fuse_req_alloc(req, (count + 1) * sizeof(struct iovec));
 	if (padded_iov == NULL)
 		return fuse_reply_err(req, ENOMEM);
 
 	memcpy(padded_iov + 1, iov, count * sizeof(struct iovec));
 	count++;
 
-	res = send_reply_iov(req, 0, padded_iov, count);
-	free(padded_iov);
-
-	return res;
+	return send_reply_iov(req, 0, padded_iov, count);
 }
 
 
@@ -384,18 +548,106 @@ size_t fuse_add_direntry_plus(fuse_req_t req, char *buf, size_t bufsize,
 	return entlen_padded;
 }
 
+void fuse_dirbuf_init(struct fuse_dirbuf *db, char *buf, size_t size,
+		      int plus)
+{
+	db->buf = buf;
+	db->size = size;
+	db->len = 0;
+	db->plus = plus;
+}
+
+static size_t direntry_namelen(const struct fuse_direntry *de)
+{
+	return de->namelen ? de->namelen : strlen(de->name);
+}
+
+size_t fuse_dirbuf_fit(const struct fuse_dirbuf *db,
+		       const struct fuse_direntry *ents, size_t count)
+{
+	size_t hdrlen = db->plus ? FUSE_NAME_OFFSET_DIRENTPLUS :
+		FUSE_NAME_OFFSET;
+	size_t rem = db->size - db->len;
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		size_t entlen = FUSE_DIRENT_ALIGN(hdrlen +
+						  direntry_namelen(&ents[i]));
+		if (entlen > rem)
+			break;
+		rem -= entlen;
+	}
+	return i;
+}
+
+size_t fuse_dirbuf_add(struct fuse_dirbuf *db,
+		       const struct fuse_direntry *ents, size_t count)
+{
+	size_t hdrlen = db->plus ? FUSE_NAME_OFFSET_DIRENTPLUS :
+		FUSE_NAME_OFFSET;
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		const struct fuse_direntry *de = &ents[i];
+		size_t namelen = direntry_namelen(de);
+		size_t entlen = FUSE_DIRENT_ALIGN(hdrlen + namelen);
+		char *p = db->buf + db->len;
+		struct fuse_dirent *dirent;
+
+		if (entlen > db->size - db->len)
+			break;
+
+		/* The padding is less than a word and the name is at least
+		   one byte, so clearing the last word before copying the
+		   name zeroes it without a variable length memset */
+		memset(p + entlen - sizeof(uint64_t), 0, sizeof(uint64_t));
+		if (db->plus) {
+			struct fuse_direntplus *dp = (struct fuse_direntplus *) p;
+
+			memset(&dp->entry_out, 0, sizeof(dp->entry_out));
+			if (de->e)
+				fill_entry(&dp->entry_out, de->e);
+			dirent = &dp->dirent;
+		} else {
+			dirent = (struct fuse_dirent *) p;
+		}
+		dirent->ino = de->ino;
+		dirent->off = de->off;
+		dirent->namelen = namelen;
+		dirent->type = de->type;
+		memcpy(dirent->name, de->name, namelen);
+		db->len += entlen;
+	}
+	return i;
+}
+
 static void fill_open(struct fuse_open_out *arg,
 		      const struct fuse_file_info *f)
 {
 	arg->fh = f->fh;
 	if (f->direct_io)
 		arg->open_flags |= FOPEN_DIRECT_IO;
+	if (f->noflush)
+		arg->open_flags |= FOPEN_NOFLUSH;
+	if (f->parallel_direct_writes)
+		arg->open_flags |= FOPEN_PARALLEL_DIRECT_WRITES;
 	if (f->keep_cache)
 		arg->open_flags |= FOPEN_KEEP_CACHE;
 	if (f->cache_readdir)
 		arg->open_flags |= FOPEN_CACHE_DIR;
 	if (f->nonseekable)
 		arg->open_flags |= FOPEN_NONSEEKABLE;
+	/*
+	 * The kernel fails passthrough opens with KEEP_CACHE, CACHE_DIR or
+	 * NONSEEKABLE.  The first two only concern the page cache, which
+	 * passthrough does not use, so drop them.  A nonseekable file is
+	 * opened without passthrough instead of becoming seekable.
+	 */
+	if (f->backing_id > 0 && !f->nonseekable) {
+		arg->open_flags &= ~(FOPEN_KEEP_CACHE | FOPEN_CACHE_DIR);
+		arg->open_flags |= FOPEN_PASSTHROUGH;
+		arg->backing_id = f->backing_id;
+	}
 }
 
 int fuse_reply_entry(fuse_req_t req, const struct fuse_entry_param *e)
@@ -459,6 +711,36 @@ int fuse_reply_open(fuse_req_t req, const struct fuse_file_info *f)
 	return send_reply_ok(req, &arg, sizeof(arg));
 }
 
+int fuse_passthrough_open(fuse_req_t req, int fd)
+{
+	struct fuse_backing_map map = { .fd = fd };
+	int res;
+
+	if (!(req->se->conn.want & FUSE_CAP_PASSTHROUGH))
+		return 0;
+
+	res = ioctl(req->se->fd, FUSE_DEV_IOC_BACKING_OPEN, &map);
+	if (res <= 0) {
+		fuse_log(FUSE_LOG_ERR, "fuse: passthrough_open: %s\n",
+			 strerror(res ? errno : EIO));
+		return 0;
+	}
+
+	return res;
+}
+
+int fuse_passthrough_close(fuse_req_t req, int backing_id)
+{
+	uint32_t id = backing_id;
+	int res;
+
+	res = ioctl(req->se->fd, FUSE_DEV_IOC_BACKING_CLOSE, &id);
+	if (res == -1)
+		return -errno;
+
+	return 0;
+}
+
 int fuse_reply_write(fuse_req_t req, size_t count)
 {
 	struct fuse_write_out arg;
@@ -922,13 +1204,14 @@ int fuse_reply_bmap(fuse_req_t req, uint64_t idx)
 	return send_reply_ok(req, &arg, sizeof(arg));
 }
 
-static struct fuse_ioctl_iovec *fuse_ioctl_iovec_copy(const struct iovec *iov,
+static struct fuse_ioctl_iovec *fuse_ioctl_iovec_copy(fuse_req_t req,
+						      const struct iovec *iov,
 						      size_t count)
 {
 	struct fuse_ioctl_iovec *fiov;
 	size_t i;
 
-	fiov = malloc(sizeof(fiov[0]) * count);
+	fiov = fuse_req_alloc(req, sizeof(fiov[0]) * count);
 	if (!fiov)
 		return NULL;
 
@@ -945,11 +1228,10 @@ int fuse_reply_ioctl_retry(fuse_req_t req,
 			   const struct iovec *out_iov, size_t out_count)
 {
 	struct fuse_ioctl_out arg;
-	struct fuse_ioctl_iovec *in_fiov = NULL;
-	struct fuse_ioctl_iovec *out_fiov = NULL;
+	struct fuse_ioctl_iovec *in_fiov;
+	struct fuse_ioctl_iovec *out_fiov;
 	struct iovec iov[4];
 	size_t count = 1;
-	int res;
 
 	memset(&arg, 0, sizeof(arg));
 	arg.flags |= FUSE_IOCTL_RETRY;
@@ -973,13 +1255,11 @@ int fuse_reply_ioctl_retry(fuse_req_t req,
 		}
 	} else {
 		/* Can't handle non-compat 64bit ioctls on 32bit */
-		if (sizeof(void *) == 4 && req->ioctl_64bit) {
-			res = fuse_reply_err(req, EINVAL);
-			goto out;
-		}
+		if (sizeof(void *) == 4 && req->ioctl_64bit)
+			return fuse_reply_err(req, EINVAL);
 
 		if (in_count) {
-			in_fiov = fuse_ioctl_iovec_copy(in_iov, in_count);
+			in_fiov = fuse_ioctl_iovec_copy(req, in_iov, in_count);
 			if (!in_fiov)
 				goto enomem;
 
@@ -988,7 +1268,7 @@ int fuse_reply_ioctl_retry(fuse_req_t req,
 			count++;
 		}
 		if (out_count) {
-			out_fiov = fuse_ioctl_iovec_copy(out_iov, out_count);
+			out_fiov = fuse_ioctl_iovec_copy(req, out_iov, out_count);
 			if (!out_fiov)
 				goto enomem;
 
@@ -998,16 +1278,10 @@ int fuse_reply_ioctl_retry(fuse_req_t req,
 		}
 	}
 
-	res = send_reply_iov(req, 0, iov, count);
-out:
-	free(in_fiov);
-	free(out_fiov);
-
-	return res;
+	return send_reply_iov(req, 0, iov, count);
 
 enomem:
-	res = fuse_reply_err(req, ENOMEM);
-	goto out;
+	return fuse_reply_err(req, ENOMEM);
 }
 
 int fuse_reply_ioctl(fuse_req_t req, int result, const void *buf, size_t size)
@@ -1036,9 +1310,8 @@ int fuse_reply_ioctl_iov(fuse_req_t req, int result, const struct iovec *iov,
 {
 	struct iovec *padded_iov;
 	struct fuse_ioctl_out arg;
-	int res;
 
-	padded_iov = malloc((count + 2) * sizeof(struct iovec));
+	padded_iov = fuse_req_alloc(req, (count + 2) * sizeof(struct iovec));
 	if (padded_iov == NULL)
 		return fuse_reply_err(req, ENOMEM);
 
@@ -1049,10 +1322,7 @@ int fuse_reply_ioctl_iov(fuse_req_t req, int result, const struct iovec *iov,
 
 	memcpy(&padded_iov[2], iov, count * sizeof(struct iovec));
 
-	res = send_reply_iov(req, 0, padded_iov, count + 2);
-	free(padded_iov);
-
-	return res;
+	return send_reply_iov(req, 0, padded_iov, count + 2);
 }
 
 int fuse_reply_poll(fuse_req_t req, unsigned revents)
@@ -1075,6 +1345,25 @@ int fuse_reply_lseek(fuse_req_t req, off_t off)
 	return send_reply_ok(req, &arg, sizeof(arg));
 }
 
+int fuse_reply_statx(fuse_req_t req, int flags, struct statx *statx,
+		     double attr_timeout)
+{
+#ifdef HAVE_STATX
+	struct fuse_statx_out arg;
+
+	memset(&arg, 0, sizeof(arg));
+	arg.flags = flags;
+	arg.attr_valid = calc_timeout_sec(attr_timeout);
+	arg.attr_valid_nsec = calc_timeout_nsec(attr_timeout);
+	convert_statx(statx, &arg.stat);
+
+	return send_reply_ok(req, &arg, sizeof(arg));
+#else
+	(void) flags; (void) statx; (void) attr_timeout;
+	return fuse_reply_err(req, ENOSYS);
+#endif
+}
+
 static void do_lookup(fuse_req_t req, fuse_ino_t nodeid, const void *inarg)
 {
 	char *name = (char *) inarg;
@@ -1150,6 +1439,24 @@ static void do_getattr(fuse_req_t req, fuse_ino_t nodeid, const void *inarg)
 		fuse_reply_err(req, ENOSYS);
 }
 
+static void do_statx(fuse_req_t req, fuse_ino_t nodeid, const void *inarg)
+{
+	struct fuse_statx_in *arg = (struct fuse_statx_in *) inarg;
+	struct fuse_file_info *fip = NULL;
+	struct fuse_file_info fi;
+
+	if (arg->getattr_flags & FUSE_GETATTR_FH) {
+		memset(&fi, 0, sizeof(fi));
+		fi.fh = arg->fh;
+		fip = &fi;
+	}
+
+	if (req->se->op.statx)
+		req->se->op.statx(req, nodeid, arg->sx_flags, arg->sx_mask, fip);
+	else
+		fuse_reply_err(req, ENOSYS);
+}
+
 static void do_setattr(fuse_req_t req, fuse_ino_t nodeid, const void *inarg)
 {
 	struct fuse_setattr_in *arg = (struct fuse_setattr_in *) inarg;
@@ -1566,7 +1873,9 @@ static void do_statfs(fuse_req_t req, fuse_ino_t nodeid, const void *inarg)
 static void do_setxattr(fuse_req_t req, fuse_ino_t nodeid, const void *inarg)
 {
 	struct fuse_setxattr_in *arg = (struct fuse_setxattr_in *) inarg;
-	char *name = PARAM(arg);
+	/* The extended request is only sent if FUSE_SETXATTR_EXT is
+	   negotiated, which it never is */
+	char *name = (char *) arg + FUSE_COMPAT_SETXATTR_IN_SIZE;
 	char *value = name + strlen(name) + 1;
 
 	if (req->se->op.setxattr)
@@ -1898,12 +2207,17 @@ static void do_init(fuse_req_t req, fuse_ino_t nodeid, const void *inarg)
 	struct fuse_session *se = req->se;
 	size_t bufsize = se->bufsize;
 	size_t outargsize = sizeof(outarg);
+	uint64_t inargflags = 0;
+	uint64_t outargflags = 0;
 
 	(void) nodeid;
 	if (se->debug) {
 		fuse_log(FUSE_LOG_DEBUG, "INIT: %u.%u\n", arg->major, arg->minor);
 		if (arg->major == 7 && arg->minor >= 6) {
 			fuse_log(FUSE_LOG_DEBUG, "flags=0x%08x\n", arg->flags);
+			if (arg->flags & FUSE_INIT_EXT)
+				fuse_log(FUSE_LOG_DEBUG, "flags2=0x%08x\n",
+					 arg->flags2);
 			fuse_log(FUSE_LOG_DEBUG, "max_readahead=0x%08x\n",
 				arg->max_readahead);
 		}
@@ -1931,50 +2245,56 @@ static void do_init(fuse_req_t req, fuse_ino_t nodeid, const void *inarg)
 	}
 
 	if (arg->minor >= 6) {
+		inargflags = arg->flags;
+		/* flags2 is only present in requests that set FUSE_INIT_EXT */
+		if (inargflags & FUSE_INIT_EXT)
+			inargflags |= (uint64_t) arg->flags2 << 32;
 		if (arg->max_readahead < se->conn.max_readahead)
 			se->conn.max_readahead = arg->max_readahead;
-		if (arg->flags & FUSE_ASYNC_READ)
+		if (inargflags & FUSE_ASYNC_READ)
 			se->conn.capable |= FUSE_CAP_ASYNC_READ;
-		if (arg->flags & FUSE_POSIX_LOCKS)
+		if (inargflags & FUSE_POSIX_LOCKS)
 			se->conn.capable |= FUSE_CAP_POSIX_LOCKS;
-		if (arg->flags & FUSE_ATOMIC_O_TRUNC)
+		if (inargflags & FUSE_ATOMIC_O_TRUNC)
 			se->conn.capable |= FUSE_CAP_ATOMIC_O_TRUNC;
-		if (arg->flags & FUSE_EXPORT_SUPPORT)
+		if (inargflags & FUSE_EXPORT_SUPPORT)
 			se->conn.capable |= FUSE_CAP_EXPORT_SUPPORT;
-		if (arg->flags & FUSE_DONT_MASK)
+		if (inargflags & FUSE_DONT_MASK)
 			se->conn.capable |= FUSE_CAP_DONT_MASK;
-		if (arg->flags & FUSE_FLOCK_LOCKS)
+		if (inargflags & FUSE_FLOCK_LOCKS)
 			se->conn.capable |= FUSE_CAP_FLOCK_LOCKS;
-		if (arg->flags & FUSE_AUTO_INVAL_DATA)
+		if (inargflags & FUSE_AUTO_INVAL_DATA)
 			se->conn.capable |= FUSE_CAP_AUTO_INVAL_DATA;
-		if (arg->flags & FUSE_DO_READDIRPLUS)
+		if (inargflags & FUSE_DO_READDIRPLUS)
 			se->conn.capable |= FUSE_CAP_READDIRPLUS;
-		if (arg->flags & FUSE_READDIRPLUS_AUTO)
+		if (inargflags & FUSE_READDIRPLUS_AUTO)
 			se->conn.capable |= FUSE_CAP_READDIRPLUS_AUTO;
-		if (arg->flags & FUSE_ASYNC_DIO)
+		if (inargflags & FUSE_ASYNC_DIO)
 			se->conn.capable |= FUSE_CAP_ASYNC_DIO;
-		if (arg->flags & FUSE_WRITEBACK_CACHE)
+		if (inargflags & FUSE_WRITEBACK_CACHE)
 			se->conn.capable |= FUSE_CAP_WRITEBACK_CACHE;
-		if (arg->flags & FUSE_NO_OPEN_SUPPORT)
+		if (inargflags & FUSE_NO_OPEN_SUPPORT)
 			se->conn.capable |= FUSE_CAP_NO_OPEN_SUPPORT;
-		if (arg->flags & FUSE_PARALLEL_DIROPS)
+		if (inargflags & FUSE_PARALLEL_DIROPS)
 			se->conn.capable |= FUSE_CAP_PARALLEL_DIROPS;
-		if (arg->flags & FUSE_POSIX_ACL)
+		if (inargflags & FUSE_POSIX_ACL)
 			se->conn.capable |= FUSE_CAP_POSIX_ACL;
-		if (arg->flags & FUSE_HANDLE_KILLPRIV)
+		if (inargflags & FUSE_HANDLE_KILLPRIV)
 			se->conn.capable |= FUSE_CAP_HANDLE_KILLPRIV;
-		if (arg->flags & FUSE_NO_OPENDIR_SUPPORT)
+		if (inargflags & FUSE_NO_OPENDIR_SUPPORT)
 			se->conn.capable |= FUSE_CAP_NO_OPENDIR_SUPPORT;
-		if (arg->flags & FUSE_EXPLICIT_INVAL_DATA)
+		if (inargflags & FUSE_EXPLICIT_INVAL_DATA)
 			se->conn.capable |= FUSE_CAP_EXPLICIT_INVAL_DATA;
-		if (!(arg->flags & FUSE_MAX_PAGES)) {
-			size_t max_bufsize =
-				FUSE_DEFAULT_MAX_PAGES_PER_REQ * getpagesize()
-				+ FUSE_BUFFER_HEADER_SIZE;
-			if (bufsize > max_bufsize) {
-				bufsize = max_bufsize;
-			}
-		}
+		if (inargflags & FUSE_PASSTHROUGH)
+			se->conn.capable |= FUSE_CAP_PASSTHROUGH;
+		if (inargflags & FUSE_MAX_PAGES)
+			se->conn.capable |= FUSE_CAP_MAX_PAGES;
+		if (inargflags & FUSE_CACHE_SYMLINKS)
+			se->conn.capable |= FUSE_CAP_CACHE_SYMLINKS;
+		if (inargflags & FUSE_HAS_EXPIRE_ONLY)
+			se->conn.capable |= FUSE_CAP_EXPIRE_ONLY;
+		if (inargflags & FUSE_DIRECT_IO_ALLOW_MMAP)
+			se->conn.capable |= FUSE_CAP_DIRECT_IO_ALLOW_MMAP;
 	} else {
 		se->conn.max_readahead = 0;
 	}
@@ -2014,7 +2334,19 @@ static void do_init(fuse_req_t req, fuse_ino_t nodeid, const void *inarg)
 	LL_SET_DEFAULT(se->op.readdirplus, FUSE_CAP_READDIRPLUS);
 	LL_SET_DEFAULT(se->op.readdirplus && se->op.readdir,
 		       FUSE_CAP_READDIRPLUS_AUTO);
+	LL_SET_DEFAULT(1, FUSE_CAP_MAX_PAGES);
+	LL_SET_DEFAULT(1, FUSE_CAP_EXPIRE_ONLY);
+	LL_SET_DEFAULT(1, FUSE_CAP_DIRECT_IO_ALLOW_MMAP);
 	se->conn.time_gran = 1;
+
+	if (!(se->conn.capable & FUSE_CAP_MAX_PAGES)) {
+		size_t max_bufsize =
+			FUSE_DEFAULT_MAX_PAGES_PER_REQ * getpagesize()
+			+ FUSE_BUFFER_HEADER_SIZE;
+		if (bufsize > max_bufsize) {
+			bufsize = max_bufsize;
+		}
+	}
 	
 	if (bufsize < FUSE_MIN_READ_BUFFER) {
 		fuse_log(FUSE_LOG_ERR, "fuse: warning: buffer size too small: %zu\n",
@@ -2023,13 +2355,28 @@ static void do_init(fuse_req_t req, fuse_ino_t nodeid, const void *inarg)
 	}
 	se->bufsize = bufsize;
 
+	/*
+	 * Requests larger than the default have to be asked for by
+	 * the filesystem, as they need correspondingly large buffers
+	 */
 	if (se->conn.max_write > bufsize - FUSE_BUFFER_HEADER_SIZE)
 		se->conn.max_write = bufsize - FUSE_BUFFER_HEADER_SIZE;
+	if (se->conn.max_write > FUSE_DEFAULT_MAX_PAGES_LIMIT * getpagesize())
+		se->conn.max_write = FUSE_DEFAULT_MAX_PAGES_LIMIT * getpagesize();
 
 	se->got_init = 1;
 	if (se->op.init)
 		se->op.init(se->userdata, &se->conn);
 
+	if ((se->conn.want & FUSE_CAP_PASSTHROUGH) &&
+	    (se->conn.want & FUSE_CAP_WRITEBACK_CACHE)) {
+		/* The kernel does not allow passthrough together with
+		   the writeback cache, fall back to regular I/O */
+		fuse_log(FUSE_LOG_ERR, "fuse: warning: passthrough is not "
+			"supported with writeback cache, disabling it\n");
+		se->conn.want &= ~FUSE_CAP_PASSTHROUGH;
+	}
+
 	if (se->conn.want & (~se->conn.capable)) {
 		fuse_log(FUSE_LOG_ERR, "fuse: error: filesystem requested capabilities "
 			"0x%x that are not supported by kernel, aborting.\n",
@@ -2051,44 +2398,66 @@ static void do_init(fuse_req_t req, fuse_ino_t nodeid, const void *inarg)
 		return;
 	}
 
+	if (se->conn.max_write > bufsize - FUSE_BUFFER_HEADER_SIZE)
+		se->conn.max_write = bufsize - FUSE_BUFFER_HEADER_SIZE;
+
+	/* Without FUSE_MAX_PAGES the kernel uses its default limit */
+	if (!(se->conn.want & FUSE_CAP_MAX_PAGES) &&
+	    se->conn.max_write > FUSE_DEFAULT_MAX_PAGES_PER_REQ * getpagesize())
+		se->conn.max_write = FUSE_DEFAULT_MAX_PAGES_PER_REQ * getpagesize();
+
 	if (se->conn.max_write < bufsize - FUSE_BUFFER_HEADER_SIZE) {
 		se->bufsize = se->conn.max_write + FUSE_BUFFER_HEADER_SIZE;
 	}
-	if (arg->flags & FUSE_MAX_PAGES) {
-		outarg.flags |= FUSE_MAX_PAGES;
+	if (se->conn.want & FUSE_CAP_MAX_PAGES) {
+		outargflags |= FUSE_MAX_PAGES;
 		outarg.max_pages = (se->conn.max_write - 1) / getpagesize() + 1;
 	}
 
 	/* Always enable big writes, this is superseded
 	   by the max_write option */
-	outarg.flags |= FUSE_BIG_WRITES;
+	outargflags |= FUSE_BIG_WRITES;
 
 	if (se->conn.want & FUSE_CAP_ASYNC_READ)
-		outarg.flags |= FUSE_ASYNC_READ;
+		outargflags |= FUSE_ASYNC_READ;
 	if (se->conn.want & FUSE_CAP_POSIX_LOCKS)
-		outarg.flags |= FUSE_POSIX_LOCKS;
+		outargflags |= FUSE_POSIX_LOCKS;
 	if (se->conn.want & FUSE_CAP_ATOMIC_O_TRUNC)
-		outarg.flags |= FUSE_ATOMIC_O_TRUNC;
+		outargflags |= FUSE_ATOMIC_O_TRUNC;
 	if (se->conn.want & FUSE_CAP_EXPORT_SUPPORT)
-		outarg.flags |= FUSE_EXPORT_SUPPORT;
+		outargflags |= FUSE_EXPORT_SUPPORT;
 	if (se->conn.want & FUSE_CAP_DONT_MASK)
-		outarg.flags |= FUSE_DONT_MASK;
+		outargflags |= FUSE_DONT_MASK;
 	if (se->conn.want & FUSE_CAP_FLOCK_LOCKS)
-		outarg.flags |= FUSE_FLOCK_LOCKS;
+		outargflags |= FUSE_FLOCK_LOCKS;
 	if (se->conn.want & FUSE_CAP_AUTO_INVAL_DATA)
-		outarg.flags |= FUSE_AUTO_INVAL_DATA;
+		outargflags |= FUSE_AUTO_INVAL_DATA;
 	if (se->conn.want & FUSE_CAP_READDIRPLUS)
-		outarg.flags |= FUSE_DO_READDIRPLUS;
+		outargflags |= FUSE_DO_READDIRPLUS;
 	if (se->conn.want & FUSE_CAP_READDIRPLUS_AUTO)
-		outarg.flags |= FUSE_READDIRPLUS_AUTO;
+		outargflags |= FUSE_READDIRPLUS_AUTO;
 	if (se->conn.want & FUSE_CAP_ASYNC_DIO)
-		outarg.flags |= FUSE_ASYNC_DIO;
+		outargflags |= FUSE_ASYNC_DIO;
 	if (se->conn.want & FUSE_CAP_WRITEBACK_CACHE)
-		outarg.flags |= FUSE_WRITEBACK_CACHE;
+		outargflags |= FUSE_WRITEBACK_CACHE;
 	if (se->conn.want & FUSE_CAP_POSIX_ACL)
-		outarg.flags |= FUSE_POSIX_ACL;
+		outargflags |= FUSE_POSIX_ACL;
 	if (se->conn.want & FUSE_CAP_EXPLICIT_INVAL_DATA)
-		outarg.flags |= FUSE_EXPLICIT_INVAL_DATA;
+		outargflags |= FUSE_EXPLICIT_INVAL_DATA;
+	if (se->conn.want & FUSE_CAP_CACHE_SYMLINKS)
+		outargflags |= FUSE_CACHE_SYMLINKS;
+	if (se->conn.want & FUSE_CAP_DIRECT_IO_ALLOW_MMAP)
+		outargflags |= FUSE_DIRECT_IO_ALLOW_MMAP;
+	if (se->conn.want & FUSE_CAP_PASSTHROUGH) {
+		outargflags |= FUSE_PASSTHROUGH;
+		/* The backing files themselves may be on a stacked fs */
+		outarg.max_stack_depth = se->conn.max_backing_stack_depth + 1;
+	}
+	if (inargflags & FUSE_INIT_EXT) {
+		outargflags |= FUSE_INIT_EXT;
+		outarg.flags2 = outargflags >> 32;
+	}
+	outarg.flags = outargflags;
 	outarg.max_readahead = se->conn.max_readahead;
 	outarg.max_write = se->conn.max_write;
 	if (se->conn.proto_minor >= 13) {
@@ -2110,6 +2479,12 @@ static void do_init(fuse_req_t req, fuse_ino_t nodeid, const void *inarg)
 	if (se->debug) {
 		fuse_log(FUSE_LOG_DEBUG, "   INIT: %u.%u\n", outarg.major, outarg.minor);
 		fuse_log(FUSE_LOG_DEBUG, "   flags=0x%08x\n", outarg.flags);
+		if (outargflags & FUSE_INIT_EXT)
+			fuse_log(FUSE_LOG_DEBUG, "   flags2=0x%08x\n",
+				 outarg.flags2);
+		if (outargflags & FUSE_PASSTHROUGH)
+			fuse_log(FUSE_LOG_DEBUG, "   max_stack_depth=%u\n",
+				 outarg.max_stack_depth);
 		fuse_log(FUSE_LOG_DEBUG, "   max_readahead=0x%08x\n",
 			outarg.max_readahead);
 		fuse_log(FUSE_LOG_DEBUG, "   max_write=0x%08x\n", outarg.max_write);
@@ -2242,8 +2617,9 @@ int fuse_lowlevel_notify_inval_inode(struct fuse_session *se, fuse_ino_t ino,
 	return send_notify_iov(se, FUSE_NOTIFY_INVAL_INODE, iov, 2);
 }
 
-int fuse_lowlevel_notify_inval_entry(struct fuse_session *se, fuse_ino_t parent,
-				     const char *name, size_t namelen)
+static int notify_inval_entry(struct fuse_session *se, fuse_ino_t parent,
+			      const char *name, size_t namelen,
+			      uint32_t flags)
 {
 	struct fuse_notify_inval_entry_out outarg;
 	struct iovec iov[3];
@@ -2256,7 +2632,7 @@ int fuse_lowlevel_notify_inval_entry(struct fuse_session *se, fuse_ino_t parent,
 
 	outarg.parent = parent;
 	outarg.namelen = namelen;
-	outarg.padding = 0;
+	outarg.flags = flags;
 
 	iov[1].iov_base = &outarg;
 	iov[1].iov_len = sizeof(outarg);
@@ -2266,6 +2642,26 @@ int fuse_lowlevel_notify_inval_entry(struct fuse_session *se, fuse_ino_t parent,
 	return send_notify_iov(se, FUSE_NOTIFY_INVAL_ENTRY, iov, 3);
 }
 
+int fuse_lowlevel_notify_inval_entry(struct fuse_session *se, fuse_ino_t parent,
+				     const char *name, size_t namelen)
+{
+	return notify_inval_entry(se, parent, name, namelen, 0);
+}
+
+int fuse_lowlevel_notify_expire_entry(struct fuse_session *se,
+				      fuse_ino_t parent, const char *name,
+				      size_t namelen)
+{
+	if (!se)
+		return -EINVAL;
+
+	if (!(se->conn.capable & FUSE_CAP_EXPIRE_ONLY))
+		return -ENOSYS;
+
+	return notify_inval_entry(se, parent, name, namelen,
+				  FUSE_EXPIRE_ONLY);
+}
+
 int fuse_lowlevel_notify_delete(struct fuse_session *se,
 				fuse_ino_t parent, fuse_ino_t child,
 				const char *name, size_t namelen)
@@ -2292,6 +2688,266 @@ int fuse_lowlevel_notify_delete(struct fuse_session *se,
 	return send_notify_iov(se, FUSE_NOTIFY_DELETE, iov, 3);
 }
 
+/*
+ * Asynchronous notifications are kept in a FIFO and, until the sender
+ * thread takes them off the queue, in a hash table by inode and name,
+ * so that repeated ones can be merged into the queued notification.
+ */
+struct fuse_notify_item {
+	struct fuse_notify_item *next;
+	struct fuse_notify_item *hash_next;
+	int type;
+	fuse_ino_t ino;
+	fuse_ino_t child;
+	off_t off;
+	off_t len;
+	size_t namelen;
+	char name[];
+};
+
+static size_t notify_hash(int type, fuse_ino_t ino, fuse_ino_t child,
+			  const char *name, size_t namelen)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	size_t i;
+
+	hash = (hash ^ type) * 1099511628211ULL;
+	hash = (hash ^ ino) * 1099511628211ULL;
+	hash = (hash ^ child) * 1099511628211ULL;
+	for (i = 0; i < namelen; i++)
+		hash = (hash ^ (unsigned char) name[i]) * 1099511628211ULL;
+
+	return hash % FUSE_NOTIFY_HASH_SIZE;
+}
+
+/* Make the queued invalidation also cover off/len */
+static void notify_merge_range(struct fuse_notify_item *it, off_t off,
+			       off_t len)
+{
+	off_t end, newend;
+
+	/* Attributes are always invalidated */
+	if (off < 0)
+		return;
+	if (it->off < 0) {
+		it->off = off;
+		it->len = len;
+		return;
+	}
+
+	/* Zero length extends to the end of the file */
+	end = it->len > 0 ? it->off + it->len : 0;
+	newend = len > 0 ? off + len : 0;
+	if (off < it->off)
+		it->off = off;
+	if (!end || !newend)
+		it->len = 0;
+	else
+		it->len = (end > newend ? end : newend) - it->off;
+}
+
+static int notify_send_item(struct fuse_session *se,
+			    struct fuse_notify_item *it)
+{
+	switch (it->type) {
+	case FUSE_NOTIFY_INVAL_INODE:
+		return fuse_lowlevel_notify_inval_inode(se, it->ino, it->off,
+							it->len);
+	case FUSE_NOTIFY_INVAL_ENTRY:
+		return fuse_lowlevel_notify_inval_entry(se, it->ino, it->name,
+							it->namelen);
+	default:
+		return fuse_lowlevel_notify_delete(se, it->ino, it->child,
+						   it->name, it->namelen);
+	}
+}
+
+static void *notify_sender(void *data)
+{
+	struct fuse_session *se = (struct fuse_session *) data;
+
+	pthread_mutex_lock(&se->notify_lock);
+	while (!se->notify_exit) {
+		struct fuse_notify_item *it = se->notify_head;
+		struct fuse_notify_item **pp;
+		int res;
+
+		if (!it) {
+			pthread_cond_wait(&se->notify_work, &se->notify_lock);
+			continue;
+		}
+
+		se->notify_head = it->next;
+		if (!se->notify_head)
+			se->notify_tail = &se->notify_head;
+		pp = &se->notify_hash[notify_hash(it->type, it->ino, it->child,
+						  it->name, it->namelen)];
+		while (*pp != it)
+			pp = &(*pp)->hash_next;
+		*pp = it->hash_next;
+		se->notify_stats.depth--;
+		se->notify_busy = 1;
+		pthread_cond_broadcast(&se->notify_space);
+		pthread_mutex_unlock(&se->notify_lock);
+
+		res = notify_send_item(se, it);
+		free(it);
+
+		pthread_mutex_lock(&se->notify_lock);
+		se->notify_busy = 0;
+		se->notify_stats.sent++;
+		if (res && res != -ENOENT)
+			se->notify_stats.failed++;
+		if (!se->notify_head)
+			pthread_cond_broadcast(&se->notify_space);
+	}
+	pthread_mutex_unlock(&se->notify_lock);
+
+	return NULL;
+}
+
+static int notify_queue_add(struct fuse_session *se, int type,
+			    fuse_ino_t ino, fuse_ino_t child, off_t off,
+			    off_t len, const char *name, size_t namelen)
+{
+	struct fuse_notify_item *it;
+	size_t hash;
+
+	if (!se)
+		return -EINVAL;
+
+	if (se->conn.proto_minor <
+	    (type == FUSE_NOTIFY_DELETE ? 18 : 12))
+		return -ENOSYS;
+
+	hash = notify_hash(type, ino, child, name, namelen);
+	pthread_mutex_lock(&se->notify_lock);
+	if (!se->notify_started) {
+		/* Not started by fuse_session_new(), which may be followed
+		   by fuse_daemonize() */
+		if (fuse_start_thread(&se->notify_thread, notify_sender,
+				      se) == -1) {
+			pthread_mutex_unlock(&se->notify_lock);
+			return -ENOMEM;
+		}
+		se->notify_started = 1;
+	}
+
+	for (;;) {
+		for (it = se->notify_hash[hash]; it; it = it->hash_next) {
+			if (it->type == type && it->ino == ino &&
+			    it->child == child && it->namelen == namelen &&
+			    memcmp(it->name, name, namelen) == 0)
+				break;
+		}
+		if (it) {
+			if (type == FUSE_NOTIFY_INVAL_INODE)
+				notify_merge_range(it, off, len);
+			se->notify_stats.coalesced++;
+			pthread_mutex_unlock(&se->notify_lock);
+			return 0;
+		}
+		if (se->notify_stats.depth < se->notify_queue_max ||
+		    se->notify_exit)
+			break;
+		se->notify_stats.blocked++;
+		pthread_cond_wait(&se->notify_space, &se->notify_lock);
+	}
+
+	it = malloc(sizeof(*it) + namelen + 1);
+	if (!it) {
+		pthread_mutex_unlock(&se->notify_lock);
+		return -ENOMEM;
+	}
+	it->next = NULL;
+	it->type = type;
+	it->ino = ino;
+	it->child = child;
+	it->off = off;
+	it->len = len;
+	it->namelen = namelen;
+	memcpy(it->name, name, namelen);
+	it->name[namelen] = '\0';
+
+	*se->notify_tail = it;
+	se->notify_tail = &it->next;
+	it->hash_next = se->notify_hash[hash];
+	se->notify_hash[hash] = it;
+	se->notify_stats.queued++;
+	if (++se->notify_stats.depth > se->notify_stats.max_depth)
+		se->notify_stats.max_depth = se->notify_stats.depth;
+	pthread_cond_signal(&se->notify_work);
+	pthread_mutex_unlock(&se->notify_lock);
+
+	return 0;
+}
+
+int fuse_lowlevel_notify_inval_inode_async(struct fuse_session *se,
+					   fuse_ino_t ino, off_t off,
+					   off_t len)
+{
+	return notify_queue_add(se, FUSE_NOTIFY_INVAL_INODE, ino, 0, off, len,
+				"", 0);
+}
+
+int fuse_lowlevel_notify_inval_entry_async(struct fuse_session *se,
+					   fuse_ino_t parent,
+					   const char *name, size_t namelen)
+{
+	return notify_queue_add(se, FUSE_NOTIFY_INVAL_ENTRY, parent, 0, 0, 0,
+				name, namelen);
+}
+
+int fuse_lowlevel_notify_delete_async(struct fuse_session *se,
+				      fuse_ino_t parent, fuse_ino_t child,
+				      const char *name, size_t namelen)
+{
+	return notify_queue_add(se, FUSE_NOTIFY_DELETE, parent, child, 0, 0,
+				name, namelen);
+}
+
+int fuse_lowlevel_notify_flush(struct fuse_session *se)
+{
+	if (!se)
+		return -EINVAL;
+
+	pthread_mutex_lock(&se->notify_lock);
+	while ((se->notify_head || se->notify_busy) && !se->notify_exit)
+		pthread_cond_wait(&se->notify_space, &se->notify_lock);
+	pthread_mutex_unlock(&se->notify_lock);
+
+	return 0;
+}
+
+void fuse_lowlevel_notify_queue_stats(struct fuse_session *se,
+				      struct fuse_notify_queue_stats *stats)
+{
+	pthread_mutex_lock(&se->notify_lock);
+	*stats = se->notify_stats;
+	pthread_mutex_unlock(&se->notify_lock);
+}
+
+static void notify_queue_destroy(struct fuse_session *se)
+{
+	pthread_mutex_lock(&se->notify_lock);
+	se->notify_exit = 1;
+	pthread_cond_broadcast(&se->notify_work);
+	pthread_cond_broadcast(&se->notify_space);
+	pthread_mutex_unlock(&se->notify_lock);
+	if (se->notify_started)
+		pthread_join(se->notify_thread, NULL);
+
+	while (se->notify_head) {
+		struct fuse_notify_item *it = se->notify_head;
+
+		se->notify_head = it->next;
+		free(it);
+	}
+	pthread_cond_destroy(&se->notify_space);
+	pthread_cond_destroy(&se->notify_work);
+	pthread_mutex_destroy(&se->notify_lock);
+}
+
 int fuse_lowlevel_notify_store(struct fuse_session *se, fuse_ino_t ino,
 			       off_t offset, struct fuse_bufvec *bufv,
 			       enum fuse_buf_copy_flags flags)
@@ -2500,6 +3156,7 @@ static struct {
 	[FUSE_RENAME2]     = { do_rename2,      "RENAME2"    },
 	[FUSE_COPY_FILE_RANGE] = { do_copy_file_range, "COPY_FILE_RANGE" },
 	[FUSE_LSEEK]	   = { do_lseek,       "LSEEK"	     },
+	[FUSE_STATX]	   = { do_statx,       "STATX"	     },
 	[CUSE_INIT]	   = { cuse_lowlevel_init, "CUSE_INIT"   },
 };
 
@@ -2681,6 +3338,9 @@ static const struct fuse_opt fuse_ll_opts[] = {
 	LL_OPTION("-d", debug, 1),
 	LL_OPTION("--debug", debug, 1),
 	LL_OPTION("allow_root", deny_others, 1),
+	LL_OPTION("groups_timeout=%lf", groups_timeout, 0),
+	LL_OPTION("notify_queue_max=%u", notify_queue_max, 0),
+	LL_OPTION("hugepages", hugepages, 1),
 	FUSE_OPT_END
 };
 
@@ -2698,7 +3358,12 @@ void fuse_lowlevel_help(void)
 	printf(
 "    -o allow_other         allow access by all users\n"
 "    -o allow_root          allow access by root\n"
-"    -o auto_unmount        auto unmount on process termination\n");
+"    -o auto_unmount        auto unmount on process termination\n"
+"    -o groups_timeout=T    cache timeout for supplementary groups (0s),\n"
+"                           keyed by pid, uid and gid: a new process\n"
+"                           reusing a pid may see the old process' groups\n"
+"    -o notify_queue_max=N  max. queued asynchronous notifications (65536)\n"
+"    -o hugepages           use 2MiB pages for request buffers\n");
 }
 
 void fuse_session_destroy(struct fuse_session *se)
@@ -2709,11 +3374,32 @@ void fuse_session_destroy(struct fuse_session *se)
 		if (se->op.destroy)
 			se->op.destroy(se->userdata);
 	}
+	notify_queue_destroy(se);
 	llp = pthread_getspecific(se->pipe_key);
 	if (llp != NULL)
 		fuse_ll_pipe_free(llp);
 	pthread_key_delete(se->pipe_key);
+	free(pthread_getspecific(se->arena_key));
+	pthread_key_delete(se->arena_key);
+	while (se->groups_oldest) {
+		struct fuse_groups *g = se->groups_oldest;
+
+		se->groups_oldest = g->newer;
+		fuse_groups_put(se, g);
+	}
+	pthread_mutex_destroy(&se->groups_lock);
 	pthread_mutex_destroy(&se->lock);
+	if (se->hugepages) {
+		struct fuse_buf_arena_stats as;
+
+		fuse_buf_arena_get_stats(&as);
+		if (se->debug)
+			fuse_log(FUSE_LOG_DEBUG, "fuse: buffer arena: %llu hits, %llu misses, %llu hugetlb, %llu thp, %llu small pages, %llu released, %zu bytes in use, %zu bytes cached\n",
+				 as.hits, as.misses, as.hugetlb, as.thp,
+				 as.fallback, as.released, as.in_use,
+				 as.cached);
+		fuse_buf_arena_put();
+	}
 	free(se->cuse_data);
 	if (se->fd != -1)
 		close(se->fd);
@@ -2728,6 +3414,21 @@ static void fuse_ll_pipe_destructor(void *data)
 	fuse_ll_pipe_free(llp);
 }
 
+void *fuse_session_buf_alloc(struct fuse_session *se, size_t size)
+{
+	if (se->hugepages)
+		return fuse_buf_arena_alloc(size);
+	return malloc(size);
+}
+
+void fuse_session_buf_free(struct fuse_session *se, void *mem, size_t size)
+{
+	if (se->hugepages)
+		fuse_buf_arena_free(mem, size);
+	else
+		free(mem);
+}
+
 int fuse_session_receive_buf(struct fuse_session *se, struct fuse_buf *buf)
 {
 	return fuse_session_receive_buf_int(se, buf, NULL);
@@ -2887,6 +3588,33 @@ restart:
 	return res;
 }
 
+/*
+ * Largest number of pages per request the kernel will accept.  Older
+ * kernels have a fixed limit, newer ones make it configurable.
+ */
+static unsigned fuse_max_pages_limit(void)
+{
+	unsigned max = FUSE_DEFAULT_MAX_PAGES_LIMIT;
+	int res;
+	int maxfd;
+	char buf[32];
+
+	maxfd = open("/proc/sys/fs/fuse/max_pages_limit", O_RDONLY);
+	if (maxfd < 0)
+		return max;
+
+	res = read(maxfd, buf, sizeof(buf) - 1);
+	close(maxfd);
+	if (res > 0) {
+		buf[res] = '\0';
+		if (atoi(buf) > 0)
+			max = atoi(buf);
+	}
+	if (max > FUSE_MAX_MAX_PAGES)
+		max = FUSE_MAX_MAX_PAGES;
+	return max;
+}
+
 struct fuse_session *fuse_session_new(struct fuse_args *args,
 				      const struct fuse_lowlevel_ops *op,
 				      size_t op_size, void *userdata)
@@ -2913,6 +3641,7 @@ struct fuse_session *fuse_session_new(struct fuse_args *args,
 	se->fd = -1;
 	se->conn.max_write = UINT_MAX;
 	se->conn.max_readahead = UINT_MAX;
+	se->notify_queue_max = 65536;
 
 	/* Parse options */
 	if(fuse_opt_parse(args, se, fuse_ll_opts, NULL) == -1)
@@ -2947,7 +3676,11 @@ struct fuse_session *fuse_session_new(struct fuse_args *args,
 	if (se->debug)
 		fuse_log(FUSE_LOG_DEBUG, "FUSE library version: %s\n", PACKAGE_VERSION);
 
-	se->bufsize = FUSE_MAX_MAX_PAGES * getpagesize() +
+	/*
+	 * This is only an upper bound, it is reduced to the negotiated
+	 * max_write on INIT.  Buffers are allocated on first use.
+	 */
+	se->bufsize = fuse_max_pages_limit() * getpagesize() +
 		FUSE_BUFFER_HEADER_SIZE;
 
 	list_init_req(&se->list);
@@ -2955,6 +3688,11 @@ struct fuse_session *fuse_session_new(struct fuse_args *args,
 	list_init_nreq(&se->notify_list);
 	se->notify_ctr = 1;
 	fuse_mutex_init(&se->lock);
+	fuse_mutex_init(&se->groups_lock);
+	fuse_mutex_init(&se->notify_lock);
+	pthread_cond_init(&se->notify_work, NULL);
+	pthread_cond_init(&se->notify_space, NULL);
+	se->notify_tail = &se->notify_head;
 
 	err = pthread_key_create(&se->pipe_key, fuse_ll_pipe_destructor);
 	if (err) {
@@ -2962,15 +3700,28 @@ struct fuse_session *fuse_session_new(struct fuse_args *args,
 			strerror(err));
 		goto out5;
 	}
+	err = pthread_key_create(&se->arena_key, fuse_req_arena_destructor);
+	if (err) {
+		fuse_log(FUSE_LOG_ERR, "fuse: failed to create thread specific key: %s\n",
+			strerror(err));
+		pthread_key_delete(se->pipe_key);
+		goto out5;
+	}
 
 	memcpy(&se->op, op, op_size);
 	se->owner = getuid();
 	se->userdata = userdata;
 
 	se->mo = mo;
+	if (se->hugepages)
+		fuse_buf_arena_get();
 	return se;
 
 out5:
+	pthread_cond_destroy(&se->notify_space);
+	pthread_cond_destroy(&se->notify_work);
+	pthread_mutex_destroy(&se->notify_lock);
+	pthread_mutex_destroy(&se->groups_lock);
 	pthread_mutex_destroy(&se->lock);
 out4:
 	fuse_opt_free_args(args);
@@ -3047,40 +3798,124 @@ void fuse_session_unmount(struct fuse_session *se)
 }
 
 #ifdef linux
-int fuse_req_getgroups(fuse_req_t req, int size, gid_t list[])
+/*
+ * With -o groups_timeout, group lists read from /proc are cached for
+ * that many seconds, keyed by the pid and the credentials of the
+ * request.  Nothing else identifies the process, so a recycled pid
+ * with the same uid and gid is served the cached list until it
+ * expires.  All entries live equally long, so the list from oldest
+ * to newest is also the order of expiry.
+ */
+#define FUSE_GROUPS_MAX 256
+
+static double fuse_groups_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static struct fuse_groups **fuse_groups_bucket(struct fuse_session *se,
+					       pid_t pid, uid_t uid, gid_t gid)
+{
+	size_t hash = ((uint32_t) pid * 2654435761U) ^ uid ^ (gid << 16);
+
+	return &se->groups_hash[hash % FUSE_GROUPS_HASH_SIZE];
+}
+
+static struct fuse_groups *fuse_groups_find(struct fuse_session *se,
+					    const struct fuse_ctx *ctx)
+{
+	struct fuse_groups *g;
+
+	g = *fuse_groups_bucket(se, ctx->pid, ctx->uid, ctx->gid);
+	for (; g != NULL; g = g->hash_next) {
+		if (g->pid == ctx->pid && g->uid == ctx->uid &&
+		    g->gid == ctx->gid)
+			return g;
+	}
+	return NULL;
+}
+
+/* Drop expired entries, and the oldest ones if the cache is full */
+static void fuse_groups_prune(struct fuse_session *se, double now)
+{
+	while (se->groups_oldest != NULL &&
+	       (se->groups_oldest->expires <= now ||
+		se->groups_count >= FUSE_GROUPS_MAX)) {
+		struct fuse_groups *g = se->groups_oldest;
+		struct fuse_groups **gp;
+
+		gp = fuse_groups_bucket(se, g->pid, g->uid, g->gid);
+		while (*gp != g)
+			gp = &(*gp)->hash_next;
+		*gp = g->hash_next;
+		se->groups_oldest = g->newer;
+		if (se->groups_oldest == NULL)
+			se->groups_newest = NULL;
+		se->groups_count--;
+		if (--g->ref == 0)
+			free(g);
+	}
+}
+
+static int fuse_groups_parse(const char *s, gid_t *list)
 {
-	char *buf;
-	size_t bufsize = 1024;
+	int count = 0;
+
+	while (1) {
+		char *end;
+		unsigned long val = strtoul(s, &end, 0);
+		if (end == s)
+			break;
+
+		s = end;
+		if (list)
+			list[count] = val;
+		count++;
+	}
+	return count;
+}
+
+static int fuse_groups_read(pid_t pid, struct fuse_groups **gp)
+{
+	char stackbuf[4096];
+	char *buf = stackbuf;
+	size_t bufsize = sizeof(stackbuf);
 	char path[128];
+	struct fuse_groups *g;
+	int count;
 	int ret;
 	int fd;
-	unsigned long pid = req->ctx.pid;
 	char *s;
 
-	sprintf(path, "/proc/%lu/task/%lu/status", pid, pid);
+	sprintf(path, "/proc/%lu/task/%lu/status", (unsigned long) pid,
+		(unsigned long) pid);
 
 retry:
-	buf = malloc(bufsize);
-	if (buf == NULL)
-		return -ENOMEM;
-
 	ret = -EIO;
 	fd = open(path, O_RDONLY);
 	if (fd == -1)
 		goto out_free;
 
-	ret = read(fd, buf, bufsize);
+	ret = read(fd, buf, bufsize - 1);
 	close(fd);
 	if (ret < 0) {
 		ret = -EIO;
 		goto out_free;
 	}
 
-	if ((size_t)ret == bufsize) {
-		free(buf);
+	if ((size_t)ret == bufsize - 1) {
+		if (buf != stackbuf)
+			free(buf);
 		bufsize *= 4;
+		buf = malloc(bufsize);
+		if (buf == NULL)
+			return -ENOMEM;
 		goto retry;
 	}
+	buf[ret] = '\0';
 
 	ret = -EIO;
 	s = strstr(buf, "\nGroups:");
@@ -3088,23 +3923,109 @@ retry:
 		goto out_free;
 
 	s += 8;
-	ret = 0;
-	while (1) {
-		char *end;
-		unsigned long val = strtoul(s, &end, 0);
-		if (end == s)
-			break;
-
-		s = end;
-		if (ret < size)
-			list[ret] = val;
-		ret++;
+	count = fuse_groups_parse(s, NULL);
+	g = malloc(sizeof(*g) + count * sizeof(gid_t));
+	if (g == NULL) {
+		ret = -ENOMEM;
+		goto out_free;
 	}
+	g->count = fuse_groups_parse(s, g->list);
+	*gp = g;
+	ret = 0;
 
 out_free:
-	free(buf);
+	if (buf != stackbuf)
+		free(buf);
 	return ret;
 }
+
+static int fuse_req_get_groups(fuse_req_t req)
+{
+	struct fuse_session *se = req->se;
+	struct fuse_groups *g, *old;
+	double now = 0;
+	int err;
+
+	if (req->groups)
+		return 0;
+
+	if (se->groups_timeout > 0) {
+		now = fuse_groups_now();
+		pthread_mutex_lock(&se->groups_lock);
+		fuse_groups_prune(se, now);
+		g = fuse_groups_find(se, &req->ctx);
+		if (g != NULL)
+			g->ref++;
+		pthread_mutex_unlock(&se->groups_lock);
+		if (g != NULL) {
+			req->groups = g;
+			return 0;
+		}
+	}
+
+	err = fuse_groups_read(req->ctx.pid, &g);
+	if (err)
+		return err;
+
+	g->pid = req->ctx.pid;
+	g->uid = req->ctx.uid;
+	g->gid = req->ctx.gid;
+	g->ref = 1;
+	g->hash_next = NULL;
+	g->newer = NULL;
+	if (se->groups_timeout > 0) {
+		pthread_mutex_lock(&se->groups_lock);
+		fuse_groups_prune(se, now);
+		old = fuse_groups_find(se, &req->ctx);
+		if (old != NULL) {
+			/* Raced with another request of the same process */
+			old->ref++;
+			free(g);
+			g = old;
+		} else {
+			struct fuse_groups **gp;
+
+			gp = fuse_groups_bucket(se, g->pid, g->uid, g->gid);
+			g->hash_next = *gp;
+			*gp = g;
+			g->expires = now + se->groups_timeout;
+			if (se->groups_newest)
+				se->groups_newest->newer = g;
+			else
+				se->groups_oldest = g;
+			se->groups_newest = g;
+			se->groups_count++;
+			g->ref++;
+		}
+		pthread_mutex_unlock(&se->groups_lock);
+	}
+	req->groups = g;
+
+	return 0;
+}
+
+int fuse_req_getgroups(fuse_req_t req, int size, gid_t list[])
+{
+	int count;
+	int err;
+
+	err = fuse_req_get_groups(req);
+	if (err)
+		return err;
+
+	count = req->groups->count;
+	if (size > count)
+		size = count;
+	if (size > 0)
+		memcpy(list, req->groups->list, size * sizeof(gid_t));
+
+	return count;
+}
+
+int fuse_req_prefetch_groups(fuse_req_t req)
+{
+	return fuse_req_get_groups(req);
+}
 #else /* linux */
 /*
  * This is currently not implemented on other than Linux...
@@ -3114,6 +4035,12 @@ int fuse_req_getgroups(fuse_req_t req, int size, gid_t list[])
 	(void) req; (void) size; (void) list;
 	return -ENOSYS;
 }
+
+int fuse_req_prefetch_groups(fuse_req_t req)
+{
+	(void) req;
+	return -ENOSYS;
+}
 #endif
 
 void fuse_session_exit(struct fuse_session *se)
@@ -0,0 +1,310 @@
+/*
+  FUSE: Filesystem in Userspace
+  Copyright (C) 2026  agent <agent@local>
+
+  Prewarming of the kernel page cache with store notifications.
+
+  This program can be distributed under the terms of the GNU LGPLv2.
+  See the file COPYING.LIB
+*/
+
+#define _GNU_SOURCE
+
+#include "config.h"
+#include "fuse_i.h"
+#include "fuse_lowlevel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define PREWARM_DEFAULT_THREADS 4
+#define PREWARM_DEFAULT_MEMORY (4 * 1024 * 1024)
+#define PREWARM_MAX_CHUNK (1024 * 1024)
+
+/*
+ * A queued range.  Workers take it apart in chunks from the front, so
+ * a large file is stored by several threads at once; the last one to
+ * finish closes the file descriptor.
+ */
+struct prewarm_range {
+	struct prewarm_range *next;
+	fuse_ino_t ino;
+	int fd;
+	int ref;
+	off_t off;
+	size_t len;
+};
+
+struct fuse_prewarm {
+	struct fuse_session *se;
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t idle;
+	struct prewarm_range *head;
+	struct prewarm_range **tail;
+	unsigned int busy;
+	int exiting;
+	size_t chunk;
+	unsigned int max_threads;
+	unsigned int nthreads;
+	pthread_t *threads;
+	struct fuse_prewarm_stats stats;
+};
+
+static void prewarm_put(struct prewarm_range *r)
+{
+	if (--r->ref == 0) {
+		close(r->fd);
+		free(r);
+	}
+}
+
+/* Called with the lock held, the queue's reference is passed on */
+static void prewarm_unlink(struct fuse_prewarm *pw, struct prewarm_range *r)
+{
+	struct prewarm_range **rp;
+
+	for (rp = &pw->head; *rp != r; rp = &(*rp)->next);
+	*rp = r->next;
+	if (!pw->head)
+		pw->tail = &pw->head;
+}
+
+static void *prewarm_worker(void *data)
+{
+	struct fuse_prewarm *pw = (struct fuse_prewarm *) data;
+
+	pthread_mutex_lock(&pw->lock);
+	while (!pw->exiting) {
+		struct prewarm_range *r = pw->head;
+		struct fuse_bufvec bufv = FUSE_BUFVEC_INIT(0);
+		off_t off;
+		size_t len;
+		int res;
+
+		if (!r) {
+			pthread_cond_wait(&pw->work, &pw->lock);
+			continue;
+		}
+
+		off = r->off;
+		len = r->len < pw->chunk ? r->len : pw->chunk;
+		r->off += len;
+		r->len -= len;
+		if (r->len)
+			r->ref++;
+		else
+			prewarm_unlink(pw, r);
+		pw->busy++;
+		pthread_mutex_unlock(&pw->lock);
+
+		bufv.buf[0].size = len;
+		bufv.buf[0].flags = FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK;
+		bufv.buf[0].fd = r->fd;
+		bufv.buf[0].pos = off;
+		res = fuse_lowlevel_notify_store(pw->se, r->ino, off, &bufv, 0);
+
+		pthread_mutex_lock(&pw->lock);
+		if (res) {
+			pw->stats.failed++;
+			/* Later chunks would fail the same way */
+			if (r->len) {
+				r->len = 0;
+				prewarm_unlink(pw, r);
+				r->ref--;
+			}
+		} else {
+			pw->stats.bytes += len;
+			pw->stats.stores++;
+		}
+		prewarm_put(r);
+		pw->busy--;
+		if (!pw->head && !pw->busy)
+			pthread_cond_broadcast(&pw->idle);
+	}
+	pthread_mutex_unlock(&pw->lock);
+
+	return NULL;
+}
+
+struct fuse_prewarm *fuse_prewarm_new(struct fuse_session *se,
+				      unsigned int threads,
+				      size_t max_memory)
+{
+	struct fuse_prewarm *pw;
+
+	if (!threads)
+		threads = PREWARM_DEFAULT_THREADS;
+	if (!max_memory)
+		max_memory = PREWARM_DEFAULT_MEMORY;
+
+	pw = calloc(1, sizeof(*pw));
+	if (!pw)
+		return NULL;
+	pw->threads = calloc(threads, sizeof(pthread_t));
+	if (!pw->threads) {
+		free(pw);
+		return NULL;
+	}
+	pw->se = se;
+	pw->max_threads = threads;
+	pw->chunk = max_memory / threads;
+	if (pw->chunk > PREWARM_MAX_CHUNK)
+		pw->chunk = PREWARM_MAX_CHUNK;
+	if (pw->chunk < (size_t) getpagesize())
+		pw->chunk = getpagesize();
+	pw->tail = &pw->head;
+	pthread_mutex_init(&pw->lock, NULL);
+	pthread_cond_init(&pw->work, NULL);
+	pthread_cond_init(&pw->idle, NULL);
+
+	return pw;
+}
+
+int fuse_prewarm_fd(struct fuse_prewarm *pw, fuse_ino_t ino, int fd,
+		    off_t off, size_t len)
+{
+	struct prewarm_range *r;
+	struct stat stbuf;
+
+	if (fstat(fd, &stbuf) == -1)
+		return -errno;
+	if (off >= stbuf.st_size)
+		return 0;
+	if (!len || len > (size_t) (stbuf.st_size - off))
+		len = stbuf.st_size - off;
+
+	r = malloc(sizeof(*r));
+	if (!r)
+		return -ENOMEM;
+	r->fd = dup(fd);
+	if (r->fd == -1) {
+		free(r);
+		return -errno;
+	}
+	r->next = NULL;
+	r->ino = ino;
+	r->ref = 1;
+	r->off = off;
+	r->len = len;
+
+	pthread_mutex_lock(&pw->lock);
+	/* Not started by fuse_prewarm_new(), which may be called before
+	   fuse_daemonize() */
+	while (pw->nthreads < pw->max_threads) {
+		if (fuse_start_thread(&pw->threads[pw->nthreads],
+				      prewarm_worker, pw) == -1)
+			break;
+		pw->nthreads++;
+	}
+	if (!pw->nthreads) {
+		pthread_mutex_unlock(&pw->lock);
+		close(r->fd);
+		free(r);
+		return -ENOMEM;
+	}
+	*pw->tail = r;
+	pw->tail = &r->next;
+	pthread_cond_broadcast(&pw->work);
+	pthread_mutex_unlock(&pw->lock);
+
+	return 0;
+}
+
+int fuse_prewarm_hints(struct fuse_prewarm *pw, const char *hintfile,
+		       fuse_prewarm_resolve_t resolve, void *data)
+{
+	FILE *fp;
+	char *line = NULL;
+	size_t linesize = 0;
+	int count = 0;
+
+	fp = fopen(hintfile, "r");
+	if (!fp)
+		return -errno;
+
+	while (getline(&line, &linesize, fp) != -1) {
+		char name[4096];
+		long long off = 0;
+		unsigned long long len = 0;
+		fuse_ino_t ino;
+		int fd;
+		int n;
+
+		n = sscanf(line, " %4095s %lld %llu", name, &off, &len);
+		if (n < 1 || name[0] == '#')
+			continue;
+		if (n == 2 || off < 0) {
+			fuse_log(FUSE_LOG_ERR, "fuse: %s: bad range for %s\n",
+				 hintfile, name);
+			continue;
+		}
+		if (resolve(data, name, &ino, &fd) != 0)
+			continue;
+		if (fuse_prewarm_fd(pw, ino, fd, off, len) == 0)
+			count++;
+		close(fd);
+	}
+	free(line);
+	fclose(fp);
+
+	return count;
+}
+
+int fuse_reply_open_prewarm(fuse_req_t req, const struct fuse_file_info *fi,
+			    struct fuse_prewarm *pw, fuse_ino_t ino, int fd,
+			    size_t len)
+{
+	int res;
+
+	res = fuse_reply_open(req, fi);
+	if (res == 0 && pw && fi->keep_cache)
+		fuse_prewarm_fd(pw, ino, fd, 0, len);
+
+	return res;
+}
+
+void fuse_prewarm_wait(struct fuse_prewarm *pw)
+{
+	pthread_mutex_lock(&pw->lock);
+	while ((pw->head || pw->busy) && !pw->exiting)
+		pthread_cond_wait(&pw->idle, &pw->lock);
+	pthread_mutex_unlock(&pw->lock);
+}
+
+void fuse_prewarm_get_stats(struct fuse_prewarm *pw,
+			    struct fuse_prewarm_stats *stats)
+{
+	pthread_mutex_lock(&pw->lock);
+	*stats = pw->stats;
+	pthread_mutex_unlock(&pw->lock);
+}
+
+void fuse_prewarm_destroy(struct fuse_prewarm *pw)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&pw->lock);
+	pw->exiting = 1;
+	pthread_cond_broadcast(&pw->work);
+	pthread_cond_broadcast(&pw->idle);
+	pthread_mutex_unlock(&pw->lock);
+	for (i = 0; i < pw->nthreads; i++)
+		pthread_join(pw->threads[i], NULL);
+
+	while (pw->head) {
+		struct prewarm_range *r = pw->head;
+
+		prewarm_unlink(pw, r);
+		prewarm_put(r);
+	}
+	pthread_cond_destroy(&pw->idle);
+	pthread_cond_destroy(&pw->work);
+	pthread_mutex_destroy(&pw->lock);
+	free(pw->threads);
+	free(pw);
+}
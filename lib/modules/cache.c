@@ -0,0 +1,1083 @@
+/*
+  fuse cache module: cache attributes, directories and symlinks
+  Copyright (C) 2026  agent <agent@local>
+
+  This program can be distributed under the terms of the GNU LGPLv2.
+  See the file COPYING.LIB
+*/
+
+#include <config.h>
+
+#include <fuse.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+
+#define DEFAULT_CACHE_TIMEOUT 20.0
+#define DEFAULT_NEGATIVE_TIMEOUT 5.0
+#define DEFAULT_MAX_SIZE 10000
+#define DEFAULT_CLEAN_INTERVAL 60.0
+
+struct cache_dirent {
+	char *name;
+	struct stat stat;
+	enum fuse_fill_dir_flags flags;
+};
+
+/*
+ * Everything cached about one path.  A field is valid until the
+ * corresponding *_valid time (on the monotonic clock) has passed, zero
+ * means it is not cached at all.
+ */
+struct cache_node {
+	struct cache_node *next;
+	char *path;
+	double stat_valid;
+	double dir_valid;
+	double link_valid;
+	int negative;
+	struct stat stat;
+	struct cache_dirent *dir;
+	size_t dir_count;
+	char *link;
+};
+
+struct cache_stats {
+	unsigned long long stat_hits;
+	unsigned long long negative_hits;
+	unsigned long long stat_misses;
+	unsigned long long dir_hits;
+	unsigned long long dir_misses;
+	unsigned long long link_hits;
+	unsigned long long link_misses;
+	unsigned long long invalidations;
+	unsigned long long evictions;
+};
+
+struct cache {
+	double stat_timeout;
+	double dir_timeout;
+	double link_timeout;
+	double negative_timeout;
+	double clean_interval;
+	unsigned max_size;
+	int show_stats;
+	pthread_mutex_t lock;
+	struct cache_node **table;
+	size_t table_size;
+	size_t count;
+	double last_clean;
+	/* Number of cached non-directories with more than one link */
+	size_t multilink;
+	/* Bumped on every invalidation, see cache_valid() */
+	uint64_t write_ctr;
+	struct cache_stats stats;
+	struct fuse_fs *next;
+};
+
+struct cache_dirbuf {
+	void *buf;
+	fuse_fill_dir_t filler;
+	struct cache_dirent *dir;
+	size_t count;
+	size_t size;
+	int uncacheable;
+};
+
+static struct cache *cache_get(void)
+{
+	return fuse_get_context()->private_data;
+}
+
+static double cache_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1000000000.0;
+}
+
+static size_t cache_hash(struct cache *c, const char *path)
+{
+	uint64_t hash = 0;
+
+	for (; *path; path++)
+		hash = hash * 31 + (unsigned char) *path;
+
+	return hash % c->table_size;
+}
+
+static void free_dir(struct cache_dirent *dir, size_t count)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++)
+		free(dir[i].name);
+	free(dir);
+}
+
+static int is_multilink(const struct cache_node *cn)
+{
+	return cn->stat_valid && !cn->negative &&
+		!S_ISDIR(cn->stat.st_mode) && cn->stat.st_nlink > 1;
+}
+
+static void free_cnode(struct cache *c, struct cache_node *cn)
+{
+	c->multilink -= is_multilink(cn);
+	free_dir(cn->dir, cn->dir_count);
+	free(cn->link);
+	free(cn->path);
+	free(cn);
+}
+
+static struct cache_node *cache_lookup(struct cache *c, const char *path)
+{
+	struct cache_node *cn;
+
+	for (cn = c->table[cache_hash(c, path)]; cn; cn = cn->next)
+		if (strcmp(cn->path, path) == 0)
+			return cn;
+
+	return NULL;
+}
+
+static void cache_clean(struct cache *c, double now)
+{
+	size_t i;
+
+	for (i = 0; i < c->table_size; i++) {
+		struct cache_node **cnp = &c->table[i];
+
+		while (*cnp) {
+			struct cache_node *cn = *cnp;
+
+			if (cn->stat_valid > now || cn->dir_valid > now ||
+			    cn->link_valid > now) {
+				cnp = &cn->next;
+				continue;
+			}
+			*cnp = cn->next;
+			free_cnode(c, cn);
+			c->count--;
+		}
+	}
+	c->last_clean = now;
+}
+
+static void cache_purge(struct cache *c)
+{
+	size_t i;
+
+	for (i = 0; i < c->table_size; i++) {
+		while (c->table[i]) {
+			struct cache_node *cn = c->table[i];
+
+			c->table[i] = cn->next;
+			free_cnode(c, cn);
+		}
+	}
+	c->stats.evictions += c->count;
+	c->count = 0;
+}
+
+static struct cache_node *cache_get_node(struct cache *c, const char *path,
+					 double now)
+{
+	struct cache_node *cn = cache_lookup(c, path);
+	size_t hash;
+
+	if (cn)
+		return cn;
+
+	if (now - c->last_clean > c->clean_interval || c->count >= c->max_size)
+		cache_clean(c, now);
+	if (c->count >= c->max_size)
+		cache_purge(c);
+
+	cn = calloc(1, sizeof(struct cache_node));
+	if (!cn)
+		return NULL;
+	cn->path = strdup(path);
+	if (!cn->path) {
+		free(cn);
+		return NULL;
+	}
+	hash = cache_hash(c, path);
+	cn->next = c->table[hash];
+	c->table[hash] = cn;
+	c->count++;
+
+	return cn;
+}
+
+static void cache_remove(struct cache *c, const char *path)
+{
+	struct cache_node **cnp = &c->table[cache_hash(c, path)];
+
+	for (; *cnp; cnp = &(*cnp)->next) {
+		struct cache_node *cn = *cnp;
+
+		if (strcmp(cn->path, path) == 0) {
+			*cnp = cn->next;
+			free_cnode(c, cn);
+			c->count--;
+			c->stats.invalidations++;
+			return;
+		}
+	}
+}
+
+/* Remove everything below @path, but not @path itself */
+static void cache_remove_children(struct cache *c, const char *path)
+{
+	size_t len = strlen(path);
+	size_t i;
+
+	if (len == 1)
+		len = 0;
+
+	for (i = 0; i < c->table_size; i++) {
+		struct cache_node **cnp = &c->table[i];
+
+		while (*cnp) {
+			struct cache_node *cn = *cnp;
+
+			if (strncmp(cn->path, path, len) != 0 ||
+			    cn->path[len] != '/' || !cn->path[len + 1]) {
+				cnp = &cn->next;
+				continue;
+			}
+			*cnp = cn->next;
+			free_cnode(c, cn);
+			c->count--;
+			c->stats.invalidations++;
+		}
+	}
+}
+
+static void cache_remove_parent(struct cache *c, const char *path)
+{
+	char *parent = strdup(path);
+	char *s;
+
+	if (!parent) {
+		cache_purge(c);
+		return;
+	}
+	s = strrchr(parent, '/');
+	if (s) {
+		if (s == parent)
+			s++;
+		*s = '\0';
+		cache_remove(c, parent);
+	}
+	free(parent);
+}
+
+/*
+ * Attributes are shared by all hard links of a file, but only cached by
+ * path.  If the file may have other links, drop the attributes of every
+ * cached path that could refer to it.
+ */
+static void cache_remove_links(struct cache *c, const char *path)
+{
+	struct cache_node *cn = cache_lookup(c, path);
+	ino_t ino = 0;
+	size_t i;
+
+	if (!c->multilink)
+		return;
+	if (cn && cn->stat_valid && !cn->negative) {
+		if (!is_multilink(cn))
+			return;
+		ino = cn->stat.st_ino;
+	}
+
+	for (i = 0; i < c->table_size; i++) {
+		for (cn = c->table[i]; cn; cn = cn->next) {
+			if (!is_multilink(cn) || (ino && cn->stat.st_ino != ino))
+				continue;
+			c->multilink--;
+			cn->stat_valid = 0;
+			c->stats.invalidations++;
+		}
+	}
+}
+
+/*
+ * Invalidation
+ *
+ * Operations that only change the object itself drop its entry,
+ * operations that add or remove names also drop the entry of the
+ * parent directory, since both its listing and its times change.
+ * Operations that change the attributes of a file also drop those
+ * cached for its other hard links.
+ * These run after the request was forwarded, when the private_data of
+ * the context already belongs to the next filesystem, so the cache is
+ * passed in explicitly.
+ */
+static void cache_invalidate(struct cache *c, const char *path)
+{
+	if (!path)
+		return;
+
+	pthread_mutex_lock(&c->lock);
+	c->write_ctr++;
+	cache_remove_links(c, path);
+	cache_remove(c, path);
+	pthread_mutex_unlock(&c->lock);
+}
+
+static void cache_invalidate_dir(struct cache *c, const char *path)
+{
+	pthread_mutex_lock(&c->lock);
+	c->write_ctr++;
+	cache_remove_links(c, path);
+	cache_remove(c, path);
+	cache_remove_parent(c, path);
+	pthread_mutex_unlock(&c->lock);
+}
+
+static void cache_invalidate_tree(struct cache *c, const char *path)
+{
+	pthread_mutex_lock(&c->lock);
+	c->write_ctr++;
+	cache_remove_links(c, path);
+	cache_remove(c, path);
+	cache_remove_children(c, path);
+	cache_remove_parent(c, path);
+	pthread_mutex_unlock(&c->lock);
+}
+
+/*
+ * Results of the next filesystem are only stored if no invalidation
+ * happened while the request was in flight, since they might already be
+ * stale otherwise.  Callers sample ->write_ctr before forwarding the
+ * request and check it again under the lock.
+ */
+static int cache_valid(struct cache *c, uint64_t ctr)
+{
+	return c->write_ctr == ctr;
+}
+
+static void cache_add_stat(struct cache *c, const char *path,
+			   const struct stat *stbuf, double now)
+{
+	struct cache_node *cn = cache_get_node(c, path, now);
+
+	if (cn) {
+		c->multilink -= is_multilink(cn);
+		cn->stat = *stbuf;
+		cn->negative = 0;
+		cn->stat_valid = now + c->stat_timeout;
+		c->multilink += is_multilink(cn);
+	}
+}
+
+/*
+ * There is deliberately no statx operation.  It would bypass the
+ * attribute cache, so the kernel is left to fall back to getattr,
+ * which is served from it.
+ */
+static int cache_getattr(const char *path, struct stat *stbuf,
+			 struct fuse_file_info *fi)
+{
+	struct cache *c = cache_get();
+	struct cache_node *cn;
+	uint64_t ctr;
+	double now;
+	int err;
+
+	if (!path)
+		return fuse_fs_getattr(c->next, path, stbuf, fi);
+
+	now = cache_now();
+	pthread_mutex_lock(&c->lock);
+	cn = cache_lookup(c, path);
+	if (cn && cn->stat_valid > now) {
+		if (cn->negative) {
+			c->stats.negative_hits++;
+			err = -ENOENT;
+		} else {
+			c->stats.stat_hits++;
+			*stbuf = cn->stat;
+			err = 0;
+		}
+		pthread_mutex_unlock(&c->lock);
+		return err;
+	}
+	c->stats.stat_misses++;
+	ctr = c->write_ctr;
+	pthread_mutex_unlock(&c->lock);
+
+	err = fuse_fs_getattr(c->next, path, stbuf, fi);
+	if (err && (err != -ENOENT || c->negative_timeout <= 0))
+		return err;
+
+	pthread_mutex_lock(&c->lock);
+	if (cache_valid(c, ctr)) {
+		if (!err) {
+			cache_add_stat(c, path, stbuf, now);
+		} else {
+			cn = cache_get_node(c, path, now);
+			if (cn) {
+				c->multilink -= is_multilink(cn);
+				cn->negative = 1;
+				cn->stat_valid = now + c->negative_timeout;
+			}
+		}
+	}
+	pthread_mutex_unlock(&c->lock);
+
+	return err;
+}
+
+static int cache_access(const char *path, int mask)
+{
+	struct cache *c = cache_get();
+	return fuse_fs_access(c->next, path, mask);
+}
+
+static int cache_readlink(const char *path, char *buf, size_t size)
+{
+	struct cache *c = cache_get();
+	struct cache_node *cn;
+	uint64_t ctr;
+	double now;
+	int err;
+
+	if (size == 0)
+		return -EINVAL;
+
+	now = cache_now();
+	pthread_mutex_lock(&c->lock);
+	cn = cache_lookup(c, path);
+	if (cn && cn->link_valid > now) {
+		c->stats.link_hits++;
+		strncpy(buf, cn->link, size - 1);
+		buf[size - 1] = '\0';
+		pthread_mutex_unlock(&c->lock);
+		return 0;
+	}
+	c->stats.link_misses++;
+	ctr = c->write_ctr;
+	pthread_mutex_unlock(&c->lock);
+
+	err = fuse_fs_readlink(c->next, path, buf, size);
+	/* Don't cache what may have been truncated */
+	if (err || strnlen(buf, size) >= size - 1)
+		return err;
+
+	pthread_mutex_lock(&c->lock);
+	if (cache_valid(c, ctr)) {
+		cn = cache_get_node(c, path, now);
+		if (cn) {
+			char *link = strdup(buf);
+
+			if (link) {
+				free(cn->link);
+				cn->link = link;
+				cn->link_valid = now + c->link_timeout;
+			}
+		}
+	}
+	pthread_mutex_unlock(&c->lock);
+
+	return 0;
+}
+
+static int cache_opendir(const char *path, struct fuse_file_info *fi)
+{
+	struct cache *c = cache_get();
+	return fuse_fs_opendir(c->next, path, fi);
+}
+
+static int cache_dirfill(void *buf, const char *name,
+			 const struct stat *stbuf, off_t off,
+			 enum fuse_fill_dir_flags flags)
+{
+	struct cache_dirbuf *cdb = buf;
+	struct cache_dirent *de;
+	int res;
+
+	res = cdb->filler(cdb->buf, name, stbuf, off, flags);
+	if (res || off || cdb->uncacheable) {
+		/* Offsets only refer to the listing of the next filesystem */
+		cdb->uncacheable = 1;
+		return res;
+	}
+
+	if (cdb->count == cdb->size) {
+		size_t newsize = cdb->size ? cdb->size * 2 : 32;
+
+		de = realloc(cdb->dir, newsize * sizeof(struct cache_dirent));
+		if (!de) {
+			cdb->uncacheable = 1;
+			return 0;
+		}
+		cdb->dir = de;
+		cdb->size = newsize;
+	}
+	de = &cdb->dir[cdb->count];
+	de->name = strdup(name);
+	if (!de->name) {
+		cdb->uncacheable = 1;
+		return 0;
+	}
+	memset(&de->stat, 0, sizeof(de->stat));
+	if (stbuf)
+		de->stat = *stbuf;
+	de->flags = flags;
+	cdb->count++;
+
+	return 0;
+}
+
+static void cache_add_dir(struct cache *c, const char *path,
+			  struct cache_dirbuf *cdb, double now)
+{
+	struct cache_node *cn;
+	size_t len = strlen(path);
+	size_t i;
+
+	/* Entries returned with full attributes also fill the stat cache */
+	for (i = 0; i < cdb->count; i++) {
+		struct cache_dirent *de = &cdb->dir[i];
+		char *child;
+
+		if (!(de->flags & FUSE_FILL_DIR_PLUS) ||
+		    strcmp(de->name, ".") == 0 || strcmp(de->name, "..") == 0)
+			continue;
+		child = malloc(len + strlen(de->name) + 2);
+		if (!child)
+			continue;
+		sprintf(child, "%s/%s", len == 1 ? "" : path, de->name);
+		cache_add_stat(c, child, &de->stat, now);
+		free(child);
+	}
+
+	cn = cache_get_node(c, path, now);
+	if (!cn)
+		return;
+	free_dir(cn->dir, cn->dir_count);
+	cn->dir = cdb->dir;
+	cn->dir_count = cdb->count;
+	cn->dir_valid = now + c->dir_timeout;
+	cdb->dir = NULL;
+	cdb->count = 0;
+}
+
+static int cache_replay_dir(struct cache *c, struct cache_node *cn, void *buf,
+			    fuse_fill_dir_t filler,
+			    enum fuse_readdir_flags flags)
+{
+	size_t i;
+
+	for (i = 0; i < cn->dir_count; i++) {
+		struct cache_dirent *de = &cn->dir[i];
+		enum fuse_fill_dir_flags fill_flags = 0;
+
+		if (flags & FUSE_READDIR_PLUS)
+			fill_flags = de->flags & FUSE_FILL_DIR_PLUS;
+		if (filler(buf, de->name, &de->stat, 0, fill_flags))
+			break;
+	}
+	c->stats.dir_hits++;
+
+	return 0;
+}
+
+static int cache_readdir(const char *path, void *buf,
+			 fuse_fill_dir_t filler, off_t offset,
+			 struct fuse_file_info *fi,
+			 enum fuse_readdir_flags flags)
+{
+	struct cache *c = cache_get();
+	struct cache_dirbuf cdb;
+	struct cache_node *cn;
+	uint64_t ctr;
+	double now;
+	int err;
+
+	if (!path || offset)
+		return fuse_fs_readdir(c->next, path, buf, filler, offset,
+				       fi, flags);
+
+	now = cache_now();
+	pthread_mutex_lock(&c->lock);
+	cn = cache_lookup(c, path);
+	if (cn && cn->dir_valid > now) {
+		err = cache_replay_dir(c, cn, buf, filler, flags);
+		pthread_mutex_unlock(&c->lock);
+		return err;
+	}
+	c->stats.dir_misses++;
+	ctr = c->write_ctr;
+	pthread_mutex_unlock(&c->lock);
+
+	memset(&cdb, 0, sizeof(cdb));
+	cdb.buf = buf;
+	cdb.filler = filler;
+	err = fuse_fs_readdir(c->next, path, &cdb, cache_dirfill, offset,
+			      fi, flags);
+	if (!err && !cdb.uncacheable) {
+		pthread_mutex_lock(&c->lock);
+		if (cache_valid(c, ctr))
+			cache_add_dir(c, path, &cdb, now);
+		pthread_mutex_unlock(&c->lock);
+	}
+	free_dir(cdb.dir, cdb.count);
+
+	return err;
+}
+
+static int cache_releasedir(const char *path, struct fuse_file_info *fi)
+{
+	struct cache *c = cache_get();
+	return fuse_fs_releasedir(c->next, path, fi);
+}
+
+static int cache_mknod(const char *path, mode_t mode, dev_t rdev)
+{
+	struct cache *c = cache_get();
+	int err = fuse_fs_mknod(c->next, path, mode, rdev);
+	cache_invalidate_dir(c, path);
+	return err;
+}
+
+static int cache_mkdir(const char *path, mode_t mode)
+{
+	struct cache *c = cache_get();
+	int err = fuse_fs_mkdir(c->next, path, mode);
+	cache_invalidate_dir(c, path);
+	return err;
+}
+
+static int cache_unlink(const char *path)
+{
+	struct cache *c = cache_get();
+	int err = fuse_fs_unlink(c->next, path);
+	cache_invalidate_dir(c, path);
+	return err;
+}
+
+static int cache_rmdir(const char *path)
+{
+	struct cache *c = cache_get();
+	int err = fuse_fs_rmdir(c->next, path);
+	cache_invalidate_tree(c, path);
+	return err;
+}
+
+static int cache_symlink(const char *from, const char *path)
+{
+	struct cache *c = cache_get();
+	int err = fuse_fs_symlink(c->next, from, path);
+	cache_invalidate_dir(c, path);
+	return err;
+}
+
+static int cache_rename(const char *from, const char *to, unsigned int flags)
+{
+	struct cache *c = cache_get();
+	int err = fuse_fs_rename(c->next, from, to, flags);
+	cache_invalidate_tree(c, from);
+	cache_invalidate_tree(c, to);
+	return err;
+}
+
+static int cache_link(const char *from, const char *to)
+{
+	struct cache *c = cache_get();
+	int err = fuse_fs_link(c->next, from, to);
+	/* The link count of @from changes */
+	cache_invalidate(c, from);
+	cache_invalidate_dir(c, to);
+	return err;
+}
+
+static int cache_chmod(const char *path, mode_t mode,
+		       struct fuse_file_info *fi)
+{
+	struct cache *c = cache_get();
+	int err = fuse_fs_chmod(c->next, path, mode, fi);
+	cache_invalidate(c, path);
+	return err;
+}
+
+static int cache_chown(const char *path, uid_t uid, gid_t gid,
+		       struct fuse_file_info *fi)
+{
+	struct cache *c = cache_get();
+	int err = fuse_fs_chown(c->next, path, uid, gid, fi);
+	cache_invalidate(c, path);
+	return err;
+}
+
+static int cache_truncate(const char *path, off_t size,
+			  struct fuse_file_info *fi)
+{
+	struct cache *c = cache_get();
+	int err = fuse_fs_truncate(c->next, path, size, fi);
+	cache_invalidate(c, path);
+	return err;
+}
+
+static int cache_utimens(const char *path, const struct timespec ts[2],
+			 struct fuse_file_info *fi)
+{
+	struct cache *c = cache_get();
+	int err = fuse_fs_utimens(c->next, path, ts, fi);
+	cache_invalidate(c, path);
+	return err;
+}
+
+static int cache_create(const char *path, mode_t mode,
+			struct fuse_file_info *fi)
+{
+	struct cache *c = cache_get();
+	int err = fuse_fs_create(c->next, path, mode, fi);
+	cache_invalidate_dir(c, path);
+	return err;
+}
+
+static int cache_open(const char *path, struct fuse_file_info *fi)
+{
+	struct cache *c = cache_get();
+	int err = fuse_fs_open(c->next, path, fi);
+	if (fi->flags & O_TRUNC)
+		cache_invalidate(c, path);
+	return err;
+}
+
+static int cache_read_buf(const char *path, struct fuse_bufvec **bufp,
+			  size_t size, off_t offset, struct fuse_file_info *fi)
+{
+	struct cache *c = cache_get();
+	return fuse_fs_read_buf(c->next, path, bufp, size, offset, fi);
+}
+
+static int cache_write_buf(const char *path, struct fuse_bufvec *buf,
+			   off_t offset, struct fuse_file_info *fi)
+{
+	struct cache *c = cache_get();
+	int res = fuse_fs_write_buf(c->next, path, buf, offset, fi);
+	cache_invalidate(c, path);
+	return res;
+}
+
+static int cache_statfs(const char *path, struct statvfs *stbuf)
+{
+	struct cache *c = cache_get();
+	return fuse_fs_statfs(c->next, path, stbuf);
+}
+
+static int cache_flush(const char *path, struct fuse_file_info *fi)
+{
+	struct cache *c = cache_get();
+	return fuse_fs_flush(c->next, path, fi);
+}
+
+static int cache_release(const char *path, struct fuse_file_info *fi)
+{
+	struct cache *c = cache_get();
+	return fuse_fs_release(c->next, path, fi);
+}
+
+static int cache_fsync(const char *path, int isdatasync,
+		       struct fuse_file_info *fi)
+{
+	struct cache *c = cache_get();
+	return fuse_fs_fsync(c->next, path, isdatasync, fi);
+}
+
+static int cache_fsyncdir(const char *path, int isdatasync,
+			  struct fuse_file_info *fi)
+{
+	struct cache *c = cache_get();
+	return fuse_fs_fsyncdir(c->next, path, isdatasync, fi);
+}
+
+static int cache_setxattr(const char *path, const char *name,
+			  const char *value, size_t size, int flags)
+{
+	struct cache *c = cache_get();
+	int err = fuse_fs_setxattr(c->next, path, name, value, size, flags);
+	cache_invalidate(c, path);
+	return err;
+}
+
+static int cache_getxattr(const char *path, const char *name, char *value,
+			  size_t size)
+{
+	struct cache *c = cache_get();
+	return fuse_fs_getxattr(c->next, path, name, value, size);
+}
+
+static int cache_listxattr(const char *path, char *list, size_t size)
+{
+	struct cache *c = cache_get();
+	return fuse_fs_listxattr(c->next, path, list, size);
+}
+
+static int cache_removexattr(const char *path, const char *name)
+{
+	struct cache *c = cache_get();
+	int err = fuse_fs_removexattr(c->next, path, name);
+	cache_invalidate(c, path);
+	return err;
+}
+
+static int cache_lock(const char *path, struct fuse_file_info *fi, int cmd,
+		      struct flock *lock)
+{
+	struct cache *c = cache_get();
+	return fuse_fs_lock(c->next, path, fi, cmd, lock);
+}
+
+static int cache_flock(const char *path, struct fuse_file_info *fi, int op)
+{
+	struct cache *c = cache_get();
+	return fuse_fs_flock(c->next, path, fi, op);
+}
+
+static int cache_bmap(const char *path, size_t blocksize, uint64_t *idx)
+{
+	struct cache *c = cache_get();
+	return fuse_fs_bmap(c->next, path, blocksize, idx);
+}
+
+static int cache_fallocate(const char *path, int mode, off_t offset,
+			   off_t length, struct fuse_file_info *fi)
+{
+	struct cache *c = cache_get();
+	int err = fuse_fs_fallocate(c->next, path, mode, offset, length, fi);
+	cache_invalidate(c, path);
+	return err;
+}
+
+static ssize_t cache_copy_file_range(const char *path_in,
+				     struct fuse_file_info *fi_in,
+				     off_t off_in, const char *path_out,
+				     struct fuse_file_info *fi_out,
+				     off_t off_out, size_t len, int flags)
+{
+	struct cache *c = cache_get();
+	ssize_t res = fuse_fs_copy_file_range(c->next, path_in, fi_in, off_in,
+					      path_out, fi_out, off_out, len,
+					      flags);
+	cache_invalidate(c, path_out);
+	return res;
+}
+
+static off_t cache_lseek(const char *path, off_t off, int whence,
+			 struct fuse_file_info *fi)
+{
+	struct cache *c = cache_get();
+	return fuse_fs_lseek(c->next, path, off, whence, fi);
+}
+
+static void cache_print_ratio(const char *what, unsigned long long hits,
+			      unsigned long long misses)
+{
+	unsigned long long total = hits + misses;
+
+	fuse_log(FUSE_LOG_INFO, "fuse-cache: %-8s %llu hits, %llu misses (%.1f%% hit rate)\n",
+		 what, hits, misses, total ? 100.0 * hits / total : 0.0);
+}
+
+static void cache_print_stats(struct cache *c)
+{
+	struct cache_stats *s = &c->stats;
+
+	cache_print_ratio("getattr", s->stat_hits + s->negative_hits,
+			  s->stat_misses);
+	fuse_log(FUSE_LOG_INFO, "fuse-cache: %-8s %llu negative hits\n",
+		 "", s->negative_hits);
+	cache_print_ratio("readdir", s->dir_hits, s->dir_misses);
+	cache_print_ratio("readlink", s->link_hits, s->link_misses);
+	fuse_log(FUSE_LOG_INFO, "fuse-cache: %llu invalidations, %llu evictions, %llu entries\n",
+		 s->invalidations, s->evictions,
+		 (unsigned long long) c->count);
+}
+
+static void *cache_init(struct fuse_conn_info *conn,
+			struct fuse_config *cfg)
+{
+	struct cache *c = cache_get();
+	fuse_fs_init(c->next, conn, cfg);
+	/* Invalidation needs the path of every modified file */
+	cfg->nullpath_ok = 0;
+	return c;
+}
+
+static void cache_destroy(void *data)
+{
+	struct cache *c = data;
+	fuse_fs_destroy(c->next);
+	if (c->show_stats)
+		cache_print_stats(c);
+	cache_purge(c);
+	free(c->table);
+	pthread_mutex_destroy(&c->lock);
+	free(c);
+}
+
+static const struct fuse_operations cache_oper = {
+	.destroy	= cache_destroy,
+	.init		= cache_init,
+	.getattr	= cache_getattr,
+	.access		= cache_access,
+	.readlink	= cache_readlink,
+	.opendir	= cache_opendir,
+	.readdir	= cache_readdir,
+	.releasedir	= cache_releasedir,
+	.mknod		= cache_mknod,
+	.mkdir		= cache_mkdir,
+	.symlink	= cache_symlink,
+	.unlink		= cache_unlink,
+	.rmdir		= cache_rmdir,
+	.rename		= cache_rename,
+	.link		= cache_link,
+	.chmod		= cache_chmod,
+	.chown		= cache_chown,
+	.truncate	= cache_truncate,
+	.utimens	= cache_utimens,
+	.create		= cache_create,
+	.open		= cache_open,
+	.read_buf	= cache_read_buf,
+	.write_buf	= cache_write_buf,
+	.statfs		= cache_statfs,
+	.flush		= cache_flush,
+	.release	= cache_release,
+	.fsync		= cache_fsync,
+	.fsyncdir	= cache_fsyncdir,
+	.setxattr	= cache_setxattr,
+	.getxattr	= cache_getxattr,
+	.listxattr	= cache_listxattr,
+	.removexattr	= cache_removexattr,
+	.lock		= cache_lock,
+	.flock		= cache_flock,
+	.bmap		= cache_bmap,
+	.fallocate	= cache_fallocate,
+	.copy_file_range = cache_copy_file_range,
+	.lseek		= cache_lseek,
+};
+
+#define CACHE_OPT(t, p, v) { t, offsetof(struct cache, p), v }
+
+static const struct fuse_opt cache_opts[] = {
+	FUSE_OPT_KEY("-h", 0),
+	FUSE_OPT_KEY("--help", 0),
+	FUSE_OPT_KEY("cache_timeout=%lf", 1),
+	CACHE_OPT("cache_stat_timeout=%lf", stat_timeout, 0),
+	CACHE_OPT("cache_dir_timeout=%lf", dir_timeout, 0),
+	CACHE_OPT("cache_link_timeout=%lf", link_timeout, 0),
+	CACHE_OPT("cache_negative_timeout=%lf", negative_timeout, 0),
+	CACHE_OPT("cache_max_size=%u", max_size, 0),
+	CACHE_OPT("cache_clean_interval=%lf", clean_interval, 0),
+	CACHE_OPT("cache_stats", show_stats, 1),
+	FUSE_OPT_END
+};
+
+static void cache_help(void)
+{
+	printf(
+"    -o cache_timeout=T         cache timeout in seconds (20)\n"
+"    -o cache_stat_timeout=T    attribute cache timeout\n"
+"    -o cache_dir_timeout=T     directory listing cache timeout\n"
+"    -o cache_link_timeout=T    symlink cache timeout\n"
+"    -o cache_negative_timeout=T  cache timeout for nonexistent names (5)\n"
+"    -o cache_max_size=N        maximum number of cached paths (10000)\n"
+"    -o cache_clean_interval=T  interval between expiry sweeps (60)\n"
+"    -o cache_stats             log hit rates when unmounting\n");
+}
+
+static int cache_opt_proc(void *data, const char *arg, int key,
+			  struct fuse_args *outargs)
+{
+	struct cache *c = data;
+	(void) outargs;
+
+	if (!key) {
+		cache_help();
+		return -1;
+	}
+
+	if (key == 1) {
+		double timeout;
+
+		if (sscanf(arg, "cache_timeout=%lf", &timeout) != 1) {
+			fuse_log(FUSE_LOG_ERR, "fuse-cache: invalid option: %s\n", arg);
+			return -1;
+		}
+		c->stat_timeout = timeout;
+		c->dir_timeout = timeout;
+		c->link_timeout = timeout;
+		return 0;
+	}
+
+	return 1;
+}
+
+static struct fuse_fs *cache_new(struct fuse_args *args,
+				 struct fuse_fs *next[])
+{
+	struct fuse_fs *fs;
+	struct cache *c;
+
+	c = calloc(1, sizeof(struct cache));
+	if (c == NULL) {
+		fuse_log(FUSE_LOG_ERR, "fuse-cache: memory allocation failed\n");
+		return NULL;
+	}
+
+	c->stat_timeout = DEFAULT_CACHE_TIMEOUT;
+	c->dir_timeout = DEFAULT_CACHE_TIMEOUT;
+	c->link_timeout = DEFAULT_CACHE_TIMEOUT;
+	c->negative_timeout = DEFAULT_NEGATIVE_TIMEOUT;
+	c->clean_interval = DEFAULT_CLEAN_INTERVAL;
+	c->max_size = DEFAULT_MAX_SIZE;
+	if (fuse_opt_parse(args, c, cache_opts, cache_opt_proc) == -1)
+		goto out_free;
+
+	if (!next[0] || next[1]) {
+		fuse_log(FUSE_LOG_ERR, "fuse-cache: exactly one next filesystem required\n");
+		goto out_free;
+	}
+
+	if (!c->max_size) {
+		fuse_log(FUSE_LOG_ERR, "fuse-cache: cache_max_size must be positive\n");
+		goto out_free;
+	}
+
+	c->table_size = c->max_size / 2 + 1;
+	c->table = calloc(c->table_size, sizeof(struct cache_node *));
+	if (!c->table) {
+		fuse_log(FUSE_LOG_ERR, "fuse-cache: memory allocation failed\n");
+		goto out_free;
+	}
+	c->last_clean = cache_now();
+	pthread_mutex_init(&c->lock, NULL);
+	c->next = next[0];
+	fs = fuse_fs_new(&cache_oper, sizeof(cache_oper), c);
+	if (!fs)
+		goto out_free_lock;
+	return fs;
+
+out_free_lock:
+	pthread_mutex_destroy(&c->lock);
+out_free:
+	free(c->table);
+	free(c);
+	return NULL;
+}
+
+FUSE_REGISTER_MODULE(cache, cache_new);
@@ -0,0 +1,1002 @@
+/*
+  fuse coalesce module: merge small writes before passing them on
+  Copyright (C) 2026  agent <agent@local>
+
+  This program can be distributed under the terms of the GNU LGPLv2.
+  See the file COPYING.LIB
+*/
+
+#include <config.h>
+
+#include <fuse.h>
+#include "fuse_i.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#define DEFAULT_SIZE (1024 * 1024)
+#define DEFAULT_TIMEOUT 1.0
+#define MIN_ALLOC (64 * 1024)
+
+enum wc_reason {
+	WC_FULL,
+	WC_TIMER,
+	WC_SYNC,
+	WC_DISCONTIG,
+	WC_OTHER,
+	WC_NREASONS
+};
+
+/*
+ * Write buffer of an open file.  While the file is open, fi->fh points
+ * here so that writes find their buffer, and the handle of the next
+ * filesystem is kept in @fi.  Directories are never written to, so
+ * their handles are passed through as they are.
+ */
+struct wc_file {
+	/* File info as returned by the next filesystem */
+	struct fuse_file_info fi;
+	char *path;
+	struct wc_file *prev;
+	struct wc_file *next;
+
+	/* Data written but not yet passed on, covering [off, off + len) */
+	char *buf;
+	size_t cap;
+	off_t off;
+	size_t len;
+	double dirty_since;
+
+	/* Data taken out of the buffer and being written */
+	int flushing;
+	off_t flush_end;
+
+	/* Error of a write-out, reported by the next write, flush or fsync */
+	int err;
+	uid_t uid;
+	gid_t gid;
+	pid_t pid;
+};
+
+struct wc_stats {
+	unsigned long long writes;
+	unsigned long long bytes;
+	unsigned long long backend_writes;
+	unsigned long long backend_bytes;
+	unsigned long long direct;
+	unsigned long long read_hits;
+	unsigned long long flushes[WC_NREASONS];
+};
+
+struct coalesce {
+	unsigned size;
+	double timeout;
+	int show_stats;
+	struct fuse *fuse;
+	pthread_mutex_t lock;
+	pthread_cond_t done;
+	pthread_cond_t work;
+	struct wc_file files;
+	int exiting;
+	int timer_started;
+	pthread_t timer;
+	struct wc_stats stats;
+	struct fuse_fs *next;
+};
+
+static struct coalesce *coalesce_get(void)
+{
+	return fuse_get_context()->private_data;
+}
+
+static double wc_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1000000000.0;
+}
+
+static struct wc_file *wc_file(struct fuse_file_info *fi)
+{
+	return (struct wc_file *) (uintptr_t) fi->fh;
+}
+
+/*
+ * File info to forward to the next filesystem: a copy of @fi that
+ * carries the handle the next filesystem returned from open
+ */
+static struct fuse_file_info *wc_next(struct fuse_file_info *fi,
+				      struct fuse_file_info *nfi)
+{
+	if (!fi)
+		return NULL;
+	*nfi = *fi;
+	nfi->fh = wc_file(fi)->fi.fh;
+	return nfi;
+}
+
+static void wc_set_path(struct wc_file *wf, const char *path)
+{
+	if (path && (!wf->path || strcmp(wf->path, path) != 0)) {
+		char *tmp = strdup(path);
+
+		if (tmp) {
+			free(wf->path);
+			wf->path = tmp;
+		}
+	}
+}
+
+static int wc_take_err(struct wc_file *wf)
+{
+	int err = wf->err;
+
+	wf->err = 0;
+	return err;
+}
+
+/* Pass on a range of memory, looping over short writes */
+static int wc_write_out(struct coalesce *wc, const char *path,
+			struct fuse_file_info *fi, const char *data,
+			off_t off, size_t len)
+{
+	unsigned long long calls = 0;
+	int res = 0;
+
+	while (len) {
+		struct fuse_bufvec bufv = FUSE_BUFVEC_INIT(len);
+
+		bufv.buf[0].mem = (void *) data;
+		res = fuse_fs_write_buf(wc->next, path, &bufv, off, fi);
+		calls++;
+		if (res <= 0) {
+			if (res == 0)
+				res = -EIO;
+			break;
+		}
+		data += res;
+		off += res;
+		len -= res;
+		res = 0;
+	}
+
+	pthread_mutex_lock(&wc->lock);
+	wc->stats.backend_writes += calls;
+	pthread_mutex_unlock(&wc->lock);
+
+	return res;
+}
+
+/*
+ * Write out the buffer of @wf.  Called with wc->lock held, which is
+ * dropped while the data is written, so that new writes can fill a
+ * fresh buffer meanwhile.  Errors are kept in wf->err.
+ */
+static void wc_flush(struct coalesce *wc, struct wc_file *wf,
+		     enum wc_reason reason, int use_creds)
+{
+	struct fuse_file_info fi;
+	char *path = NULL;
+	char *buf;
+	size_t cap;
+	off_t off;
+	size_t len;
+	int err;
+
+	while (wf->flushing)
+		pthread_cond_wait(&wc->done, &wc->lock);
+	if (!wf->len)
+		return;
+
+	buf = wf->buf;
+	cap = wf->cap;
+	off = wf->off;
+	len = wf->len;
+	wf->buf = NULL;
+	wf->cap = 0;
+	wf->len = 0;
+	wf->flushing = 1;
+	wf->flush_end = off + len;
+	fi = wf->fi;
+	if (wf->path)
+		path = strdup(wf->path);
+	if (use_creds) {
+		struct fuse_context *ctx = fuse_thread_context(wc->fuse);
+
+		ctx->uid = wf->uid;
+		ctx->gid = wf->gid;
+		ctx->pid = wf->pid;
+	}
+	wc->stats.flushes[reason]++;
+	wc->stats.backend_bytes += len;
+	pthread_mutex_unlock(&wc->lock);
+
+	if (wf->path && !path)
+		err = -ENOMEM;
+	else
+		err = wc_write_out(wc, path, &fi, buf, off, len);
+	free(path);
+
+	pthread_mutex_lock(&wc->lock);
+	/* Keep the allocation for the next batch */
+	if (!wf->buf) {
+		wf->buf = buf;
+		wf->cap = cap;
+	} else {
+		free(buf);
+	}
+	if (err && !wf->err)
+		wf->err = err;
+	wf->flushing = 0;
+	pthread_cond_broadcast(&wc->done);
+}
+
+static int wc_match(struct wc_file *wf, const char *path,
+		    struct fuse_file_info *fi)
+{
+	if (fi && wc_file(fi) == wf)
+		return 1;
+	return path && wf->path && strcmp(wf->path, path) == 0;
+}
+
+static int wc_overlaps(struct wc_file *wf, off_t start, off_t end)
+{
+	if (wf->flushing)
+		return 1;
+	if (!wf->len)
+		return 0;
+	return end < 0 ||
+		(wf->off < end && start < wf->off + (off_t) wf->len);
+}
+
+/*
+ * Write out the buffers of every handle of @path (and of @fi) that
+ * overlap [start, end), or all of them if @end is negative.  Called
+ * with wc->lock held.
+ */
+static void wc_flush_range(struct coalesce *wc, const char *path,
+			   struct fuse_file_info *fi, off_t start, off_t end)
+{
+	struct wc_file *wf;
+
+	/* The list may change while the lock is dropped, so start over */
+	for (wf = wc->files.next; wf != &wc->files; wf = wf->next) {
+		if (wc_match(wf, path, fi) && wc_overlaps(wf, start, end)) {
+			wc_flush(wc, wf, WC_OTHER, 0);
+			wf = &wc->files;
+		}
+	}
+}
+
+static void wc_sync(struct coalesce *wc, const char *path,
+		    struct fuse_file_info *fi)
+{
+	pthread_mutex_lock(&wc->lock);
+	wc_flush_range(wc, path, fi, 0, -1);
+	pthread_mutex_unlock(&wc->lock);
+}
+
+static int wc_reserve(struct coalesce *wc, struct wc_file *wf, size_t need)
+{
+	size_t cap;
+	char *buf;
+
+	if (wf->cap >= need)
+		return 0;
+	cap = wf->cap ? wf->cap * 2 : MIN_ALLOC;
+	if (cap < need)
+		cap = need;
+	if (cap > wc->size)
+		cap = wc->size;
+	buf = realloc(wf->buf, cap);
+	if (!buf)
+		return -ENOMEM;
+	wf->buf = buf;
+	wf->cap = cap;
+	return 0;
+}
+
+static int coalesce_write_buf(const char *path, struct fuse_bufvec *buf,
+			      off_t offset, struct fuse_file_info *fi)
+{
+	struct coalesce *wc = coalesce_get();
+	struct wc_file *wf = wc_file(fi);
+	struct fuse_context *ctx = fuse_get_context();
+	size_t size = fuse_buf_size(buf);
+	struct fuse_bufvec dst;
+	struct fuse_file_info nfi;
+	ssize_t res;
+
+	pthread_mutex_lock(&wc->lock);
+	wc_set_path(wf, path);
+	wc->stats.writes++;
+	wc->stats.bytes += size;
+
+	if (size > wc->size) {
+		/* Nothing to gain, keep the order and pass it on */
+		wc_flush(wc, wf, WC_DISCONTIG, 0);
+		res = wc_take_err(wf);
+		wc->stats.direct++;
+		wc->stats.backend_writes++;
+		wc->stats.backend_bytes += size;
+		pthread_mutex_unlock(&wc->lock);
+		if (res)
+			return res;
+
+		return fuse_fs_write_buf(wc->next, path, buf, offset,
+					 wc_next(fi, &nfi));
+	}
+
+	/* Extend or overwrite the buffered range, or start a new one */
+	while (wf->len &&
+	       (offset < wf->off || offset > wf->off + (off_t) wf->len ||
+		offset + size - wf->off > wc->size))
+		wc_flush(wc, wf, WC_DISCONTIG, 0);
+
+	res = wc_take_err(wf);
+	if (res)
+		goto out;
+
+	if (!wf->len) {
+		wf->off = offset;
+		wf->dirty_since = wc_now();
+	}
+	res = wc_reserve(wc, wf, offset + size - wf->off);
+	if (res)
+		goto out;
+
+	dst = FUSE_BUFVEC_INIT(size);
+	dst.buf[0].mem = wf->buf + (offset - wf->off);
+	res = fuse_buf_copy(&dst, buf, 0);
+	if (res < 0)
+		goto out;
+	if ((size_t) res != size) {
+		res = -EIO;
+		goto out;
+	}
+	if (offset + size - wf->off > wf->len)
+		wf->len = offset + size - wf->off;
+	wf->uid = ctx->uid;
+	wf->gid = ctx->gid;
+	wf->pid = ctx->pid;
+
+	if (wf->len == wc->size)
+		wc_flush(wc, wf, WC_FULL, 0);
+	res = size;
+out:
+	pthread_mutex_unlock(&wc->lock);
+	return res;
+}
+
+static int wc_serve(struct coalesce *wc, struct wc_file *wf,
+		    struct fuse_bufvec **bufp, size_t size, off_t off)
+{
+	struct fuse_bufvec *bufv;
+	void *mem = NULL;
+
+	if (!wf->len || off < wf->off ||
+	    off + size > wf->off + (off_t) wf->len)
+		return 0;
+
+	bufv = malloc(sizeof(struct fuse_bufvec));
+	if (size)
+		mem = malloc(size);
+	if (!bufv || (size && !mem)) {
+		free(bufv);
+		free(mem);
+		return 0;
+	}
+	memcpy(mem, wf->buf + (off - wf->off), size);
+
+	*bufv = FUSE_BUFVEC_INIT(size);
+	bufv->buf[0].mem = mem;
+	*bufp = bufv;
+	wc->stats.read_hits++;
+
+	return 1;
+}
+
+static int coalesce_read_buf(const char *path, struct fuse_bufvec **bufp,
+			     size_t size, off_t offset,
+			     struct fuse_file_info *fi)
+{
+	struct coalesce *wc = coalesce_get();
+	struct wc_file *wf = wc_file(fi);
+	struct fuse_file_info nfi;
+
+	pthread_mutex_lock(&wc->lock);
+	if (wc_serve(wc, wf, bufp, size, offset)) {
+		pthread_mutex_unlock(&wc->lock);
+		return 0;
+	}
+	/* Anything buffered for this range must reach the file first */
+	wc_flush_range(wc, path, fi, offset, offset + size);
+	pthread_mutex_unlock(&wc->lock);
+
+	return fuse_fs_read_buf(wc->next, path, bufp, size, offset,
+				wc_next(fi, &nfi));
+}
+
+static void *wc_timer(void *data)
+{
+	struct coalesce *wc = data;
+	double interval = wc->timeout / 2;
+
+	if (interval < 0.01)
+		interval = 0.01;
+
+	pthread_mutex_lock(&wc->lock);
+	while (!wc->exiting) {
+		struct wc_file *wf;
+		struct timespec timeout;
+		struct timeval now;
+		double expire = wc_now() - wc->timeout;
+		long long nsec;
+
+		for (wf = wc->files.next; wf != &wc->files; wf = wf->next) {
+			if (wf->len && !wf->flushing &&
+			    wf->dirty_since <= expire) {
+				wc_flush(wc, wf, WC_TIMER, 1);
+				wf = &wc->files;
+			}
+		}
+
+		gettimeofday(&now, NULL);
+		nsec = now.tv_usec * 1000LL + (long long) (interval * 1e9);
+		timeout.tv_sec = now.tv_sec + nsec / 1000000000;
+		timeout.tv_nsec = nsec % 1000000000;
+		pthread_cond_timedwait(&wc->work, &wc->lock, &timeout);
+	}
+	pthread_mutex_unlock(&wc->lock);
+
+	return NULL;
+}
+
+static struct wc_file *wc_file_new(struct coalesce *wc, const char *path,
+				   struct fuse_file_info *fi)
+{
+	struct wc_file *wf = calloc(1, sizeof(struct wc_file));
+
+	if (!wf)
+		return NULL;
+	wf->path = strdup(path);
+	if (!wf->path) {
+		free(wf);
+		return NULL;
+	}
+	wf->fi = *fi;
+
+	pthread_mutex_lock(&wc->lock);
+	wf->next = wc->files.next;
+	wf->prev = &wc->files;
+	wf->next->prev = wf;
+	wc->files.next = wf;
+	pthread_mutex_unlock(&wc->lock);
+
+	fi->fh = (uintptr_t) wf;
+	return wf;
+}
+
+/* Write out what is left and unwrap the handle, returns a pending error */
+static int wc_file_free(struct coalesce *wc, struct fuse_file_info *fi)
+{
+	struct wc_file *wf = wc_file(fi);
+	int err;
+
+	pthread_mutex_lock(&wc->lock);
+	wc_flush(wc, wf, WC_SYNC, 0);
+	err = wc_take_err(wf);
+	wf->prev->next = wf->next;
+	wf->next->prev = wf->prev;
+	pthread_mutex_unlock(&wc->lock);
+
+	fi->fh = wf->fi.fh;
+	free(wf->buf);
+	free(wf->path);
+	free(wf);
+	return err;
+}
+
+/*
+ * There is deliberately no statx operation, so that the kernel falls
+ * back to getattr and every size it sees includes the pending data.
+ */
+static int coalesce_getattr(const char *path, struct stat *stbuf,
+			    struct fuse_file_info *fi)
+{
+	struct coalesce *wc = coalesce_get();
+	struct fuse_file_info nfi;
+	int err = fuse_fs_getattr(wc->next, path, stbuf, wc_next(fi, &nfi));
+
+	/* Account for data that has not reached the file yet */
+	if (!err && S_ISREG(stbuf->st_mode)) {
+		struct wc_file *wf;
+
+		pthread_mutex_lock(&wc->lock);
+		for (wf = wc->files.next; wf != &wc->files; wf = wf->next) {
+			if (!wc_match(wf, path, fi))
+				continue;
+			if (wf->len && wf->off + (off_t) wf->len > stbuf->st_size)
+				stbuf->st_size = wf->off + wf->len;
+			if (wf->flushing && wf->flush_end > stbuf->st_size)
+				stbuf->st_size = wf->flush_end;
+		}
+		pthread_mutex_unlock(&wc->lock);
+	}
+	return err;
+}
+
+static int coalesce_access(const char *path, int mask)
+{
+	struct coalesce *wc = coalesce_get();
+	return fuse_fs_access(wc->next, path, mask);
+}
+
+static int coalesce_readlink(const char *path, char *buf, size_t size)
+{
+	struct coalesce *wc = coalesce_get();
+	return fuse_fs_readlink(wc->next, path, buf, size);
+}
+
+static int coalesce_opendir(const char *path, struct fuse_file_info *fi)
+{
+	struct coalesce *wc = coalesce_get();
+	return fuse_fs_opendir(wc->next, path, fi);
+}
+
+static int coalesce_readdir(const char *path, void *buf,
+			    fuse_fill_dir_t filler, off_t offset,
+			    struct fuse_file_info *fi,
+			    enum fuse_readdir_flags flags)
+{
+	struct coalesce *wc = coalesce_get();
+	return fuse_fs_readdir(wc->next, path, buf, filler, offset, fi,
+			       flags);
+}
+
+static int coalesce_releasedir(const char *path, struct fuse_file_info *fi)
+{
+	struct coalesce *wc = coalesce_get();
+	return fuse_fs_releasedir(wc->next, path, fi);
+}
+
+static int coalesce_mknod(const char *path, mode_t mode, dev_t rdev)
+{
+	struct coalesce *wc = coalesce_get();
+	return fuse_fs_mknod(wc->next, path, mode, rdev);
+}
+
+static int coalesce_mkdir(const char *path, mode_t mode)
+{
+	struct coalesce *wc = coalesce_get();
+	return fuse_fs_mkdir(wc->next, path, mode);
+}
+
+static int coalesce_unlink(const char *path)
+{
+	struct coalesce *wc = coalesce_get();
+	return fuse_fs_unlink(wc->next, path);
+}
+
+static int coalesce_rmdir(const char *path)
+{
+	struct coalesce *wc = coalesce_get();
+	return fuse_fs_rmdir(wc->next, path);
+}
+
+static int coalesce_symlink(const char *from, const char *path)
+{
+	struct coalesce *wc = coalesce_get();
+	return fuse_fs_symlink(wc->next, from, path);
+}
+
+static int coalesce_rename(const char *from, const char *to,
+			   unsigned int flags)
+{
+	struct coalesce *wc = coalesce_get();
+
+	/* Buffered data is written by path, which is about to change */
+	wc_sync(wc, from, NULL);
+	wc_sync(wc, to, NULL);
+	return fuse_fs_rename(wc->next, from, to, flags);
+}
+
+static int coalesce_link(const char *from, const char *to)
+{
+	struct coalesce *wc = coalesce_get();
+	return fuse_fs_link(wc->next, from, to);
+}
+
+static int coalesce_chmod(const char *path, mode_t mode,
+			  struct fuse_file_info *fi)
+{
+	struct coalesce *wc = coalesce_get();
+	struct fuse_file_info nfi;
+
+	return fuse_fs_chmod(wc->next, path, mode, wc_next(fi, &nfi));
+}
+
+static int coalesce_chown(const char *path, uid_t uid, gid_t gid,
+			  struct fuse_file_info *fi)
+{
+	struct coalesce *wc = coalesce_get();
+	struct fuse_file_info nfi;
+
+	return fuse_fs_chown(wc->next, path, uid, gid, wc_next(fi, &nfi));
+}
+
+static int coalesce_truncate(const char *path, off_t size,
+			     struct fuse_file_info *fi)
+{
+	struct coalesce *wc = coalesce_get();
+	struct fuse_file_info nfi;
+
+	wc_sync(wc, path, fi);
+	return fuse_fs_truncate(wc->next, path, size, wc_next(fi, &nfi));
+}
+
+static int coalesce_utimens(const char *path, const struct timespec ts[2],
+			    struct fuse_file_info *fi)
+{
+	struct coalesce *wc = coalesce_get();
+	struct fuse_file_info nfi;
+
+	/* Otherwise a later write-out would update the times again */
+	wc_sync(wc, path, fi);
+	return fuse_fs_utimens(wc->next, path, ts, wc_next(fi, &nfi));
+}
+
+static int coalesce_create(const char *path, mode_t mode,
+			   struct fuse_file_info *fi)
+{
+	struct coalesce *wc = coalesce_get();
+	int err = fuse_fs_create(wc->next, path, mode, fi);
+	if (!err && !wc_file_new(wc, path, fi)) {
+		fuse_fs_release(wc->next, path, fi);
+		err = -ENOMEM;
+	}
+	return err;
+}
+
+static int coalesce_open(const char *path, struct fuse_file_info *fi)
+{
+	struct coalesce *wc = coalesce_get();
+	int err = fuse_fs_open(wc->next, path, fi);
+	if (!err && !wc_file_new(wc, path, fi)) {
+		fuse_fs_release(wc->next, path, fi);
+		err = -ENOMEM;
+	}
+	return err;
+}
+
+static int coalesce_statfs(const char *path, struct statvfs *stbuf)
+{
+	struct coalesce *wc = coalesce_get();
+	return fuse_fs_statfs(wc->next, path, stbuf);
+}
+
+static int coalesce_flush(const char *path, struct fuse_file_info *fi)
+{
+	struct coalesce *wc = coalesce_get();
+	struct wc_file *wf = wc_file(fi);
+	struct fuse_file_info nfi;
+	int werr;
+	int err;
+
+	pthread_mutex_lock(&wc->lock);
+	wc_flush(wc, wf, WC_SYNC, 0);
+	werr = wc_take_err(wf);
+	pthread_mutex_unlock(&wc->lock);
+
+	err = fuse_fs_flush(wc->next, path, wc_next(fi, &nfi));
+	/* The kernel stops sending flush requests after -ENOSYS */
+	if (err == -ENOSYS)
+		err = 0;
+	return werr ? werr : err;
+}
+
+static int coalesce_release(const char *path, struct fuse_file_info *fi)
+{
+	struct coalesce *wc = coalesce_get();
+	int werr = wc_file_free(wc, fi);
+	int err = fuse_fs_release(wc->next, path, fi);
+	return werr ? werr : err;
+}
+
+static int coalesce_fsync(const char *path, int isdatasync,
+			  struct fuse_file_info *fi)
+{
+	struct coalesce *wc = coalesce_get();
+	struct wc_file *wf = wc_file(fi);
+	struct fuse_file_info nfi;
+	int werr;
+	int err;
+
+	pthread_mutex_lock(&wc->lock);
+	wc_flush(wc, wf, WC_SYNC, 0);
+	werr = wc_take_err(wf);
+	pthread_mutex_unlock(&wc->lock);
+
+	err = fuse_fs_fsync(wc->next, path, isdatasync, wc_next(fi, &nfi));
+	if (err == -ENOSYS)
+		err = 0;
+	return werr ? werr : err;
+}
+
+static int coalesce_fsyncdir(const char *path, int isdatasync,
+			     struct fuse_file_info *fi)
+{
+	struct coalesce *wc = coalesce_get();
+	return fuse_fs_fsyncdir(wc->next, path, isdatasync, fi);
+}
+
+static int coalesce_setxattr(const char *path, const char *name,
+			     const char *value, size_t size, int flags)
+{
+	struct coalesce *wc = coalesce_get();
+	return fuse_fs_setxattr(wc->next, path, name, value, size, flags);
+}
+
+static int coalesce_getxattr(const char *path, const char *name,
+			     char *value, size_t size)
+{
+	struct coalesce *wc = coalesce_get();
+	return fuse_fs_getxattr(wc->next, path, name, value, size);
+}
+
+static int coalesce_listxattr(const char *path, char *list, size_t size)
+{
+	struct coalesce *wc = coalesce_get();
+	return fuse_fs_listxattr(wc->next, path, list, size);
+}
+
+static int coalesce_removexattr(const char *path, const char *name)
+{
+	struct coalesce *wc = coalesce_get();
+	return fuse_fs_removexattr(wc->next, path, name);
+}
+
+static int coalesce_lock(const char *path, struct fuse_file_info *fi,
+			 int cmd, struct flock *lock)
+{
+	struct coalesce *wc = coalesce_get();
+	struct fuse_file_info nfi;
+
+	return fuse_fs_lock(wc->next, path, wc_next(fi, &nfi), cmd, lock);
+}
+
+static int coalesce_flock(const char *path, struct fuse_file_info *fi,
+			  int op)
+{
+	struct coalesce *wc = coalesce_get();
+	struct fuse_file_info nfi;
+
+	return fuse_fs_flock(wc->next, path, wc_next(fi, &nfi), op);
+}
+
+static int coalesce_bmap(const char *path, size_t blocksize, uint64_t *idx)
+{
+	struct coalesce *wc = coalesce_get();
+
+	wc_sync(wc, path, NULL);
+	return fuse_fs_bmap(wc->next, path, blocksize, idx);
+}
+
+static int coalesce_fallocate(const char *path, int mode, off_t offset,
+			      off_t length, struct fuse_file_info *fi)
+{
+	struct coalesce *wc = coalesce_get();
+	struct fuse_file_info nfi;
+
+	wc_sync(wc, path, fi);
+	return fuse_fs_fallocate(wc->next, path, mode, offset, length,
+				 wc_next(fi, &nfi));
+}
+
+static ssize_t coalesce_copy_file_range(const char *path_in,
+					struct fuse_file_info *fi_in,
+					off_t off_in, const char *path_out,
+					struct fuse_file_info *fi_out,
+					off_t off_out, size_t len, int flags)
+{
+	struct coalesce *wc = coalesce_get();
+	struct fuse_file_info nfi_in;
+	struct fuse_file_info nfi_out;
+
+	wc_sync(wc, path_in, fi_in);
+	wc_sync(wc, path_out, fi_out);
+	return fuse_fs_copy_file_range(wc->next, path_in,
+				       wc_next(fi_in, &nfi_in), off_in,
+				       path_out, wc_next(fi_out, &nfi_out),
+				       off_out, len, flags);
+}
+
+static off_t coalesce_lseek(const char *path, off_t off, int whence,
+			    struct fuse_file_info *fi)
+{
+	struct coalesce *wc = coalesce_get();
+	struct fuse_file_info nfi;
+
+	/* SEEK_DATA and SEEK_HOLE need to see every write */
+	wc_sync(wc, path, fi);
+	return fuse_fs_lseek(wc->next, path, off, whence, wc_next(fi, &nfi));
+}
+
+static void coalesce_print_stats(struct coalesce *wc)
+{
+	struct wc_stats *s = &wc->stats;
+	unsigned long long saved = s->writes > s->backend_writes ?
+		s->writes - s->backend_writes : 0;
+
+	fuse_log(FUSE_LOG_INFO, "fuse-coalesce: %llu writes of %llu bytes passed on as %llu writes of %llu bytes (%llu calls and %llu bytes saved)\n",
+		 s->writes, s->bytes, s->backend_writes, s->backend_bytes,
+		 saved, s->bytes - s->backend_bytes);
+	fuse_log(FUSE_LOG_INFO, "fuse-coalesce: %llu buffers full, %llu timed out, %llu synced, %llu not contiguous, %llu flushed for other operations, %llu large writes, %llu reads from buffer\n",
+		 s->flushes[WC_FULL], s->flushes[WC_TIMER],
+		 s->flushes[WC_SYNC], s->flushes[WC_DISCONTIG],
+		 s->flushes[WC_OTHER], s->direct, s->read_hits);
+}
+
+static void *coalesce_init(struct fuse_conn_info *conn,
+			   struct fuse_config *cfg)
+{
+	struct coalesce *wc = coalesce_get();
+
+	wc->fuse = fuse_get_context()->fuse;
+	fuse_fs_init(wc->next, conn, cfg);
+	/* Don't touch cfg->nullpath_ok, we can work with
+	   either */
+
+	if (wc->timeout > 0 &&
+	    fuse_start_thread(&wc->timer, wc_timer, wc) == 0)
+		wc->timer_started = 1;
+	return wc;
+}
+
+static void coalesce_destroy(void *data)
+{
+	struct coalesce *wc = data;
+
+	pthread_mutex_lock(&wc->lock);
+	wc->exiting = 1;
+	pthread_cond_broadcast(&wc->work);
+	pthread_mutex_unlock(&wc->lock);
+	if (wc->timer_started)
+		pthread_join(wc->timer, NULL);
+
+	fuse_fs_destroy(wc->next);
+	if (wc->show_stats)
+		coalesce_print_stats(wc);
+	pthread_cond_destroy(&wc->work);
+	pthread_cond_destroy(&wc->done);
+	pthread_mutex_destroy(&wc->lock);
+	free(wc);
+}
+
+static const struct fuse_operations coalesce_oper = {
+	.destroy	= coalesce_destroy,
+	.init		= coalesce_init,
+	.getattr	= coalesce_getattr,
+	.access		= coalesce_access,
+	.readlink	= coalesce_readlink,
+	.opendir	= coalesce_opendir,
+	.readdir	= coalesce_readdir,
+	.releasedir	= coalesce_releasedir,
+	.mknod		= coalesce_mknod,
+	.mkdir		= coalesce_mkdir,
+	.symlink	= coalesce_symlink,
+	.unlink		= coalesce_unlink,
+	.rmdir		= coalesce_rmdir,
+	.rename		= coalesce_rename,
+	.link		= coalesce_link,
+	.chmod		= coalesce_chmod,
+	.chown		= coalesce_chown,
+	.truncate	= coalesce_truncate,
+	.utimens	= coalesce_utimens,
+	.create		= coalesce_create,
+	.open		= coalesce_open,
+	.read_buf	= coalesce_read_buf,
+	.write_buf	= coalesce_write_buf,
+	.statfs		= coalesce_statfs,
+	.flush		= coalesce_flush,
+	.release	= coalesce_release,
+	.fsync		= coalesce_fsync,
+	.fsyncdir	= coalesce_fsyncdir,
+	.setxattr	= coalesce_setxattr,
+	.getxattr	= coalesce_getxattr,
+	.listxattr	= coalesce_listxattr,
+	.removexattr	= coalesce_removexattr,
+	.lock		= coalesce_lock,
+	.flock		= coalesce_flock,
+	.bmap		= coalesce_bmap,
+	.fallocate	= coalesce_fallocate,
+	.copy_file_range = coalesce_copy_file_range,
+	.lseek		= coalesce_lseek,
+};
+
+#define COALESCE_OPT(t, p, v) { t, offsetof(struct coalesce, p), v }
+
+static const struct fuse_opt coalesce_opts[] = {
+	FUSE_OPT_KEY("-h", 0),
+	FUSE_OPT_KEY("--help", 0),
+	COALESCE_OPT("coalesce_size=%u", size, 0),
+	COALESCE_OPT("coalesce_timeout=%lf", timeout, 0),
+	COALESCE_OPT("coalesce_stats", show_stats, 1),
+	FUSE_OPT_END
+};
+
+static void coalesce_help(void)
+{
+	printf(
+"    -o coalesce_size=N         largest write passed on in bytes (1048576)\n"
+"    -o coalesce_timeout=T      seconds before buffered data is written (1.0)\n"
+"    -o coalesce_stats          log write statistics when unmounting\n");
+}
+
+static int coalesce_opt_proc(void *data, const char *arg, int key,
+			     struct fuse_args *outargs)
+{
+	(void) data; (void) arg; (void) outargs;
+
+	if (!key) {
+		coalesce_help();
+		return -1;
+	}
+
+	return 1;
+}
+
+static struct fuse_fs *coalesce_new(struct fuse_args *args,
+				    struct fuse_fs *next[])
+{
+	struct fuse_fs *fs;
+	struct coalesce *wc;
+
+	wc = calloc(1, sizeof(struct coalesce));
+	if (wc == NULL) {
+		fuse_log(FUSE_LOG_ERR, "fuse-coalesce: memory allocation failed\n");
+		return NULL;
+	}
+
+	wc->size = DEFAULT_SIZE;
+	wc->timeout = DEFAULT_TIMEOUT;
+	if (fuse_opt_parse(args, wc, coalesce_opts, coalesce_opt_proc) == -1)
+		goto out_free;
+
+	if (!next[0] || next[1]) {
+		fuse_log(FUSE_LOG_ERR, "fuse-coalesce: exactly one next filesystem required\n");
+		goto out_free;
+	}
+
+	if (!wc->size) {
+		fuse_log(FUSE_LOG_ERR, "fuse-coalesce: invalid buffer size\n");
+		goto out_free;
+	}
+
+	pthread_mutex_init(&wc->lock, NULL);
+	pthread_cond_init(&wc->done, NULL);
+	pthread_cond_init(&wc->work, NULL);
+	wc->files.next = wc->files.prev = &wc->files;
+	wc->next = next[0];
+	fs = fuse_fs_new(&coalesce_oper, sizeof(coalesce_oper), wc);
+	if (!fs)
+		goto out_destroy;
+	return fs;
+
+out_destroy:
+	pthread_cond_destroy(&wc->work);
+	pthread_cond_destroy(&wc->done);
+	pthread_mutex_destroy(&wc->lock);
+out_free:
+	free(wc);
+	return NULL;
+}
+
+FUSE_REGISTER_MODULE(coalesce, coalesce_new);
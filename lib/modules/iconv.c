@@ -12,6 +12,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 #include <errno.h>
 #include <iconv.h>
@@ -19,13 +20,40 @@
 #include <locale.h>
 #include <langinfo.h>
 
+#define NAME_CACHE_SIZE 64
+#define NAME_CACHE_MAX 255
+
+struct iconv_name {
+	char *name;
+	char *conv;
+};
+
+/*
+ * Conversion state of one thread: iconv descriptors keep state between
+ * calls, so each thread has its own, together with a small cache of
+ * recently converted names in either direction.
+ */
+struct iconv_thread {
+	iconv_t tofs;
+	iconv_t fromfs;
+	struct iconv_name cache[2][NAME_CACHE_SIZE];
+	char *scratch;
+	struct iconv *ic;
+	struct iconv_thread *prev;
+	struct iconv_thread *next;
+};
+
 struct iconv {
 	struct fuse_fs *next;
 	pthread_mutex_t lock;
 	char *from_code;
 	char *to_code;
-	iconv_t tofs;
-	iconv_t fromfs;
+	char *from;
+	char *to;
+	/* Both charsets leave ASCII alone */
+	int ascii;
+	pthread_key_t key;
+	struct iconv_thread threads;
 };
 
 struct iconv_dh {
@@ -39,10 +67,94 @@ static struct iconv *iconv_get(void)
 	return fuse_get_context()->private_data;
 }
 
-static int iconv_convpath(struct iconv *ic, const char *path, char **newpathp,
-			  int fromfs)
+static void iconv_thread_close(struct iconv_thread *t)
+{
+	int i;
+	int j;
+
+	for (i = 0; i < 2; i++) {
+		for (j = 0; j < NAME_CACHE_SIZE; j++) {
+			free(t->cache[i][j].name);
+			free(t->cache[i][j].conv);
+		}
+	}
+	free(t->scratch);
+	iconv_close(t->tofs);
+	iconv_close(t->fromfs);
+	free(t);
+}
+
+/* Destructor of the thread specific data */
+static void iconv_thread_free(void *data)
+{
+	struct iconv_thread *t = data;
+	struct iconv *ic = t->ic;
+
+	pthread_mutex_lock(&ic->lock);
+	t->prev->next = t->next;
+	t->next->prev = t->prev;
+	pthread_mutex_unlock(&ic->lock);
+	iconv_thread_close(t);
+}
+
+static struct iconv_thread *iconv_thread_get(struct iconv *ic)
+{
+	struct iconv_thread *t = pthread_getspecific(ic->key);
+
+	if (t)
+		return t;
+
+	t = calloc(1, sizeof(struct iconv_thread));
+	if (!t)
+		return NULL;
+	t->tofs = iconv_open(ic->from, ic->to);
+	if (t->tofs == (iconv_t) -1)
+		goto out_free;
+	t->fromfs = iconv_open(ic->to, ic->from);
+	if (t->fromfs == (iconv_t) -1)
+		goto out_close_to;
+	t->ic = ic;
+	if (pthread_setspecific(ic->key, t) != 0)
+		goto out_close_from;
+
+	pthread_mutex_lock(&ic->lock);
+	t->next = ic->threads.next;
+	t->prev = &ic->threads;
+	t->next->prev = t;
+	ic->threads.next = t;
+	pthread_mutex_unlock(&ic->lock);
+	return t;
+
+out_close_from:
+	iconv_close(t->fromfs);
+out_close_to:
+	iconv_close(t->tofs);
+out_free:
+	free(t);
+	return NULL;
+}
+
+/* Check a word at a time for bytes with the high bit set */
+static int iconv_is_ascii(const char *s, size_t len)
+{
+	uint64_t acc = 0;
+	size_t i;
+
+	for (i = 0; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+		uint64_t w;
+
+		memcpy(&w, s + i, sizeof(w));
+		acc |= w;
+	}
+	for (; i < len; i++)
+		acc |= (unsigned char) s[i];
+
+	return !(acc & 0x8080808080808080ULL);
+}
+
+static int iconv_convert(iconv_t cd, const char *path, size_t pathlen,
+			 char **newpathp)
 {
-	size_t pathlen;
 	size_t newpathlen;
 	char *newpath;
 	size_t plen;
@@ -50,12 +162,6 @@ static int iconv_convpath(struct iconv *ic, const char *path, char **newpathp,
 	size_t res;
 	int err;
 
-	if (path == NULL) {
-		*newpathp = NULL;
-		return 0;
-	}
-
-	pathlen = strlen(path);
 	newpathlen = pathlen * 4;
 	newpath = malloc(newpathlen + 1);
 	if (!newpath)
@@ -63,11 +169,10 @@ static int iconv_convpath(struct iconv *ic, const char *path, char **newpathp,
 
 	plen = newpathlen;
 	p = newpath;
-	pthread_mutex_lock(&ic->lock);
 	do {
-		res = iconv(fromfs ? ic->fromfs : ic->tofs, (char **) &path,
-			    &pathlen, &p, &plen);
+		res = iconv(cd, (char **) &path, &pathlen, &p, &plen);
 		if (res == (size_t) -1) {
+			size_t done = p - newpath;
 			char *tmp;
 			size_t inc;
 
@@ -82,23 +187,105 @@ static int iconv_convpath(struct iconv *ic, const char *path, char **newpathp,
 			if (!tmp)
 				goto err;
 
-			p = tmp + (p - newpath);
+			p = tmp + done;
 			plen += inc;
 			newpath = tmp;
 		}
 	} while (res == (size_t) -1);
-	pthread_mutex_unlock(&ic->lock);
 	*p = '\0';
 	*newpathp = newpath;
 	return 0;
 
 err:
-	iconv(fromfs ? ic->fromfs : ic->tofs, NULL, NULL, NULL, NULL);
-	pthread_mutex_unlock(&ic->lock);
+	iconv(cd, NULL, NULL, NULL, NULL);
 	free(newpath);
 	return err;
 }
 
+/*
+ * Convert a name without allocating for the caller.  The result is
+ * either @name itself, or owned by the calling thread and valid until
+ * its next conversion.
+ */
+static int iconv_convname(struct iconv *ic, const char *name,
+			  const char **newnamep, int fromfs)
+{
+	struct iconv_thread *t;
+	struct iconv_name *ent;
+	uint32_t hash = 2166136261U;
+	size_t len;
+	char *conv;
+	int err;
+
+	if (name == NULL) {
+		*newnamep = NULL;
+		return 0;
+	}
+
+	len = strlen(name);
+	if (ic->ascii && iconv_is_ascii(name, len)) {
+		*newnamep = name;
+		return 0;
+	}
+
+	t = iconv_thread_get(ic);
+	if (!t)
+		return -ENOMEM;
+
+	for (conv = (char *) name; *conv; conv++)
+		hash = (hash ^ (unsigned char) *conv) * 16777619U;
+	ent = &t->cache[fromfs][hash % NAME_CACHE_SIZE];
+	if (ent->name && strcmp(ent->name, name) == 0) {
+		*newnamep = ent->conv;
+		return 0;
+	}
+
+	err = iconv_convert(fromfs ? t->fromfs : t->tofs, name, len, &conv);
+	if (err)
+		return err;
+
+	if (len <= NAME_CACHE_MAX) {
+		char *tmp = strdup(name);
+
+		if (tmp) {
+			free(ent->name);
+			free(ent->conv);
+			ent->name = tmp;
+			ent->conv = conv;
+			*newnamep = conv;
+			return 0;
+		}
+	}
+	free(t->scratch);
+	t->scratch = conv;
+	*newnamep = conv;
+	return 0;
+}
+
+/* The result is @path itself or must be released with iconv_putpath() */
+static int iconv_convpath(struct iconv *ic, const char *path, char **newpathp,
+			  int fromfs)
+{
+	const char *newpath;
+	int err = iconv_convname(ic, path, &newpath, fromfs);
+
+	if (err)
+		return err;
+	if (newpath != path) {
+		newpath = strdup(newpath);
+		if (!newpath)
+			return -ENOMEM;
+	}
+	*newpathp = (char *) newpath;
+	return 0;
+}
+
+static void iconv_putpath(const char *path, char *newpath)
+{
+	if (newpath != path)
+		free(newpath);
+}
+
 static int iconv_getattr(const char *path, struct stat *stbuf,
 			 struct fuse_file_info *fi)
 {
@@ -107,7 +294,7 @@ static int iconv_getattr(const char *path, struct stat *stbuf,
 	int err = iconv_convpath(ic, path, &newpath, 0);
 	if (!err) {
 		err = fuse_fs_getattr(ic->next, newpath, stbuf, fi);
-		free(newpath);
+		iconv_putpath(path, newpath);
 	}
 	return err;
 }
@@ -119,7 +306,7 @@ static int iconv_access(const char *path, int mask)
 	int err = iconv_convpath(ic, path, &newpath, 0);
 	if (!err) {
 		err = fuse_fs_access(ic->next, newpath, mask);
-		free(newpath);
+		iconv_putpath(path, newpath);
 	}
 	return err;
 }
@@ -134,13 +321,13 @@ static int iconv_readlink(const char *path, char *buf, size_t size)
 		if (!err) {
 			char *newlink;
 			err = iconv_convpath(ic, buf, &newlink, 1);
-			if (!err) {
+			if (!err && newlink != buf) {
 				strncpy(buf, newlink, size - 1);
 				buf[size - 1] = '\0';
 				free(newlink);
 			}
 		}
-		free(newpath);
+		iconv_putpath(path, newpath);
 	}
 	return err;
 }
@@ -152,7 +339,7 @@ static int iconv_opendir(const char *path, struct fuse_file_info *fi)
 	int err = iconv_convpath(ic, path, &newpath, 0);
 	if (!err) {
 		err = fuse_fs_opendir(ic->next, newpath, fi);
-		free(newpath);
+		iconv_putpath(path, newpath);
 	}
 	return err;
 }
@@ -162,12 +349,10 @@ static int iconv_dir_fill(void *buf, const char *name,
 			  enum fuse_fill_dir_flags flags)
 {
 	struct iconv_dh *dh = buf;
-	char *newname;
+	const char *newname;
 	int res = 0;
-	if (iconv_convpath(dh->ic, name, &newname, 1) == 0) {
+	if (iconv_convname(dh->ic, name, &newname, 1) == 0)
 		res = dh->prev_filler(dh->prev_buf, newname, stbuf, off, flags);
-		free(newname);
-	}
 	return res;
 }
 
@@ -185,7 +370,7 @@ static int iconv_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
 		dh.prev_filler = filler;
 		err = fuse_fs_readdir(ic->next, newpath, &dh, iconv_dir_fill,
 				      offset, fi, flags);
-		free(newpath);
+		iconv_putpath(path, newpath);
 	}
 	return err;
 }
@@ -197,7 +382,7 @@ static int iconv_releasedir(const char *path, struct fuse_file_info *fi)
 	int err = iconv_convpath(ic, path, &newpath, 0);
 	if (!err) {
 		err = fuse_fs_releasedir(ic->next, newpath, fi);
-		free(newpath);
+		iconv_putpath(path, newpath);
 	}
 	return err;
 }
@@ -209,7 +394,7 @@ static int iconv_mknod(const char *path, mode_t mode, dev_t rdev)
 	int err = iconv_convpath(ic, path, &newpath, 0);
 	if (!err) {
 		err = fuse_fs_mknod(ic->next, newpath, mode, rdev);
-		free(newpath);
+		iconv_putpath(path, newpath);
 	}
 	return err;
 }
@@ -221,7 +406,7 @@ static int iconv_mkdir(const char *path, mode_t mode)
 	int err = iconv_convpath(ic, path, &newpath, 0);
 	if (!err) {
 		err = fuse_fs_mkdir(ic->next, newpath, mode);
-		free(newpath);
+		iconv_putpath(path, newpath);
 	}
 	return err;
 }
@@ -233,7 +418,7 @@ static int iconv_unlink(const char *path)
 	int err = iconv_convpath(ic, path, &newpath, 0);
 	if (!err) {
 		err = fuse_fs_unlink(ic->next, newpath);
-		free(newpath);
+		iconv_putpath(path, newpath);
 	}
 	return err;
 }
@@ -245,7 +430,7 @@ static int iconv_rmdir(const char *path)
 	int err = iconv_convpath(ic, path, &newpath, 0);
 	if (!err) {
 		err = fuse_fs_rmdir(ic->next, newpath);
-		free(newpath);
+		iconv_putpath(path, newpath);
 	}
 	return err;
 }
@@ -260,9 +445,9 @@ static int iconv_symlink(const char *from, const char *to)
 		err = iconv_convpath(ic, to, &newto, 0);
 		if (!err) {
 			err = fuse_fs_symlink(ic->next, newfrom, newto);
-			free(newto);
+			iconv_putpath(to, newto);
 		}
-		free(newfrom);
+		iconv_putpath(from, newfrom);
 	}
 	return err;
 }
@@ -277,9 +462,9 @@ static int iconv_rename(const char *from, const char *to, unsigned int flags)
 		err = iconv_convpath(ic, to, &newto, 0);
 		if (!err) {
 			err = fuse_fs_rename(ic->next, newfrom, newto, flags);
-			free(newto);
+			iconv_putpath(to, newto);
 		}
-		free(newfrom);
+		iconv_putpath(from, newfrom);
 	}
 	return err;
 }
@@ -294,9 +479,9 @@ static int iconv_link(const char *from, const char *to)
 		err = iconv_convpath(ic, to, &newto, 0);
 		if (!err) {
 			err = fuse_fs_link(ic->next, newfrom, newto);
-			free(newto);
+			iconv_putpath(to, newto);
 		}
-		free(newfrom);
+		iconv_putpath(from, newfrom);
 	}
 	return err;
 }
@@ -309,7 +494,7 @@ static int iconv_chmod(const char *path, mode_t mode,
 	int err = iconv_convpath(ic, path, &newpath, 0);
 	if (!err) {
 		err = fuse_fs_chmod(ic->next, newpath, mode, fi);
-		free(newpath);
+		iconv_putpath(path, newpath);
 	}
 	return err;
 }
@@ -322,7 +507,7 @@ static int iconv_chown(const char *path, uid_t uid, gid_t gid,
 	int err = iconv_convpath(ic, path, &newpath, 0);
 	if (!err) {
 		err = fuse_fs_chown(ic->next, newpath, uid, gid, fi);
-		free(newpath);
+		iconv_putpath(path, newpath);
 	}
 	return err;
 }
@@ -335,7 +520,7 @@ static int iconv_truncate(const char *path, off_t size,
 	int err = iconv_convpath(ic, path, &newpath, 0);
 	if (!err) {
 		err = fuse_fs_truncate(ic->next, newpath, size, fi);
-		free(newpath);
+		iconv_putpath(path, newpath);
 	}
 	return err;
 }
@@ -348,7 +533,7 @@ static int iconv_utimens(const char *path, const struct timespec ts[2],
 	int err = iconv_convpath(ic, path, &newpath, 0);
 	if (!err) {
 		err = fuse_fs_utimens(ic->next, newpath, ts, fi);
-		free(newpath);
+		iconv_putpath(path, newpath);
 	}
 	return err;
 }
@@ -361,7 +546,7 @@ static int iconv_create(const char *path, mode_t mode,
 	int err = iconv_convpath(ic, path, &newpath, 0);
 	if (!err) {
 		err = fuse_fs_create(ic->next, newpath, mode, fi);
-		free(newpath);
+		iconv_putpath(path, newpath);
 	}
 	return err;
 }
@@ -373,7 +558,7 @@ static int iconv_open_file(const char *path, struct fuse_file_info *fi)
 	int err = iconv_convpath(ic, path, &newpath, 0);
 	if (!err) {
 		err = fuse_fs_open(ic->next, newpath, fi);
-		free(newpath);
+		iconv_putpath(path, newpath);
 	}
 	return err;
 }
@@ -386,7 +571,7 @@ static int iconv_read_buf(const char *path, struct fuse_bufvec **bufp,
 	int err = iconv_convpath(ic, path, &newpath, 0);
 	if (!err) {
 		err = fuse_fs_read_buf(ic->next, newpath, bufp, size, offset, fi);
-		free(newpath);
+		iconv_putpath(path, newpath);
 	}
 	return err;
 }
@@ -399,7 +584,7 @@ static int iconv_write_buf(const char *path, struct fuse_bufvec *buf,
 	int err = iconv_convpath(ic, path, &newpath, 0);
 	if (!err) {
 		err = fuse_fs_write_buf(ic->next, newpath, buf, offset, fi);
-		free(newpath);
+		iconv_putpath(path, newpath);
 	}
 	return err;
 }
@@ -411,7 +596,7 @@ static int iconv_statfs(const char *path, struct statvfs *stbuf)
 	int err = iconv_convpath(ic, path, &newpath, 0);
 	if (!err) {
 		err = fuse_fs_statfs(ic->next, newpath, stbuf);
-		free(newpath);
+		iconv_putpath(path, newpath);
 	}
 	return err;
 }
@@ -423,7 +608,7 @@ static int iconv_flush(const char *path, struct fuse_file_info *fi)
 	int err = iconv_convpath(ic, path, &newpath, 0);
 	if (!err) {
 		err = fuse_fs_flush(ic->next, newpath, fi);
-		free(newpath);
+		iconv_putpath(path, newpath);
 	}
 	return err;
 }
@@ -435,7 +620,7 @@ static int iconv_release(const char *path, struct fuse_file_info *fi)
 	int err = iconv_convpath(ic, path, &newpath, 0);
 	if (!err) {
 		err = fuse_fs_release(ic->next, newpath, fi);
-		free(newpath);
+		iconv_putpath(path, newpath);
 	}
 	return err;
 }
@@ -448,7 +633,7 @@ static int iconv_fsync(const char *path, int isdatasync,
 	int err = iconv_convpath(ic, path, &newpath, 0);
 	if (!err) {
 		err = fuse_fs_fsync(ic->next, newpath, isdatasync, fi);
-		free(newpath);
+		iconv_putpath(path, newpath);
 	}
 	return err;
 }
@@ -461,7 +646,7 @@ static int iconv_fsyncdir(const char *path, int isdatasync,
 	int err = iconv_convpath(ic, path, &newpath, 0);
 	if (!err) {
 		err = fuse_fs_fsyncdir(ic->next, newpath, isdatasync, fi);
-		free(newpath);
+		iconv_putpath(path, newpath);
 	}
 	return err;
 }
@@ -475,7 +660,7 @@ static int iconv_setxattr(const char *path, const char *name,
 	if (!err) {
 		err = fuse_fs_setxattr(ic->next, newpath, name, value, size,
 				       flags);
-		free(newpath);
+		iconv_putpath(path, newpath);
 	}
 	return err;
 }
@@ -488,7 +673,7 @@ static int iconv_getxattr(const char *path, const char *name, char *value,
 	int err = iconv_convpath(ic, path, &newpath, 0);
 	if (!err) {
 		err = fuse_fs_getxattr(ic->next, newpath, name, value, size);
-		free(newpath);
+		iconv_putpath(path, newpath);
 	}
 	return err;
 }
@@ -500,7 +685,7 @@ static int iconv_listxattr(const char *path, char *list, size_t size)
 	int err = iconv_convpath(ic, path, &newpath, 0);
 	if (!err) {
 		err = fuse_fs_listxattr(ic->next, newpath, list, size);
-		free(newpath);
+		iconv_putpath(path, newpath);
 	}
 	return err;
 }
@@ -512,7 +697,7 @@ static int iconv_removexattr(const char *path, const char *name)
 	int err = iconv_convpath(ic, path, &newpath, 0);
 	if (!err) {
 		err = fuse_fs_removexattr(ic->next, newpath, name);
-		free(newpath);
+		iconv_putpath(path, newpath);
 	}
 	return err;
 }
@@ -525,7 +710,7 @@ static int iconv_lock(const char *path, struct fuse_file_info *fi, int cmd,
 	int err = iconv_convpath(ic, path, &newpath, 0);
 	if (!err) {
 		err = fuse_fs_lock(ic->next, newpath, fi, cmd, lock);
-		free(newpath);
+		iconv_putpath(path, newpath);
 	}
 	return err;
 }
@@ -537,7 +722,7 @@ static int iconv_flock(const char *path, struct fuse_file_info *fi, int op)
 	int err = iconv_convpath(ic, path, &newpath, 0);
 	if (!err) {
 		err = fuse_fs_flock(ic->next, newpath, fi, op);
-		free(newpath);
+		iconv_putpath(path, newpath);
 	}
 	return err;
 }
@@ -549,7 +734,7 @@ static int iconv_bmap(const char *path, size_t blocksize, uint64_t *idx)
 	int err = iconv_convpath(ic, path, &newpath, 0);
 	if (!err) {
 		err = fuse_fs_bmap(ic->next, newpath, blocksize, idx);
-		free(newpath);
+		iconv_putpath(path, newpath);
 	}
 	return err;
 }
@@ -562,11 +747,24 @@ static off_t iconv_lseek(const char *path, off_t off, int whence,
 	int res = iconv_convpath(ic, path, &newpath, 0);
 	if (!res) {
 		res = fuse_fs_lseek(ic->next, newpath, off, whence, fi);
-		free(newpath);
+		iconv_putpath(path, newpath);
 	}
 	return res;
 }
 
+static int iconv_statx(const char *path, int flags, int mask,
+		       struct statx *stxbuf, struct fuse_file_info *fi)
+{
+	struct iconv *ic = iconv_get();
+	char *newpath;
+	int err = iconv_convpath(ic, path, &newpath, 0);
+	if (!err) {
+		err = fuse_fs_statx(ic->next, newpath, flags, mask, stxbuf, fi);
+		iconv_putpath(path, newpath);
+	}
+	return err;
+}
+
 static void *iconv_init(struct fuse_conn_info *conn,
 			struct fuse_config *cfg)
 {
@@ -581,11 +779,19 @@ static void iconv_destroy(void *data)
 {
 	struct iconv *ic = data;
 	fuse_fs_destroy(ic->next);
-	iconv_close(ic->tofs);
-	iconv_close(ic->fromfs);
+	/* Also stops the destructor from running in remaining threads */
+	pthread_key_delete(ic->key);
+	while (ic->threads.next != &ic->threads) {
+		struct iconv_thread *t = ic->threads.next;
+
+		ic->threads.next = t->next;
+		iconv_thread_close(t);
+	}
 	pthread_mutex_destroy(&ic->lock);
 	free(ic->from_code);
 	free(ic->to_code);
+	free(ic->from);
+	free(ic->to);
 	free(ic);
 }
 
@@ -626,6 +832,7 @@ static const struct fuse_operations iconv_oper = {
 	.flock		= iconv_flock,
 	.bmap		= iconv_bmap,
 	.lseek		= iconv_lseek,
+	.statx		= iconv_statx,
 };
 
 static const struct fuse_opt iconv_opts[] = {
@@ -662,14 +869,38 @@ static int iconv_opt_proc(void *data, const char *arg, int key,
 	return 1;
 }
 
+/* Do both conversions map every ASCII character onto itself? */
+static int iconv_check_ascii(iconv_t tofs, iconv_t fromfs)
+{
+	char ascii[128];
+	char *conv;
+	int res = 0;
+	int i;
+
+	for (i = 1; i < 128; i++)
+		ascii[i - 1] = i;
+	ascii[127] = '\0';
+
+	if (iconv_convert(tofs, ascii, 127, &conv) == 0) {
+		res = strcmp(conv, ascii) == 0;
+		free(conv);
+	}
+	if (res && iconv_convert(fromfs, ascii, 127, &conv) == 0) {
+		res = strcmp(conv, ascii) == 0;
+		free(conv);
+	} else {
+		res = 0;
+	}
+	return res;
+}
+
 static struct fuse_fs *iconv_new(struct fuse_args *args,
 				 struct fuse_fs *next[])
 {
 	struct fuse_fs *fs;
 	struct iconv *ic;
-	char *old = NULL;
-	const char *from;
-	const char *to;
+	iconv_t tofs;
+	iconv_t fromfs;
 
 	ic = calloc(1, sizeof(struct iconv));
 	if (ic == NULL) {
@@ -685,47 +916,65 @@ static struct fuse_fs *iconv_new(struct fuse_args *args,
 		goto out_free;
 	}
 
-	from = ic->from_code ? ic->from_code : "UTF-8";
-	to = ic->to_code ? ic->to_code : "";
+	/*
+	 * Threads open their own descriptors later on, so resolve the
+	 * charset of the locale now instead of switching locales then.
+	 */
+	ic->from = strdup(ic->from_code ? ic->from_code : "UTF-8");
+	if (ic->to_code && ic->to_code[0]) {
+		ic->to = strdup(ic->to_code);
+	} else {
+		char *old = strdup(setlocale(LC_CTYPE, ""));
+		ic->to = strdup(nl_langinfo(CODESET));
+		setlocale(LC_CTYPE, old);
+		free(old);
+	}
+	if (!ic->from || !ic->to) {
+		fuse_log(FUSE_LOG_ERR, "fuse-iconv: memory allocation failed\n");
+		goto out_free;
+	}
+
 	/* FIXME: detect charset equivalence? */
-	if (!to[0])
-		old = strdup(setlocale(LC_CTYPE, ""));
-	ic->tofs = iconv_open(from, to);
-	if (ic->tofs == (iconv_t) -1) {
+	tofs = iconv_open(ic->from, ic->to);
+	if (tofs == (iconv_t) -1) {
 		fuse_log(FUSE_LOG_ERR, "fuse-iconv: cannot convert from %s to %s\n",
-			to, from);
+			ic->to, ic->from);
 		goto out_free;
 	}
-	ic->fromfs = iconv_open(to, from);
-	if (ic->tofs == (iconv_t) -1) {
+	fromfs = iconv_open(ic->to, ic->from);
+	if (fromfs == (iconv_t) -1) {
 		fuse_log(FUSE_LOG_ERR, "fuse-iconv: cannot convert from %s to %s\n",
-			from, to);
-		goto out_iconv_close_to;
+			ic->from, ic->to);
+		iconv_close(tofs);
+		goto out_free;
 	}
-	if (old) {
-		setlocale(LC_CTYPE, old);
-		free(old);
+	ic->ascii = iconv_check_ascii(tofs, fromfs);
+	iconv_close(fromfs);
+	iconv_close(tofs);
+
+	if (pthread_key_create(&ic->key, iconv_thread_free) != 0) {
+		fuse_log(FUSE_LOG_ERR, "fuse-iconv: failed to create thread specific key\n");
+		goto out_free;
 	}
+	pthread_mutex_init(&ic->lock, NULL);
+	ic->threads.next = ic->threads.prev = &ic->threads;
 
 	ic->next = next[0];
 	fs = fuse_fs_new(&iconv_oper, sizeof(iconv_oper), ic);
 	if (!fs)
-		goto out_iconv_close_from;
+		goto out_destroy;
 
 	return fs;
 
-out_iconv_close_from:
-	iconv_close(ic->fromfs);
-out_iconv_close_to:
-	iconv_close(ic->tofs);
+out_destroy:
+	pthread_mutex_destroy(&ic->lock);
+	pthread_key_delete(ic->key);
 out_free:
 	free(ic->from_code);
 	free(ic->to_code);
+	free(ic->from);
+	free(ic->to);
 	free(ic);
-	if (old) {
-		setlocale(LC_CTYPE, old);
-		free(old);
-	}
 	return NULL;
 }
 
@@ -0,0 +1,1008 @@
+/*
+  fuse readahead module: prefetch sequentially read files
+  Copyright (C) 2026  agent <agent@local>
+
+  This program can be distributed under the terms of the GNU LGPLv2.
+  See the file COPYING.LIB
+*/
+
+#include <config.h>
+
+#include <fuse.h>
+#include "fuse_i.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#define DEFAULT_WINDOW (256 * 1024)
+#define DEFAULT_MAX_WINDOW (4 * 1024 * 1024)
+#define DEFAULT_MAX_MEM (64 * 1024 * 1024)
+#define DEFAULT_THREADS 4
+#define MAX_THREADS 64
+
+/* Prefetched data of one file handle, shared with readers copying it out */
+struct ra_buf {
+	int refs;
+	off_t off;
+	size_t len;
+	size_t size;
+	int eof;
+	char data[];
+};
+
+/*
+ * The module replaces the file handle of the next filesystem with a
+ * pointer to this, and puts it back while forwarding a request.
+ * Directory handles are wrapped as well, so that every handle seen by
+ * the module is one of its own.
+ */
+struct ra_file {
+	/* File info as returned by the next filesystem */
+	struct fuse_file_info fi;
+	char *path;
+	struct ra_file *prev;
+	struct ra_file *next;
+
+	/* Where the next read continues if access is sequential */
+	off_t next_off;
+	size_t window;
+	struct ra_buf *buf;
+
+	/* Prefetch queued or in flight */
+	int pending;
+	off_t pend_off;
+	size_t pend_len;
+	unsigned int gen;
+	uid_t uid;
+	gid_t gid;
+	pid_t pid;
+	struct ra_file *queue_next;
+};
+
+struct ra_stats {
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long waits;
+	unsigned long long hit_bytes;
+	unsigned long long prefetched;
+	unsigned long long wasted;
+	unsigned long long throttled;
+};
+
+struct readahead {
+	unsigned window;
+	unsigned max_window;
+	unsigned max_mem;
+	unsigned threads;
+	int show_stats;
+	struct fuse *fuse;
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t done;
+	struct ra_file files;
+	struct ra_file *queue;
+	struct ra_file **queue_tail;
+	size_t mem;
+	int exiting;
+	unsigned nworkers;
+	pthread_t workers[MAX_THREADS];
+	struct ra_stats stats;
+	struct fuse_fs *next;
+};
+
+static struct readahead *readahead_get(void)
+{
+	return fuse_get_context()->private_data;
+}
+
+static struct ra_file *ra_file(struct fuse_file_info *fi)
+{
+	return (struct ra_file *) (uintptr_t) fi->fh;
+}
+
+/* Swap in the file handle of the next filesystem */
+static uint64_t ra_enter(struct fuse_file_info *fi)
+{
+	uint64_t fh = 0;
+
+	if (fi) {
+		fh = fi->fh;
+		fi->fh = ra_file(fi)->fi.fh;
+	}
+	return fh;
+}
+
+static void ra_leave(struct fuse_file_info *fi, uint64_t fh)
+{
+	if (fi)
+		fi->fh = fh;
+}
+
+static void ra_free_bufvec(struct fuse_bufvec *bufv)
+{
+	size_t i;
+
+	for (i = 0; i < bufv->count; i++)
+		if (!(bufv->buf[i].flags & FUSE_BUF_IS_FD))
+			free(bufv->buf[i].mem);
+	free(bufv);
+}
+
+static void ra_buf_put(struct readahead *ra, struct ra_buf *b)
+{
+	if (b && --b->refs == 0) {
+		ra->mem -= b->size;
+		free(b);
+	}
+}
+
+/* Bytes of @b that were prefetched but never read */
+static size_t ra_unread(struct ra_file *rf, struct ra_buf *b)
+{
+	off_t end = b->off + b->len;
+
+	if (rf->next_off <= b->off)
+		return b->len;
+	if (rf->next_off >= end)
+		return 0;
+	return end - rf->next_off;
+}
+
+static void ra_drop(struct readahead *ra, struct ra_file *rf)
+{
+	if (rf->buf) {
+		ra->stats.wasted += ra_unread(rf, rf->buf);
+		ra_buf_put(ra, rf->buf);
+		rf->buf = NULL;
+	}
+	/* Discard the result of a prefetch in flight */
+	rf->gen++;
+}
+
+static void ra_invalidate(struct readahead *ra, const char *path,
+			  struct fuse_file_info *fi)
+{
+	struct ra_file *rf;
+
+	pthread_mutex_lock(&ra->lock);
+	if (fi)
+		ra_drop(ra, ra_file(fi));
+	if (path) {
+		for (rf = ra->files.next; rf != &ra->files; rf = rf->next)
+			if (rf->path && strcmp(rf->path, path) == 0)
+				ra_drop(ra, rf);
+	}
+	pthread_mutex_unlock(&ra->lock);
+}
+
+/*
+ * Install the result of a prefetch, keeping the unread tail of the
+ * previous buffer if the two are contiguous.
+ */
+static void ra_install(struct readahead *ra, struct ra_file *rf,
+		       struct ra_buf *b)
+{
+	struct ra_buf *old = rf->buf;
+	int merged = 0;
+
+	if (old && old->off + (off_t) old->len == b->off &&
+	    rf->next_off >= old->off && rf->next_off < b->off) {
+		size_t tail = b->off - rf->next_off;
+		struct ra_buf *nb = malloc(sizeof(struct ra_buf) + tail + b->len);
+
+		if (nb) {
+			memcpy(nb->data, old->data + (rf->next_off - old->off),
+			       tail);
+			memcpy(nb->data + tail, b->data, b->len);
+			nb->refs = 1;
+			nb->off = rf->next_off;
+			nb->len = tail + b->len;
+			nb->size = tail + b->len;
+			nb->eof = b->eof;
+			ra->mem += nb->size;
+			ra_buf_put(ra, b);
+			b = nb;
+			merged = 1;
+		}
+	}
+	if (old) {
+		if (!merged)
+			ra->stats.wasted += ra_unread(rf, old);
+		ra_buf_put(ra, old);
+	}
+	rf->buf = b;
+}
+
+static void ra_prefetch(struct readahead *ra, struct ra_file *rf)
+{
+	struct fuse_context *ctx;
+	struct fuse_bufvec *bufv = NULL;
+	struct fuse_bufvec dst;
+	struct fuse_file_info fi;
+	struct ra_buf *b;
+	unsigned int gen;
+	char *path = NULL;
+	off_t off;
+	size_t len;
+	ssize_t res;
+
+	pthread_mutex_lock(&ra->lock);
+	off = rf->pend_off;
+	len = rf->pend_len;
+	gen = rf->gen;
+	fi = rf->fi;
+	if (rf->path)
+		path = strdup(rf->path);
+	ctx = fuse_thread_context(ra->fuse);
+	ctx->uid = rf->uid;
+	ctx->gid = rf->gid;
+	ctx->pid = rf->pid;
+	pthread_mutex_unlock(&ra->lock);
+
+	b = malloc(sizeof(struct ra_buf) + len);
+	if (!b || (rf->path && !path)) {
+		res = -ENOMEM;
+		goto out;
+	}
+
+	res = fuse_fs_read_buf(ra->next, path, &bufv, len, off, &fi);
+	if (res == 0) {
+		dst = FUSE_BUFVEC_INIT(len);
+		dst.buf[0].mem = b->data;
+		res = fuse_buf_copy(&dst, bufv, 0);
+		ra_free_bufvec(bufv);
+	}
+
+out:
+	free(path);
+	pthread_mutex_lock(&ra->lock);
+	rf->pending = 0;
+	if (res >= 0 && gen == rf->gen) {
+		b->refs = 1;
+		b->off = off;
+		b->len = res;
+		b->size = len;
+		b->eof = (size_t) res < len;
+		ra->stats.prefetched += res;
+		ra_install(ra, rf, b);
+	} else {
+		ra->mem -= len;
+		free(b);
+	}
+	pthread_cond_broadcast(&ra->done);
+	pthread_mutex_unlock(&ra->lock);
+}
+
+static void *ra_worker(void *data)
+{
+	struct readahead *ra = data;
+
+	pthread_mutex_lock(&ra->lock);
+	while (!ra->exiting) {
+		struct ra_file *rf = ra->queue;
+
+		if (!rf) {
+			pthread_cond_wait(&ra->work, &ra->lock);
+			continue;
+		}
+		ra->queue = rf->queue_next;
+		if (!ra->queue)
+			ra->queue_tail = &ra->queue;
+		pthread_mutex_unlock(&ra->lock);
+		ra_prefetch(ra, rf);
+		pthread_mutex_lock(&ra->lock);
+	}
+	pthread_mutex_unlock(&ra->lock);
+
+	return NULL;
+}
+
+/* Called with ra->lock held after a sequential read */
+static void ra_schedule(struct readahead *ra, struct ra_file *rf)
+{
+	struct fuse_context *ctx = fuse_get_context();
+	struct ra_buf *b = rf->buf;
+	off_t start = rf->next_off;
+
+	if (rf->pending || !ra->nworkers)
+		return;
+	if (b && rf->next_off >= b->off) {
+		off_t end = b->off + b->len;
+
+		/* Nothing to prefetch past the end of the file */
+		if (b->eof)
+			return;
+		/* Keep going once half of the window has been consumed */
+		if (rf->next_off < end) {
+			if (end - rf->next_off > (off_t) rf->window / 2)
+				return;
+			start = end;
+		}
+	}
+
+	if (ra->mem + rf->window > ra->max_mem) {
+		ra->stats.throttled++;
+		return;
+	}
+	ra->mem += rf->window;
+	rf->pending = 1;
+	rf->pend_off = start;
+	rf->pend_len = rf->window;
+	rf->uid = ctx->uid;
+	rf->gid = ctx->gid;
+	rf->pid = ctx->pid;
+	rf->queue_next = NULL;
+	*ra->queue_tail = rf;
+	ra->queue_tail = &rf->queue_next;
+	pthread_cond_signal(&ra->work);
+
+	if (rf->window < ra->max_window) {
+		rf->window *= 2;
+		if (rf->window > ra->max_window)
+			rf->window = ra->max_window;
+	}
+}
+
+static int ra_covers(struct ra_file *rf, off_t off)
+{
+	struct ra_buf *b = rf->buf;
+
+	if (b && off >= b->off && off <= b->off + (off_t) b->len)
+		return 1;
+	return rf->pending && off >= rf->pend_off &&
+		off < rf->pend_off + (off_t) rf->pend_len;
+}
+
+static int ra_serve(struct readahead *ra, struct ra_file *rf,
+		    struct fuse_bufvec **bufp, size_t size, off_t off)
+{
+	struct ra_buf *b = rf->buf;
+	struct fuse_bufvec *bufv;
+	size_t avail;
+	size_t n;
+	void *mem = NULL;
+
+	if (!b || off < b->off || off > b->off + (off_t) b->len)
+		return 0;
+	avail = b->off + b->len - off;
+	if (avail < size && !b->eof)
+		return 0;
+	n = avail < size ? avail : size;
+
+	bufv = malloc(sizeof(struct fuse_bufvec));
+	if (n)
+		mem = malloc(n);
+	if (!bufv || (n && !mem)) {
+		free(bufv);
+		free(mem);
+		return 0;
+	}
+
+	/* Copy outside of the lock, the buffer may be replaced meanwhile */
+	b->refs++;
+	pthread_mutex_unlock(&ra->lock);
+	memcpy(mem, b->data + (off - b->off), n);
+	pthread_mutex_lock(&ra->lock);
+	ra_buf_put(ra, b);
+
+	*bufv = FUSE_BUFVEC_INIT(n);
+	bufv->buf[0].mem = mem;
+	*bufp = bufv;
+	ra->stats.hits++;
+	ra->stats.hit_bytes += n;
+
+	return 1;
+}
+
+static int readahead_read_buf(const char *path, struct fuse_bufvec **bufp,
+			      size_t size, off_t offset,
+			      struct fuse_file_info *fi)
+{
+	struct readahead *ra = readahead_get();
+	struct ra_file *rf = ra_file(fi);
+	int sequential;
+	uint64_t fh;
+	int res;
+
+	pthread_mutex_lock(&ra->lock);
+	if (path && (!rf->path || strcmp(rf->path, path) != 0)) {
+		char *tmp = strdup(path);
+
+		if (tmp) {
+			free(rf->path);
+			rf->path = tmp;
+		}
+	}
+	/*
+	 * Concurrent requests of a sequential reader (e.g. kernel
+	 * readahead) may arrive slightly out of order, so anything within
+	 * the prefetched range still counts as sequential.
+	 */
+	sequential = (offset == rf->next_off) || ra_covers(rf, offset);
+	if (!sequential) {
+		ra_drop(ra, rf);
+		rf->window = ra->window;
+	}
+
+	for (;;) {
+		if (ra_serve(ra, rf, bufp, size, offset)) {
+			res = 0;
+			goto out;
+		}
+		if (!rf->pending || offset < rf->pend_off ||
+		    offset >= rf->pend_off + (off_t) rf->pend_len)
+			break;
+		ra->stats.waits++;
+		pthread_cond_wait(&ra->done, &ra->lock);
+	}
+	ra->stats.misses++;
+	pthread_mutex_unlock(&ra->lock);
+
+	fh = ra_enter(fi);
+	res = fuse_fs_read_buf(ra->next, path, bufp, size, offset, fi);
+	ra_leave(fi, fh);
+
+	pthread_mutex_lock(&ra->lock);
+out:
+	if (res == 0) {
+		off_t end = offset + fuse_buf_size(*bufp);
+
+		if (!sequential || end > rf->next_off)
+			rf->next_off = end;
+		if (sequential)
+			ra_schedule(ra, rf);
+	}
+	pthread_mutex_unlock(&ra->lock);
+
+	return res;
+}
+
+static struct ra_file *ra_file_new(struct readahead *ra, const char *path,
+				   struct fuse_file_info *fi)
+{
+	struct ra_file *rf = calloc(1, sizeof(struct ra_file));
+
+	if (!rf)
+		return NULL;
+	if (path) {
+		rf->path = strdup(path);
+		if (!rf->path) {
+			free(rf);
+			return NULL;
+		}
+	}
+	rf->fi = *fi;
+	rf->window = ra->window;
+
+	pthread_mutex_lock(&ra->lock);
+	rf->next = ra->files.next;
+	rf->prev = &ra->files;
+	rf->next->prev = rf;
+	ra->files.next = rf;
+	pthread_mutex_unlock(&ra->lock);
+
+	fi->fh = (uintptr_t) rf;
+	return rf;
+}
+
+static void ra_file_free(struct readahead *ra, struct fuse_file_info *fi)
+{
+	struct ra_file *rf = ra_file(fi);
+
+	pthread_mutex_lock(&ra->lock);
+	/* The worker uses the handle of the next filesystem */
+	while (rf->pending)
+		pthread_cond_wait(&ra->done, &ra->lock);
+	ra_drop(ra, rf);
+	rf->prev->next = rf->next;
+	rf->next->prev = rf->prev;
+	pthread_mutex_unlock(&ra->lock);
+
+	fi->fh = rf->fi.fh;
+	free(rf->path);
+	free(rf);
+}
+
+static int readahead_getattr(const char *path, struct stat *stbuf,
+			     struct fuse_file_info *fi)
+{
+	struct readahead *ra = readahead_get();
+	uint64_t fh = ra_enter(fi);
+	int err = fuse_fs_getattr(ra->next, path, stbuf, fi);
+	ra_leave(fi, fh);
+	return err;
+}
+
+static int readahead_statx(const char *path, int flags, int mask,
+			   struct statx *stxbuf, struct fuse_file_info *fi)
+{
+	struct readahead *ra = readahead_get();
+	uint64_t fh = ra_enter(fi);
+	int err = fuse_fs_statx(ra->next, path, flags, mask, stxbuf, fi);
+	ra_leave(fi, fh);
+	return err;
+}
+
+static int readahead_access(const char *path, int mask)
+{
+	struct readahead *ra = readahead_get();
+	return fuse_fs_access(ra->next, path, mask);
+}
+
+static int readahead_readlink(const char *path, char *buf, size_t size)
+{
+	struct readahead *ra = readahead_get();
+	return fuse_fs_readlink(ra->next, path, buf, size);
+}
+
+static int readahead_opendir(const char *path, struct fuse_file_info *fi)
+{
+	struct readahead *ra = readahead_get();
+	int err = fuse_fs_opendir(ra->next, path, fi);
+	if (!err && !ra_file_new(ra, NULL, fi)) {
+		fuse_fs_releasedir(ra->next, path, fi);
+		err = -ENOMEM;
+	}
+	return err;
+}
+
+static int readahead_readdir(const char *path, void *buf,
+			     fuse_fill_dir_t filler, off_t offset,
+			     struct fuse_file_info *fi,
+			     enum fuse_readdir_flags flags)
+{
+	struct readahead *ra = readahead_get();
+	uint64_t fh = ra_enter(fi);
+	int err = fuse_fs_readdir(ra->next, path, buf, filler, offset, fi,
+				  flags);
+	ra_leave(fi, fh);
+	return err;
+}
+
+static int readahead_releasedir(const char *path, struct fuse_file_info *fi)
+{
+	struct readahead *ra = readahead_get();
+	ra_file_free(ra, fi);
+	return fuse_fs_releasedir(ra->next, path, fi);
+}
+
+static int readahead_mknod(const char *path, mode_t mode, dev_t rdev)
+{
+	struct readahead *ra = readahead_get();
+	return fuse_fs_mknod(ra->next, path, mode, rdev);
+}
+
+static int readahead_mkdir(const char *path, mode_t mode)
+{
+	struct readahead *ra = readahead_get();
+	return fuse_fs_mkdir(ra->next, path, mode);
+}
+
+static int readahead_unlink(const char *path)
+{
+	struct readahead *ra = readahead_get();
+	return fuse_fs_unlink(ra->next, path);
+}
+
+static int readahead_rmdir(const char *path)
+{
+	struct readahead *ra = readahead_get();
+	return fuse_fs_rmdir(ra->next, path);
+}
+
+static int readahead_symlink(const char *from, const char *path)
+{
+	struct readahead *ra = readahead_get();
+	return fuse_fs_symlink(ra->next, from, path);
+}
+
+static int readahead_rename(const char *from, const char *to,
+			    unsigned int flags)
+{
+	struct readahead *ra = readahead_get();
+	int err = fuse_fs_rename(ra->next, from, to, flags);
+	/* A file replaced by the rename may still be open */
+	ra_invalidate(ra, to, NULL);
+	return err;
+}
+
+static int readahead_link(const char *from, const char *to)
+{
+	struct readahead *ra = readahead_get();
+	return fuse_fs_link(ra->next, from, to);
+}
+
+static int readahead_chmod(const char *path, mode_t mode,
+			   struct fuse_file_info *fi)
+{
+	struct readahead *ra = readahead_get();
+	uint64_t fh = ra_enter(fi);
+	int err = fuse_fs_chmod(ra->next, path, mode, fi);
+	ra_leave(fi, fh);
+	return err;
+}
+
+static int readahead_chown(const char *path, uid_t uid, gid_t gid,
+			   struct fuse_file_info *fi)
+{
+	struct readahead *ra = readahead_get();
+	uint64_t fh = ra_enter(fi);
+	int err = fuse_fs_chown(ra->next, path, uid, gid, fi);
+	ra_leave(fi, fh);
+	return err;
+}
+
+static int readahead_truncate(const char *path, off_t size,
+			      struct fuse_file_info *fi)
+{
+	struct readahead *ra = readahead_get();
+	uint64_t fh = ra_enter(fi);
+	int err = fuse_fs_truncate(ra->next, path, size, fi);
+	ra_leave(fi, fh);
+	ra_invalidate(ra, path, fi);
+	return err;
+}
+
+static int readahead_utimens(const char *path, const struct timespec ts[2],
+			     struct fuse_file_info *fi)
+{
+	struct readahead *ra = readahead_get();
+	uint64_t fh = ra_enter(fi);
+	int err = fuse_fs_utimens(ra->next, path, ts, fi);
+	ra_leave(fi, fh);
+	return err;
+}
+
+static int readahead_create(const char *path, mode_t mode,
+			    struct fuse_file_info *fi)
+{
+	struct readahead *ra = readahead_get();
+	int err = fuse_fs_create(ra->next, path, mode, fi);
+	if (!err && !ra_file_new(ra, path, fi)) {
+		fuse_fs_release(ra->next, path, fi);
+		err = -ENOMEM;
+	}
+	return err;
+}
+
+static int readahead_open(const char *path, struct fuse_file_info *fi)
+{
+	struct readahead *ra = readahead_get();
+	int err = fuse_fs_open(ra->next, path, fi);
+	if (!err && !ra_file_new(ra, path, fi)) {
+		fuse_fs_release(ra->next, path, fi);
+		err = -ENOMEM;
+	}
+	return err;
+}
+
+static int readahead_write_buf(const char *path, struct fuse_bufvec *buf,
+			       off_t offset, struct fuse_file_info *fi)
+{
+	struct readahead *ra = readahead_get();
+	uint64_t fh = ra_enter(fi);
+	int res = fuse_fs_write_buf(ra->next, path, buf, offset, fi);
+	ra_leave(fi, fh);
+	ra_invalidate(ra, path, fi);
+	return res;
+}
+
+static int readahead_statfs(const char *path, struct statvfs *stbuf)
+{
+	struct readahead *ra = readahead_get();
+	return fuse_fs_statfs(ra->next, path, stbuf);
+}
+
+static int readahead_flush(const char *path, struct fuse_file_info *fi)
+{
+	struct readahead *ra = readahead_get();
+	uint64_t fh = ra_enter(fi);
+	int err = fuse_fs_flush(ra->next, path, fi);
+	ra_leave(fi, fh);
+	return err;
+}
+
+static int readahead_release(const char *path, struct fuse_file_info *fi)
+{
+	struct readahead *ra = readahead_get();
+	ra_file_free(ra, fi);
+	return fuse_fs_release(ra->next, path, fi);
+}
+
+static int readahead_fsync(const char *path, int isdatasync,
+			   struct fuse_file_info *fi)
+{
+	struct readahead *ra = readahead_get();
+	uint64_t fh = ra_enter(fi);
+	int err = fuse_fs_fsync(ra->next, path, isdatasync, fi);
+	ra_leave(fi, fh);
+	return err;
+}
+
+static int readahead_fsyncdir(const char *path, int isdatasync,
+			      struct fuse_file_info *fi)
+{
+	struct readahead *ra = readahead_get();
+	uint64_t fh = ra_enter(fi);
+	int err = fuse_fs_fsyncdir(ra->next, path, isdatasync, fi);
+	ra_leave(fi, fh);
+	return err;
+}
+
+static int readahead_setxattr(const char *path, const char *name,
+			      const char *value, size_t size, int flags)
+{
+	struct readahead *ra = readahead_get();
+	return fuse_fs_setxattr(ra->next, path, name, value, size, flags);
+}
+
+static int readahead_getxattr(const char *path, const char *name,
+			      char *value, size_t size)
+{
+	struct readahead *ra = readahead_get();
+	return fuse_fs_getxattr(ra->next, path, name, value, size);
+}
+
+static int readahead_listxattr(const char *path, char *list, size_t size)
+{
+	struct readahead *ra = readahead_get();
+	return fuse_fs_listxattr(ra->next, path, list, size);
+}
+
+static int readahead_removexattr(const char *path, const char *name)
+{
+	struct readahead *ra = readahead_get();
+	return fuse_fs_removexattr(ra->next, path, name);
+}
+
+static int readahead_lock(const char *path, struct fuse_file_info *fi,
+			  int cmd, struct flock *lock)
+{
+	struct readahead *ra = readahead_get();
+	uint64_t fh = ra_enter(fi);
+	int err = fuse_fs_lock(ra->next, path, fi, cmd, lock);
+	ra_leave(fi, fh);
+	return err;
+}
+
+static int readahead_flock(const char *path, struct fuse_file_info *fi,
+			   int op)
+{
+	struct readahead *ra = readahead_get();
+	uint64_t fh = ra_enter(fi);
+	int err = fuse_fs_flock(ra->next, path, fi, op);
+	ra_leave(fi, fh);
+	return err;
+}
+
+static int readahead_bmap(const char *path, size_t blocksize, uint64_t *idx)
+{
+	struct readahead *ra = readahead_get();
+	return fuse_fs_bmap(ra->next, path, blocksize, idx);
+}
+
+static int readahead_fallocate(const char *path, int mode, off_t offset,
+			       off_t length, struct fuse_file_info *fi)
+{
+	struct readahead *ra = readahead_get();
+	uint64_t fh = ra_enter(fi);
+	int err = fuse_fs_fallocate(ra->next, path, mode, offset, length, fi);
+	ra_leave(fi, fh);
+	ra_invalidate(ra, path, fi);
+	return err;
+}
+
+static ssize_t readahead_copy_file_range(const char *path_in,
+					 struct fuse_file_info *fi_in,
+					 off_t off_in, const char *path_out,
+					 struct fuse_file_info *fi_out,
+					 off_t off_out, size_t len, int flags)
+{
+	struct readahead *ra = readahead_get();
+	uint64_t fh_in = ra_enter(fi_in);
+	uint64_t fh_out = ra_enter(fi_out);
+	ssize_t res = fuse_fs_copy_file_range(ra->next, path_in, fi_in, off_in,
+					      path_out, fi_out, off_out, len,
+					      flags);
+	ra_leave(fi_out, fh_out);
+	ra_leave(fi_in, fh_in);
+	ra_invalidate(ra, path_out, fi_out);
+	return res;
+}
+
+static off_t readahead_lseek(const char *path, off_t off, int whence,
+			     struct fuse_file_info *fi)
+{
+	struct readahead *ra = readahead_get();
+	uint64_t fh = ra_enter(fi);
+	off_t res = fuse_fs_lseek(ra->next, path, off, whence, fi);
+	ra_leave(fi, fh);
+	return res;
+}
+
+static void readahead_print_stats(struct readahead *ra)
+{
+	struct ra_stats *s = &ra->stats;
+	unsigned long long reads = s->hits + s->misses;
+
+	fuse_log(FUSE_LOG_INFO, "fuse-readahead: %llu reads, %llu from prefetched data (%.1f%%), %llu waited for it\n",
+		 reads, s->hits, reads ? 100.0 * s->hits / reads : 0.0,
+		 s->waits);
+	fuse_log(FUSE_LOG_INFO, "fuse-readahead: %llu bytes prefetched, %llu used, %llu wasted, %llu prefetches over memory limit\n",
+		 s->prefetched, s->hit_bytes, s->wasted, s->throttled);
+}
+
+static void *readahead_init(struct fuse_conn_info *conn,
+			    struct fuse_config *cfg)
+{
+	struct readahead *ra = readahead_get();
+	unsigned i;
+
+	ra->fuse = fuse_get_context()->fuse;
+	fuse_fs_init(ra->next, conn, cfg);
+	/* Don't touch cfg->nullpath_ok, we can work with
+	   either */
+
+	for (i = 0; i < ra->threads; i++) {
+		if (fuse_start_thread(&ra->workers[i], ra_worker, ra) == -1)
+			break;
+		ra->nworkers++;
+	}
+	return ra;
+}
+
+static void readahead_destroy(void *data)
+{
+	struct readahead *ra = data;
+	unsigned i;
+
+	pthread_mutex_lock(&ra->lock);
+	ra->exiting = 1;
+	pthread_cond_broadcast(&ra->work);
+	pthread_mutex_unlock(&ra->lock);
+	for (i = 0; i < ra->nworkers; i++)
+		pthread_join(ra->workers[i], NULL);
+
+	fuse_fs_destroy(ra->next);
+	if (ra->show_stats)
+		readahead_print_stats(ra);
+	pthread_cond_destroy(&ra->done);
+	pthread_cond_destroy(&ra->work);
+	pthread_mutex_destroy(&ra->lock);
+	free(ra);
+}
+
+static const struct fuse_operations readahead_oper = {
+	.destroy	= readahead_destroy,
+	.init		= readahead_init,
+	.getattr	= readahead_getattr,
+	.access		= readahead_access,
+	.readlink	= readahead_readlink,
+	.opendir	= readahead_opendir,
+	.readdir	= readahead_readdir,
+	.releasedir	= readahead_releasedir,
+	.mknod		= readahead_mknod,
+	.mkdir		= readahead_mkdir,
+	.symlink	= readahead_symlink,
+	.unlink		= readahead_unlink,
+	.rmdir		= readahead_rmdir,
+	.rename		= readahead_rename,
+	.link		= readahead_link,
+	.chmod		= readahead_chmod,
+	.chown		= readahead_chown,
+	.truncate	= readahead_truncate,
+	.utimens	= readahead_utimens,
+	.create		= readahead_create,
+	.open		= readahead_open,
+	.read_buf	= readahead_read_buf,
+	.write_buf	= readahead_write_buf,
+	.statfs		= readahead_statfs,
+	.flush		= readahead_flush,
+	.release	= readahead_release,
+	.fsync		= readahead_fsync,
+	.fsyncdir	= readahead_fsyncdir,
+	.setxattr	= readahead_setxattr,
+	.getxattr	= readahead_getxattr,
+	.listxattr	= readahead_listxattr,
+	.removexattr	= readahead_removexattr,
+	.lock		= readahead_lock,
+	.flock		= readahead_flock,
+	.bmap		= readahead_bmap,
+	.fallocate	= readahead_fallocate,
+	.copy_file_range = readahead_copy_file_range,
+	.lseek		= readahead_lseek,
+	.statx		= readahead_statx,
+};
+
+#define READAHEAD_OPT(t, p, v) { t, offsetof(struct readahead, p), v }
+
+static const struct fuse_opt readahead_opts[] = {
+	FUSE_OPT_KEY("-h", 0),
+	FUSE_OPT_KEY("--help", 0),
+	READAHEAD_OPT("readahead_window=%u", window, 0),
+	READAHEAD_OPT("readahead_max_window=%u", max_window, 0),
+	READAHEAD_OPT("readahead_max_mem=%u", max_mem, 0),
+	READAHEAD_OPT("readahead_threads=%u", threads, 0),
+	READAHEAD_OPT("readahead_stats", show_stats, 1),
+	FUSE_OPT_END
+};
+
+static void readahead_help(void)
+{
+	printf(
+"    -o readahead_window=N      initial prefetch size in bytes (262144)\n"
+"    -o readahead_max_window=N  maximum prefetch size in bytes (4194304)\n"
+"    -o readahead_max_mem=N     memory limit for prefetched data (67108864)\n"
+"    -o readahead_threads=N     number of prefetch threads (4)\n"
+"    -o readahead_stats         log prefetch statistics when unmounting\n");
+}
+
+static int readahead_opt_proc(void *data, const char *arg, int key,
+			      struct fuse_args *outargs)
+{
+	(void) data; (void) arg; (void) outargs;
+
+	if (!key) {
+		readahead_help();
+		return -1;
+	}
+
+	return 1;
+}
+
+static struct fuse_fs *readahead_new(struct fuse_args *args,
+				     struct fuse_fs *next[])
+{
+	struct fuse_fs *fs;
+	struct readahead *ra;
+
+	ra = calloc(1, sizeof(struct readahead));
+	if (ra == NULL) {
+		fuse_log(FUSE_LOG_ERR, "fuse-readahead: memory allocation failed\n");
+		return NULL;
+	}
+
+	ra->window = DEFAULT_WINDOW;
+	ra->max_window = DEFAULT_MAX_WINDOW;
+	ra->max_mem = DEFAULT_MAX_MEM;
+	ra->threads = DEFAULT_THREADS;
+	if (fuse_opt_parse(args, ra, readahead_opts, readahead_opt_proc) == -1)
+		goto out_free;
+
+	if (!next[0] || next[1]) {
+		fuse_log(FUSE_LOG_ERR, "fuse-readahead: exactly one next filesystem required\n");
+		goto out_free;
+	}
+
+	if (!ra->window || ra->max_window < ra->window) {
+		fuse_log(FUSE_LOG_ERR, "fuse-readahead: invalid window size\n");
+		goto out_free;
+	}
+	if (ra->threads > MAX_THREADS)
+		ra->threads = MAX_THREADS;
+
+	pthread_mutex_init(&ra->lock, NULL);
+	pthread_cond_init(&ra->work, NULL);
+	pthread_cond_init(&ra->done, NULL);
+	ra->files.next = ra->files.prev = &ra->files;
+	ra->queue_tail = &ra->queue;
+	ra->next = next[0];
+	fs = fuse_fs_new(&readahead_oper, sizeof(readahead_oper), ra);
+	if (!fs)
+		goto out_destroy;
+	return fs;
+
+out_destroy:
+	pthread_cond_destroy(&ra->done);
+	pthread_cond_destroy(&ra->work);
+	pthread_mutex_destroy(&ra->lock);
+out_free:
+	free(ra);
+	return NULL;
+}
+
+FUSE_REGISTER_MODULE(readahead, readahead_new);
@@ -0,0 +1,1020 @@
+/*
+  fuse stats module: per-operation latency statistics
+  Copyright (C) 2026  agent <agent@local>
+
+  This program can be distributed under the terms of the GNU LGPLv2.
+  See the file COPYING.LIB
+*/
+
+#include <config.h>
+
+#include <fuse.h>
+#include "fuse_i.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+
+#define DEFAULT_SLOW 1.0
+
+/* Bucket i counts calls that took less than 2^i microseconds */
+#define NBUCKETS 32
+
+enum stats_op {
+	OP_GETATTR,
+	OP_STATX,
+	OP_ACCESS,
+	OP_READLINK,
+	OP_OPENDIR,
+	OP_READDIR,
+	OP_RELEASEDIR,
+	OP_MKNOD,
+	OP_MKDIR,
+	OP_SYMLINK,
+	OP_UNLINK,
+	OP_RMDIR,
+	OP_RENAME,
+	OP_LINK,
+	OP_CHMOD,
+	OP_CHOWN,
+	OP_TRUNCATE,
+	OP_UTIMENS,
+	OP_CREATE,
+	OP_OPEN,
+	OP_READ,
+	OP_WRITE,
+	OP_STATFS,
+	OP_FLUSH,
+	OP_RELEASE,
+	OP_FSYNC,
+	OP_FSYNCDIR,
+	OP_SETXATTR,
+	OP_GETXATTR,
+	OP_LISTXATTR,
+	OP_REMOVEXATTR,
+	OP_LOCK,
+	OP_FLOCK,
+	OP_BMAP,
+	OP_IOCTL,
+	OP_POLL,
+	OP_FALLOCATE,
+	OP_COPY_FILE_RANGE,
+	OP_LSEEK,
+	OP_COUNT
+};
+
+static const char *stats_op_names[OP_COUNT] = {
+	[OP_GETATTR]		= "getattr",
+	[OP_STATX]		= "statx",
+	[OP_ACCESS]		= "access",
+	[OP_READLINK]		= "readlink",
+	[OP_OPENDIR]		= "opendir",
+	[OP_READDIR]		= "readdir",
+	[OP_RELEASEDIR]		= "releasedir",
+	[OP_MKNOD]		= "mknod",
+	[OP_MKDIR]		= "mkdir",
+	[OP_SYMLINK]		= "symlink",
+	[OP_UNLINK]		= "unlink",
+	[OP_RMDIR]		= "rmdir",
+	[OP_RENAME]		= "rename",
+	[OP_LINK]		= "link",
+	[OP_CHMOD]		= "chmod",
+	[OP_CHOWN]		= "chown",
+	[OP_TRUNCATE]		= "truncate",
+	[OP_UTIMENS]		= "utimens",
+	[OP_CREATE]		= "create",
+	[OP_OPEN]		= "open",
+	[OP_READ]		= "read",
+	[OP_WRITE]		= "write",
+	[OP_STATFS]		= "statfs",
+	[OP_FLUSH]		= "flush",
+	[OP_RELEASE]		= "release",
+	[OP_FSYNC]		= "fsync",
+	[OP_FSYNCDIR]		= "fsyncdir",
+	[OP_SETXATTR]		= "setxattr",
+	[OP_GETXATTR]		= "getxattr",
+	[OP_LISTXATTR]		= "listxattr",
+	[OP_REMOVEXATTR]	= "removexattr",
+	[OP_LOCK]		= "lock",
+	[OP_FLOCK]		= "flock",
+	[OP_BMAP]		= "bmap",
+	[OP_IOCTL]		= "ioctl",
+	[OP_POLL]		= "poll",
+	[OP_FALLOCATE]		= "fallocate",
+	[OP_COPY_FILE_RANGE]	= "copy_file_range",
+	[OP_LSEEK]		= "lseek",
+};
+
+struct stats_hist {
+	pthread_mutex_t lock;
+	unsigned long long calls;
+	unsigned long long errors;
+	unsigned long long total_ns;
+	unsigned long long max_ns;
+	unsigned long long buckets[NBUCKETS];
+};
+
+struct stats {
+	double slow;
+	int signal;
+	int signal_active;
+	unsigned long long slow_ns;
+	struct fuse *fuse;
+	struct stats_hist ops[OP_COUNT];
+	struct stats *next_instance;
+	struct fuse_fs *next;
+};
+
+/* Instances that fuse_stats_dump() and the dump signal know about */
+static pthread_mutex_t stats_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct stats *stats_list;
+
+/* The signal handler wakes up a thread through a pipe */
+static int stats_signal_users;
+static int stats_signo;
+static int stats_pipe[2] = { -1, -1 };
+static pthread_t stats_signal_thread;
+
+static struct stats *stats_get(void)
+{
+	return fuse_get_context()->private_data;
+}
+
+static void stats_start(struct timespec *start)
+{
+	clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+static void stats_end(struct stats *st, enum stats_op op, const char *path,
+		      const struct timespec *start, int res)
+{
+	struct stats_hist *h = &st->ops[op];
+	unsigned long long ns;
+	unsigned long long us;
+	struct timespec now;
+	int bucket = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ns = (now.tv_sec - start->tv_sec) * 1000000000ULL +
+		now.tv_nsec - start->tv_nsec;
+	for (us = ns / 1000; us && bucket < NBUCKETS - 1; us >>= 1)
+		bucket++;
+
+	pthread_mutex_lock(&h->lock);
+	h->calls++;
+	if (res < 0)
+		h->errors++;
+	h->total_ns += ns;
+	if (ns > h->max_ns)
+		h->max_ns = ns;
+	h->buckets[bucket]++;
+	pthread_mutex_unlock(&h->lock);
+
+	if (st->slow_ns && ns >= st->slow_ns)
+		fuse_log(FUSE_LOG_NOTICE, "fuse-stats: slow %s on %s: %.3f ms, result %i\n",
+			 stats_op_names[op], path ? path : "(no path)",
+			 ns / 1000000.0, res);
+}
+
+/* Upper bound in microseconds of the p-th percentile */
+static unsigned long long stats_percentile(struct stats_hist *h, double p)
+{
+	unsigned long long want = h->calls * p;
+	unsigned long long seen = 0;
+	int i;
+
+	for (i = 0; i < NBUCKETS - 1; i++) {
+		seen += h->buckets[i];
+		if (seen > want)
+			break;
+	}
+	if (i == NBUCKETS - 1 || (1ULL << i) * 1000 > h->max_ns)
+		return h->max_ns / 1000;
+	return 1ULL << i;
+}
+
+static void stats_dump(struct stats *st)
+{
+	char line[NBUCKETS * 48];
+	int op;
+	int i;
+
+	fuse_log(FUSE_LOG_INFO, "fuse-stats: %-16s %10s %8s %10s %10s %10s %10s %10s\n",
+		 "operation", "calls", "errors", "avg us", "p50 us",
+		 "p90 us", "p99 us", "max us");
+	for (op = 0; op < OP_COUNT; op++) {
+		struct stats_hist h;
+		size_t len = 0;
+
+		pthread_mutex_lock(&st->ops[op].lock);
+		h = st->ops[op];
+		pthread_mutex_unlock(&st->ops[op].lock);
+		if (!h.calls)
+			continue;
+
+		fuse_log(FUSE_LOG_INFO, "fuse-stats: %-16s %10llu %8llu %10llu %10llu %10llu %10llu %10llu\n",
+			 stats_op_names[op], h.calls, h.errors,
+			 h.total_ns / h.calls / 1000,
+			 stats_percentile(&h, 0.5), stats_percentile(&h, 0.9),
+			 stats_percentile(&h, 0.99), h.max_ns / 1000);
+
+		line[0] = '\0';
+		for (i = 0; i < NBUCKETS; i++) {
+			if (!h.buckets[i])
+				continue;
+			len += snprintf(line + len, sizeof(line) - len,
+					i < NBUCKETS - 1 ? " <%llu:%llu" :
+					" >=%llu:%llu",
+					1ULL << (i < NBUCKETS - 1 ? i : i - 1),
+					h.buckets[i]);
+		}
+		fuse_log(FUSE_LOG_INFO, "fuse-stats: %-16s%s\n", "", line);
+	}
+}
+
+int fuse_stats_dump(struct fuse *f)
+{
+	struct stats *st;
+	int found = 0;
+
+	pthread_mutex_lock(&stats_list_lock);
+	for (st = stats_list; st; st = st->next_instance) {
+		if (f && st->fuse != f)
+			continue;
+		stats_dump(st);
+		found = 1;
+	}
+	pthread_mutex_unlock(&stats_list_lock);
+
+	return found ? 0 : -ENOENT;
+}
+
+static void stats_signal_handler(int sig)
+{
+	int saved_errno = errno;
+	ssize_t res;
+
+	(void) sig;
+	res = write(stats_pipe[1], "", 1);
+	(void) res;
+	errno = saved_errno;
+}
+
+static void *stats_signal_loop(void *data)
+{
+	char buf[64];
+
+	(void) data;
+	for (;;) {
+		ssize_t res = read(stats_pipe[0], buf, sizeof(buf));
+
+		if (res == -1 && errno == EINTR)
+			continue;
+		if (res <= 0)
+			break;
+		fuse_stats_dump(NULL);
+	}
+	return NULL;
+}
+
+static int stats_set_handler(int sig, void (*handler)(int), int remove)
+{
+	struct sigaction sa;
+	struct sigaction old_sa;
+
+	memset(&sa, 0, sizeof(struct sigaction));
+	sa.sa_handler = remove ? SIG_DFL : handler;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART;
+
+	if (sigaction(sig, NULL, &old_sa) == -1)
+		return -1;
+	/* Leave handlers installed by the application alone */
+	if (old_sa.sa_handler != (remove ? handler : SIG_DFL))
+		return remove ? 0 : -1;
+	return sigaction(sig, &sa, NULL);
+}
+
+/* Called with stats_list_lock held */
+static void stats_signal_start(struct stats *st)
+{
+	if (stats_signal_users) {
+		if (st->signal != stats_signo)
+			fuse_log(FUSE_LOG_ERR, "fuse-stats: already dumping on signal %i\n",
+				 stats_signo);
+		else {
+			stats_signal_users++;
+			st->signal_active = 1;
+		}
+		return;
+	}
+
+	if (pipe(stats_pipe) == -1) {
+		fuse_log(FUSE_LOG_ERR, "fuse-stats: pipe: %s\n",
+			 strerror(errno));
+		return;
+	}
+	fcntl(stats_pipe[0], F_SETFD, FD_CLOEXEC);
+	fcntl(stats_pipe[1], F_SETFD, FD_CLOEXEC);
+	fcntl(stats_pipe[1], F_SETFL, O_NONBLOCK);
+	if (fuse_start_thread(&stats_signal_thread, stats_signal_loop,
+			      NULL) == -1)
+		goto out_close;
+	if (stats_set_handler(st->signal, stats_signal_handler, 0) == -1) {
+		fuse_log(FUSE_LOG_ERR, "fuse-stats: signal %i is already in use\n",
+			 st->signal);
+		goto out_join;
+	}
+	stats_signo = st->signal;
+	stats_signal_users = 1;
+	st->signal_active = 1;
+	return;
+
+out_join:
+	close(stats_pipe[1]);
+	pthread_join(stats_signal_thread, NULL);
+	close(stats_pipe[0]);
+	return;
+out_close:
+	close(stats_pipe[0]);
+	close(stats_pipe[1]);
+}
+
+/* Called with stats_list_lock held */
+static void stats_signal_stop(struct stats *st)
+{
+	if (!st->signal_active || --stats_signal_users)
+		return;
+
+	stats_set_handler(stats_signo, stats_signal_handler, 1);
+	/* The thread takes stats_list_lock for dumping */
+	pthread_mutex_unlock(&stats_list_lock);
+	close(stats_pipe[1]);
+	pthread_join(stats_signal_thread, NULL);
+	close(stats_pipe[0]);
+	pthread_mutex_lock(&stats_list_lock);
+}
+
+static int stats_getattr(const char *path, struct stat *stbuf,
+			 struct fuse_file_info *fi)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_getattr(st->next, path, stbuf, fi);
+	stats_end(st, OP_GETATTR, path, &start, err);
+	return err;
+}
+
+static int stats_statx(const char *path, int flags, int mask,
+		       struct statx *stxbuf, struct fuse_file_info *fi)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_statx(st->next, path, flags, mask, stxbuf, fi);
+	stats_end(st, OP_STATX, path, &start, err);
+	return err;
+}
+
+static int stats_access(const char *path, int mask)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_access(st->next, path, mask);
+	stats_end(st, OP_ACCESS, path, &start, err);
+	return err;
+}
+
+static int stats_readlink(const char *path, char *buf, size_t size)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_readlink(st->next, path, buf, size);
+	stats_end(st, OP_READLINK, path, &start, err);
+	return err;
+}
+
+static int stats_opendir(const char *path, struct fuse_file_info *fi)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_opendir(st->next, path, fi);
+	stats_end(st, OP_OPENDIR, path, &start, err);
+	return err;
+}
+
+static int stats_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
+			 off_t offset, struct fuse_file_info *fi,
+			 enum fuse_readdir_flags flags)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_readdir(st->next, path, buf, filler, offset, fi, flags);
+	stats_end(st, OP_READDIR, path, &start, err);
+	return err;
+}
+
+static int stats_releasedir(const char *path, struct fuse_file_info *fi)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_releasedir(st->next, path, fi);
+	stats_end(st, OP_RELEASEDIR, path, &start, err);
+	return err;
+}
+
+static int stats_mknod(const char *path, mode_t mode, dev_t rdev)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_mknod(st->next, path, mode, rdev);
+	stats_end(st, OP_MKNOD, path, &start, err);
+	return err;
+}
+
+static int stats_mkdir(const char *path, mode_t mode)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_mkdir(st->next, path, mode);
+	stats_end(st, OP_MKDIR, path, &start, err);
+	return err;
+}
+
+static int stats_unlink(const char *path)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_unlink(st->next, path);
+	stats_end(st, OP_UNLINK, path, &start, err);
+	return err;
+}
+
+static int stats_rmdir(const char *path)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_rmdir(st->next, path);
+	stats_end(st, OP_RMDIR, path, &start, err);
+	return err;
+}
+
+static int stats_symlink(const char *from, const char *path)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_symlink(st->next, from, path);
+	stats_end(st, OP_SYMLINK, path, &start, err);
+	return err;
+}
+
+static int stats_rename(const char *from, const char *to, unsigned int flags)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_rename(st->next, from, to, flags);
+	stats_end(st, OP_RENAME, from, &start, err);
+	return err;
+}
+
+static int stats_link(const char *from, const char *to)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_link(st->next, from, to);
+	stats_end(st, OP_LINK, to, &start, err);
+	return err;
+}
+
+static int stats_chmod(const char *path, mode_t mode,
+		       struct fuse_file_info *fi)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_chmod(st->next, path, mode, fi);
+	stats_end(st, OP_CHMOD, path, &start, err);
+	return err;
+}
+
+static int stats_chown(const char *path, uid_t uid, gid_t gid,
+		       struct fuse_file_info *fi)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_chown(st->next, path, uid, gid, fi);
+	stats_end(st, OP_CHOWN, path, &start, err);
+	return err;
+}
+
+static int stats_truncate(const char *path, off_t size,
+			  struct fuse_file_info *fi)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_truncate(st->next, path, size, fi);
+	stats_end(st, OP_TRUNCATE, path, &start, err);
+	return err;
+}
+
+static int stats_utimens(const char *path, const struct timespec ts[2],
+			 struct fuse_file_info *fi)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_utimens(st->next, path, ts, fi);
+	stats_end(st, OP_UTIMENS, path, &start, err);
+	return err;
+}
+
+static int stats_create(const char *path, mode_t mode,
+			struct fuse_file_info *fi)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_create(st->next, path, mode, fi);
+	stats_end(st, OP_CREATE, path, &start, err);
+	return err;
+}
+
+static int stats_open(const char *path, struct fuse_file_info *fi)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_open(st->next, path, fi);
+	stats_end(st, OP_OPEN, path, &start, err);
+	return err;
+}
+
+static int stats_read_buf(const char *path, struct fuse_bufvec **bufp,
+			  size_t size, off_t offset, struct fuse_file_info *fi)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_read_buf(st->next, path, bufp, size, offset, fi);
+	stats_end(st, OP_READ, path, &start, err);
+	return err;
+}
+
+static int stats_write_buf(const char *path, struct fuse_bufvec *buf,
+			   off_t offset, struct fuse_file_info *fi)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int res;
+
+	stats_start(&start);
+	res = fuse_fs_write_buf(st->next, path, buf, offset, fi);
+	stats_end(st, OP_WRITE, path, &start, res);
+	return res;
+}
+
+static int stats_statfs(const char *path, struct statvfs *stbuf)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_statfs(st->next, path, stbuf);
+	stats_end(st, OP_STATFS, path, &start, err);
+	return err;
+}
+
+static int stats_flush(const char *path, struct fuse_file_info *fi)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_flush(st->next, path, fi);
+	stats_end(st, OP_FLUSH, path, &start, err);
+	return err;
+}
+
+static int stats_release(const char *path, struct fuse_file_info *fi)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_release(st->next, path, fi);
+	stats_end(st, OP_RELEASE, path, &start, err);
+	return err;
+}
+
+static int stats_fsync(const char *path, int isdatasync,
+		       struct fuse_file_info *fi)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_fsync(st->next, path, isdatasync, fi);
+	stats_end(st, OP_FSYNC, path, &start, err);
+	return err;
+}
+
+static int stats_fsyncdir(const char *path, int isdatasync,
+			  struct fuse_file_info *fi)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_fsyncdir(st->next, path, isdatasync, fi);
+	stats_end(st, OP_FSYNCDIR, path, &start, err);
+	return err;
+}
+
+static int stats_setxattr(const char *path, const char *name,
+			  const char *value, size_t size, int flags)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_setxattr(st->next, path, name, value, size, flags);
+	stats_end(st, OP_SETXATTR, path, &start, err);
+	return err;
+}
+
+static int stats_getxattr(const char *path, const char *name, char *value,
+			  size_t size)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_getxattr(st->next, path, name, value, size);
+	stats_end(st, OP_GETXATTR, path, &start, err);
+	return err;
+}
+
+static int stats_listxattr(const char *path, char *list, size_t size)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_listxattr(st->next, path, list, size);
+	stats_end(st, OP_LISTXATTR, path, &start, err);
+	return err;
+}
+
+static int stats_removexattr(const char *path, const char *name)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_removexattr(st->next, path, name);
+	stats_end(st, OP_REMOVEXATTR, path, &start, err);
+	return err;
+}
+
+static int stats_lock(const char *path, struct fuse_file_info *fi, int cmd,
+		      struct flock *lock)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_lock(st->next, path, fi, cmd, lock);
+	stats_end(st, OP_LOCK, path, &start, err);
+	return err;
+}
+
+static int stats_flock(const char *path, struct fuse_file_info *fi, int op)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_flock(st->next, path, fi, op);
+	stats_end(st, OP_FLOCK, path, &start, err);
+	return err;
+}
+
+static int stats_bmap(const char *path, size_t blocksize, uint64_t *idx)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_bmap(st->next, path, blocksize, idx);
+	stats_end(st, OP_BMAP, path, &start, err);
+	return err;
+}
+
+static int stats_ioctl(const char *path, unsigned int cmd, void *arg,
+		       struct fuse_file_info *fi, unsigned int flags,
+		       void *data)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_ioctl(st->next, path, cmd, arg, fi, flags, data);
+	stats_end(st, OP_IOCTL, path, &start, err);
+	return err;
+}
+
+static int stats_poll(const char *path, struct fuse_file_info *fi,
+		      struct fuse_pollhandle *ph, unsigned *reventsp)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_poll(st->next, path, fi, ph, reventsp);
+	stats_end(st, OP_POLL, path, &start, err);
+	return err;
+}
+
+static int stats_fallocate(const char *path, int mode, off_t offset,
+			   off_t length, struct fuse_file_info *fi)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	int err;
+
+	stats_start(&start);
+	err = fuse_fs_fallocate(st->next, path, mode, offset, length, fi);
+	stats_end(st, OP_FALLOCATE, path, &start, err);
+	return err;
+}
+
+static ssize_t stats_copy_file_range(const char *path_in,
+				     struct fuse_file_info *fi_in,
+				     off_t off_in, const char *path_out,
+				     struct fuse_file_info *fi_out,
+				     off_t off_out, size_t len, int flags)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	ssize_t res;
+
+	stats_start(&start);
+	res = fuse_fs_copy_file_range(st->next, path_in, fi_in, off_in,
+				      path_out, fi_out, off_out, len, flags);
+	stats_end(st, OP_COPY_FILE_RANGE, path_out, &start, res < 0 ? res : 0);
+	return res;
+}
+
+static off_t stats_lseek(const char *path, off_t off, int whence,
+			 struct fuse_file_info *fi)
+{
+	struct stats *st = stats_get();
+	struct timespec start;
+	off_t res;
+
+	stats_start(&start);
+	res = fuse_fs_lseek(st->next, path, off, whence, fi);
+	stats_end(st, OP_LSEEK, path, &start, res < 0 ? res : 0);
+	return res;
+}
+
+static void *stats_init(struct fuse_conn_info *conn, struct fuse_config *cfg)
+{
+	struct stats *st = stats_get();
+
+	st->fuse = fuse_get_context()->fuse;
+	fuse_fs_init(st->next, conn, cfg);
+	/* Don't touch cfg->nullpath_ok, we can work with
+	   either */
+
+	pthread_mutex_lock(&stats_list_lock);
+	st->next_instance = stats_list;
+	stats_list = st;
+	if (st->signal)
+		stats_signal_start(st);
+	pthread_mutex_unlock(&stats_list_lock);
+
+	return st;
+}
+
+static void stats_destroy(void *data)
+{
+	struct stats *st = data;
+	struct stats **stp;
+	int op;
+
+	fuse_fs_destroy(st->next);
+
+	pthread_mutex_lock(&stats_list_lock);
+	stats_signal_stop(st);
+	for (stp = &stats_list; *stp; stp = &(*stp)->next_instance) {
+		if (*stp == st) {
+			*stp = st->next_instance;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&stats_list_lock);
+
+	stats_dump(st);
+	for (op = 0; op < OP_COUNT; op++)
+		pthread_mutex_destroy(&st->ops[op].lock);
+	free(st);
+}
+
+static const struct fuse_operations stats_oper = {
+	.destroy	= stats_destroy,
+	.init		= stats_init,
+	.getattr	= stats_getattr,
+	.access		= stats_access,
+	.readlink	= stats_readlink,
+	.opendir	= stats_opendir,
+	.readdir	= stats_readdir,
+	.releasedir	= stats_releasedir,
+	.mknod		= stats_mknod,
+	.mkdir		= stats_mkdir,
+	.symlink	= stats_symlink,
+	.unlink		= stats_unlink,
+	.rmdir		= stats_rmdir,
+	.rename		= stats_rename,
+	.link		= stats_link,
+	.chmod		= stats_chmod,
+	.chown		= stats_chown,
+	.truncate	= stats_truncate,
+	.utimens	= stats_utimens,
+	.create		= stats_create,
+	.open		= stats_open,
+	.read_buf	= stats_read_buf,
+	.write_buf	= stats_write_buf,
+	.statfs		= stats_statfs,
+	.flush		= stats_flush,
+	.release	= stats_release,
+	.fsync		= stats_fsync,
+	.fsyncdir	= stats_fsyncdir,
+	.setxattr	= stats_setxattr,
+	.getxattr	= stats_getxattr,
+	.listxattr	= stats_listxattr,
+	.removexattr	= stats_removexattr,
+	.lock		= stats_lock,
+	.flock		= stats_flock,
+	.bmap		= stats_bmap,
+	.ioctl		= stats_ioctl,
+	.poll		= stats_poll,
+	.fallocate	= stats_fallocate,
+	.copy_file_range = stats_copy_file_range,
+	.lseek		= stats_lseek,
+	.statx		= stats_statx,
+};
+
+#define STATS_OPT(t, p, v) { t, offsetof(struct stats, p), v }
+
+static const struct fuse_opt stats_opts[] = {
+	FUSE_OPT_KEY("-h", 0),
+	FUSE_OPT_KEY("--help", 0),
+	STATS_OPT("stats_slow=%lf", slow, 0),
+	STATS_OPT("stats_signal=%i", signal, 0),
+	FUSE_OPT_END
+};
+
+static void stats_help(void)
+{
+	printf(
+"    -o stats_slow=T            log calls taking T seconds or more (1.0)\n"
+"    -o stats_signal=N          dump statistics on signal N (SIGUSR1)\n");
+}
+
+static int stats_opt_proc(void *data, const char *arg, int key,
+			  struct fuse_args *outargs)
+{
+	(void) data; (void) arg; (void) outargs;
+
+	if (!key) {
+		stats_help();
+		return -1;
+	}
+
+	return 1;
+}
+
+static struct fuse_fs *stats_new(struct fuse_args *args,
+				 struct fuse_fs *next[])
+{
+	struct fuse_fs *fs;
+	struct stats *st;
+	int op;
+
+	st = calloc(1, sizeof(struct stats));
+	if (st == NULL) {
+		fuse_log(FUSE_LOG_ERR, "fuse-stats: memory allocation failed\n");
+		return NULL;
+	}
+
+	st->slow = DEFAULT_SLOW;
+	st->signal = SIGUSR1;
+	if (fuse_opt_parse(args, st, stats_opts, stats_opt_proc) == -1)
+		goto out_free;
+
+	if (!next[0] || next[1]) {
+		fuse_log(FUSE_LOG_ERR, "fuse-stats: exactly one next filesystem required\n");
+		goto out_free;
+	}
+
+	if (st->signal < 0 || st->signal >= NSIG) {
+		fuse_log(FUSE_LOG_ERR, "fuse-stats: invalid signal number\n");
+		goto out_free;
+	}
+	st->slow_ns = st->slow > 0 ? st->slow * 1000000000.0 : 0;
+
+	for (op = 0; op < OP_COUNT; op++)
+		pthread_mutex_init(&st->ops[op].lock, NULL);
+	st->next = next[0];
+	fs = fuse_fs_new(&stats_oper, sizeof(stats_oper), st);
+	if (!fs)
+		goto out_destroy;
+	return fs;
+
+out_destroy:
+	for (op = 0; op < OP_COUNT; op++)
+		pthread_mutex_destroy(&st->ops[op].lock);
+out_free:
+	free(st);
+	return NULL;
+}
+
+FUSE_REGISTER_MODULE(stats, stats_new);
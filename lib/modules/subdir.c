@@ -553,6 +553,19 @@ static off_t subdir_lseek(const char *path, off_t off, int whence,
 	return res;
 }
 
+static int subdir_statx(const char *path, int flags, int mask,
+			struct statx *stxbuf, struct fuse_file_info *fi)
+{
+	struct subdir *d = subdir_get();
+	char *newpath;
+	int err = subdir_addpath(d, path, &newpath);
+	if (!err) {
+		err = fuse_fs_statx(d->next, newpath, flags, mask, stxbuf, fi);
+		free(newpath);
+	}
+	return err;
+}
+
 static void *subdir_init(struct fuse_conn_info *conn,
 			 struct fuse_config *cfg)
 {
@@ -608,6 +621,7 @@ static const struct fuse_operations subdir_oper = {
 	.flock		= subdir_flock,
 	.bmap		= subdir_bmap,
 	.lseek		= subdir_lseek,
+	.statx		= subdir_statx,
 };
 
 static const struct fuse_opt subdir_opts[] = {
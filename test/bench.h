@@ -0,0 +1,44 @@
+/*
+  FUSE: Filesystem in Userspace
+  Copyright (C) 2026  agent <agent@local>
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+/* Timing helpers shared by the benchmarks */
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <stdio.h>
+#include <time.h>
+
+static inline double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Prints the time since start and the rate of count units per second */
+static inline void bench_report(const char *phase, long count,
+                                const char *unit, double start)
+{
+    double secs = bench_now() - start;
+
+    printf("%-28s %8ld %-4s %10.3f ms %12.0f %s/s\n", phase, count, unit,
+           secs * 1e3, secs > 0 ? count / secs : 0.0, unit);
+}
+
+#endif /* BENCH_H_ */
+
+
+/**
+ * Local Variables:
+ * mode: c
+ * indent-tabs-mode: nil
+ * c-basic-offset: 4
+ * End:
+ */
@@ -0,0 +1,385 @@
+/*
+  FUSE: Filesystem in Userspace
+  Copyright (C) 2026  agent <agent@local>
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+/*
+ * Test for the cache module.  The kernel caches nothing, so every
+ * stat, readlink and listing reaches the module.  Repeating them must
+ * not reach the file system below, a missing name must be answered
+ * from its negative entry, and unlink, rename and write through the
+ * mount must drop what was cached for the names involved.
+ */
+
+#define FUSE_USE_VERSION 32
+
+#include <config.h>
+#include <fuse.h>
+#include <fuse_lowlevel.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#ifndef __linux__
+#include <limits.h>
+#else
+#include <linux/limits.h>
+#endif
+
+#define MAX_FILES 16
+
+struct tfs_file {
+    char name[16];
+    mode_t mode;
+    off_t size;
+    const char *target;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct tfs_file files[MAX_FILES] = {
+    { "file", S_IFREG | 0644, 100, NULL },
+    { "link", S_IFLNK | 0777, 4, "file" },
+    { "victim", S_IFREG | 0644, 0, NULL },
+    { "old", S_IFREG | 0644, 0, NULL },
+};
+static int num_files = 4;
+static int getattr_cnt;
+static int readlink_cnt;
+static int readdir_cnt;
+
+static struct tfs_file *find_file(const char *path)
+{
+    int i;
+
+    for (i = 0; i < num_files; i++) {
+        if (path[0] == '/' && strcmp(path + 1, files[i].name) == 0)
+            return &files[i];
+    }
+    return NULL;
+}
+
+static void *tfs_init(struct fuse_conn_info *conn, struct fuse_config *cfg)
+{
+    (void) conn;
+    /* Leave all caching to the module */
+    cfg->entry_timeout = 0;
+    cfg->negative_timeout = 0;
+    cfg->attr_timeout = 0;
+    return NULL;
+}
+
+static int tfs_getattr(const char *path, struct stat *stbuf,
+                       struct fuse_file_info *fi)
+{
+    struct tfs_file *f;
+    int res = 0;
+
+    (void) fi;
+    __atomic_add_fetch(&getattr_cnt, 1, __ATOMIC_SEQ_CST);
+    memset(stbuf, 0, sizeof(*stbuf));
+    pthread_mutex_lock(&lock);
+    if (strcmp(path, "/") == 0) {
+        stbuf->st_mode = S_IFDIR | 0755;
+        stbuf->st_nlink = 2;
+    } else if ((f = find_file(path)) != NULL) {
+        stbuf->st_mode = f->mode;
+        stbuf->st_nlink = 1;
+        stbuf->st_size = f->size;
+    } else
+        res = -ENOENT;
+    pthread_mutex_unlock(&lock);
+
+    return res;
+}
+
+static int tfs_readlink(const char *path, char *buf, size_t size)
+{
+    struct tfs_file *f;
+    int res = 0;
+
+    __atomic_add_fetch(&readlink_cnt, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&lock);
+    f = find_file(path);
+    if (f == NULL)
+        res = -ENOENT;
+    else if (!S_ISLNK(f->mode))
+        res = -EINVAL;
+    else
+        snprintf(buf, size, "%s", f->target);
+    pthread_mutex_unlock(&lock);
+
+    return res;
+}
+
+static int tfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
+                       off_t offset, struct fuse_file_info *fi,
+                       enum fuse_readdir_flags flags)
+{
+    int i;
+
+    (void) offset; (void) fi; (void) flags;
+    if (strcmp(path, "/") != 0)
+        return -ENOTDIR;
+
+    __atomic_add_fetch(&readdir_cnt, 1, __ATOMIC_SEQ_CST);
+    filler(buf, ".", NULL, 0, 0);
+    filler(buf, "..", NULL, 0, 0);
+    pthread_mutex_lock(&lock);
+    for (i = 0; i < num_files; i++)
+        filler(buf, files[i].name, NULL, 0, 0);
+    pthread_mutex_unlock(&lock);
+
+    return 0;
+}
+
+static int tfs_unlink(const char *path)
+{
+    struct tfs_file *f;
+    int res = 0;
+
+    pthread_mutex_lock(&lock);
+    f = find_file(path);
+    if (f == NULL)
+        res = -ENOENT;
+    else
+        *f = files[--num_files];
+    pthread_mutex_unlock(&lock);
+
+    return res;
+}
+
+static int tfs_rename(const char *from, const char *to, unsigned int flags)
+{
+    struct tfs_file *f;
+    int res = 0;
+
+    if (flags)
+        return -EINVAL;
+    pthread_mutex_lock(&lock);
+    f = find_file(from);
+    if (f == NULL)
+        res = -ENOENT;
+    else if (find_file(to) != NULL || strlen(to + 1) >= sizeof(f->name))
+        res = -EINVAL;
+    else
+        strcpy(f->name, to + 1);
+    pthread_mutex_unlock(&lock);
+
+    return res;
+}
+
+static int tfs_open(const char *path, struct fuse_file_info *fi)
+{
+    struct tfs_file *f;
+
+    (void) fi;
+    pthread_mutex_lock(&lock);
+    f = find_file(path);
+    pthread_mutex_unlock(&lock);
+
+    return f ? 0 : -ENOENT;
+}
+
+static int tfs_write(const char *path, const char *buf, size_t size,
+                     off_t offset, struct fuse_file_info *fi)
+{
+    struct tfs_file *f;
+    int res = size;
+
+    (void) buf; (void) fi;
+    pthread_mutex_lock(&lock);
+    f = find_file(path);
+    if (f == NULL)
+        res = -ENOENT;
+    else if (offset + (off_t) size > f->size)
+        f->size = offset + size;
+    pthread_mutex_unlock(&lock);
+
+    return res;
+}
+
+static const struct fuse_operations tfs_oper = {
+    .init       = tfs_init,
+    .getattr    = tfs_getattr,
+    .readlink   = tfs_readlink,
+    .readdir    = tfs_readdir,
+    .unlink     = tfs_unlink,
+    .rename     = tfs_rename,
+    .open       = tfs_open,
+    .write      = tfs_write,
+};
+
+static int counter(int *cnt)
+{
+    return __atomic_load_n(cnt, __ATOMIC_SEQ_CST);
+}
+
+static int listed(const char *mountpoint, const char *name)
+{
+    struct dirent *de;
+    int found = 0;
+    DIR *dirp;
+
+    dirp = opendir(mountpoint);
+    assert(dirp != NULL);
+    while ((de = readdir(dirp)) != NULL) {
+        if (strcmp(de->d_name, name) == 0)
+            found = 1;
+    }
+    closedir(dirp);
+    return found;
+}
+
+static int exists(const char *mountpoint, const char *name)
+{
+    char fname[PATH_MAX];
+    struct stat stbuf;
+
+    assert(snprintf(fname, PATH_MAX, "%s/%s", mountpoint, name) > 0);
+    if (stat(fname, &stbuf) == 0)
+        return 1;
+    assert(errno == ENOENT);
+    return 0;
+}
+
+static off_t file_size(const char *fname)
+{
+    struct stat stbuf;
+
+    assert(stat(fname, &stbuf) == 0);
+    return stbuf.st_size;
+}
+
+static void test_fs(const char *mountpoint)
+{
+    char fname[PATH_MAX];
+    char from[PATH_MAX];
+    char target[16];
+    int before;
+    int fd;
+
+    /* Attributes */
+    assert(snprintf(fname, PATH_MAX, "%s/file", mountpoint) > 0);
+    assert(file_size(fname) == 100);
+    before = counter(&getattr_cnt);
+    assert(file_size(fname) == 100);
+    assert(counter(&getattr_cnt) == before);
+
+    /* Negative entries */
+    assert(!exists(mountpoint, "missing"));
+    before = counter(&getattr_cnt);
+    assert(!exists(mountpoint, "missing"));
+    assert(counter(&getattr_cnt) == before);
+
+    /* Symlink targets */
+    assert(snprintf(fname, PATH_MAX, "%s/link", mountpoint) > 0);
+    assert(readlink(fname, target, sizeof(target)) == 4);
+    before = counter(&readlink_cnt);
+    assert(readlink(fname, target, sizeof(target)) == 4);
+    assert(memcmp(target, "file", 4) == 0);
+    assert(counter(&readlink_cnt) == before);
+
+    /* Listings */
+    assert(listed(mountpoint, "victim"));
+    before = counter(&readdir_cnt);
+    assert(listed(mountpoint, "victim"));
+    assert(counter(&readdir_cnt) == before);
+
+    /* Unlink drops the entry and the listing of the parent */
+    assert(exists(mountpoint, "victim"));
+    assert(snprintf(fname, PATH_MAX, "%s/victim", mountpoint) > 0);
+    assert(unlink(fname) == 0);
+    assert(!exists(mountpoint, "victim"));
+    assert(!listed(mountpoint, "victim"));
+
+    /* Rename drops both names, including a negative entry */
+    assert(exists(mountpoint, "old"));
+    assert(!exists(mountpoint, "new"));
+    assert(snprintf(from, PATH_MAX, "%s/old", mountpoint) > 0);
+    assert(snprintf(fname, PATH_MAX, "%s/new", mountpoint) > 0);
+    assert(rename(from, fname) == 0);
+    assert(!exists(mountpoint, "old"));
+    assert(exists(mountpoint, "new"));
+    assert(listed(mountpoint, "new"));
+    assert(!listed(mountpoint, "old"));
+
+    /* Write drops the attributes */
+    assert(snprintf(fname, PATH_MAX, "%s/file", mountpoint) > 0);
+    assert(file_size(fname) == 100);
+    fd = open(fname, O_WRONLY);
+    assert(fd != -1);
+    assert(pwrite(fd, "data", 4, 200) == 4);
+    assert(close(fd) == 0);
+    before = counter(&getattr_cnt);
+    assert(file_size(fname) == 204);
+    assert(counter(&getattr_cnt) > before);
+
+    printf("%d getattr, %d readlink, %d readdir calls\n",
+           counter(&getattr_cnt), counter(&readlink_cnt),
+           counter(&readdir_cnt));
+}
+
+static void *run_fs(void *data)
+{
+    struct fuse *fuse = (struct fuse *) data;
+    assert(fuse_loop(fuse) == 0);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+    struct fuse_cmdline_opts fuse_opts;
+    struct fuse *fuse;
+    pthread_t fs_thread;
+
+    assert(fuse_parse_cmdline(&args, &fuse_opts) == 0);
+    assert(fuse_opts.mountpoint != NULL);
+#ifndef __FreeBSD__
+    assert(fuse_opt_add_arg(&args, "-oauto_unmount") == 0);
+#endif
+    assert(fuse_opt_add_arg(&args, "-omodules=cache,cache_timeout=60,"
+                            "cache_negative_timeout=60") == 0);
+    fuse = fuse_new(&args, &tfs_oper, sizeof(tfs_oper), NULL);
+    fuse_opt_free_args(&args);
+    assert(fuse != NULL);
+    assert(fuse_set_signal_handlers(fuse_get_session(fuse)) == 0);
+    assert(fuse_mount(fuse, fuse_opts.mountpoint) == 0);
+
+    /* Start file-system thread */
+    assert(pthread_create(&fs_thread, NULL, run_fs, (void *)fuse) == 0);
+
+    test_fs(fuse_opts.mountpoint);
+    free(fuse_opts.mountpoint);
+
+    /* Stop file system */
+    fuse_exit(fuse);
+    fuse_unmount(fuse);
+    assert(pthread_join(fs_thread, NULL) == 0);
+
+    fuse_remove_signal_handlers(fuse_get_session(fuse));
+    fuse_destroy(fuse);
+
+    printf("Test completed successfully.\n");
+    return 0;
+}
+
+
+/**
+ * Local Variables:
+ * mode: c
+ * indent-tabs-mode: nil
+ * c-basic-offset: 4
+ * End:
+ */
@@ -0,0 +1,268 @@
+/*
+  FUSE: Filesystem in Userspace
+  Copyright (C) 2026  agent <agent@local>
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+/*
+ * Test for the cancellation tokens of the high-level API.  A child
+ * process reads a file whose read handler blocks until its request is
+ * cancelled.  Killing the child must wake up the handler through the
+ * token, which it either polls, registers a callback on, or whose file
+ * descriptor it waits for.
+ */
+
+#define FUSE_USE_VERSION 32
+
+#include <config.h>
+#include <fuse.h>
+#include <fuse_lowlevel.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <assert.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#ifndef __linux__
+#include <limits.h>
+#else
+#include <linux/limits.h>
+#endif
+
+#define FILE_NAME "slow"
+#define WAIT_SECS 10
+
+enum {
+    MODE_POLL,
+    MODE_CALLBACK,
+    MODE_FD,
+};
+
+/* Command line parsing */
+struct options {
+    int mode;
+} options = {
+    .mode = MODE_FD,
+};
+
+#define OPTION(t, p, v)                         \
+    { t, offsetof(struct options, p), v }
+static const struct fuse_opt option_spec[] = {
+    OPTION("--poll", mode, MODE_POLL),
+    OPTION("--callback", mode, MODE_CALLBACK),
+    OPTION("--fd", mode, MODE_FD),
+    FUSE_OPT_END
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static int started;
+static int called;
+static int result;
+
+static void *tfs_init(struct fuse_conn_info *conn, struct fuse_config *cfg)
+{
+    (void) conn;
+    /* Reads must not go through the page cache, they can't be interrupted */
+    cfg->direct_io = 1;
+    return NULL;
+}
+
+static int tfs_getattr(const char *path, struct stat *stbuf,
+                       struct fuse_file_info *fi)
+{
+    (void) fi;
+
+    memset(stbuf, 0, sizeof(*stbuf));
+    if (strcmp(path, "/") == 0) {
+        stbuf->st_mode = S_IFDIR | 0755;
+        stbuf->st_nlink = 2;
+    } else if (strcmp(path, "/" FILE_NAME) == 0) {
+        stbuf->st_mode = S_IFREG | 0444;
+        stbuf->st_nlink = 1;
+        stbuf->st_size = 4096;
+    } else
+        return -ENOENT;
+
+    return 0;
+}
+
+static int tfs_open(const char *path, struct fuse_file_info *fi)
+{
+    (void) fi;
+
+    if (strcmp(path, "/" FILE_NAME) != 0)
+        return -ENOENT;
+    return 0;
+}
+
+static void wait_for(int *flag)
+{
+    struct timespec deadline;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += WAIT_SECS;
+    pthread_mutex_lock(&lock);
+    while (!*flag) {
+        if (pthread_cond_timedwait(&cond, &lock, &deadline) == ETIMEDOUT)
+            break;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+static void set_flag(int *flag, int val)
+{
+    pthread_mutex_lock(&lock);
+    *flag = val;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&lock);
+}
+
+static void cancel_cb(void *data)
+{
+    (void) data;
+    set_flag(&called, 1);
+}
+
+static int tfs_read(const char *path, char *buf, size_t size, off_t offset,
+                    struct fuse_file_info *fi)
+{
+    struct fuse_cancel *cancel = fuse_get_cancel();
+    struct pollfd pfd;
+    int i;
+
+    (void) path; (void) buf; (void) size; (void) offset; (void) fi;
+    assert(cancel != NULL);
+    set_flag(&started, 1);
+
+    switch (options.mode) {
+    case MODE_POLL:
+        for (i = 0; i < WAIT_SECS * 100; i++) {
+            if (fuse_cancel_requested(cancel))
+                break;
+            usleep(10000);
+        }
+        break;
+    case MODE_CALLBACK:
+        fuse_cancel_set_callback(cancel, cancel_cb, NULL);
+        wait_for(&called);
+        fuse_cancel_set_callback(cancel, NULL, NULL);
+        break;
+    case MODE_FD:
+        pfd.fd = fuse_cancel_fd(cancel);
+        assert(pfd.fd >= 0);
+        pfd.events = POLLIN;
+        assert(poll(&pfd, 1, WAIT_SECS * 1000) == 1);
+        break;
+    }
+
+    set_flag(&result, fuse_cancel_requested(cancel) && fuse_interrupted() ?
+             1 : -1);
+    return -EINTR;
+}
+
+static const struct fuse_operations tfs_oper = {
+    .init       = tfs_init,
+    .getattr    = tfs_getattr,
+    .open       = tfs_open,
+    .read       = tfs_read,
+};
+
+static void test_fs(char *mountpoint)
+{
+    char fname[PATH_MAX];
+    char buf[4096];
+    pid_t pid;
+    int status;
+
+    assert(snprintf(fname, PATH_MAX, "%s/" FILE_NAME, mountpoint) > 0);
+
+    pid = fork();
+    assert(pid != -1);
+    if (pid == 0) {
+        int fd = open(fname, O_RDONLY);
+
+        if (fd == -1) {
+            perror(fname);
+            _exit(1);
+        }
+        read(fd, buf, sizeof(buf));
+        _exit(0);
+    }
+
+    wait_for(&started);
+    assert(started);
+    assert(kill(pid, SIGKILL) == 0);
+    wait_for(&result);
+    assert(result == 1);
+    assert(waitpid(pid, &status, 0) == pid);
+    assert(WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL);
+}
+
+static void *run_fs(void *data)
+{
+    struct fuse *fuse = (struct fuse *) data;
+    struct fuse_loop_config config = {
+        .clone_fd = 0,
+        .max_idle_threads = 10,
+    };
+    assert(fuse_loop_mt(fuse, &config) == 0);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+    struct fuse_cmdline_opts fuse_opts;
+    struct fuse *fuse;
+    pthread_t fs_thread;
+
+    assert(fuse_opt_parse(&args, &options, option_spec, NULL) == 0);
+    assert(fuse_parse_cmdline(&args, &fuse_opts) == 0);
+    assert(fuse_opts.mountpoint != NULL);
+#ifndef __FreeBSD__
+    assert(fuse_opt_add_arg(&args, "-oauto_unmount") == 0);
+#endif
+    assert(fuse_opt_add_arg(&args, "-ointr") == 0);
+    fuse = fuse_new(&args, &tfs_oper, sizeof(tfs_oper), NULL);
+    fuse_opt_free_args(&args);
+    assert(fuse != NULL);
+    assert(fuse_set_signal_handlers(fuse_get_session(fuse)) == 0);
+    assert(fuse_mount(fuse, fuse_opts.mountpoint) == 0);
+
+    /* Start file-system thread */
+    assert(pthread_create(&fs_thread, NULL, run_fs, (void *)fuse) == 0);
+
+    test_fs(fuse_opts.mountpoint);
+    free(fuse_opts.mountpoint);
+
+    /* Stop file system */
+    fuse_exit(fuse);
+    fuse_unmount(fuse);
+    assert(pthread_join(fs_thread, NULL) == 0);
+
+    fuse_remove_signal_handlers(fuse_get_session(fuse));
+    fuse_destroy(fuse);
+
+    printf("Test completed successfully.\n");
+    return 0;
+}
+
+
+/**
+ * Local Variables:
+ * mode: c
+ * indent-tabs-mode: nil
+ * c-basic-offset: 4
+ * End:
+ */
@@ -35,6 +35,105 @@ def test_write_cache(tmpdir, writeback, output_checker):
         cmdline.append('-owriteback_cache')
     subprocess.check_call(cmdline, stdout=output_checker.fd, stderr=output_checker.fd)
 
+def test_lock_bench(tmpdir, output_checker):
+    mnt_dir = str(tmpdir)
+    cmdline = [ pjoin(basename, 'test', 'test_lock_bench'),
+                '--locks=1000', mnt_dir ]
+    subprocess.check_call(cmdline, stdout=output_checker.fd, stderr=output_checker.fd)
+
+
+@pytest.mark.parametrize("mode", ('poll', 'callback', 'fd'))
+@pytest.mark.parametrize("intr_signal", (True, False))
+def test_cancel(tmpdir, mode, intr_signal, output_checker):
+    mnt_dir = str(tmpdir)
+    cmdline = [ pjoin(basename, 'test', 'test_cancel'),
+                '--' + mode, mnt_dir ]
+    if not intr_signal:
+        cmdline.append('-ointr_signal=0')
+    subprocess.check_call(cmdline, stdout=output_checker.fd, stderr=output_checker.fd)
+
+
+@pytest.mark.skipif(fuse_proto < (7,12),
+                    reason='not supported by running kernel')
+def test_notify_queue(tmpdir, output_checker):
+    mnt_dir = str(tmpdir)
+    cmdline = [ pjoin(basename, 'test', 'test_notify_queue'), mnt_dir ]
+    subprocess.check_call(cmdline, stdout=output_checker.fd, stderr=output_checker.fd)
+
+
+@pytest.mark.skipif(fuse_proto < (7,15),
+                    reason='not supported by running kernel')
+def test_prewarm(tmpdir, output_checker):
+    mnt_dir = str(tmpdir)
+    cmdline = [ pjoin(basename, 'test', 'test_prewarm'), mnt_dir ]
+    subprocess.check_call(cmdline, stdout=output_checker.fd, stderr=output_checker.fd)
+
+
+def test_init_flags(output_checker):
+    # Talks to a stand-in for the kernel, works without /dev/fuse
+    cmdline = [ pjoin(basename, 'test', 'test_init_flags') ]
+    subprocess.check_call(cmdline, stdout=output_checker.fd, stderr=output_checker.fd)
+
+
+def test_dirbuf(output_checker):
+    # Packs replies in memory, works without /dev/fuse
+    cmdline = [ pjoin(basename, 'test', 'test_dirbuf'),
+                '--entries=20000', '--rounds=5' ]
+    subprocess.check_call(cmdline, stdout=output_checker.fd, stderr=output_checker.fd)
+
+
+@pytest.mark.skipif(fuse_proto < (7,28),
+                    reason='not supported by running kernel')
+@pytest.mark.parametrize("auto", (False, True))
+def test_readdir_cache(tmpdir, auto, output_checker):
+    mnt_dir = str(tmpdir)
+    cmdline = [ pjoin(basename, 'test', 'test_readdir_cache'), mnt_dir ]
+    if auto:
+        cmdline.append('--auto')
+    subprocess.check_call(cmdline, stdout=output_checker.fd, stderr=output_checker.fd)
+
+
+def test_cache_module(tmpdir, output_checker):
+    mnt_dir = str(tmpdir)
+    cmdline = [ pjoin(basename, 'test', 'test_cache_module'), mnt_dir ]
+    subprocess.check_call(cmdline, stdout=output_checker.fd, stderr=output_checker.fd)
+
+
+@pytest.mark.parametrize("cache", (False, True))
+def test_symlink_bench(tmpdir, cache, output_checker):
+    if cache and fuse_proto < (7,28):
+        pytest.skip('symlink caching not supported by running kernel')
+    mnt_dir = str(tmpdir)
+    cmdline = [ pjoin(basename, 'test', 'test_symlink_bench'),
+                '--rounds=200', mnt_dir ]
+    if cache:
+        cmdline.append('--cache')
+    subprocess.check_call(cmdline, stdout=output_checker.fd, stderr=output_checker.fd)
+
+
+@pytest.mark.parametrize("hugepages", (False, True))
+@pytest.mark.parametrize("max_write", (128, 1024, 4096))
+def test_stream_bench(tmpdir, max_write, hugepages, output_checker):
+    if max_write > 128 and fuse_proto < (7,28):
+        pytest.skip('large requests not supported by running kernel')
+    mnt_dir = str(tmpdir)
+    cmdline = [ pjoin(basename, 'test', 'test_stream_bench'),
+                '--max-write=%d' % (max_write * 1024), '--size=64', mnt_dir ]
+    if hugepages:
+        cmdline.append('-ohugepages')
+    subprocess.check_call(cmdline, stdout=output_checker.fd, stderr=output_checker.fd)
+
+
+@pytest.mark.skipif(fuse_proto < (7,39),
+                    reason='not supported by running kernel')
+@pytest.mark.parametrize("modules", (None, 'stats', 'readahead'))
+def test_statx(tmpdir, modules, output_checker):
+    mnt_dir = str(tmpdir)
+    cmdline = [ pjoin(basename, 'test', 'test_statx'), mnt_dir ]
+    if modules:
+        cmdline.append('-omodules=' + modules)
+    subprocess.check_call(cmdline, stdout=output_checker.fd, stderr=output_checker.fd)
+
 
 names = [ 'notify_inval_inode', 'invalidate_path' ]
 if fuse_proto >= (7,15):
@@ -0,0 +1,221 @@
+/*
+  FUSE: Filesystem in Userspace
+  Copyright (C) 2026  agent <agent@local>
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+/*
+ * Benchmark for packing directory listings into readdir replies.  A
+ * large listing is packed into reply sized buffers once entry by entry
+ * with fuse_add_direntry() and fuse_add_direntry_plus(), and once in
+ * batches with fuse_dirbuf_add().  Both must produce the same bytes.
+ * No file system is mounted.
+ */
+
+#define FUSE_USE_VERSION 32
+
+#include <config.h>
+#include <fuse_lowlevel.h>
+#include <fuse_opt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stddef.h>
+#include <sys/stat.h>
+
+#include "bench.h"
+
+#define REPLY_SIZE (128 * 1024)
+
+/* Command line parsing */
+struct options {
+    int entries;
+    int rounds;
+} options = {
+    .entries = 100000,
+    .rounds = 20,
+};
+
+#define OPTION(t, p)                           \
+    { t, offsetof(struct options, p), 1 }
+static const struct fuse_opt option_spec[] = {
+    OPTION("--entries=%d", entries),
+    OPTION("--rounds=%d", rounds),
+    FUSE_OPT_END
+};
+
+static char **names;
+static struct fuse_direntry *ents;
+static struct fuse_entry_param *params;
+
+static void make_entries(int count)
+{
+    int i;
+
+    names = calloc(count, sizeof(names[0]));
+    ents = calloc(count, sizeof(ents[0]));
+    params = calloc(count, sizeof(params[0]));
+    assert(names && ents && params);
+
+    for (i = 0; i < count; i++) {
+        struct fuse_entry_param *e = &params[i];
+        char name[64];
+        int len;
+
+        /* Names of 1 to 40 characters, to hit every padding */
+        len = snprintf(name, sizeof(name), "%x-%.*s", i, i % 32,
+                       "abcdefghijklmnopqrstuvwxyz012345");
+        names[i] = strdup(i ? name : ".");
+        assert(names[i] != NULL);
+
+        e->ino = i + 100;
+        e->generation = i;
+        e->attr.st_ino = i + 1000;
+        e->attr.st_mode = (i % 3 ? S_IFREG : S_IFDIR) | 0644;
+        e->attr.st_size = i * 17;
+        e->attr_timeout = 1.5;
+        e->entry_timeout = 2.5;
+
+        ents[i].name = names[i];
+        ents[i].namelen = i ? (size_t) len : 1;
+        ents[i].ino = e->attr.st_ino;
+        ents[i].type = (e->attr.st_mode & S_IFMT) >> 12;
+        ents[i].off = i + 1;
+        ents[i].e = e;
+    }
+}
+
+/* Returns the number of entries packed starting at 'first' */
+static int pack_single(char *buf, int first, int count, int plus,
+                       size_t *len)
+{
+    size_t rem = REPLY_SIZE;
+    char *p = buf;
+    int i;
+
+    for (i = first; i < count; i++) {
+        size_t entsize;
+
+        if (plus) {
+            entsize = fuse_add_direntry_plus(NULL, p, rem, names[i],
+                                             &params[i], i + 1);
+        } else {
+            entsize = fuse_add_direntry(NULL, p, rem, names[i],
+                                        &params[i].attr, i + 1);
+        }
+        if (entsize > rem)
+            break;
+        p += entsize;
+        rem -= entsize;
+    }
+    *len = REPLY_SIZE - rem;
+    return i - first;
+}
+
+static int pack_batch(char *buf, int first, int count, int plus,
+                      size_t *len)
+{
+    struct fuse_dirbuf db;
+    size_t n;
+
+    fuse_dirbuf_init(&db, buf, REPLY_SIZE, plus);
+    n = fuse_dirbuf_add(&db, ents + first, count - first);
+    *len = db.len;
+    return n;
+}
+
+static void check(int count, int plus)
+{
+    char *buf1 = malloc(REPLY_SIZE);
+    char *buf2 = malloc(REPLY_SIZE);
+    int first = 0;
+
+    assert(buf1 && buf2);
+    while (first < count) {
+        struct fuse_dirbuf db;
+        size_t len1, len2;
+        int n1, n2;
+
+        /* Stale data must not show through the padding */
+        memset(buf1, 0xaa, REPLY_SIZE);
+        memset(buf2, 0x55, REPLY_SIZE);
+        n1 = pack_single(buf1, first, count, plus, &len1);
+        n2 = pack_batch(buf2, first, count, plus, &len2);
+        assert(n1 > 0);
+        assert(n1 == n2);
+        assert(len1 == len2);
+        assert(memcmp(buf1, buf2, len1) == 0);
+
+        fuse_dirbuf_init(&db, buf2, REPLY_SIZE, plus);
+        assert(fuse_dirbuf_fit(&db, ents + first, count - first) ==
+               (size_t) n1);
+        first += n1;
+    }
+    free(buf1);
+    free(buf2);
+}
+
+static void bench(const char *phase, int count, int plus,
+                  int (*pack)(char *, int, int, int, size_t *))
+{
+    char *buf = malloc(REPLY_SIZE);
+    double start;
+    long total = 0;
+    int round;
+
+    assert(buf != NULL);
+    start = bench_now();
+    for (round = 0; round < options.rounds; round++) {
+        int first = 0;
+
+        while (first < count) {
+            size_t len;
+
+            first += pack(buf, first, count, plus, &len);
+            total++;
+        }
+    }
+    bench_report(phase, (long) count * options.rounds, "ents", start);
+    printf("%-28s %8ld replies\n", "", total);
+    free(buf);
+}
+
+int main(int argc, char *argv[])
+{
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+    int i;
+
+    assert(fuse_opt_parse(&args, &options, option_spec, NULL) == 0);
+    assert(options.entries > 0 && options.rounds > 0);
+    fuse_opt_free_args(&args);
+
+    make_entries(options.entries);
+    check(options.entries, 0);
+    check(options.entries, 1);
+
+    bench("readdir, one by one", options.entries, 0, pack_single);
+    bench("readdir, batched", options.entries, 0, pack_batch);
+    bench("readdirplus, one by one", options.entries, 1, pack_single);
+    bench("readdirplus, batched", options.entries, 1, pack_batch);
+
+    for (i = 0; i < options.entries; i++)
+        free(names[i]);
+    free(names);
+    free(ents);
+    free(params);
+
+    printf("Test completed successfully.\n");
+    return 0;
+}
+
+
+/**
+ * Local Variables:
+ * mode: c
+ * indent-tabs-mode: nil
+ * c-basic-offset: 4
+ * End:
+ */
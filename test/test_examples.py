@@ -16,6 +16,9 @@ import filecmp
 import tempfile
 import time
 import errno
+import re
+import signal
+import threading
 import sys
 from tempfile import NamedTemporaryFile
 from contextlib import contextmanager
@@ -171,7 +174,348 @@ def test_passthrough(short_tmpdir, name, debug, output_checker, writeback):
     else:
         umount(mount_process, mnt_dir)
 
-@pytest.mark.parametrize("cache", (False, True))
+def test_cache_module(short_tmpdir, output_checker):
+    mnt_dir = str(short_tmpdir.mkdir('mnt'))
+    src_dir = str(short_tmpdir.mkdir('src'))
+
+    cmdline = base_cmdline + \
+              [ pjoin(basename, 'example', 'passthrough'),
+                '-f', '-o', 'modules=cache,cache_negative_timeout=60',
+                mnt_dir ]
+    mount_process = subprocess.Popen(cmdline, stdout=output_checker.fd,
+                                     stderr=output_checker.fd)
+    try:
+        wait_for_mount(mount_process, mnt_dir)
+        work_dir = mnt_dir + src_dir
+
+        # Only operations that go through the mount, everything else
+        # is hidden by the cache until it expires
+        tst_statvfs(work_dir)
+        tst_create(work_dir)
+        tst_mkdir(work_dir)
+        tst_symlink(work_dir)
+        tst_link(work_dir)
+        tst_truncate_path(work_dir)
+        tst_truncate_fd(work_dir)
+        tst_utimens(work_dir, ns_tol=1000)
+        tst_open_unlink(work_dir)
+    except:
+        cleanup(mount_process, mnt_dir)
+        raise
+    else:
+        umount(mount_process, mnt_dir)
+
+def test_readahead_module(short_tmpdir, output_checker):
+    mnt_dir = str(short_tmpdir.mkdir('mnt'))
+    src_dir = str(short_tmpdir.mkdir('src'))
+
+    cmdline = base_cmdline + \
+              [ pjoin(basename, 'example', 'passthrough'),
+                '-f', '-o', 'modules=readahead,readahead_window=4096',
+                mnt_dir ]
+    mount_process = subprocess.Popen(cmdline, stdout=output_checker.fd,
+                                     stderr=output_checker.fd)
+    try:
+        wait_for_mount(mount_process, mnt_dir)
+        work_dir = mnt_dir + src_dir
+
+        tst_open_read(src_dir, work_dir)
+        tst_open_write(src_dir, work_dir)
+        tst_seek(src_dir, work_dir)
+        tst_read_after_write(src_dir, work_dir)
+        tst_truncate_fd(work_dir)
+    except:
+        cleanup(mount_process, mnt_dir)
+        raise
+    else:
+        umount(mount_process, mnt_dir)
+
+def test_coalesce_module(short_tmpdir, output_checker):
+    mnt_dir = str(short_tmpdir.mkdir('mnt'))
+    src_dir = str(short_tmpdir.mkdir('src'))
+
+    cmdline = base_cmdline + \
+              [ pjoin(basename, 'example', 'passthrough'),
+                '-f', '-o', 'modules=coalesce,coalesce_timeout=0.1',
+                mnt_dir ]
+    mount_process = subprocess.Popen(cmdline, stdout=output_checker.fd,
+                                     stderr=output_checker.fd)
+    try:
+        wait_for_mount(mount_process, mnt_dir)
+        work_dir = mnt_dir + src_dir
+
+        tst_open_write(src_dir, work_dir)
+        tst_append(src_dir, work_dir)
+        tst_seek(src_dir, work_dir)
+        tst_read_after_write(src_dir, work_dir)
+        tst_truncate_fd(work_dir)
+        tst_open_unlink(work_dir)
+
+        # Small writes reach the file once it is closed, or after
+        # the timeout while it stays open
+        name = name_generator()
+        with os_open(pjoin(work_dir, name), os.O_WRONLY|os.O_CREAT) as fd:
+            for i in range(100):
+                os.write(fd, b'%03d' % i)
+            assert os.fstat(fd).st_size == 300
+            safe_sleep(1)
+            with open(pjoin(src_dir, name), 'rb') as fh:
+                assert len(fh.read()) == 300
+            os.write(fd, b'end')
+        with open(pjoin(src_dir, name), 'rb') as fh:
+            assert fh.read()[-6:] == b'099end'
+    except:
+        cleanup(mount_process, mnt_dir)
+        raise
+    else:
+        umount(mount_process, mnt_dir)
+
+def test_stats_module(short_tmpdir, output_checker):
+    mnt_dir = str(short_tmpdir.mkdir('mnt'))
+    src_dir = str(short_tmpdir.mkdir('src'))
+    log_file = pjoin(str(short_tmpdir), 'stats.log')
+
+    cmdline = base_cmdline + \
+              [ pjoin(basename, 'example', 'passthrough'),
+                '-f', '-o', 'modules=stats', mnt_dir ]
+    with open(log_file, 'w') as log:
+        mount_process = subprocess.Popen(cmdline, stdout=output_checker.fd,
+                                         stderr=log)
+    try:
+        wait_for_mount(mount_process, mnt_dir)
+        work_dir = mnt_dir + src_dir
+
+        tst_create(work_dir)
+        tst_open_read(src_dir, work_dir)
+        tst_readdir(src_dir, work_dir)
+        with pytest.raises(FileNotFoundError):
+            os.stat(pjoin(work_dir, name_generator()))
+
+        os.kill(mount_process.pid, signal.SIGUSR1)
+        safe_sleep(0.5)
+        with open(log_file) as fh:
+            dump = fh.read()
+        assert re.search(r'^fuse-stats: getattr +[0-9]+ +[1-9]', dump,
+                         re.MULTILINE)
+        assert re.search(r'^fuse-stats: read +[1-9]', dump, re.MULTILINE)
+    except:
+        cleanup(mount_process, mnt_dir)
+        raise
+    else:
+        umount(mount_process, mnt_dir)
+
+    # Dumped once more when unmounting
+    with open(log_file) as fh:
+        assert fh.read().count('fuse-stats: operation') == 2
+
+def test_iconv_module(short_tmpdir, output_checker):
+    mnt_dir = str(short_tmpdir.mkdir('mnt'))
+    src_dir = str(short_tmpdir.mkdir('src'))
+
+    cmdline = base_cmdline + \
+              [ pjoin(basename, 'example', 'passthrough'),
+                '-f', '-o', 'modules=iconv,from_code=UTF-8,to_code=ISO-8859-1',
+                mnt_dir ]
+    mount_process = subprocess.Popen(cmdline, stdout=output_checker.fd,
+                                     stderr=output_checker.fd)
+    try:
+        wait_for_mount(mount_process, mnt_dir)
+        work_dir = os.fsencode(mnt_dir + src_dir)
+        src = os.fsencode(src_dir)
+
+        # Latin-1 in the mount, UTF-8 underneath
+        with open(pjoin(work_dir, b'caf\xe9'), 'wb') as fh:
+            fh.write(b'foo')
+        assert os.listdir(src) == [ b'caf\xc3\xa9' ]
+        names = [ b'plain%d' % i for i in range(100) ] + \
+                [ b'\xc3\xa9t\xc3\xa9%d' % i for i in range(100) ]
+        for name in names:
+            os_create(pjoin(src, name))
+        listing = os.listdir(work_dir)
+        assert sorted(listing) == sorted(
+            [ b'caf\xe9' ] + [ n.replace(b'\xc3\xa9', b'\xe9') for n in names ])
+        assert os.stat(pjoin(work_dir, b'\xe9t\xe942')).st_size == 0
+        os.symlink(b'caf\xe9', pjoin(work_dir, b'link'))
+        assert os.readlink(pjoin(src, b'link')) == b'caf\xc3\xa9'
+        assert os.readlink(pjoin(work_dir, b'link')) == b'caf\xe9'
+    except:
+        cleanup(mount_process, mnt_dir)
+        raise
+    else:
+        umount(mount_process, mnt_dir)
+
+def test_coalesce_getattr(short_tmpdir, output_checker):
+    mnt_dir = str(short_tmpdir.mkdir('mnt'))
+    src_dir = str(short_tmpdir.mkdir('src'))
+    log_file = pjoin(str(short_tmpdir), 'fuse.log')
+
+    cmdline = base_cmdline + \
+              [ pjoin(basename, 'example', 'passthrough'), '-f',
+                '-o', 'coalesce_getattr,attr_timeout=0,entry_timeout=0',
+                mnt_dir ]
+    with open(log_file, 'w') as log:
+        mount_process = subprocess.Popen(cmdline, stdout=output_checker.fd,
+                                         stderr=log)
+    try:
+        wait_for_mount(mount_process, mnt_dir)
+        work_dir = mnt_dir + src_dir
+        name = pjoin(src_dir, name_generator())
+        with open(name, 'wb') as fh:
+            fh.write(b'x' * 4242)
+        errors = []
+
+        def stat_storm():
+            try:
+                for _ in range(200):
+                    fstat = os.stat(mnt_dir + name)
+                    assert fstat.st_size == 4242
+                    with pytest.raises(FileNotFoundError):
+                        os.stat(pjoin(work_dir, 'does-not-exist'))
+            except Exception as exc:
+                errors.append(exc)
+
+        threads = [ threading.Thread(target=stat_storm) for _ in range(8) ]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        assert not errors
+
+        # Changes must be visible once the calls are done
+        with open(name, 'ab') as fh:
+            fh.write(b'y')
+        assert os.stat(mnt_dir + name).st_size == 4243
+    except:
+        cleanup(mount_process, mnt_dir)
+        raise
+    else:
+        umount(mount_process, mnt_dir)
+
+    with open(log_file) as fh:
+        assert re.search(r'^fuse: getattr: [1-9][0-9]* requests, [1-9][0-9]* calls',
+                         fh.read(), re.MULTILINE)
+
+def test_xattr_cache(short_tmpdir, output_checker):
+    mnt_dir = str(short_tmpdir.mkdir('mnt'))
+    src_dir = str(short_tmpdir.mkdir('src'))
+    log_file = pjoin(str(short_tmpdir), 'fuse.log')
+
+    cmdline = base_cmdline + \
+              [ pjoin(basename, 'example', 'passthrough'), '-f',
+                '-o', 'xattr_timeout=60', mnt_dir ]
+    with open(log_file, 'w') as log:
+        mount_process = subprocess.Popen(cmdline, stdout=output_checker.fd,
+                                         stderr=log)
+    try:
+        wait_for_mount(mount_process, mnt_dir)
+        name = name_generator()
+        src_name = pjoin(src_dir, name)
+        mnt_name = mnt_dir + src_name
+        with open(src_name, 'wb') as fh:
+            fh.write(b'data')
+        try:
+            os.setxattr(src_name, 'user.probe', b'x')
+        except OSError as exc:
+            if exc.errno == errno.ENOTSUP:
+                pytest.skip('xattrs not supported by %s' % src_dir)
+            raise
+        os.removexattr(src_name, 'user.probe')
+
+        for _ in range(10):
+            with pytest.raises(OSError) as exc_info:
+                os.getxattr(mnt_name, 'user.foo')
+            assert exc_info.value.errno == errno.ENODATA
+
+        # Changes through the mount point are seen immediately
+        os.setxattr(mnt_name, 'user.foo', b'bar')
+        assert os.getxattr(mnt_name, 'user.foo') == b'bar'
+        assert os.getxattr(mnt_name, 'user.foo') == b'bar'
+        os.setxattr(mnt_name, 'user.foo', b'bazz')
+        assert os.getxattr(mnt_name, 'user.foo') == b'bazz'
+        os.removexattr(mnt_name, 'user.foo')
+        with pytest.raises(OSError) as exc_info:
+            os.getxattr(mnt_name, 'user.foo')
+        assert exc_info.value.errno == errno.ENODATA
+
+        # Changes behind its back are not
+        os.setxattr(src_name, 'user.foo', b'hidden')
+        with pytest.raises(OSError) as exc_info:
+            os.getxattr(mnt_name, 'user.foo')
+        assert exc_info.value.errno == errno.ENODATA
+    except:
+        cleanup(mount_process, mnt_dir)
+        raise
+    else:
+        umount(mount_process, mnt_dir)
+
+    with open(log_file) as fh:
+        assert re.search(r'^fuse: xattr cache: [1-9][0-9]* hits',
+                         fh.read(), re.MULTILINE)
+
+def test_readdir_window(short_tmpdir, output_checker):
+    mnt_dir = str(short_tmpdir.mkdir('mnt'))
+    src_dir = str(short_tmpdir.mkdir('src'))
+
+    # passthrough ignores readdir offsets, so with a small buffer the
+    # directory is listed in several windows
+    cmdline = base_cmdline + \
+              [ pjoin(basename, 'example', 'passthrough'), '-f',
+                '-o', 'max_readdir_buffer=4096', mnt_dir ]
+    mount_process = subprocess.Popen(cmdline, stdout=output_checker.fd,
+                                     stderr=output_checker.fd)
+    try:
+        wait_for_mount(mount_process, mnt_dir)
+        names = [ 'entry-%04d-%s' % (i, 'x' * 40) for i in range(500) ]
+        for name in names:
+            os.mknod(pjoin(src_dir, name))
+        listed = os.listdir(mnt_dir + src_dir)
+        assert len(listed) == len(names)
+        assert sorted(listed) == names
+
+        # Rewinding lists the directory again
+        fd = os.open(mnt_dir + src_dir, os.O_RDONLY | os.O_DIRECTORY)
+        try:
+            first = os.listdir(fd)
+            os.lseek(fd, 0, os.SEEK_SET)
+            assert sorted(os.listdir(fd)) == sorted(first) == names
+        finally:
+            os.close(fd)
+    except:
+        cleanup(mount_process, mnt_dir)
+        raise
+    else:
+        umount(mount_process, mnt_dir)
+
+def test_readdirplus_prefetch(short_tmpdir, output_checker):
+    mnt_dir = str(short_tmpdir.mkdir('mnt'))
+    src_dir = str(short_tmpdir.mkdir('src'))
+    log_file = pjoin(str(short_tmpdir), 'fuse.log')
+
+    cmdline = base_cmdline + \
+              [ pjoin(basename, 'example', 'passthrough'), '-f',
+                '-o', 'readdirplus_prefetch=4', mnt_dir ]
+    with open(log_file, 'w') as log:
+        mount_process = subprocess.Popen(cmdline, stdout=output_checker.fd,
+                                         stderr=log)
+    try:
+        wait_for_mount(mount_process, mnt_dir)
+        for i in range(100):
+            with open(pjoin(src_dir, 'file%03d' % i), 'wb') as fh:
+                fh.write(b'x' * i)
+        with os.scandir(mnt_dir + src_dir) as it:
+            sizes = { ent.name: ent.stat().st_size for ent in it }
+        assert sizes == { 'file%03d' % i: i for i in range(100) }
+    except:
+        cleanup(mount_process, mnt_dir)
+        raise
+    else:
+        umount(mount_process, mnt_dir)
+
+    with open(log_file) as fh:
+        assert re.search(r'^fuse: readdirplus: [0-9]+ entries prefetched',
+                         fh.read(), re.MULTILINE)
+
+@pytest.mark.parametrize("cache", (False, True, 'passthrough'))
 def test_passthrough_hp(short_tmpdir, cache, output_checker):
     mnt_dir = str(short_tmpdir.mkdir('mnt'))
     src_dir = str(short_tmpdir.mkdir('src'))
@@ -182,6 +526,9 @@ def test_passthrough_hp(short_tmpdir, cache, output_checker):
 
     if not cache:
         cmdline.append('--nocache')
+    elif cache == 'passthrough':
+        # Falls back to regular I/O if the kernel doesn't support it
+        cmdline.append('--passthrough')
         
     mount_process = subprocess.Popen(cmdline, stdout=output_checker.fd,
                                      stderr=output_checker.fd)
@@ -303,7 +650,7 @@ def test_null(tmpdir, output_checker):
 
 @pytest.mark.skipif(fuse_proto < (7,12),
                     reason='not supported by running kernel')
-@pytest.mark.parametrize("notify", (True, False))
+@pytest.mark.parametrize("notify", (True, False, 'async'))
 def test_notify_inval_entry(tmpdir, notify, output_checker):
     mnt_dir = str(tmpdir)
     cmdline = base_cmdline + \
@@ -312,6 +659,8 @@ def test_notify_inval_entry(tmpdir, notify, output_checker):
                 '--timeout=5', mnt_dir ]
     if not notify:
         cmdline.append('--no-notify')
+    elif notify == 'async':
+        cmdline.append('--async')
     mount_process = subprocess.Popen(cmdline, stdout=output_checker.fd,
                                      stderr=output_checker.fd)
     try:
@@ -511,6 +860,27 @@ def tst_seek(src_dir, mnt_dir):
     with open(fullname, 'rb') as fh:
         assert fh.read() == b'\0foocom\n'
         
+def tst_read_after_write(src_dir, mnt_dir):
+    name = name_generator()
+    with open(pjoin(src_dir, name), 'wb') as fh_out, \
+         open(TEST_FILE, 'rb') as fh_in:
+        shutil.copyfileobj(fh_in, fh_out)
+    with open(TEST_FILE, 'rb') as fh:
+        data = bytearray(fh.read())
+    fullname = pjoin(mnt_dir, name)
+    with os_open(fullname, os.O_RDWR) as fd:
+        # Read sequentially to get data prefetched, then overwrite
+        # some of it through the same and through a new descriptor
+        assert os.pread(fd, 4096, 0) == data[:4096]
+        assert os.pread(fd, 4096, 4096) == data[4096:8192]
+        os.pwrite(fd, b'foo', 8192)
+        data[8192:8195] = b'foo'
+        assert os.pread(fd, 4096, 8192) == data[8192:12288]
+        with os_open(fullname, os.O_WRONLY) as fd2:
+            os.pwrite(fd2, b'bar', 12288)
+        data[12288:12291] = b'bar'
+        assert os.pread(fd, 4096, 12288) == data[12288:16384]
+
 def tst_open_unlink(mnt_dir):
     name = pjoin(mnt_dir, name_generator())
     data1 = b'foo'
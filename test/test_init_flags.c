@@ -0,0 +1,318 @@
+/*
+  FUSE: Filesystem in Userspace
+  Copyright (C) 2026  agent <agent@local>
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+/*
+ * Test for the negotiation of INIT flags.  Instead of /dev/fuse, the
+ * session talks to one end of a socket pair that is passed to it as
+ * /dev/fd/N, and the test plays the kernel on the other end.  This way
+ * flags can be offered that the running kernel may not know about.
+ */
+
+#define FUSE_USE_VERSION 32
+
+#include <config.h>
+#include <fuse_lowlevel.h>
+#include <fuse_kernel.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#define TEST_NAME "expired"
+
+struct kernel {
+    struct fuse_session *se;
+    int fd;
+    uint64_t unique;
+};
+
+static unsigned want_set;
+static unsigned want_clear;
+static struct fuse_conn_info conn_seen;
+
+static void tfs_init(void *userdata, struct fuse_conn_info *conn)
+{
+    (void) userdata;
+
+    conn->want |= want_set;
+    conn->want &= ~want_clear;
+    conn_seen = *conn;
+}
+
+static void tfs_open(fuse_req_t req, fuse_ino_t ino,
+                     struct fuse_file_info *fi)
+{
+    (void) ino;
+
+    fi->direct_io = 1;
+    fi->noflush = 1;
+    fi->parallel_direct_writes = 1;
+    fuse_reply_open(req, fi);
+}
+
+static void tfs_setxattr(fuse_req_t req, fuse_ino_t ino, const char *name,
+                         const char *value, size_t size, int flags)
+{
+    (void) ino; (void) flags;
+
+    if (strcmp(name, "user.foo") == 0 && size == 3 &&
+        memcmp(value, "bar", 3) == 0)
+        fuse_reply_err(req, 0);
+    else
+        fuse_reply_err(req, EINVAL);
+}
+
+static const struct fuse_lowlevel_ops tfs_oper = {
+    .init       = tfs_init,
+    .open       = tfs_open,
+    .setxattr   = tfs_setxattr,
+};
+
+static void kernel_start(struct kernel *k)
+{
+    struct fuse_args args = FUSE_ARGS_INIT(0, NULL);
+    char devfd[32];
+    int sv[2];
+
+    assert(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == 0);
+    assert(fuse_opt_add_arg(&args, "test_init_flags") == 0);
+    k->se = fuse_session_new(&args, &tfs_oper, sizeof(tfs_oper), NULL);
+    fuse_opt_free_args(&args);
+    assert(k->se != NULL);
+    snprintf(devfd, sizeof(devfd), "/dev/fd/%d", sv[0]);
+    assert(fuse_session_mount(k->se, devfd) == 0);
+    k->fd = sv[1];
+    k->unique = 0;
+}
+
+static void kernel_stop(struct kernel *k)
+{
+    /* Closes the session's end of the socket pair */
+    fuse_session_destroy(k->se);
+    close(k->fd);
+}
+
+/* Sends a request and has the session process it */
+static void kernel_request(struct kernel *k, uint32_t opcode,
+                           uint64_t nodeid, const void *arg, size_t argsize)
+{
+    struct fuse_buf fbuf = { .mem = NULL };
+    struct fuse_in_header in;
+    char buf[sizeof(in) + 128];
+
+    assert(argsize <= sizeof(buf) - sizeof(in));
+    memset(&in, 0, sizeof(in));
+    in.len = sizeof(in) + argsize;
+    in.opcode = opcode;
+    in.unique = k->unique += 2;
+    in.nodeid = nodeid;
+    memcpy(buf, &in, sizeof(in));
+    memcpy(buf + sizeof(in), arg, argsize);
+    assert(write(k->fd, buf, in.len) == (ssize_t) in.len);
+
+    assert(fuse_session_receive_buf(k->se, &fbuf) == (int) in.len);
+    fuse_session_process_buf(k->se, &fbuf);
+    free(fbuf.mem);
+}
+
+/* Receives a reply or notification, returns the size of its argument */
+static size_t kernel_reply(struct kernel *k, uint64_t unique, int32_t error,
+                           void *arg, size_t argsize)
+{
+    struct fuse_out_header out;
+    char buf[sizeof(out) + 256];
+    ssize_t res;
+
+    res = read(k->fd, buf, sizeof(buf));
+    assert(res >= (ssize_t) sizeof(out));
+    memcpy(&out, buf, sizeof(out));
+    assert(out.len == res);
+    assert(out.unique == unique);
+    assert(out.error == error);
+    res -= sizeof(out);
+    assert((size_t) res <= argsize);
+    memcpy(arg, buf + sizeof(out), res);
+
+    return res;
+}
+
+static void kernel_init(struct kernel *k, uint32_t minor, uint64_t flags,
+                        struct fuse_init_out *outarg)
+{
+    struct fuse_init_in arg;
+    size_t argsize = sizeof(arg);
+
+    memset(&arg, 0, sizeof(arg));
+    arg.major = FUSE_KERNEL_VERSION;
+    arg.minor = minor;
+    arg.max_readahead = 128 * 1024;
+    arg.flags = flags;
+    arg.flags2 = flags >> 32;
+    /* Older kernels send the request without flags2 */
+    if (!(flags & FUSE_INIT_EXT))
+        argsize = offsetof(struct fuse_init_in, flags2);
+    kernel_request(k, FUSE_INIT, 0, &arg, argsize);
+
+    memset(outarg, 0, sizeof(*outarg));
+    assert(kernel_reply(k, k->unique, 0, outarg, sizeof(*outarg)) ==
+           sizeof(*outarg));
+    assert(outarg->major == FUSE_KERNEL_VERSION);
+    assert(outarg->minor == FUSE_KERNEL_MINOR_VERSION);
+}
+
+/* Returns the flags of the INIT reply */
+static uint64_t init_flags(const struct fuse_init_out *outarg)
+{
+    uint64_t flags = outarg->flags;
+
+    if (flags & FUSE_INIT_EXT)
+        flags |= (uint64_t) outarg->flags2 << 32;
+    return flags;
+}
+
+static void test_old_kernel(void)
+{
+    struct fuse_init_out outarg;
+    struct kernel k;
+    uint64_t flags;
+
+    want_set = want_clear = 0;
+    kernel_start(&k);
+    kernel_init(&k, 31, FUSE_ASYNC_READ, &outarg);
+    flags = init_flags(&outarg);
+
+    assert(!(conn_seen.capable & (FUSE_CAP_MAX_PAGES |
+                                  FUSE_CAP_CACHE_SYMLINKS |
+                                  FUSE_CAP_EXPIRE_ONLY |
+                                  FUSE_CAP_DIRECT_IO_ALLOW_MMAP)));
+    assert(!(flags & (FUSE_INIT_EXT | FUSE_MAX_PAGES)));
+    assert(outarg.flags2 == 0);
+    assert(outarg.max_write <= 32 * (unsigned) getpagesize());
+    assert(fuse_lowlevel_notify_expire_entry(k.se, FUSE_ROOT_ID, TEST_NAME,
+                                             strlen(TEST_NAME)) == -ENOSYS);
+    kernel_stop(&k);
+}
+
+static void test_new_kernel(void)
+{
+    struct fuse_notify_inval_entry_out *entry;
+    struct fuse_init_out outarg;
+    struct fuse_open_in open_in;
+    struct fuse_open_out open_out;
+    struct fuse_setxattr_in setxattr_in;
+    char buf[sizeof(*entry) + sizeof(TEST_NAME)];
+    struct kernel k;
+    uint64_t flags;
+
+    want_set = want_clear = 0;
+    kernel_start(&k);
+    kernel_init(&k, 40, FUSE_ASYNC_READ | FUSE_MAX_PAGES |
+                FUSE_CACHE_SYMLINKS | FUSE_INIT_EXT | FUSE_HAS_EXPIRE_ONLY |
+                FUSE_DIRECT_IO_ALLOW_MMAP, &outarg);
+    flags = init_flags(&outarg);
+
+    /* Everything offered is capable, symlink caching is not default */
+    assert(conn_seen.capable & FUSE_CAP_MAX_PAGES);
+    assert(conn_seen.capable & FUSE_CAP_CACHE_SYMLINKS);
+    assert(conn_seen.capable & FUSE_CAP_EXPIRE_ONLY);
+    assert(conn_seen.capable & FUSE_CAP_DIRECT_IO_ALLOW_MMAP);
+    assert(conn_seen.want & FUSE_CAP_MAX_PAGES);
+    assert(conn_seen.want & FUSE_CAP_DIRECT_IO_ALLOW_MMAP);
+    assert(!(conn_seen.want & FUSE_CAP_CACHE_SYMLINKS));
+
+    assert(flags & FUSE_INIT_EXT);
+    assert(flags & FUSE_MAX_PAGES);
+    assert(flags & FUSE_DIRECT_IO_ALLOW_MMAP);
+    assert(!(flags & FUSE_CACHE_SYMLINKS));
+    assert(outarg.max_write > 32 * (unsigned) getpagesize());
+    assert(outarg.max_pages ==
+           (outarg.max_write - 1) / getpagesize() + 1);
+
+    /* Expire-only invalidation */
+    assert(fuse_lowlevel_notify_expire_entry(k.se, FUSE_ROOT_ID, TEST_NAME,
+                                             strlen(TEST_NAME)) == 0);
+    assert(kernel_reply(&k, 0, FUSE_NOTIFY_INVAL_ENTRY, buf, sizeof(buf)) ==
+           sizeof(buf));
+    entry = (struct fuse_notify_inval_entry_out *) buf;
+    assert(entry->parent == FUSE_ROOT_ID);
+    assert(entry->namelen == strlen(TEST_NAME));
+    assert(entry->flags == FUSE_EXPIRE_ONLY);
+    assert(strcmp(buf + sizeof(*entry), TEST_NAME) == 0);
+
+    /* Regular invalidation leaves the flags clear */
+    assert(fuse_lowlevel_notify_inval_entry(k.se, FUSE_ROOT_ID, TEST_NAME,
+                                            strlen(TEST_NAME)) == 0);
+    assert(kernel_reply(&k, 0, FUSE_NOTIFY_INVAL_ENTRY, buf, sizeof(buf)) ==
+           sizeof(buf));
+    assert(entry->flags == 0);
+
+    /* Open flags */
+    memset(&open_in, 0, sizeof(open_in));
+    kernel_request(&k, FUSE_OPEN, 2, &open_in, sizeof(open_in));
+    assert(kernel_reply(&k, k.unique, 0, &open_out, sizeof(open_out)) ==
+           sizeof(open_out));
+    assert(open_out.open_flags == (FOPEN_DIRECT_IO | FOPEN_NOFLUSH |
+                                   FOPEN_PARALLEL_DIRECT_WRITES));
+
+    /* Without FUSE_SETXATTR_EXT, the short request is sent */
+    memset(&setxattr_in, 0, sizeof(setxattr_in));
+    setxattr_in.size = 3;
+    memcpy(buf, &setxattr_in, FUSE_COMPAT_SETXATTR_IN_SIZE);
+    memcpy(buf + FUSE_COMPAT_SETXATTR_IN_SIZE, "user.foo\0bar", 12);
+    kernel_request(&k, FUSE_SETXATTR, 2, buf,
+                   FUSE_COMPAT_SETXATTR_IN_SIZE + 12);
+    assert(kernel_reply(&k, k.unique, 0, buf, sizeof(buf)) == 0);
+    kernel_stop(&k);
+}
+
+static void test_new_kernel_want(void)
+{
+    struct fuse_init_out outarg;
+    struct kernel k;
+    uint64_t flags;
+
+    want_set = FUSE_CAP_CACHE_SYMLINKS;
+    want_clear = FUSE_CAP_MAX_PAGES | FUSE_CAP_DIRECT_IO_ALLOW_MMAP;
+    kernel_start(&k);
+    kernel_init(&k, 40, FUSE_ASYNC_READ | FUSE_MAX_PAGES |
+                FUSE_CACHE_SYMLINKS | FUSE_INIT_EXT |
+                FUSE_DIRECT_IO_ALLOW_MMAP, &outarg);
+    flags = init_flags(&outarg);
+
+    assert(flags & FUSE_INIT_EXT);
+    assert(flags & FUSE_CACHE_SYMLINKS);
+    assert(!(flags & (FUSE_MAX_PAGES | FUSE_DIRECT_IO_ALLOW_MMAP)));
+    assert(outarg.flags2 == 0);
+    assert(outarg.max_write <= 32 * (unsigned) getpagesize());
+    kernel_stop(&k);
+}
+
+int main(int argc, char *argv[])
+{
+    (void) argc; (void) argv;
+
+    test_old_kernel();
+    test_new_kernel();
+    test_new_kernel_want();
+
+    printf("Test completed successfully.\n");
+    return 0;
+}
+
+
+/**
+ * Local Variables:
+ * mode: c
+ * indent-tabs-mode: nil
+ * c-basic-offset: 4
+ * End:
+ */
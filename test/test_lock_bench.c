@@ -0,0 +1,276 @@
+/*
+  FUSE: Filesystem in Userspace
+  Copyright (C) 2026  agent <agent@local>
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+/*
+ * Lock-heavy benchmark for the POSIX lock bookkeeping of the
+ * high-level library.  Mounts a file system with a single file, takes
+ * many byte range locks on it, queries them from a second process,
+ * merges and splits them, and reports the rate of each phase.  Every
+ * query must see the locks that were taken.
+ */
+
+#define FUSE_USE_VERSION 30
+
+#include <config.h>
+#include <fuse.h>
+#include <fuse_lowlevel.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <assert.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#include "bench.h"
+
+#ifndef __linux__
+#include <limits.h>
+#else
+#include <linux/limits.h>
+#endif
+
+#define FILE_NAME "lock_me"
+
+/* Command line parsing */
+struct options {
+    int locks;
+} options = {
+    .locks = 10000,
+};
+
+#define OPTION(t, p)                           \
+    { t, offsetof(struct options, p), 1 }
+static const struct fuse_opt option_spec[] = {
+    OPTION("--locks=%d", locks),
+    FUSE_OPT_END
+};
+
+static void *tfs_init(struct fuse_conn_info *conn, struct fuse_config *cfg)
+{
+    (void) conn;
+    cfg->attr_timeout = 3600;
+    cfg->entry_timeout = 3600;
+    return NULL;
+}
+
+static int tfs_getattr(const char *path, struct stat *stbuf,
+                       struct fuse_file_info *fi)
+{
+    (void) fi;
+
+    memset(stbuf, 0, sizeof(*stbuf));
+    if (strcmp(path, "/") == 0) {
+        stbuf->st_mode = S_IFDIR | 0755;
+        stbuf->st_nlink = 2;
+    } else if (strcmp(path, "/" FILE_NAME) == 0) {
+        stbuf->st_mode = S_IFREG | 0666;
+        stbuf->st_nlink = 1;
+    } else
+        return -ENOENT;
+
+    return 0;
+}
+
+static int tfs_open(const char *path, struct fuse_file_info *fi)
+{
+    (void) fi;
+
+    if (strcmp(path, "/" FILE_NAME) != 0)
+        return -ENOENT;
+    return 0;
+}
+
+/* The library tracks the locks itself, the file system grants all of them */
+static int tfs_lock(const char *path, struct fuse_file_info *fi, int cmd,
+                    struct flock *lock)
+{
+    (void) path; (void) fi;
+
+    if (cmd == F_GETLK)
+        lock->l_type = F_UNLCK;
+    return 0;
+}
+
+static const struct fuse_operations tfs_oper = {
+    .init       = tfs_init,
+    .getattr    = tfs_getattr,
+    .open       = tfs_open,
+    .lock       = tfs_lock,
+};
+
+static int set_lock(int fd, int type, off_t start, off_t len)
+{
+    struct flock fl = {
+        .l_type = type,
+        .l_whence = SEEK_SET,
+        .l_start = start,
+        .l_len = len,
+    };
+    return fcntl(fd, F_SETLK, &fl);
+}
+
+static struct flock get_lock(int fd, int type, off_t start, off_t len)
+{
+    struct flock fl = {
+        .l_type = type,
+        .l_whence = SEEK_SET,
+        .l_start = start,
+        .l_len = len,
+    };
+    assert(fcntl(fd, F_GETLK, &fl) == 0);
+    return fl;
+}
+
+/* Query the locks of the parent from a different lock owner */
+static void check_from_child(const char *fname, int merged)
+{
+    int n = options.locks;
+    double start;
+    pid_t pid;
+    int status;
+    int fd;
+    int i;
+
+    fflush(stdout);
+    pid = fork();
+    assert(pid != -1);
+    if (pid) {
+        assert(waitpid(pid, &status, 0) == pid);
+        assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        return;
+    }
+
+    fd = open(fname, O_RDWR);
+    assert(fd != -1);
+    start = bench_now();
+    for (i = 0; i < n; i++) {
+        struct flock fl = get_lock(fd, F_RDLCK, 2 * i + 1, 1);
+
+        if (merged) {
+            assert(fl.l_type == F_WRLCK);
+            assert(fl.l_start == 0 && fl.l_len == 2 * n);
+        } else {
+            assert(fl.l_type == F_UNLCK);
+        }
+        fl = get_lock(fd, F_RDLCK, 2 * i, 1);
+        assert(fl.l_type == F_WRLCK);
+        assert(fl.l_start == (merged ? 0 : 2 * i));
+    }
+    bench_report(merged ? "getlk (one merged lock)" :
+                 "getlk (disjoint locks)", 2 * n, "ops", start);
+    close(fd);
+    fflush(stdout);
+    _exit(0);
+}
+
+static void test_fs(char *mountpoint)
+{
+    char fname[PATH_MAX];
+    int n = options.locks;
+    double start;
+    int fd;
+    int i;
+
+    assert(snprintf(fname, PATH_MAX, "%s/" FILE_NAME, mountpoint) > 0);
+    fd = open(fname, O_RDWR);
+    if (fd == -1) {
+        perror(fname);
+        assert(0);
+    }
+
+    /* Every other byte: nothing can be merged */
+    start = bench_now();
+    for (i = 0; i < n; i++)
+        assert(set_lock(fd, F_WRLCK, 2 * i, 1) == 0);
+    bench_report("setlk (disjoint)", n, "ops", start);
+    check_from_child(fname, 0);
+
+    /* Fill the gaps, everything collapses into one lock */
+    start = bench_now();
+    for (i = n - 1; i >= 0; i--)
+        assert(set_lock(fd, F_WRLCK, 2 * i + 1, 1) == 0);
+    bench_report("setlk (merging)", n, "ops", start);
+    check_from_child(fname, 1);
+
+    /* Punch holes, splitting the lock again */
+    start = bench_now();
+    for (i = 0; i < n; i++)
+        assert(set_lock(fd, F_UNLCK, 2 * i + 1, 1) == 0);
+    bench_report("unlock (splitting)", n, "ops", start);
+    check_from_child(fname, 0);
+
+    /* Downgrade and release a range at a time */
+    start = bench_now();
+    for (i = 0; i < n; i++)
+        assert(set_lock(fd, F_RDLCK, 2 * i, 1) == 0);
+    bench_report("setlk (downgrade)", n, "ops", start);
+    start = bench_now();
+    for (i = 0; i < n; i++)
+        assert(set_lock(fd, F_UNLCK, 2 * i, 2) == 0);
+    bench_report("unlock (release)", n, "ops", start);
+
+    close(fd);
+}
+
+static void *run_fs(void *data)
+{
+    struct fuse *fuse = (struct fuse *) data;
+    assert(fuse_loop(fuse) == 0);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+    struct fuse_cmdline_opts fuse_opts;
+    struct fuse *fuse;
+    pthread_t fs_thread;
+
+    assert(fuse_opt_parse(&args, &options, option_spec, NULL) == 0);
+    assert(fuse_parse_cmdline(&args, &fuse_opts) == 0);
+    assert(fuse_opts.mountpoint != NULL);
+    assert(options.locks > 0);
+#ifndef __FreeBSD__
+    assert(fuse_opt_add_arg(&args, "-oauto_unmount") == 0);
+#endif
+    fuse = fuse_new(&args, &tfs_oper, sizeof(tfs_oper), NULL);
+    fuse_opt_free_args(&args);
+    assert(fuse != NULL);
+    assert(fuse_set_signal_handlers(fuse_get_session(fuse)) == 0);
+    assert(fuse_mount(fuse, fuse_opts.mountpoint) == 0);
+
+    /* Start file-system thread */
+    assert(pthread_create(&fs_thread, NULL, run_fs, (void *)fuse) == 0);
+
+    test_fs(fuse_opts.mountpoint);
+    free(fuse_opts.mountpoint);
+
+    /* Stop file system */
+    fuse_exit(fuse);
+    fuse_unmount(fuse);
+    assert(pthread_join(fs_thread, NULL) == 0);
+
+    fuse_remove_signal_handlers(fuse_get_session(fuse));
+    fuse_destroy(fuse);
+
+    printf("Test completed successfully.\n");
+    return 0;
+}
+
+
+/**
+ * Local Variables:
+ * mode: c
+ * indent-tabs-mode: nil
+ * c-basic-offset: 4
+ * End:
+ */
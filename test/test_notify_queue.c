@@ -0,0 +1,168 @@
+/*
+  FUSE: Filesystem in Userspace
+  Copyright (C) 2026  agent <agent@local>
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+/*
+ * Test for the asynchronous notification queue.  Many invalidations
+ * for a small set of inodes and entries are queued into a short queue,
+ * so that callers have to wait for room and repeated notifications are
+ * merged, and the statistics are checked after flushing the queue.
+ */
+
+#define FUSE_USE_VERSION 32
+
+#include <config.h>
+#include <fuse_lowlevel.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define NUM_CALLS 20000
+#define NUM_NAMES 16
+#define QUEUE_MAX 16
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static int initialized;
+
+static void tfs_init(void *userdata, struct fuse_conn_info *conn)
+{
+    (void) userdata; (void) conn;
+
+    pthread_mutex_lock(&lock);
+    initialized = 1;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&lock);
+}
+
+static void tfs_getattr(fuse_req_t req, fuse_ino_t ino,
+                        struct fuse_file_info *fi)
+{
+    struct stat stbuf;
+
+    (void) fi;
+    if (ino != FUSE_ROOT_ID) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+    memset(&stbuf, 0, sizeof(stbuf));
+    stbuf.st_ino = ino;
+    stbuf.st_mode = S_IFDIR | 0755;
+    stbuf.st_nlink = 2;
+    fuse_reply_attr(req, &stbuf, 0);
+}
+
+static const struct fuse_lowlevel_ops tfs_oper = {
+    .init       = tfs_init,
+    .getattr    = tfs_getattr,
+};
+
+static void test_queue(struct fuse_session *se)
+{
+    struct fuse_notify_queue_stats stats;
+    char name[32];
+    int i;
+
+    pthread_mutex_lock(&lock);
+    while (!initialized)
+        pthread_cond_wait(&cond, &lock);
+    pthread_mutex_unlock(&lock);
+
+    for (i = 0; i < NUM_CALLS; i++) {
+        switch (i % 3) {
+        case 0:
+            assert(fuse_lowlevel_notify_inval_inode_async
+                   (se, FUSE_ROOT_ID, (i % 64) * 4096, 4096) == 0);
+            break;
+        case 1:
+            assert(fuse_lowlevel_notify_inval_inode_async
+                   (se, FUSE_ROOT_ID, -1, 0) == 0);
+            break;
+        case 2:
+            snprintf(name, sizeof(name), "file%d", i % NUM_NAMES);
+            assert(fuse_lowlevel_notify_inval_entry_async
+                   (se, FUSE_ROOT_ID, name, strlen(name)) == 0);
+            break;
+        }
+    }
+    assert(fuse_lowlevel_notify_flush(se) == 0);
+
+    fuse_lowlevel_notify_queue_stats(se, &stats);
+    printf("%llu queued, %llu coalesced, %llu sent, %llu failed, "
+           "%llu blocked, max depth %u\n",
+           (unsigned long long) stats.queued,
+           (unsigned long long) stats.coalesced,
+           (unsigned long long) stats.sent,
+           (unsigned long long) stats.failed,
+           (unsigned long long) stats.blocked, stats.max_depth);
+    assert(stats.queued + stats.coalesced == NUM_CALLS);
+    assert(stats.sent == stats.queued);
+    assert(stats.failed == 0);
+    assert(stats.depth == 0);
+    assert(stats.max_depth <= QUEUE_MAX);
+}
+
+static void *run_fs(void *data)
+{
+    struct fuse_session *se = (struct fuse_session *) data;
+    assert(fuse_session_loop(se) == 0);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+    struct fuse_cmdline_opts fuse_opts;
+    struct fuse_session *se;
+    pthread_t fs_thread;
+    char opt[32];
+
+    assert(fuse_parse_cmdline(&args, &fuse_opts) == 0);
+    assert(fuse_opts.mountpoint != NULL);
+#ifndef __FreeBSD__
+    assert(fuse_opt_add_arg(&args, "-oauto_unmount") == 0);
+#endif
+    snprintf(opt, sizeof(opt), "-onotify_queue_max=%d", QUEUE_MAX);
+    assert(fuse_opt_add_arg(&args, opt) == 0);
+    se = fuse_session_new(&args, &tfs_oper,
+                          sizeof(tfs_oper), NULL);
+    fuse_opt_free_args(&args);
+    assert (se != NULL);
+    assert(fuse_set_signal_handlers(se) == 0);
+    assert(fuse_session_mount(se, fuse_opts.mountpoint) == 0);
+
+    /* Start file-system thread */
+    assert(pthread_create(&fs_thread, NULL, run_fs, (void *)se) == 0);
+
+    test_queue(se);
+    free(fuse_opts.mountpoint);
+
+    /* Stop file system */
+    fuse_session_exit(se);
+    fuse_session_unmount(se);
+    assert(pthread_join(fs_thread, NULL) == 0);
+
+    fuse_remove_signal_handlers(se);
+    fuse_session_destroy(se);
+
+    printf("Test completed successfully.\n");
+    return 0;
+}
+
+
+/**
+ * Local Variables:
+ * mode: c
+ * indent-tabs-mode: nil
+ * c-basic-offset: 4
+ * End:
+ */
@@ -0,0 +1,308 @@
+/*
+  FUSE: Filesystem in Userspace
+  Copyright (C) 2026  agent <agent@local>
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+/*
+ * Test for page cache prewarming.  One file is prewarmed through a hint
+ * file after it has been looked up, another one when it is opened.
+ * Reading either file afterwards must not send any READ requests.
+ */
+
+#define FUSE_USE_VERSION 32
+
+#include <config.h>
+#include <fuse_lowlevel.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <assert.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#ifndef __linux__
+#include <limits.h>
+#else
+#include <linux/limits.h>
+#endif
+
+#define FILE_SIZE (256 * 1024)
+#define NUM_FILES 2
+
+static const char *file_names[NUM_FILES] = { "hinted", "opened" };
+static int backing_fds[NUM_FILES];
+static struct fuse_prewarm *pw;
+static int read_cnt;
+static int initialized;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+
+static void tfs_init(void *userdata, struct fuse_conn_info *conn)
+{
+    (void) userdata; (void) conn;
+
+    pthread_mutex_lock(&lock);
+    initialized = 1;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&lock);
+}
+
+static int tfs_stat(fuse_ino_t ino, struct stat *stbuf)
+{
+    memset(stbuf, 0, sizeof(*stbuf));
+    stbuf->st_ino = ino;
+    if (ino == FUSE_ROOT_ID) {
+        stbuf->st_mode = S_IFDIR | 0755;
+        stbuf->st_nlink = 2;
+    } else if (ino >= 2 && ino < 2 + NUM_FILES) {
+        stbuf->st_mode = S_IFREG | 0444;
+        stbuf->st_nlink = 1;
+        stbuf->st_size = FILE_SIZE;
+    } else
+        return -1;
+    return 0;
+}
+
+static void tfs_lookup(fuse_req_t req, fuse_ino_t parent, const char *name)
+{
+    struct fuse_entry_param e;
+    int i;
+
+    memset(&e, 0, sizeof(e));
+    for (i = 0; i < NUM_FILES; i++) {
+        if (parent == FUSE_ROOT_ID && strcmp(name, file_names[i]) == 0)
+            break;
+    }
+    if (i == NUM_FILES) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+    e.ino = 2 + i;
+    e.attr_timeout = 600;
+    e.entry_timeout = 600;
+    tfs_stat(e.ino, &e.attr);
+    fuse_reply_entry(req, &e);
+}
+
+static void tfs_getattr(fuse_req_t req, fuse_ino_t ino,
+                        struct fuse_file_info *fi)
+{
+    struct stat stbuf;
+
+    (void) fi;
+    if (tfs_stat(ino, &stbuf) != 0)
+        fuse_reply_err(req, ENOENT);
+    else
+        fuse_reply_attr(req, &stbuf, 600);
+}
+
+static void tfs_open(fuse_req_t req, fuse_ino_t ino,
+                     struct fuse_file_info *fi)
+{
+    if (ino < 2 || ino >= 2 + NUM_FILES)
+        fuse_reply_err(req, EISDIR);
+    else if ((fi->flags & O_ACCMODE) != O_RDONLY)
+        fuse_reply_err(req, EACCES);
+    else {
+        fi->keep_cache = 1;
+        if (ino == 2)
+            fuse_reply_open(req, fi);
+        else
+            fuse_reply_open_prewarm(req, fi, pw, ino,
+                                    backing_fds[ino - 2], 0);
+    }
+}
+
+static void tfs_read(fuse_req_t req, fuse_ino_t ino, size_t size,
+                     off_t off, struct fuse_file_info *fi)
+{
+    struct fuse_bufvec bufv = FUSE_BUFVEC_INIT(size);
+
+    (void) fi;
+    __atomic_add_fetch(&read_cnt, 1, __ATOMIC_SEQ_CST);
+    bufv.buf[0].flags = FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK;
+    bufv.buf[0].fd = backing_fds[ino - 2];
+    bufv.buf[0].pos = off;
+    fuse_reply_data(req, &bufv, 0);
+}
+
+static const struct fuse_lowlevel_ops tfs_oper = {
+    .init       = tfs_init,
+    .lookup     = tfs_lookup,
+    .getattr    = tfs_getattr,
+    .open       = tfs_open,
+    .read       = tfs_read,
+};
+
+static int resolve(void *data, const char *name, fuse_ino_t *ino, int *fd)
+{
+    (void) data;
+    assert(strcmp(name, file_names[0]) == 0);
+    *ino = 2;
+    *fd = dup(backing_fds[0]);
+    return 0;
+}
+
+static void check_contents(const char *fname, int idx)
+{
+    char buf[4096];
+    char expected[4096];
+    off_t off = 0;
+    ssize_t res;
+    int fd;
+
+    fd = open(fname, O_RDONLY);
+    assert(fd != -1);
+    while ((res = read(fd, buf, sizeof(buf))) > 0) {
+        assert(pread(backing_fds[idx], expected, res, off) == res);
+        assert(memcmp(buf, expected, res) == 0);
+        off += res;
+    }
+    assert(res == 0);
+    assert(off == FILE_SIZE);
+    close(fd);
+}
+
+static void wait_stored(uint64_t bytes)
+{
+    struct fuse_prewarm_stats stats;
+    int i;
+
+    /* The open handler may queue the file after open() has returned */
+    for (i = 0; i < 1000; i++) {
+        fuse_prewarm_wait(pw);
+        fuse_prewarm_get_stats(pw, &stats);
+        if (stats.bytes >= bytes)
+            return;
+        usleep(10000);
+    }
+}
+
+static void test_fs(const char *mountpoint)
+{
+    struct fuse_prewarm_stats stats;
+    char fname[PATH_MAX];
+    char hintfile[] = "/tmp/fuse-prewarm-XXXXXX";
+    struct stat stbuf;
+    FILE *fp;
+    int fd;
+
+    pthread_mutex_lock(&lock);
+    while (!initialized)
+        pthread_cond_wait(&cond, &lock);
+    pthread_mutex_unlock(&lock);
+
+    /* The kernel only accepts data for inodes it knows */
+    assert(snprintf(fname, PATH_MAX, "%s/%s", mountpoint,
+                    file_names[0]) > 0);
+    assert(stat(fname, &stbuf) == 0);
+
+    fd = mkstemp(hintfile);
+    assert(fd != -1);
+    fp = fdopen(fd, "w");
+    assert(fp != NULL);
+    fprintf(fp, "# hot files\n\n%s\n", file_names[0]);
+    fclose(fp);
+    assert(fuse_prewarm_hints(pw, hintfile, resolve, NULL) == 1);
+    unlink(hintfile);
+    fuse_prewarm_wait(pw);
+    check_contents(fname, 0);
+
+    assert(snprintf(fname, PATH_MAX, "%s/%s", mountpoint,
+                    file_names[1]) > 0);
+    fd = open(fname, O_RDONLY);
+    assert(fd != -1);
+    wait_stored(NUM_FILES * FILE_SIZE);
+    check_contents(fname, 1);
+    close(fd);
+
+    /* check_contents() opened the file once more */
+    wait_stored((NUM_FILES + 1) * FILE_SIZE);
+    fuse_prewarm_get_stats(pw, &stats);
+    printf("%llu bytes in %llu stores, %llu failed, %d reads\n",
+           (unsigned long long) stats.bytes,
+           (unsigned long long) stats.stores,
+           (unsigned long long) stats.failed, read_cnt);
+    assert(stats.bytes == (NUM_FILES + 1) * FILE_SIZE);
+    assert(stats.failed == 0);
+    assert(read_cnt == 0);
+}
+
+static void *run_fs(void *data)
+{
+    struct fuse_session *se = (struct fuse_session *) data;
+    assert(fuse_session_loop(se) == 0);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+    struct fuse_cmdline_opts fuse_opts;
+    struct fuse_session *se;
+    pthread_t fs_thread;
+    char buf[FILE_SIZE];
+    int i, j;
+
+    for (i = 0; i < NUM_FILES; i++) {
+        FILE *fp = tmpfile();
+
+        assert(fp != NULL);
+        for (j = 0; j < FILE_SIZE; j++)
+            buf[j] = (j * 7 + i * 13 + j / 4096) & 0xff;
+        assert(fwrite(buf, 1, FILE_SIZE, fp) == FILE_SIZE);
+        assert(fflush(fp) == 0);
+        backing_fds[i] = dup(fileno(fp));
+        fclose(fp);
+    }
+
+    assert(fuse_parse_cmdline(&args, &fuse_opts) == 0);
+    assert(fuse_opts.mountpoint != NULL);
+#ifndef __FreeBSD__
+    assert(fuse_opt_add_arg(&args, "-oauto_unmount") == 0);
+#endif
+    se = fuse_session_new(&args, &tfs_oper,
+                          sizeof(tfs_oper), NULL);
+    fuse_opt_free_args(&args);
+    assert (se != NULL);
+    assert(fuse_set_signal_handlers(se) == 0);
+    assert(fuse_session_mount(se, fuse_opts.mountpoint) == 0);
+
+    /* Four stores of 64 KiB per file */
+    pw = fuse_prewarm_new(se, 2, 128 * 1024);
+    assert(pw != NULL);
+
+    /* Start file-system thread */
+    assert(pthread_create(&fs_thread, NULL, run_fs, (void *)se) == 0);
+
+    test_fs(fuse_opts.mountpoint);
+    free(fuse_opts.mountpoint);
+
+    /* Stop file system */
+    fuse_session_exit(se);
+    fuse_session_unmount(se);
+    assert(pthread_join(fs_thread, NULL) == 0);
+
+    fuse_prewarm_destroy(pw);
+    fuse_remove_signal_handlers(se);
+    fuse_session_destroy(se);
+
+    printf("Test completed successfully.\n");
+    return 0;
+}
+
+
+/**
+ * Local Variables:
+ * mode: c
+ * indent-tabs-mode: nil
+ * c-basic-offset: 4
+ * End:
+ */
@@ -0,0 +1,256 @@
+/*
+  FUSE: Filesystem in Userspace
+  Copyright (C) 2026  agent <agent@local>
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+/*
+ * Test for kernel caching of directory listings in the high-level
+ * API.  A second listing must be served by the kernel, a file created
+ * through the mount must show up, and a change made behind the
+ * kernel's back must show up with auto_cache_readdir only.
+ */
+
+#define FUSE_USE_VERSION 32
+
+#include <config.h>
+#include <fuse.h>
+#include <fuse_lowlevel.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#ifndef __linux__
+#include <limits.h>
+#else
+#include <linux/limits.h>
+#endif
+
+#define MAX_FILES 16
+
+/* Command line parsing */
+struct options {
+    int auto_mode;
+} options = {
+    .auto_mode = 0,
+};
+
+#define OPTION(t, p, v)                         \
+    { t, offsetof(struct options, p), v }
+static const struct fuse_opt option_spec[] = {
+    OPTION("--auto", auto_mode, 1),
+    FUSE_OPT_END
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static char names[MAX_FILES][16];
+static int num_files;
+static time_t dir_mtime = 1000;
+static int readdir_cnt;
+
+static void add_file(const char *name)
+{
+    pthread_mutex_lock(&lock);
+    assert(num_files < MAX_FILES);
+    strcpy(names[num_files++], name);
+    dir_mtime++;
+    pthread_mutex_unlock(&lock);
+}
+
+static int find_file(const char *path)
+{
+    int i;
+
+    for (i = 0; i < num_files; i++) {
+        if (path[0] == '/' && strcmp(path + 1, names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static void *tfs_init(struct fuse_conn_info *conn, struct fuse_config *cfg)
+{
+    (void) conn;
+    cfg->ac_attr_timeout = 0;
+    if (options.auto_mode)
+        cfg->auto_cache_readdir = 1;
+    else
+        cfg->cache_readdir = 1;
+    return NULL;
+}
+
+static int tfs_getattr(const char *path, struct stat *stbuf,
+                       struct fuse_file_info *fi)
+{
+    int res = 0;
+
+    (void) fi;
+    memset(stbuf, 0, sizeof(*stbuf));
+    pthread_mutex_lock(&lock);
+    if (strcmp(path, "/") == 0) {
+        stbuf->st_mode = S_IFDIR | 0755;
+        stbuf->st_nlink = 2;
+        stbuf->st_mtime = dir_mtime;
+    } else if (find_file(path) != -1) {
+        stbuf->st_mode = S_IFREG | 0644;
+        stbuf->st_nlink = 1;
+    } else
+        res = -ENOENT;
+    pthread_mutex_unlock(&lock);
+
+    return res;
+}
+
+static int tfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
+                       off_t offset, struct fuse_file_info *fi,
+                       enum fuse_readdir_flags flags)
+{
+    int i;
+
+    (void) offset; (void) fi; (void) flags;
+    if (strcmp(path, "/") != 0)
+        return -ENOTDIR;
+
+    __atomic_add_fetch(&readdir_cnt, 1, __ATOMIC_SEQ_CST);
+    filler(buf, ".", NULL, 0, 0);
+    filler(buf, "..", NULL, 0, 0);
+    pthread_mutex_lock(&lock);
+    for (i = 0; i < num_files; i++)
+        filler(buf, names[i], NULL, 0, 0);
+    pthread_mutex_unlock(&lock);
+
+    return 0;
+}
+
+static int tfs_mknod(const char *path, mode_t mode, dev_t rdev)
+{
+    (void) rdev;
+    if (!S_ISREG(mode) || strchr(path + 1, '/') != NULL)
+        return -EINVAL;
+    add_file(path + 1);
+    return 0;
+}
+
+static const struct fuse_operations tfs_oper = {
+    .init       = tfs_init,
+    .getattr    = tfs_getattr,
+    .readdir    = tfs_readdir,
+    .mknod      = tfs_mknod,
+};
+
+static int listed(const char *mountpoint, const char *name)
+{
+    struct dirent *de;
+    int found = 0;
+    DIR *dirp;
+
+    dirp = opendir(mountpoint);
+    assert(dirp != NULL);
+    while ((de = readdir(dirp)) != NULL) {
+        if (strcmp(de->d_name, name) == 0)
+            found = 1;
+    }
+    closedir(dirp);
+    return found;
+}
+
+static void test_fs(const char *mountpoint)
+{
+    char fname[PATH_MAX];
+    int before;
+
+    add_file("one");
+    add_file("two");
+
+    /* First listing fills the cache, the second one uses it */
+    before = readdir_cnt;
+    assert(listed(mountpoint, "one"));
+    assert(readdir_cnt > before);
+    before = readdir_cnt;
+    assert(listed(mountpoint, "two"));
+    assert(readdir_cnt == before);
+
+    /* Created through the mount, the kernel drops the listing */
+    assert(snprintf(fname, PATH_MAX, "%s/three", mountpoint) > 0);
+    assert(mknod(fname, S_IFREG | 0644, 0) == 0);
+    before = readdir_cnt;
+    assert(listed(mountpoint, "three"));
+    assert(readdir_cnt > before);
+    before = readdir_cnt;
+    assert(listed(mountpoint, "three"));
+    assert(readdir_cnt == before);
+
+    /* Changed behind the kernel's back */
+    add_file("four");
+    before = readdir_cnt;
+    if (options.auto_mode) {
+        assert(listed(mountpoint, "four"));
+        assert(readdir_cnt > before);
+    } else {
+        assert(!listed(mountpoint, "four"));
+        assert(readdir_cnt == before);
+    }
+    printf("%d readdir calls\n", readdir_cnt);
+}
+
+static void *run_fs(void *data)
+{
+    struct fuse *fuse = (struct fuse *) data;
+    assert(fuse_loop(fuse) == 0);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+    struct fuse_cmdline_opts fuse_opts;
+    struct fuse *fuse;
+    pthread_t fs_thread;
+
+    assert(fuse_opt_parse(&args, &options, option_spec, NULL) == 0);
+    assert(fuse_parse_cmdline(&args, &fuse_opts) == 0);
+    assert(fuse_opts.mountpoint != NULL);
+#ifndef __FreeBSD__
+    assert(fuse_opt_add_arg(&args, "-oauto_unmount") == 0);
+#endif
+    fuse = fuse_new(&args, &tfs_oper, sizeof(tfs_oper), NULL);
+    fuse_opt_free_args(&args);
+    assert(fuse != NULL);
+    assert(fuse_set_signal_handlers(fuse_get_session(fuse)) == 0);
+    assert(fuse_mount(fuse, fuse_opts.mountpoint) == 0);
+
+    /* Start file-system thread */
+    assert(pthread_create(&fs_thread, NULL, run_fs, (void *)fuse) == 0);
+
+    test_fs(fuse_opts.mountpoint);
+    free(fuse_opts.mountpoint);
+
+    /* Stop file system */
+    fuse_exit(fuse);
+    fuse_unmount(fuse);
+    assert(pthread_join(fs_thread, NULL) == 0);
+
+    fuse_remove_signal_handlers(fuse_get_session(fuse));
+    fuse_destroy(fuse);
+
+    printf("Test completed successfully.\n");
+    return 0;
+}
+
+
+/**
+ * Local Variables:
+ * mode: c
+ * indent-tabs-mode: nil
+ * c-basic-offset: 4
+ * End:
+ */
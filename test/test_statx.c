@@ -0,0 +1,164 @@
+/*
+  FUSE: Filesystem in Userspace
+  Copyright (C) 2026  agent <agent@local>
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+/*
+ * Test for the statx operation of the high-level API.  Asking for the
+ * birth time of a file must reach the file system's statx handler with
+ * the requested mask, and the birth time it returns must show up in
+ * userspace.
+ */
+
+#define FUSE_USE_VERSION 32
+#define _GNU_SOURCE
+
+#include <config.h>
+#include <fuse.h>
+#include <fuse_lowlevel.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#ifndef __linux__
+#include <limits.h>
+#else
+#include <linux/limits.h>
+#endif
+
+#define FILE_NAME "born"
+#define FILE_SIZE 1234
+#define BIRTH_SEC 1000000000
+#define BIRTH_NSEC 123456789
+
+static int statx_cnt;
+static int statx_mask;
+
+static int tfs_getattr(const char *path, struct stat *stbuf,
+                       struct fuse_file_info *fi)
+{
+    (void) fi;
+
+    memset(stbuf, 0, sizeof(*stbuf));
+    if (strcmp(path, "/") == 0) {
+        stbuf->st_mode = S_IFDIR | 0755;
+        stbuf->st_nlink = 2;
+    } else if (strcmp(path, "/" FILE_NAME) == 0) {
+        stbuf->st_mode = S_IFREG | 0444;
+        stbuf->st_nlink = 1;
+        stbuf->st_size = FILE_SIZE;
+    } else
+        return -ENOENT;
+
+    return 0;
+}
+
+static int tfs_statx(const char *path, int flags, int mask,
+                     struct statx *stxbuf, struct fuse_file_info *fi)
+{
+    struct stat stbuf;
+    int res;
+
+    (void) flags;
+    res = tfs_getattr(path, &stbuf, fi);
+    if (res)
+        return res;
+
+    __atomic_add_fetch(&statx_cnt, 1, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&statx_mask, mask, __ATOMIC_SEQ_CST);
+    stxbuf->stx_mask = STATX_BASIC_STATS | STATX_BTIME;
+    stxbuf->stx_mode = stbuf.st_mode;
+    stxbuf->stx_nlink = stbuf.st_nlink;
+    stxbuf->stx_size = stbuf.st_size;
+    stxbuf->stx_blksize = 4096;
+    stxbuf->stx_btime.tv_sec = BIRTH_SEC;
+    stxbuf->stx_btime.tv_nsec = BIRTH_NSEC;
+
+    return 0;
+}
+
+static const struct fuse_operations tfs_oper = {
+    .getattr    = tfs_getattr,
+    .statx      = tfs_statx,
+};
+
+static void test_fs(char *mountpoint)
+{
+    char fname[PATH_MAX];
+    struct statx stx;
+
+    assert(snprintf(fname, PATH_MAX, "%s/" FILE_NAME, mountpoint) > 0);
+
+    memset(&stx, 0, sizeof(stx));
+    assert(statx(AT_FDCWD, fname, AT_STATX_FORCE_SYNC,
+                 STATX_BASIC_STATS | STATX_BTIME, &stx) == 0);
+    printf("%d statx requests, mask 0x%x\n", statx_cnt, statx_mask);
+    assert(statx_cnt > 0);
+    assert(statx_mask & STATX_BTIME);
+    assert(stx.stx_mask & STATX_BTIME);
+    assert(stx.stx_btime.tv_sec == BIRTH_SEC);
+    assert(stx.stx_btime.tv_nsec == BIRTH_NSEC);
+    assert(stx.stx_size == FILE_SIZE);
+    assert(S_ISREG(stx.stx_mode));
+}
+
+static void *run_fs(void *data)
+{
+    struct fuse *fuse = (struct fuse *) data;
+    assert(fuse_loop(fuse) == 0);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+    struct fuse_cmdline_opts fuse_opts;
+    struct fuse *fuse;
+    pthread_t fs_thread;
+
+    assert(fuse_parse_cmdline(&args, &fuse_opts) == 0);
+    assert(fuse_opts.mountpoint != NULL);
+#ifndef __FreeBSD__
+    assert(fuse_opt_add_arg(&args, "-oauto_unmount") == 0);
+#endif
+    fuse = fuse_new(&args, &tfs_oper, sizeof(tfs_oper), NULL);
+    fuse_opt_free_args(&args);
+    assert(fuse != NULL);
+    assert(fuse_set_signal_handlers(fuse_get_session(fuse)) == 0);
+    assert(fuse_mount(fuse, fuse_opts.mountpoint) == 0);
+
+    /* Start file-system thread */
+    assert(pthread_create(&fs_thread, NULL, run_fs, (void *)fuse) == 0);
+
+    test_fs(fuse_opts.mountpoint);
+    free(fuse_opts.mountpoint);
+
+    /* Stop file system */
+    fuse_exit(fuse);
+    fuse_unmount(fuse);
+    assert(pthread_join(fs_thread, NULL) == 0);
+
+    fuse_remove_signal_handlers(fuse_get_session(fuse));
+    fuse_destroy(fuse);
+
+    printf("Test completed successfully.\n");
+    return 0;
+}
+
+
+/**
+ * Local Variables:
+ * mode: c
+ * indent-tabs-mode: nil
+ * c-basic-offset: 4
+ * End:
+ */
@@ -0,0 +1,295 @@
+/*
+  FUSE: Filesystem in Userspace
+  Copyright (C) 2026  agent <agent@local>
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+/*
+ * Streaming benchmark for large requests.  Mounts a file system with
+ * one direct I/O file, streams data into it and back out of it with
+ * large write() and read() calls, and reports the throughput and the
+ * size of the requests the kernel sent.  The requests must be as
+ * large as --max-write allows, clamped to the kernel limit.
+ */
+
+#define FUSE_USE_VERSION 32
+
+#include <config.h>
+#include <fuse.h>
+#include <fuse_lowlevel.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "bench.h"
+
+#ifndef __linux__
+#include <limits.h>
+#else
+#include <linux/limits.h>
+#endif
+
+/* Size of the write() and read() calls */
+#define IO_SIZE (8 * 1024 * 1024)
+
+/* Command line parsing */
+struct options {
+    unsigned max_write;
+    int size;
+} options = {
+    .max_write = 1024 * 1024,
+    .size = 256,
+};
+
+#define OPTION(t, p)                           \
+    { t, offsetof(struct options, p), 1 }
+static const struct fuse_opt option_spec[] = {
+    OPTION("--max-write=%u", max_write),
+    OPTION("--size=%d", size),
+    FUSE_OPT_END
+};
+
+struct stream_stats {
+    long requests;
+    size_t largest;
+};
+
+static struct stream_stats read_stats;
+static struct stream_stats write_stats;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+/* Byte n of the file is n & 0xff */
+static unsigned char *pattern;
+static off_t file_size;
+
+static void account(struct stream_stats *stats, size_t size)
+{
+    pthread_mutex_lock(&lock);
+    stats->requests++;
+    if (size > stats->largest)
+        stats->largest = size;
+    pthread_mutex_unlock(&lock);
+}
+
+static void *tfs_init(struct fuse_conn_info *conn, struct fuse_config *cfg)
+{
+    conn->max_write = options.max_write;
+    cfg->direct_io = 1;
+    return NULL;
+}
+
+static int tfs_getattr(const char *path, struct stat *stbuf,
+                       struct fuse_file_info *fi)
+{
+    (void) fi;
+    memset(stbuf, 0, sizeof(*stbuf));
+    if (strcmp(path, "/") == 0) {
+        stbuf->st_mode = S_IFDIR | 0755;
+        stbuf->st_nlink = 2;
+    } else if (strcmp(path, "/stream") == 0) {
+        stbuf->st_mode = S_IFREG | 0644;
+        stbuf->st_nlink = 1;
+        pthread_mutex_lock(&lock);
+        stbuf->st_size = file_size;
+        pthread_mutex_unlock(&lock);
+    } else
+        return -ENOENT;
+
+    return 0;
+}
+
+static int tfs_open(const char *path, struct fuse_file_info *fi)
+{
+    (void) fi;
+    if (strcmp(path, "/stream") != 0)
+        return -ENOENT;
+    return 0;
+}
+
+static int tfs_read(const char *path, char *buf, size_t size, off_t offset,
+                    struct fuse_file_info *fi)
+{
+    (void) path; (void) fi;
+    account(&read_stats, size);
+    pthread_mutex_lock(&lock);
+    if (offset >= file_size)
+        size = 0;
+    else if (size > (size_t) (file_size - offset))
+        size = file_size - offset;
+    pthread_mutex_unlock(&lock);
+    memcpy(buf, pattern + (offset & 0xff), size);
+    return size;
+}
+
+static int tfs_write(const char *path, const char *buf, size_t size,
+                     off_t offset, struct fuse_file_info *fi)
+{
+    const unsigned char *data = (const unsigned char *) buf;
+
+    (void) path; (void) fi;
+    account(&write_stats, size);
+    if (size && (data[0] != pattern[offset & 0xff] ||
+                 data[size - 1] != pattern[(offset + size - 1) & 0xff]))
+        return -EIO;
+    pthread_mutex_lock(&lock);
+    if (offset + (off_t) size > file_size)
+        file_size = offset + size;
+    pthread_mutex_unlock(&lock);
+    return size;
+}
+
+static int tfs_truncate(const char *path, off_t size,
+                        struct fuse_file_info *fi)
+{
+    (void) path; (void) fi;
+    pthread_mutex_lock(&lock);
+    file_size = size;
+    pthread_mutex_unlock(&lock);
+    return 0;
+}
+
+static const struct fuse_operations tfs_oper = {
+    .init       = tfs_init,
+    .getattr    = tfs_getattr,
+    .open       = tfs_open,
+    .read       = tfs_read,
+    .write      = tfs_write,
+    .truncate   = tfs_truncate,
+};
+
+static void report(const char *phase, size_t bytes, double start,
+                   const struct stream_stats *stats)
+{
+    bench_report(phase, bytes >> 20, "MiB", start);
+    printf("%-28s %8ld requests, largest %zu KiB\n", "", stats->requests,
+           stats->largest >> 10);
+}
+
+/* Largest request the kernel will send for a given max_write */
+static size_t expected_size(void)
+{
+    size_t limit = 256 * getpagesize();
+    FILE *fp;
+    int pages;
+
+    fp = fopen("/proc/sys/fs/fuse/max_pages_limit", "r");
+    if (fp) {
+        if (fscanf(fp, "%d", &pages) == 1 && pages > 0)
+            limit = (size_t) pages * getpagesize();
+        fclose(fp);
+    }
+    return options.max_write < limit ? options.max_write : limit;
+}
+
+static void test_fs(const char *mountpoint)
+{
+    size_t total = (size_t) options.size << 20;
+    size_t expected = expected_size();
+    char fname[PATH_MAX];
+    unsigned char *buf;
+    double start;
+    size_t off;
+    int fd;
+
+    assert(posix_memalign((void **) &buf, getpagesize(), IO_SIZE) == 0);
+    assert(snprintf(fname, PATH_MAX, "%s/stream", mountpoint) > 0);
+    fd = open(fname, O_RDWR | O_TRUNC);
+    assert(fd != -1);
+
+    printf("max_write %u KiB, expecting %zu KiB requests\n",
+           options.max_write >> 10, expected >> 10);
+
+    memcpy(buf, pattern, IO_SIZE);
+    start = bench_now();
+    for (off = 0; off < total; off += IO_SIZE)
+        assert(pwrite(fd, buf, IO_SIZE, off) == IO_SIZE);
+    report("stream write", total, start, &write_stats);
+    assert(write_stats.largest == expected);
+
+    start = bench_now();
+    for (off = 0; off < total; off += IO_SIZE) {
+        assert(pread(fd, buf, IO_SIZE, off) == IO_SIZE);
+        assert(buf[0] == 0 && buf[IO_SIZE - 1] == 0xff);
+    }
+    report("stream read", total, start, &read_stats);
+    assert(read_stats.largest == expected);
+
+    assert(close(fd) == 0);
+    free(buf);
+}
+
+static void *run_fs(void *data)
+{
+    struct fuse *fuse = (struct fuse *) data;
+    struct fuse_loop_config config = {
+        .clone_fd = 0,
+        .max_idle_threads = 10,
+    };
+    assert(fuse_loop_mt(fuse, &config) == 0);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+    struct fuse_cmdline_opts fuse_opts;
+    struct fuse *fuse;
+    pthread_t fs_thread;
+    int i;
+
+    assert(fuse_opt_parse(&args, &options, option_spec, NULL) == 0);
+    assert(options.max_write >= 4096 && options.max_write <= IO_SIZE &&
+           options.max_write % 4096 == 0);
+    assert(options.size > 0 && options.size % (IO_SIZE >> 20) == 0);
+    assert(fuse_parse_cmdline(&args, &fuse_opts) == 0);
+    assert(fuse_opts.mountpoint != NULL);
+#ifndef __FreeBSD__
+    assert(fuse_opt_add_arg(&args, "-oauto_unmount") == 0);
+#endif
+
+    pattern = malloc(IO_SIZE + 256);
+    assert(pattern != NULL);
+    for (i = 0; i < IO_SIZE + 256; i++)
+        pattern[i] = i;
+
+    fuse = fuse_new(&args, &tfs_oper, sizeof(tfs_oper), NULL);
+    fuse_opt_free_args(&args);
+    assert(fuse != NULL);
+    assert(fuse_set_signal_handlers(fuse_get_session(fuse)) == 0);
+    assert(fuse_mount(fuse, fuse_opts.mountpoint) == 0);
+
+    /* Start file-system thread */
+    assert(pthread_create(&fs_thread, NULL, run_fs, (void *)fuse) == 0);
+
+    test_fs(fuse_opts.mountpoint);
+    free(fuse_opts.mountpoint);
+
+    /* Stop file system */
+    fuse_exit(fuse);
+    fuse_unmount(fuse);
+    assert(pthread_join(fs_thread, NULL) == 0);
+
+    fuse_remove_signal_handlers(fuse_get_session(fuse));
+    fuse_destroy(fuse);
+    free(pattern);
+
+    printf("Test completed successfully.\n");
+    return 0;
+}
+
+
+/**
+ * Local Variables:
+ * mode: c
+ * indent-tabs-mode: nil
+ * c-basic-offset: 4
+ * End:
+ */
@@ -0,0 +1,261 @@
+/*
+  FUSE: Filesystem in Userspace
+  Copyright (C) 2026  agent <agent@local>
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+/*
+ * Benchmark for resolving chains of symbolic links through the
+ * high-level library.  Mounts a file system with one chain of links
+ * ending in a regular file, resolves it many times, and reports the
+ * rate and the number of readlink() calls.  With --cache the kernel
+ * caches the targets; then each link must be read only once, and the
+ * cached targets must be dropped by fuse_invalidate_path() and when a
+ * link is replaced behind the kernel's back.
+ */
+
+#define FUSE_USE_VERSION 32
+
+#include <config.h>
+#include <fuse.h>
+#include <fuse_lowlevel.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "bench.h"
+
+#ifndef __linux__
+#include <limits.h>
+#else
+#include <linux/limits.h>
+#endif
+
+/* The kernel follows at most 40 links per lookup */
+#define MAX_DEPTH 32
+
+/* Command line parsing */
+struct options {
+    int depth;
+    int rounds;
+    int cache;
+} options = {
+    .depth = MAX_DEPTH,
+    .rounds = 10000,
+};
+
+#define OPTION(t, p, v)                         \
+    { t, offsetof(struct options, p), v }
+static const struct fuse_opt option_spec[] = {
+    OPTION("--depth=%d", depth, 0),
+    OPTION("--rounds=%d", rounds, 0),
+    OPTION("--cache", cache, 1),
+    FUSE_OPT_END
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static const char *last_target = "target";
+static time_t last_mtime = 1000;
+static int readlink_cnt;
+
+/* Returns the index of link "/lN", or -1 */
+static int link_index(const char *path)
+{
+    char *end;
+    long idx;
+
+    if (path[0] != '/' || path[1] != 'l' || !path[2])
+        return -1;
+    idx = strtol(path + 2, &end, 10);
+    if (*end || idx < 0 || idx >= options.depth)
+        return -1;
+    return idx;
+}
+
+static void link_target(int idx, char *buf, size_t size)
+{
+    if (idx == options.depth - 1) {
+        pthread_mutex_lock(&lock);
+        snprintf(buf, size, "%s", last_target);
+        pthread_mutex_unlock(&lock);
+    } else
+        snprintf(buf, size, "l%d", idx + 1);
+}
+
+static void *tfs_init(struct fuse_conn_info *conn, struct fuse_config *cfg)
+{
+    (void) conn;
+    cfg->entry_timeout = 3600;
+    /* Link attributes are fetched again on lstat() */
+    cfg->attr_timeout = 0;
+    cfg->cache_symlinks = options.cache;
+    return NULL;
+}
+
+static int tfs_getattr(const char *path, struct stat *stbuf,
+                       struct fuse_file_info *fi)
+{
+    char target[32];
+    int idx;
+
+    (void) fi;
+    memset(stbuf, 0, sizeof(*stbuf));
+    idx = link_index(path);
+    if (strcmp(path, "/") == 0) {
+        stbuf->st_mode = S_IFDIR | 0755;
+        stbuf->st_nlink = 2;
+    } else if (strcmp(path, "/target") == 0 ||
+               strcmp(path, "/other") == 0) {
+        stbuf->st_mode = S_IFREG | 0644;
+        stbuf->st_nlink = 1;
+    } else if (idx != -1) {
+        link_target(idx, target, sizeof(target));
+        stbuf->st_mode = S_IFLNK | 0777;
+        stbuf->st_nlink = 1;
+        stbuf->st_size = strlen(target);
+        if (idx == options.depth - 1) {
+            pthread_mutex_lock(&lock);
+            stbuf->st_mtime = last_mtime;
+            pthread_mutex_unlock(&lock);
+        }
+    } else
+        return -ENOENT;
+
+    return 0;
+}
+
+static int tfs_readlink(const char *path, char *buf, size_t size)
+{
+    int idx = link_index(path);
+
+    if (idx == -1)
+        return -EINVAL;
+    __atomic_add_fetch(&readlink_cnt, 1, __ATOMIC_SEQ_CST);
+    link_target(idx, buf, size);
+    return 0;
+}
+
+static const struct fuse_operations tfs_oper = {
+    .init       = tfs_init,
+    .getattr    = tfs_getattr,
+    .readlink   = tfs_readlink,
+};
+
+static ino_t resolve(const char *mountpoint, const char *name)
+{
+    char fname[PATH_MAX];
+    struct stat stbuf;
+
+    assert(snprintf(fname, PATH_MAX, "%s/%s", mountpoint, name) > 0);
+    assert(stat(fname, &stbuf) == 0);
+    assert(S_ISREG(stbuf.st_mode));
+    return stbuf.st_ino;
+}
+
+static void test_fs(struct fuse *fuse, const char *mountpoint)
+{
+    char fname[PATH_MAX];
+    struct stat stbuf;
+    double start;
+    int reads;
+    int i;
+
+    start = bench_now();
+    for (i = 0; i < options.rounds; i++)
+        assert(resolve(mountpoint, "l0") == resolve(mountpoint, "target"));
+    bench_report("resolve chain", options.rounds, "ops", start);
+    reads = __atomic_load_n(&readlink_cnt, __ATOMIC_SEQ_CST);
+    printf("%-28s %8d links, %d readlink calls\n", "", options.depth,
+           reads);
+
+    if (!options.cache) {
+        assert(reads == options.depth * options.rounds);
+        return;
+    }
+    assert(reads == options.depth);
+
+    /* Explicit invalidation drops one target */
+    assert(fuse_invalidate_path(fuse, "/l1") == 0);
+    resolve(mountpoint, "l0");
+    assert(readlink_cnt == reads + 1);
+
+    /* Replaced behind the kernel's back, noticed on lstat() */
+    pthread_mutex_lock(&lock);
+    last_target = "other";
+    last_mtime++;
+    pthread_mutex_unlock(&lock);
+    assert(snprintf(fname, PATH_MAX, "%s/l%d", mountpoint,
+                    options.depth - 1) > 0);
+    assert(lstat(fname, &stbuf) == 0);
+    assert(S_ISLNK(stbuf.st_mode));
+    assert(fuse_lowlevel_notify_flush(fuse_get_session(fuse)) == 0);
+    assert(resolve(mountpoint, "l0") == resolve(mountpoint, "other"));
+    assert(readlink_cnt == reads + 2);
+}
+
+static void *run_fs(void *data)
+{
+    struct fuse *fuse = (struct fuse *) data;
+    struct fuse_loop_config config = {
+        .clone_fd = 0,
+        .max_idle_threads = 10,
+    };
+    assert(fuse_loop_mt(fuse, &config) == 0);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+    struct fuse_cmdline_opts fuse_opts;
+    struct fuse *fuse;
+    pthread_t fs_thread;
+
+    assert(fuse_opt_parse(&args, &options, option_spec, NULL) == 0);
+    assert(options.depth > 1 && options.depth <= MAX_DEPTH);
+    assert(options.rounds > 0);
+    assert(fuse_parse_cmdline(&args, &fuse_opts) == 0);
+    assert(fuse_opts.mountpoint != NULL);
+#ifndef __FreeBSD__
+    assert(fuse_opt_add_arg(&args, "-oauto_unmount") == 0);
+#endif
+    fuse = fuse_new(&args, &tfs_oper, sizeof(tfs_oper), NULL);
+    fuse_opt_free_args(&args);
+    assert(fuse != NULL);
+    assert(fuse_set_signal_handlers(fuse_get_session(fuse)) == 0);
+    assert(fuse_mount(fuse, fuse_opts.mountpoint) == 0);
+
+    /* Start file-system thread */
+    assert(pthread_create(&fs_thread, NULL, run_fs, (void *)fuse) == 0);
+
+    test_fs(fuse, fuse_opts.mountpoint);
+    free(fuse_opts.mountpoint);
+
+    /* Stop file system */
+    fuse_exit(fuse);
+    fuse_unmount(fuse);
+    assert(pthread_join(fs_thread, NULL) == 0);
+
+    fuse_remove_signal_handlers(fuse_get_session(fuse));
+    fuse_destroy(fuse);
+
+    printf("Test completed successfully.\n");
+    return 0;
+}
+
+
+/**
+ * Local Variables:
+ * mode: c
+ * indent-tabs-mode: nil
+ * c-basic-offset: 4
+ * End:
+ */